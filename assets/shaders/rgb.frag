@@ -0,0 +1,11 @@
+precision mediump float;
+uniform sampler2D  uRGBTex;   // The RGB texture sampler.
+varying vec2       vTexCoord; // Texture coordinates.
+
+/*
+ * Shows an RGB texture, e.g. a demosaiced RAW preview, on the screen.
+ */
+void main()
+{
+   gl_FragColor = vec4( texture2D( uRGBTex, vTexCoord ).rgb, 1.0 );
+}
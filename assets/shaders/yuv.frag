@@ -15,9 +15,9 @@ void main()
    // to the same value of the texture at the same location
    vec3 yuv;
    vec2 lookupCoord = vec2(vTexCoord.x, vTexCoord.y);
-   yuv.r = texture2D( uYTex, lookupCoord );
-   yuv.b = texture2D( uVTex, lookupCoord );
-   yuv.g = texture2D( uUTex, lookupCoord );
+   yuv.r = texture2D( uYTex, lookupCoord ).r;
+   yuv.b = texture2D( uVTex, lookupCoord ).r;
+   yuv.g = texture2D( uUTex, lookupCoord ).r;
 
    gl_FragColor.b = 1.164 * ( yuv.r - 0.0625)                          + 2.018 * ( yuv.g - 0.5);
    gl_FragColor.g = 1.164 * ( yuv.r - 0.0625) - 0.813 * ( yuv.b - 0.5) - 0.391 * ( yuv.g - 0.5);
@@ -0,0 +1,26 @@
+precision mediump float;
+uniform sampler2D  uYTex;     // The Y texture sampler.
+uniform sampler2D  uUVTex;    // The interleaved chroma texture sampler.
+uniform float      uVUOrder;  // 0.0 for NV12 (U first), 1.0 for NV21.
+varying vec2       vTexCoord; // Texture coordinates.
+
+/*
+ * Semi-planar variant of yuv.frag. Both chroma samples come from a single
+ * luminance-alpha texture: luminance holds the first byte of each pair,
+ * alpha the second.
+ */
+void main()
+{
+   vec3 yuv;
+   vec2 chroma = texture2D( uUVTex, vTexCoord ).ra;
+   chroma = mix( chroma, chroma.yx, uVUOrder );
+
+   yuv.r = texture2D( uYTex, vTexCoord ).r;
+   yuv.g = chroma.x;
+   yuv.b = chroma.y;
+
+   gl_FragColor.b = 1.164 * ( yuv.r - 0.0625)                          + 2.018 * ( yuv.g - 0.5);
+   gl_FragColor.g = 1.164 * ( yuv.r - 0.0625) - 0.813 * ( yuv.b - 0.5) - 0.391 * ( yuv.g - 0.5);
+   gl_FragColor.r = 1.164 * ( yuv.r - 0.0625) + 1.596 * ( yuv.b - 0.5);
+   gl_FragColor.a = 1.0;
+}
@@ -4,15 +4,164 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE    := NativeCamera
 LOCAL_CFLAGS += -std=c++11 
-LOCAL_SRC_FILES := NativeCamera.cpp ImageSave.cpp
+LOCAL_SRC_FILES := NativeCamera.cpp ImageSave.cpp ReplayCamera.cpp \
+                   AsyncImageSaver.cpp FramePool.cpp ThreadPool.cpp \
+                   YuvConverter.cpp JpegEncoder.cpp DngWriter.cpp \
+                   ZslCapture.cpp Demosaic.cpp FrameTracer.cpp \
+                   StreamConsumer.cpp FrameDistributor.cpp \
+                   YuvUploader.cpp StatisticsEngine.cpp StatisticsExchange.cpp \
+                   BurstMerge.cpp BurstCapture.cpp MotionGate.cpp \
+                   VideoRecorder.cpp RawCodec.cpp CameraSession.cpp \
+                   FramePairer.cpp BufferView.cpp Resampler.cpp \
+                   MetadataJournal.cpp
+# The frame processing kernels use NEON intrinsics.
+LOCAL_ARM_NEON  := true
 LOCAL_STATIC_LIBRARIES += nvappbase nvui nvassetloader nvglutils nveglutil nvgamepad external_regal
+LOCAL_STATIC_LIBRARIES += libjpeg
 LOCAL_LDLIBS :=  -lEGL -landroid
 LOCAL_SHARED_LIBRARIES += native_camera2
 
 include $(BUILD_SHARED_LIBRARY)
 
+# Demosaic throughput benchmark, run with adb shell.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := demosaic_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/DemosaicBench.cpp Demosaic.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
+# Statistics engine cost per frame, run with adb shell.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := statistics_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/StatisticsBench.cpp StatisticsEngine.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
+# Burst merge time of an 8 frame burst, run with adb shell.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := burst_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/BurstBench.cpp BurstMerge.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
+# Sustained video recording to flash, run with adb shell.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := recorder_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/RecorderBench.cpp VideoRecorder.cpp
+
+include $(BUILD_EXECUTABLE)
+
+# RAW codec ratio and throughput on recorded frames, run with adb shell.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := raw_codec_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/RawCodecBench.cpp RawCodec.cpp VideoRecorder.cpp \
+                   ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
+# Digital zoom and downscale time per frame, run with adb shell.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := resampler_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/ResamplerBench.cpp BufferView.cpp Resampler.cpp \
+                   ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
+# Per-frame hot paths at every camera size against a baseline, run with
+# adb shell; builds for the host too, see the file.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := frame_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/FrameBench.cpp ImageSave.cpp JpegEncoder.cpp \
+                   DngWriter.cpp RawCodec.cpp YuvConverter.cpp Demosaic.cpp \
+                   Resampler.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+LOCAL_STATIC_LIBRARIES += libjpeg
+LOCAL_SHARED_LIBRARIES += native_camera2
+
+include $(BUILD_EXECUTABLE)
+
+# Recorded frames through the capture and save paths, run with adb shell;
+# builds for the host too, see the file.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := replay_bench
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := bench/ReplayBench.cpp ReplayCamera.cpp FrameDistributor.cpp \
+                   FramePool.cpp FrameTracer.cpp AsyncImageSaver.cpp \
+                   ImageSave.cpp JpegEncoder.cpp DngWriter.cpp RawCodec.cpp \
+                   YuvConverter.cpp BufferView.cpp Resampler.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+LOCAL_STATIC_LIBRARIES += libjpeg
+
+include $(BUILD_EXECUTABLE)
+
+# Queries the metadata journal, run with adb shell; builds for the host
+# too, see the file.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := journal_tool
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := tools/JournalTool.cpp MetadataJournal.cpp
+
+include $(BUILD_EXECUTABLE)
+
+# YUV to RGB kernels against the preview shader, run with adb shell; builds for
+# the host too, see the file.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := yuv_converter_test
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := test/YuvConverterTest.cpp YuvConverter.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
+# Metadata journal against a statistics thread slower than the camera, run
+# with adb shell; builds for the host too, see the file.
+include $(CLEAR_VARS)
+
+LOCAL_MODULE    := journal_test
+LOCAL_CFLAGS += -std=c++11
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(LOCAL_PATH)/external/native_camera2/include
+LOCAL_SRC_FILES := test/JournalTest.cpp StatisticsExchange.cpp \
+                   StatisticsEngine.cpp FrameDistributor.cpp FramePool.cpp \
+                   FrameTracer.cpp MetadataJournal.cpp ThreadPool.cpp
+LOCAL_ARM_NEON  := true
+
+include $(BUILD_EXECUTABLE)
+
 $(call import-add-path, $(LOCAL_PATH)/external)
 $(call import-add-path, $(LOCAL_PATH)/../../)
 
 $(call import-module,nvapp)
-$(call import-module,native_camera2);
\ No newline at end of file
+$(call import-module,native_camera2);
+$(call import-module,opencv_3rdparty)
\ No newline at end of file
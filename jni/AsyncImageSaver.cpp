@@ -0,0 +1,338 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "AsyncImageSaver.h"
+#include "FrameTracer.h"
+#include "ImageSave.h"
+#include "JpegEncoder.h"
+#include "Resampler.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// Long enough for the usual "<prefix>-<index>" names, so that queueing a
+// frame does not reallocate the slot's filename.
+constexpr size_t FILENAME_RESERVE = 128;
+
+}
+
+AsyncImageSaver::AsyncImageSaver( const Options& options,
+        CompletionCallback callback ) :
+    mOptions(options),
+    mCallback(callback),
+    mRing( std::max( options.queueCapacity, 1u ) ),
+    mMaxQueueDepth(0),
+    mFramesWritten(0),
+    mFramesFailed(0),
+    mFramesDropped(0),
+    mBytesWritten(0)
+{
+    for ( auto& job : mRing )
+    {
+        job.filename.reserve( FILENAME_RESERVE );
+    }
+
+    const unsigned numThreads = std::max( options.numThreads, 1u );
+    for ( unsigned i = 0; i < numThreads; ++i )
+    {
+        mWorkers.push_back( std::thread( &AsyncImageSaver::workerLoop, this ) );
+    }
+}
+
+AsyncImageSaver::~AsyncImageSaver()
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mQuit = true;
+    }
+    mJobAvailable.notify_all();
+
+    for ( auto& worker : mWorkers )
+    {
+        worker.join();
+    }
+}
+
+bool AsyncImageSaver::save( std::unique_ptr<nv::camera2::CameraFrame> frame,
+        FileType type, const std::string& filename,
+        const BufferView::Rect& region )
+{
+    return save( FramePool::Frame( frame.release(), FramePool::Recycler() ),
+            type, filename, region );
+}
+
+bool AsyncImageSaver::save( FramePool::Frame frame,
+        FileType type, const std::string& filename,
+        const BufferView::Rect& region )
+{
+    if ( !frame || !frame->imageBuffer ) return false;
+
+    Job job;
+    job.frame = std::move( frame );
+    job.type = type;
+    job.filename = filename;
+    job.region = region;
+    return enqueue( job );
+}
+
+bool AsyncImageSaver::save( FrameDistributor::FrameRef frame,
+        FileType type, const std::string& filename,
+        const BufferView::Rect& region )
+{
+    if ( !frame || !frame->imageBuffer ) return false;
+
+    Job job;
+    job.shared = std::move( frame );
+    job.type = type;
+    job.filename = filename;
+    job.region = region;
+    return enqueue( job );
+}
+
+bool AsyncImageSaver::enqueue( Job& job )
+{
+    const unsigned capacity = mRing.size();
+    const int64_t captureTime = job.get()->captureTime;
+    const int32_t requestId = job.get()->requestId;
+    Job dropped;
+    bool accepted = true;
+
+    {
+        std::unique_lock<std::mutex> lk( mMutex );
+
+        if ( mCount == capacity )
+        {
+            switch ( mOptions.overflowPolicy )
+            {
+            case OverflowPolicy::BLOCK:
+                mSlotAvailable.wait( lk, [&]{ return mCount < capacity; } );
+                break;
+
+            case OverflowPolicy::DROP_OLDEST:
+                dropped.frame = std::move( mRing[mHead].frame );
+                dropped.shared = std::move( mRing[mHead].shared );
+                dropped.type = mRing[mHead].type;
+                dropped.filename.swap( mRing[mHead].filename );
+                mHead = ( mHead + 1 ) % capacity;
+                --mCount;
+                break;
+
+            case OverflowPolicy::DROP_NEWEST:
+                accepted = false;
+                break;
+            }
+        }
+
+        if ( accepted )
+        {
+            Job& slot = mRing[( mHead + mCount ) % capacity];
+            slot.frame = std::move( job.frame );
+            slot.shared = std::move( job.shared );
+            slot.type = job.type;
+            slot.filename.assign( job.filename );
+            slot.region = job.region;
+            ++mCount;
+
+            unsigned depth = mMaxQueueDepth.load( std::memory_order_relaxed );
+            while ( mCount > depth &&
+                    !mMaxQueueDepth.compare_exchange_weak( depth, mCount ) ) {}
+        }
+    }
+
+    if ( accepted )
+    {
+        mJobAvailable.notify_one();
+
+        const int64_t now = FrameTracer::now();
+        FrameTracer::instance().record( FrameTracer::Stage::SAVE_ENQUEUE,
+                captureTime, requestId, now, now );
+    }
+    else
+    {
+        dropped.frame = std::move( job.frame );
+        dropped.shared = std::move( job.shared );
+        dropped.type = job.type;
+        dropped.filename.swap( job.filename );
+    }
+
+    // Release dropped frames outside the lock.
+    if ( dropped.get() )
+    {
+        complete( dropped, 0, true );
+    }
+
+    return accepted;
+}
+
+void AsyncImageSaver::flush()
+{
+    std::unique_lock<std::mutex> lk( mMutex );
+    mIdle.wait( lk, [this]{ return mCount == 0 && mActive == 0; } );
+}
+
+AsyncImageSaver::Counters AsyncImageSaver::counters() const
+{
+    Counters c;
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        c.queueDepth = mCount;
+    }
+    c.maxQueueDepth = mMaxQueueDepth;
+    c.framesWritten = mFramesWritten;
+    c.framesFailed  = mFramesFailed;
+    c.framesDropped = mFramesDropped;
+    c.bytesWritten  = mBytesWritten;
+    return c;
+}
+
+void AsyncImageSaver::workerLoop()
+{
+    Job job;
+    job.filename.reserve( FILENAME_RESERVE );
+
+    // Scaled regions of one size reuse the same buffer.
+    Resampler::Options resamplerOptions;
+    resamplerOptions.filter = Resampler::Filter::LANCZOS;
+    resamplerOptions.poolCapacity = 1;
+    Resampler resampler( resamplerOptions );
+
+    // The encoder keeps its libjpeg instances from one JPEG to the next.
+    JpegEncoder encoder;
+
+    std::unique_lock<std::mutex> lk( mMutex );
+
+    for (;;)
+    {
+        mJobAvailable.wait( lk, [this]{ return mQuit || mCount > 0; } );
+
+        // Drain the queue before quitting.
+        if ( mCount == 0 ) break;
+
+        Job& slot = mRing[mHead];
+        job.frame = std::move( slot.frame );
+        job.shared = std::move( slot.shared );
+        job.type = slot.type;
+        job.filename.swap( slot.filename );
+        job.region = slot.region;
+        mHead = ( mHead + 1 ) % mRing.size();
+        --mCount;
+        ++mActive;
+
+        lk.unlock();
+        mSlotAvailable.notify_one();
+
+        const nv::camera2::CameraFrame& frame = *job.get();
+        const int64_t start = FrameTracer::now();
+
+        // Without a usable region the whole frame is written.
+        BufferView view;
+        Resampler::Buffer scaled;
+        nv::camera2::CameraBuffer* buffer = frame.imageBuffer.get();
+        if ( !job.region.empty() && view.attach( *buffer, job.region ) )
+        {
+            buffer = &view;
+            if ( mOptions.scaleRegions )
+            {
+                const nv::camera2::CameraBuffer::Data luma =
+                        frame.imageBuffer->data(0);
+                scaled = resampler.resample( view,
+                        nv::camera2::Size( luma.width, luma.height ) );
+                if ( scaled ) buffer = scaled.get();
+            }
+        }
+        nv::camera2::CameraBuffer& img = *buffer;
+
+        size_t bytes = 0;
+        switch ( job.type )
+        {
+        case FileType::PGM:
+            bytes = ImageSave::writePGM( img, mOptions.properties, job.filename );
+            break;
+        case FileType::JPG:
+            bytes = ImageSave::writeJPG( img, encoder, job.filename );
+            break;
+        case FileType::RAW: bytes = ImageSave::writeRAW( img, job.filename ); break;
+        case FileType::DNG:
+            bytes = ImageSave::writeDNG( frame, mOptions.properties, job.filename );
+            break;
+        case FileType::PACKED_RAW:
+        case FileType::LOSSLESS_RAW:
+            bytes = ImageSave::writeNVRAW( frame, mOptions.properties, job.filename,
+                    job.type == FileType::LOSSLESS_RAW );
+            break;
+        }
+        FrameTracer::instance().record( FrameTracer::Stage::SAVE_COMPLETE,
+                frame, start );
+        complete( job, bytes, false );
+
+        lk.lock();
+        --mActive;
+        if ( mCount == 0 && mActive == 0 )
+        {
+            mIdle.notify_all();
+        }
+    }
+}
+
+void AsyncImageSaver::complete( Job& job, size_t bytes, bool dropped )
+{
+    if ( dropped )
+    {
+        ++mFramesDropped;
+        FrameTracer::instance().recordDrop( FrameTracer::Stage::SAVE_ENQUEUE );
+    }
+    else if ( bytes > 0 )
+    {
+        ++mFramesWritten;
+        mBytesWritten += bytes;
+    }
+    else
+    {
+        ++mFramesFailed;
+    }
+
+    if ( mCallback )
+    {
+        Result result;
+        result.requestId = job.get()->requestId;
+        result.captureTime = job.get()->captureTime;
+        result.type = job.type;
+        result.filename = job.filename;
+        result.bytesWritten = bytes;
+        result.dropped = dropped;
+        mCallback( result );
+    }
+
+    job.frame.reset();
+    job.shared.reset();
+}
@@ -0,0 +1,195 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef AsyncImageSaver_H
+#define AsyncImageSaver_H
+
+#include "BufferView.h"
+#include "FrameDistributor.h"
+#include "FramePool.h"
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * Write-behind saver for camera frames. Frames handed to save() are
+ * owned by the saver and written to ImageSave::outputDir() by a pool of
+ * worker threads, so the capture thread never touches the filesystem.
+ *
+ * The queue is a fixed ring allocated up front; once it is full the
+ * overflow policy decides whether save() blocks or which frame is lost.
+ */
+class AsyncImageSaver
+{
+public:
+
+    enum class FileType
+    {
+        PGM,            //< RAW16 up to the white level of Options::properties.
+        JPG,
+        RAW,
+        DNG,            //< Needs Options::properties of the camera.
+        PACKED_RAW,     //< RawCodec, bit packed; needs Options::properties.
+        LOSSLESS_RAW    //< RawCodec, compressed; needs Options::properties.
+    };
+
+    enum class OverflowPolicy
+    {
+        BLOCK,          //< save() waits for a free slot.
+        DROP_OLDEST,    //< The oldest queued frame is discarded.
+        DROP_NEWEST     //< The frame passed to save() is discarded.
+    };
+
+    struct Options
+    {
+        unsigned numThreads = 1;
+        unsigned queueCapacity = 8;
+        OverflowPolicy overflowPolicy = OverflowPolicy::DROP_OLDEST;
+        nv::camera2::StaticProperties properties;
+
+        // YCbCr_420_888 regions are scaled back up to the frame size with
+        // a Lanczos Resampler, as digital zoom does, instead of being
+        // written at their own size.
+        bool scaleRegions = false;
+    };
+
+    struct Result
+    {
+        int32_t requestId = 0;
+        int64_t captureTime = 0;
+        FileType type = FileType::PGM;
+        std::string filename;
+        size_t bytesWritten = 0;    //< 0 if the write failed or was dropped.
+        bool dropped = false;
+    };
+
+    struct Counters
+    {
+        unsigned queueDepth = 0;
+        unsigned maxQueueDepth = 0;
+        uint64_t framesWritten = 0;
+        uint64_t framesFailed = 0;
+        uint64_t framesDropped = 0;
+        uint64_t bytesWritten = 0;
+    };
+
+    /*!
+     * Called once for every frame passed to save(), from a worker thread
+     * for written frames and from the thread that called save() for
+     * dropped ones. The frame is released right after the call returns.
+     */
+    typedef std::function<void( const Result& )> CompletionCallback;
+
+    explicit AsyncImageSaver( const Options& options,
+            CompletionCallback callback = CompletionCallback() );
+
+    // Writes out all queued frames before returning.
+    ~AsyncImageSaver();
+
+    /*!
+     * Queues a frame for writing. The filename is relative to
+     * ImageSave::outputDir() and without extension, as for ImageSave.
+     * A region other than an empty one writes a BufferView of the frame
+     * instead of all of it; DNG and RawCodec files are always whole.
+     * Returns false if the frame was dropped.
+     */
+    bool save( std::unique_ptr<nv::camera2::CameraFrame> frame,
+            FileType type, const std::string& filename,
+            const BufferView::Rect& region = BufferView::Rect() );
+
+    // Pooled frames go back to their pool once written or dropped.
+    bool save( FramePool::Frame frame,
+            FileType type, const std::string& filename,
+            const BufferView::Rect& region = BufferView::Rect() );
+
+    // Distributed frames are written without a copy; the saver holds a
+    // reference until the frame is written or dropped.
+    bool save( FrameDistributor::FrameRef frame,
+            FileType type, const std::string& filename,
+            const BufferView::Rect& region = BufferView::Rect() );
+
+    // Blocks until every frame queued so far has been written.
+    void flush();
+
+    Counters counters() const;
+
+private:
+
+    // Holds either an owned or a shared frame.
+    struct Job
+    {
+        FramePool::Frame frame;
+        FrameDistributor::FrameRef shared;
+        FileType type = FileType::PGM;
+        std::string filename;
+        BufferView::Rect region;
+
+        const nv::camera2::CameraFrame* get() const
+        {
+            return frame ? frame.get() : shared.get();
+        }
+    };
+
+    bool enqueue( Job& job );
+    void workerLoop();
+    void complete( Job& job, size_t bytes, bool dropped );
+
+    const Options mOptions;
+    CompletionCallback mCallback;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mSlotAvailable;
+    std::condition_variable mIdle;
+
+    std::vector<Job> mRing;
+    unsigned mHead = 0;
+    unsigned mCount = 0;
+    unsigned mActive = 0;
+    bool mQuit = false;
+
+    std::atomic<unsigned> mMaxQueueDepth;
+    std::atomic<uint64_t> mFramesWritten;
+    std::atomic<uint64_t> mFramesFailed;
+    std::atomic<uint64_t> mFramesDropped;
+    std::atomic<uint64_t> mBytesWritten;
+
+    std::vector<std::thread> mWorkers;
+};
+
+#endif
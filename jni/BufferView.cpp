@@ -0,0 +1,126 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "BufferView.h"
+
+#include <algorithm>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+int32_t alignDown( int32_t value )
+{
+    return value & ~1;
+}
+
+int32_t alignUp( int32_t value )
+{
+    return ( value + 1 ) & ~1;
+}
+
+// Moves the plane to the sample at (x, y) of the plane.
+CameraBuffer::Data offsetPlane( CameraBuffer::Data plane, int32_t x,
+        int32_t y, int32_t width, int32_t height, bool strideInSamples )
+{
+    const int32_t step = std::max( plane.channel_step, 1 );
+    const int32_t bytes = std::max( plane.bytes_per_channel, 1 );
+
+    // RAW16 strides are in pixels, YCbCr strides in bytes.
+    const size_t offset = strideInSamples ?
+            ( size_t(y) * plane.stride + size_t(x) * step ) * bytes :
+            size_t(y) * plane.stride + size_t(x) * step * bytes;
+
+    plane.ptr = static_cast<uint8_t*>( plane.ptr ) + offset;
+    plane.width = width;
+    plane.height = height;
+    return plane;
+}
+
+}
+
+bool BufferView::attach( CameraBuffer& source, const Rect& rect )
+{
+    format_ = UNKNOWN;
+    number_of_planes_ = 0;
+    mRect = Rect();
+
+    const PixelFormat format = source.format();
+    if ( format != YCbCr_420_888 && format != RAW16 ) return false;
+
+    const unsigned planes = source.numberOfPlanes();
+    if ( planes == 0 || ( format == YCbCr_420_888 && planes < 3 ) ) return false;
+
+    const Data luma = source.data(0);
+    if ( !luma.ptr ) return false;
+
+    // Even edges, inside the source.
+    const int32_t x0 = std::max( alignDown( rect.x ), 0 );
+    const int32_t y0 = std::max( alignDown( rect.y ), 0 );
+    const int32_t x1 = std::min( alignUp( rect.x + rect.width ),
+            alignDown( luma.width ) );
+    const int32_t y1 = std::min( alignUp( rect.y + rect.height ),
+            alignDown( luma.height ) );
+    if ( x1 <= x0 || y1 <= y0 ) return false;
+
+    mRect = Rect( x0, y0, x1 - x0, y1 - y0 );
+    format_ = format;
+    number_of_planes_ = std::min( planes, unsigned( MAX_NUMBER_OF_PLANES ) );
+
+    const bool raw = format == RAW16;
+    buffer_planes_[0] = offsetPlane( luma, x0, y0, mRect.width, mRect.height,
+            raw );
+
+    // Chroma planes are subsampled by two both ways; NV12 and NV21 planes
+    // keep their one byte distance since both move by the same offset.
+    for ( unsigned i = 1; i < number_of_planes_; ++i )
+    {
+        buffer_planes_[i] = offsetPlane( source.data(i), x0 / 2, y0 / 2,
+                mRect.width / 2, mRect.height / 2, raw );
+    }
+    return true;
+}
+
+BufferView::Rect BufferView::zoomRect( int32_t width, int32_t height,
+        float zoom, float maxZoom, float centerX, float centerY )
+{
+    if ( maxZoom < 1.0f || zoom <= 1.0f ) return Rect( 0, 0, width, height );
+
+    zoom = std::min( zoom, maxZoom );
+    const int32_t w = std::max( alignDown( int32_t( width / zoom ) ), 2 );
+    const int32_t h = std::max( alignDown( int32_t( height / zoom ) ), 2 );
+
+    const int32_t x = int32_t( centerX * width ) - w / 2;
+    const int32_t y = int32_t( centerY * height ) - h / 2;
+    return Rect( alignDown( std::min( std::max( x, 0 ), width - w ) ),
+            alignDown( std::min( std::max( y, 0 ), height - h ) ), w, h );
+}
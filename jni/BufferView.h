@@ -0,0 +1,105 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef BufferView_H
+#define BufferView_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+
+/*!
+ * A rectangle of another CameraBuffer, without a copy. The planes of the
+ * view point into the planes of the source with its strides and channel
+ * steps, so anything taking a CameraBuffer takes a view and only reads
+ * the pixels inside it.
+ *
+ * Edges are aligned to even pixels so the chroma of YCbCr_420_888 and
+ * the Bayer phase of RAW16 stay the same as in the source. The source
+ * must outlive the view; a view of a view is a view of the source.
+ */
+class BufferView : public nv::camera2::CameraBuffer
+{
+public:
+
+    struct Rect
+    {
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t width = 0;
+        int32_t height = 0;
+
+        Rect() = default;
+        Rect( int32_t x, int32_t y, int32_t w, int32_t h ) :
+            x(x), y(y), width(w), height(h) {}
+
+        bool empty() const
+        {
+            return width <= 0 || height <= 0;
+        }
+    };
+
+    BufferView() = default;
+
+    BufferView( nv::camera2::CameraBuffer& source, const Rect& rect )
+    {
+        attach( source, rect );
+    }
+
+    /*!
+     * Views rect of source, grown to even edges and clipped to the
+     * source. Returns false, leaving the view empty, for formats other
+     * than YCbCr_420_888 and RAW16 or if nothing of rect is left.
+     */
+    bool attach( nv::camera2::CameraBuffer& source, const Rect& rect );
+
+    // The rectangle after alignment, in source pixels.
+    const Rect& rect() const
+    {
+        return mRect;
+    }
+
+    /*!
+     * The centered rectangle of a width x height frame that digital zoom
+     * shows, with the center moved as far as it has to for the rectangle
+     * to stay inside. zoom is clamped to 1..maxZoom, usually
+     * StaticProperties::scaler.availableMaxDigitalZoom; without a
+     * maxZoom of at least 1 the whole frame is returned.
+     */
+    static Rect zoomRect( int32_t width, int32_t height, float zoom,
+            float maxZoom, float centerX = 0.5f, float centerY = 0.5f );
+
+private:
+
+    Rect mRect;
+};
+
+#endif
@@ -0,0 +1,192 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "BurstCapture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Frames are waited for in slices, to notice cancel().
+constexpr int DEQUEUE_TIMEOUT_US = 100000;
+
+int64_t elapsedUs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+}
+
+// Exposure time times sensitivity, from the result if the HAL reports it.
+double exposureProduct( const CameraFrame& frame )
+{
+    const Request::Sensor& result = frame.resultSettings.sensor;
+    const Request::Sensor& sensor = result.exposure > 0 && result.sensitivity > 0 ?
+            result : frame.requestSettings.sensor;
+    return double( std::max<int64_t>( sensor.exposure, 1 ) ) *
+           std::max( sensor.sensitivity, 1 );
+}
+
+}
+
+BurstCapture::BurstCapture( CameraDevice& device, CameraStream& stream,
+        const StaticProperties& properties, const Options& options ) :
+    mDevice(device),
+    mStream(stream),
+    mProperties(properties),
+    mOptions(options),
+    mMerge( properties, options.merge ),
+    mCancelled(false)
+{
+}
+
+void BurstCapture::cancel()
+{
+    mCancelled = true;
+}
+
+std::unique_ptr<CameraFrame> BurstCapture::capture( const RequestSettings& base )
+{
+    mStats = Stats();
+    mCancelled = false;
+
+    const unsigned frames = std::max( mOptions.frames, 1u );
+    const bool bracket = mOptions.mode == Mode::BRACKET &&
+            !mOptions.evSteps.empty();
+    if ( bracket && mStream.format() != RAW16 ) return nullptr;
+
+    // Results without exposure fall back to the defaults.
+    const Request::Sensor baseSensor = base.sensor.exposure > 0 &&
+            base.sensor.sensitivity > 0 ? base.sensor : Request::Sensor();
+
+    const auto& sensor = mProperties.sensor;
+    std::vector<CaptureRequest> requests( frames );
+    for ( unsigned i = 0; i < frames; ++i )
+    {
+        CaptureRequest& request = requests[i];
+        mDevice.initializeDefaultSettings( CAPTURE_INTENT::STILL_CAPTURE,
+                request );
+
+        int64_t exposure = baseSensor.exposure;
+        if ( bracket )
+        {
+            const float ev = mOptions.evSteps[i % mOptions.evSteps.size()];
+            exposure = int64_t( exposure * std::pow( 2.0, double(ev) ) + 0.5 );
+        }
+        if ( sensor.maxExposure > 0 ) exposure = std::min( exposure, sensor.maxExposure );
+        if ( sensor.minExposure > 0 ) exposure = std::max( exposure, sensor.minExposure );
+
+        // Auto exposure would drift over the burst; white balance is held
+        // for the same reason.
+        request.settings.control.aeMode = AE_MODE::OFF;
+        request.settings.control.awbLock = true;
+        request.settings.sensor.exposure = exposure;
+        request.settings.sensor.sensitivity = baseSensor.sensitivity;
+        request.settings.sensor.frameDuration = std::max(
+                baseSensor.frameDuration, exposure );
+
+        request.outputs.clear();
+        request.outputs.push_back( &mStream );
+    }
+    mStats.framesRequested = frames;
+
+    const auto start = std::chrono::steady_clock::now();
+    mDevice.capture( requests );
+
+    // Frames come in request order, so the first one to arrive is the
+    // reference unless the HAL dropped it.
+    std::vector<bool> pending( frames, true );
+    unsigned outstanding = frames;
+    std::unique_ptr<CameraFrame> reference;
+    double referenceExposure = 1.0;
+
+    while ( outstanding > 0 && !mCancelled )
+    {
+        const int64_t remaining = mOptions.timeoutUs - elapsedUs( start );
+        if ( remaining <= 0 ) break;
+
+        std::unique_ptr<CameraFrame> frame = mStream.dequeue(
+                int( std::min<int64_t>( remaining, DEQUEUE_TIMEOUT_US ) ) );
+        if ( !frame || !frame->imageBuffer ) continue;
+
+        unsigned index = 0;
+        while ( index < frames && ( !pending[index] ||
+                requests[index].requestId != frame->requestId ) )
+        {
+            ++index;
+        }
+        // Frames of other requests are released right away.
+        if ( index == frames ) continue;
+
+        pending[index] = false;
+        --outstanding;
+
+        if ( !reference )
+        {
+            if ( !mMerge.begin( *frame->imageBuffer ) ) return nullptr;
+            referenceExposure = exposureProduct( *frame );
+            reference = std::move( frame );
+        }
+        else
+        {
+            const float gain = bracket ?
+                    float( referenceExposure / exposureProduct( *frame ) ) : 1.0f;
+            mMerge.add( *frame->imageBuffer, gain );
+        }
+    }
+
+    mStats.captureUs = elapsedUs( start );
+    if ( !reference || mCancelled )
+    {
+        // Drops the merge started on the reference.
+        mMerge.finish();
+        return nullptr;
+    }
+
+    const auto finishStart = std::chrono::steady_clock::now();
+    std::unique_ptr<CameraFrame> merged( new CameraFrame() );
+    merged->requestId = reference->requestId;
+    merged->captureTime = reference->captureTime;
+    merged->requestSettings = reference->requestSettings;
+    merged->resultSettings = reference->resultSettings;
+    merged->autoControlState = reference->autoControlState;
+    merged->statistics = reference->statistics;
+    merged->imageBuffer = mMerge.finish();
+
+    mStats.finishUs = elapsedUs( finishStart );
+    mStats.merge = mMerge.lastStats();
+    mStats.framesMerged = mStats.merge.frames;
+    return merged;
+}
@@ -0,0 +1,131 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef BurstCapture_H
+#define BurstCapture_H
+
+#include "BurstMerge.h"
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*!
+ * Captures a burst of stills and merges it with BurstMerge into one frame
+ * with less noise than any of them, for low light or, with bracketed
+ * exposures, to clean up the shadows.
+ *
+ * The burst is submitted as one list of requests with auto exposure off,
+ * so every frame gets exactly the requested exposure. Frames are merged
+ * as they come off the stream; besides the reference only the frame being
+ * merged is held, so the burst may be longer than the number of buffers
+ * the HAL allocates for the stream.
+ *
+ * The stream can be shared with a repeating request, frames of other
+ * requests are released as they arrive. Nothing else may dequeue from the
+ * stream during capture().
+ */
+class BurstCapture
+{
+public:
+
+    enum class Mode
+    {
+        REPEAT,     //< Every frame with the base exposure.
+        BRACKET     //< Exposures stepped by Options::evSteps. RAW16 only.
+    };
+
+    struct Options
+    {
+        unsigned frames = 8;
+        Mode mode = Mode::REPEAT;
+
+        /*
+         * Exposure of each frame in EV relative to the base settings,
+         * repeated over the burst. The first frame is the reference the
+         * others are aligned and scaled to, so brighter frames only add
+         * where they are not clipped.
+         */
+        std::vector<float> evSteps = { 0.0f, 1.0f, 2.0f };
+
+        // Longest wait for the whole burst.
+        int timeoutUs = 3000000;
+
+        BurstMerge::Options merge;
+    };
+
+    struct Stats
+    {
+        unsigned framesRequested = 0;
+        unsigned framesMerged = 0;      //< Reference included.
+        int64_t captureUs = 0;          //< Submission to the last frame.
+        int64_t finishUs = 0;           //< Last frame to the merged frame.
+        BurstMerge::Stats merge;
+    };
+
+    BurstCapture( nv::camera2::CameraDevice& device,
+            nv::camera2::CameraStream& stream,
+            const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    /*!
+     * Submits the burst with the exposure time and sensitivity of base,
+     * usually the last result of the preview, and merges its frames.
+     * Returns the merged frame with the metadata of the reference, or
+     * nullptr if no frame of the burst arrived in time or cancel() was
+     * called. Frames missing at the timeout are left out of the merge.
+     */
+    std::unique_ptr<nv::camera2::CameraFrame> capture(
+            const nv::camera2::RequestSettings& base );
+
+    // Makes a running capture() return nullptr. Callable from any thread.
+    void cancel();
+
+    // Statistics of the last capture().
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    nv::camera2::CameraDevice& mDevice;
+    nv::camera2::CameraStream& mStream;
+    const nv::camera2::StaticProperties mProperties;
+    const Options mOptions;
+
+    BurstMerge mMerge;
+    std::atomic<bool> mCancelled;
+    Stats mStats;
+};
+
+#endif
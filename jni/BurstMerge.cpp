@@ -0,0 +1,1000 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "BurstMerge.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define BURST_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define BURST_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Alignment tiles, in pixels of the pyramid base.
+constexpr int TILE = 16;
+
+// Tiles shrink on coarser levels, the matched window does not.
+constexpr int MIN_WINDOW = 8;
+
+// Pyramid rows built per task.
+constexpr int BAND = 16;
+
+// Tiles weighted less than this are left out.
+constexpr float MIN_WEIGHT = 1.0f / 16;
+
+constexpr int TONE_CURVE_SIZE = 4096;
+
+/*
+ * downsample() writes count pixels, each the average of a 2x2 block of
+ * row0 and row1, rounded as two rounded pair averages.
+ * sad() returns the sum of absolute differences of two 8 bit windows.
+ * accumulate16() adds (src - black) * scale to value and weight to
+ * weightSum for every sample below clip; black alternates between the
+ * two values starting at an even column. accumulate8() adds src * weight.
+ * finish16() and finish8() write value / weightSum (+ black), rounded
+ * and clamped.
+ */
+typedef void (*DownsampleKernel)( const uint8_t* row0, const uint8_t* row1,
+        int count, uint8_t* out );
+typedef uint32_t (*SadKernel)( const uint8_t* a, int aStride,
+        const uint8_t* b, int bStride, int width, int height );
+typedef void (*Accumulate16Kernel)( const uint16_t* src, int count,
+        const float* black, float scale, float weight, int clip,
+        float* value, float* weightSum );
+typedef void (*Accumulate8Kernel)( const uint8_t* src, int count,
+        float weight, float* value, float* weightSum );
+typedef void (*Finish16Kernel)( const float* value, const float* weightSum,
+        int count, const float* black, float maxValue, uint16_t* out );
+typedef void (*Finish8Kernel)( const float* value, const float* weightSum,
+        int count, uint8_t* out );
+
+struct KernelSet
+{
+    DownsampleKernel downsample;
+    SadKernel sad;
+    Accumulate16Kernel accumulate16;
+    Accumulate8Kernel accumulate8;
+    Finish16Kernel finish16;
+    Finish8Kernel finish8;
+};
+
+void downsampleScalar( const uint8_t* row0, const uint8_t* row1, int count,
+        uint8_t* out )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        const int left  = ( row0[2*x] + row1[2*x] + 1 ) >> 1;
+        const int right = ( row0[2*x + 1] + row1[2*x + 1] + 1 ) >> 1;
+        out[x] = uint8_t( ( left + right + 1 ) >> 1 );
+    }
+}
+
+uint32_t sadScalar( const uint8_t* a, int aStride, const uint8_t* b,
+        int bStride, int width, int height )
+{
+    uint32_t sum = 0;
+    for ( int y = 0; y < height; ++y, a += aStride, b += bStride )
+    {
+        for ( int x = 0; x < width; ++x )
+        {
+            sum += std::abs( a[x] - b[x] );
+        }
+    }
+    return sum;
+}
+
+void accumulate16Scalar( const uint16_t* src, int count, const float* black,
+        float scale, float weight, int clip, float* value, float* weightSum )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        if ( src[x] < clip )
+        {
+            value[x] += ( float(src[x]) - black[x & 1] ) * scale;
+            weightSum[x] += weight;
+        }
+    }
+}
+
+void accumulate8Scalar( const uint8_t* src, int count, float weight,
+        float* value, float* weightSum )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        value[x] += float(src[x]) * weight;
+        weightSum[x] += weight;
+    }
+}
+
+void finish16Scalar( const float* value, const float* weightSum, int count,
+        const float* black, float maxValue, uint16_t* out )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        const float v = value[x] / weightSum[x] + black[x & 1] + 0.5f;
+        out[x] = uint16_t( std::min( std::max( v, 0.0f ), maxValue ) );
+    }
+}
+
+void finish8Scalar( const float* value, const float* weightSum, int count,
+        uint8_t* out )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        const float v = value[x] / weightSum[x] + 0.5f;
+        out[x] = uint8_t( std::min( std::max( v, 0.0f ), 255.0f ) );
+    }
+}
+
+#if BURST_HAVE_SSE2
+
+void downsampleSse2( const uint8_t* row0, const uint8_t* row1, int count,
+        uint8_t* out )
+{
+    const __m128i lowBytes = _mm_set1_epi16( 0xff );
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const __m128i v0 = _mm_avg_epu8(
+                _mm_loadu_si128( (const __m128i*) ( row0 + 2*x ) ),
+                _mm_loadu_si128( (const __m128i*) ( row1 + 2*x ) ) );
+        const __m128i v1 = _mm_avg_epu8(
+                _mm_loadu_si128( (const __m128i*) ( row0 + 2*x + 16 ) ),
+                _mm_loadu_si128( (const __m128i*) ( row1 + 2*x + 16 ) ) );
+
+        const __m128i h0 = _mm_avg_epu16( _mm_and_si128( v0, lowBytes ),
+                _mm_srli_epi16( v0, 8 ) );
+        const __m128i h1 = _mm_avg_epu16( _mm_and_si128( v1, lowBytes ),
+                _mm_srli_epi16( v1, 8 ) );
+        _mm_storeu_si128( (__m128i*) ( out + x ), _mm_packus_epi16( h0, h1 ) );
+    }
+    downsampleScalar( row0 + 2*x, row1 + 2*x, count - x, out + x );
+}
+
+uint32_t sadSse2( const uint8_t* a, int aStride, const uint8_t* b,
+        int bStride, int width, int height )
+{
+    __m128i sum = _mm_setzero_si128();
+    uint32_t tail = 0;
+
+    for ( int y = 0; y < height; ++y, a += aStride, b += bStride )
+    {
+        int x = 0;
+        for ( ; x + 16 <= width; x += 16 )
+        {
+            sum = _mm_add_epi64( sum, _mm_sad_epu8(
+                    _mm_loadu_si128( (const __m128i*) ( a + x ) ),
+                    _mm_loadu_si128( (const __m128i*) ( b + x ) ) ) );
+        }
+        for ( ; x + 8 <= width; x += 8 )
+        {
+            sum = _mm_add_epi64( sum, _mm_sad_epu8(
+                    _mm_loadl_epi64( (const __m128i*) ( a + x ) ),
+                    _mm_loadl_epi64( (const __m128i*) ( b + x ) ) ) );
+        }
+        for ( ; x < width; ++x )
+        {
+            tail += std::abs( a[x] - b[x] );
+        }
+    }
+
+    return uint32_t( _mm_cvtsi128_si32( sum ) ) +
+           uint32_t( _mm_cvtsi128_si32( _mm_srli_si128( sum, 8 ) ) ) + tail;
+}
+
+void accumulate16Sse2( const uint16_t* src, int count, const float* black,
+        float scale, float weight, int clip, float* value, float* weightSum )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clipLevel = _mm_set1_epi32( clip );
+    const __m128 blackPair = _mm_setr_ps( black[0], black[1], black[0], black[1] );
+    const __m128 scaleV = _mm_set1_ps( scale );
+    const __m128 weightV = _mm_set1_ps( weight );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const __m128i v = _mm_loadu_si128( (const __m128i*) ( src + x ) );
+        const __m128i half[2] = { _mm_unpacklo_epi16( v, zero ),
+                                  _mm_unpackhi_epi16( v, zero ) };
+        for ( int i = 0; i < 2; ++i )
+        {
+            const __m128 keep = _mm_castsi128_ps(
+                    _mm_cmplt_epi32( half[i], clipLevel ) );
+            const __m128 sample = _mm_mul_ps(
+                    _mm_sub_ps( _mm_cvtepi32_ps( half[i] ), blackPair ), scaleV );
+
+            float* v = value + x + 4*i;
+            float* w = weightSum + x + 4*i;
+            _mm_storeu_ps( v, _mm_add_ps( _mm_loadu_ps( v ),
+                    _mm_and_ps( keep, sample ) ) );
+            _mm_storeu_ps( w, _mm_add_ps( _mm_loadu_ps( w ),
+                    _mm_and_ps( keep, weightV ) ) );
+        }
+    }
+    accumulate16Scalar( src + x, count - x, black, scale, weight, clip,
+            value + x, weightSum + x );
+}
+
+void accumulate8Sse2( const uint8_t* src, int count, float weight,
+        float* value, float* weightSum )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 weightV = _mm_set1_ps( weight );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const __m128i v = _mm_unpacklo_epi8(
+                _mm_loadl_epi64( (const __m128i*) ( src + x ) ), zero );
+        const __m128 half[2] = {
+                _mm_cvtepi32_ps( _mm_unpacklo_epi16( v, zero ) ),
+                _mm_cvtepi32_ps( _mm_unpackhi_epi16( v, zero ) ) };
+        for ( int i = 0; i < 2; ++i )
+        {
+            float* v = value + x + 4*i;
+            float* w = weightSum + x + 4*i;
+            _mm_storeu_ps( v, _mm_add_ps( _mm_loadu_ps( v ),
+                    _mm_mul_ps( half[i], weightV ) ) );
+            _mm_storeu_ps( w, _mm_add_ps( _mm_loadu_ps( w ), weightV ) );
+        }
+    }
+    accumulate8Scalar( src + x, count - x, weight, value + x, weightSum + x );
+}
+
+// Rounded and clamped to [0, maxValue] as finish16Scalar() does.
+inline __m128i finishFour( const float* value, const float* weightSum,
+        __m128 offset, __m128 maxValue )
+{
+    const __m128 v = _mm_add_ps( _mm_div_ps( _mm_loadu_ps( value ),
+            _mm_loadu_ps( weightSum ) ), offset );
+    return _mm_cvttps_epi32( _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ),
+            maxValue ) );
+}
+
+void finish16Sse2( const float* value, const float* weightSum, int count,
+        const float* black, float maxValue, uint16_t* out )
+{
+    const __m128 offset = _mm_setr_ps( black[0] + 0.5f, black[1] + 0.5f,
+            black[0] + 0.5f, black[1] + 0.5f );
+    const __m128 maxV = _mm_set1_ps( maxValue );
+    const __m128i bias32 = _mm_set1_epi32( 32768 );
+    const __m128i bias16 = _mm_set1_epi16( -32768 );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        // SSE2 only packs signed 32 bit lanes, so pack biased values.
+        const __m128i lo = _mm_sub_epi32(
+                finishFour( value + x, weightSum + x, offset, maxV ), bias32 );
+        const __m128i hi = _mm_sub_epi32(
+                finishFour( value + x + 4, weightSum + x + 4, offset, maxV ), bias32 );
+        _mm_storeu_si128( (__m128i*) ( out + x ),
+                _mm_xor_si128( _mm_packs_epi32( lo, hi ), bias16 ) );
+    }
+    finish16Scalar( value + x, weightSum + x, count - x, black, maxValue, out + x );
+}
+
+void finish8Sse2( const float* value, const float* weightSum, int count,
+        uint8_t* out )
+{
+    const __m128 offset = _mm_set1_ps( 0.5f );
+    const __m128 maxV = _mm_set1_ps( 255.0f );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const __m128i lo = finishFour( value + x, weightSum + x, offset, maxV );
+        const __m128i hi = finishFour( value + x + 4, weightSum + x + 4, offset, maxV );
+        const __m128i packed = _mm_packs_epi32( lo, hi );
+        _mm_storel_epi64( (__m128i*) ( out + x ), _mm_packus_epi16( packed, packed ) );
+    }
+    finish8Scalar( value + x, weightSum + x, count - x, out + x );
+}
+
+#endif
+
+#if BURST_HAVE_NEON
+
+void downsampleNeon( const uint8_t* row0, const uint8_t* row1, int count,
+        uint8_t* out )
+{
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const uint8x16x2_t a = vld2q_u8( row0 + 2*x );
+        const uint8x16x2_t b = vld2q_u8( row1 + 2*x );
+        vst1q_u8( out + x, vrhaddq_u8( vrhaddq_u8( a.val[0], b.val[0] ),
+                                       vrhaddq_u8( a.val[1], b.val[1] ) ) );
+    }
+    downsampleScalar( row0 + 2*x, row1 + 2*x, count - x, out + x );
+}
+
+uint32_t sadNeon( const uint8_t* a, int aStride, const uint8_t* b,
+        int bStride, int width, int height )
+{
+    uint32x4_t sum = vdupq_n_u32( 0 );
+    uint32_t tail = 0;
+
+    for ( int y = 0; y < height; ++y, a += aStride, b += bStride )
+    {
+        uint16x8_t row = vdupq_n_u16( 0 );
+        int x = 0;
+        for ( ; x + 16 <= width; x += 16 )
+        {
+            const uint8x16_t va = vld1q_u8( a + x );
+            const uint8x16_t vb = vld1q_u8( b + x );
+            row = vabal_u8( row, vget_low_u8( va ), vget_low_u8( vb ) );
+            row = vabal_u8( row, vget_high_u8( va ), vget_high_u8( vb ) );
+        }
+        for ( ; x + 8 <= width; x += 8 )
+        {
+            row = vabal_u8( row, vld1_u8( a + x ), vld1_u8( b + x ) );
+        }
+        sum = vpadalq_u16( sum, row );
+        for ( ; x < width; ++x )
+        {
+            tail += std::abs( a[x] - b[x] );
+        }
+    }
+
+    const uint64x2_t pairs = vpaddlq_u32( sum );
+    return uint32_t( vgetq_lane_u64( pairs, 0 ) + vgetq_lane_u64( pairs, 1 ) ) + tail;
+}
+
+void accumulate16Neon( const uint16_t* src, int count, const float* black,
+        float scale, float weight, int clip, float* value, float* weightSum )
+{
+    const float blackLanes[4] = { black[0], black[1], black[0], black[1] };
+    const float32x4_t blackPair = vld1q_f32( blackLanes );
+    const uint32x4_t clipLevel = vdupq_n_u32( uint32_t(clip) );
+    const uint32x4_t weightBits = vreinterpretq_u32_f32( vdupq_n_f32( weight ) );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const uint16x8_t v = vld1q_u16( src + x );
+        const uint32x4_t half[2] = { vmovl_u16( vget_low_u16( v ) ),
+                                     vmovl_u16( vget_high_u16( v ) ) };
+        for ( int i = 0; i < 2; ++i )
+        {
+            const uint32x4_t keep = vcltq_u32( half[i], clipLevel );
+            // Multiplied separately, as the scalar kernel does not fuse.
+            const float32x4_t sample = vmulq_n_f32(
+                    vsubq_f32( vcvtq_f32_u32( half[i] ), blackPair ), scale );
+
+            float* v = value + x + 4*i;
+            float* w = weightSum + x + 4*i;
+            vst1q_f32( v, vaddq_f32( vld1q_f32( v ), vreinterpretq_f32_u32(
+                    vandq_u32( keep, vreinterpretq_u32_f32( sample ) ) ) ) );
+            vst1q_f32( w, vaddq_f32( vld1q_f32( w ), vreinterpretq_f32_u32(
+                    vandq_u32( keep, weightBits ) ) ) );
+        }
+    }
+    accumulate16Scalar( src + x, count - x, black, scale, weight, clip,
+            value + x, weightSum + x );
+}
+
+void accumulate8Neon( const uint8_t* src, int count, float weight,
+        float* value, float* weightSum )
+{
+    const float32x4_t weightV = vdupq_n_f32( weight );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const uint16x8_t v = vmovl_u8( vld1_u8( src + x ) );
+        const float32x4_t half[2] = {
+                vcvtq_f32_u32( vmovl_u16( vget_low_u16( v ) ) ),
+                vcvtq_f32_u32( vmovl_u16( vget_high_u16( v ) ) ) };
+        for ( int i = 0; i < 2; ++i )
+        {
+            float* v = value + x + 4*i;
+            float* w = weightSum + x + 4*i;
+            vst1q_f32( v, vaddq_f32( vld1q_f32( v ), vmulq_f32( half[i], weightV ) ) );
+            vst1q_f32( w, vaddq_f32( vld1q_f32( w ), weightV ) );
+        }
+    }
+    accumulate8Scalar( src + x, count - x, weight, value + x, weightSum + x );
+}
+
+#endif
+
+const KernelSet* selectKernel( BurstMerge::Kernel kernel )
+{
+    static const KernelSet scalar = { downsampleScalar, sadScalar,
+            accumulate16Scalar, accumulate8Scalar, finish16Scalar, finish8Scalar };
+#if BURST_HAVE_NEON
+    // ARMv7 NEON has no vector divide, finishing stays scalar.
+    static const KernelSet neon = { downsampleNeon, sadNeon,
+            accumulate16Neon, accumulate8Neon, finish16Scalar, finish8Scalar };
+#endif
+#if BURST_HAVE_SSE2
+    static const KernelSet sse2 = { downsampleSse2, sadSse2,
+            accumulate16Sse2, accumulate8Sse2, finish16Sse2, finish8Sse2 };
+#endif
+
+    switch ( kernel )
+    {
+    case BurstMerge::Kernel::AUTO:
+#if BURST_HAVE_NEON
+        return &neon;
+#elif BURST_HAVE_SSE2
+        return &sse2;
+#endif
+        return &scalar;
+
+    case BurstMerge::Kernel::SCALAR:
+        return &scalar;
+
+#if BURST_HAVE_NEON
+    case BurstMerge::Kernel::NEON:
+        return &neon;
+#endif
+
+#if BURST_HAVE_SSE2
+    case BurstMerge::Kernel::SSE2:
+        return &sse2;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+int64_t elapsedUs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+}
+
+/*
+ * The merged frame. Owns its samples; YCbCr_420_888 chroma is planar, as
+ * ImageSave and the uploaders expect of a plain I420 buffer.
+ */
+class MergedBuffer : public CameraBuffer
+{
+public:
+
+    MergedBuffer( PixelFormat format, int32_t width, int32_t height )
+    {
+        format_ = format;
+        if ( format == RAW16 )
+        {
+            number_of_planes_ = 1;
+            data_.resize( size_t(width) * height * 2 );
+            setPlane( 0, data_.data(), width, height, 2 );
+            return;
+        }
+
+        const int32_t chromaWidth = width / 2;
+        const int32_t chromaHeight = height / 2;
+        const size_t lumaBytes = size_t(width) * height;
+        const size_t chromaBytes = size_t(chromaWidth) * chromaHeight;
+
+        number_of_planes_ = 3;
+        data_.resize( lumaBytes + 2 * chromaBytes );
+        setPlane( 0, data_.data(), width, height, 1 );
+        setPlane( 1, data_.data() + lumaBytes, chromaWidth, chromaHeight, 1 );
+        setPlane( 2, data_.data() + lumaBytes + chromaBytes,
+                chromaWidth, chromaHeight, 1 );
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height, int32_t bytesPerChannel )
+    {
+        Data& d = buffer_planes_[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = width;
+        d.num_channels = 1;
+        d.bytes_per_channel = bytesPerChannel;
+        d.channel_step = 1;
+    }
+
+    std::vector<uint8_t> data_;
+};
+
+struct Motion
+{
+    int dx = 0;             //< In pyramid base pixels.
+    int dy = 0;
+    float weight = 0.0f;
+};
+
+/*
+ * Coarse to fine search of the tile at (tileX, tileY) of the pyramid base.
+ * Every level searches around twice the offset found on the level above;
+ * the coarsest level around no motion. Ties go to the smaller step.
+ */
+Motion alignTile( const KernelSet& kernels, const std::vector<const uint8_t*>& ref,
+        const std::vector<const uint8_t*>& alt, const std::vector<int>& widths,
+        const std::vector<int>& heights, int tileX, int tileY,
+        int searchRadius, float noiseLevel )
+{
+    const int top = int( widths.size() ) - 1;
+    int dx = 0;
+    int dy = 0;
+    uint32_t best = 0;
+    int window = 0;
+
+    for ( int level = top; level >= 0; --level )
+    {
+        if ( level < top )
+        {
+            dx *= 2;
+            dy *= 2;
+        }
+
+        const int width = widths[level];
+        const int height = heights[level];
+        const int w = std::min( std::max( TILE >> level, MIN_WINDOW ), width );
+        const int h = std::min( std::max( TILE >> level, MIN_WINDOW ), height );
+        const int x0 = std::min( std::max(
+                ( ( tileX * TILE + TILE / 2 ) >> level ) - w / 2, 0 ), width - w );
+        const int y0 = std::min( std::max(
+                ( ( tileY * TILE + TILE / 2 ) >> level ) - h / 2, 0 ), height - h );
+        const uint8_t* window0 = ref[level] + size_t(y0) * width + x0;
+
+        const int radius = level == top ? searchRadius : level > 0 ? 2 : 1;
+        best = UINT32_MAX;
+        int bestStep = 0;
+        int bestX = dx;
+        int bestY = dy;
+
+        for ( int sy = -radius; sy <= radius; ++sy )
+        {
+            const int y = y0 + dy + sy;
+            if ( y < 0 || y + h > height ) continue;
+
+            for ( int sx = -radius; sx <= radius; ++sx )
+            {
+                const int x = x0 + dx + sx;
+                if ( x < 0 || x + w > width ) continue;
+
+                const uint32_t sad = kernels.sad( window0, width,
+                        alt[level] + size_t(y) * width + x, width, w, h );
+                const int step = std::abs( sx ) + std::abs( sy );
+                if ( sad < best || ( sad == best && step < bestStep ) )
+                {
+                    best = sad;
+                    bestStep = step;
+                    bestX = dx + sx;
+                    bestY = dy + sy;
+                }
+            }
+        }
+
+        dx = bestX;
+        dy = bestY;
+        window = w * h;
+    }
+
+    Motion motion;
+    motion.dx = dx;
+    motion.dy = dy;
+    if ( best != UINT32_MAX )
+    {
+        const float excess = std::max( float(best) / window - noiseLevel, 0.0f ) /
+                noiseLevel;
+        motion.weight = 1.0f / ( 1.0f + excess * excess );
+        if ( motion.weight < MIN_WEIGHT ) motion.weight = 0.0f;
+    }
+    return motion;
+}
+
+}
+
+BurstMerge::BurstMerge( const StaticProperties& properties,
+        const Options& options ) :
+    mOptions(options)
+{
+    mOptions.searchRadius = std::max( mOptions.searchRadius, 1 );
+    mOptions.noiseLevel = std::max( mOptions.noiseLevel, 0.5f );
+    mKernels = selectKernel( mOptions.kernel );
+
+    const auto& sensor = properties.sensor;
+    mWhite = sensor.whiteLevel > 0 ? std::min( sensor.whiteLevel, 65535 ) : 65535;
+    for ( int i = 0; i < 4; ++i )
+    {
+        mBlack[i] = float( std::min( std::max( sensor.blackLevelPattern[i], 0 ),
+                mWhite - 1 ) );
+    }
+
+    // Square root of the linear signal: shot noise becomes about the same
+    // at all levels, so one noise level fits the whole frame.
+    for ( int i = 0; i < TONE_CURVE_SIZE; ++i )
+    {
+        mToneCurve[i] = uint8_t( 255.0 * std::sqrt( double(i) /
+                ( TONE_CURVE_SIZE - 1 ) ) + 0.5 );
+    }
+}
+
+bool BurstMerge::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+void BurstMerge::buildPyramid( CameraBuffer& frame, float gain,
+        Pyramid& pyramid )
+{
+    const KernelSet& kernels = *static_cast<const KernelSet*>( mKernels );
+    const CameraBuffer::Data plane = frame.data(0);
+
+    // The base has a pixel per 2x2 quad, further levels halve it.
+    unsigned levels = 1;
+    for ( int w = plane.width / 2, h = plane.height / 2;
+          levels <= mOptions.pyramidLevels && w / 2 >= MIN_WINDOW &&
+          h / 2 >= MIN_WINDOW; w /= 2, h /= 2 )
+    {
+        ++levels;
+    }
+    pyramid.resize( levels );
+    for ( unsigned l = 0; l < levels; ++l )
+    {
+        Level& level = pyramid[l];
+        level.width = l == 0 ? plane.width / 2 : pyramid[l - 1].width / 2;
+        level.height = l == 0 ? plane.height / 2 : pyramid[l - 1].height / 2;
+        level.pixels.resize( size_t(level.width) * level.height );
+    }
+
+    Level& base = pyramid[0];
+    const unsigned bands = ( base.height + BAND - 1 ) / BAND;
+
+    if ( mFormat == RAW16 )
+    {
+        const int blackSum = int( mBlack[0] + mBlack[1] + mBlack[2] + mBlack[3] );
+        const float black = 0.25f * blackSum;
+        const float scale = 0.25f * gain * ( TONE_CURVE_SIZE - 1 ) /
+                std::max( mWhite - black, 1.0f );
+
+        ThreadPool::instance().parallelFor( bands, [&]( unsigned band ) {
+            const int y1 = std::min( int( band + 1 ) * BAND, base.height );
+            for ( int y = band * BAND; y < y1; ++y )
+            {
+                const uint16_t* row0 = (const uint16_t*) plane.ptr +
+                        size_t(2*y) * plane.stride;
+                const uint16_t* row1 = row0 + plane.stride;
+                uint8_t* out = &base.pixels[size_t(y) * base.width];
+                for ( int x = 0; x < base.width; ++x )
+                {
+                    const int sum = row0[2*x] + row0[2*x + 1] +
+                            row1[2*x] + row1[2*x + 1] - blackSum;
+                    const int i = std::min( int( std::max( sum, 0 ) * scale ),
+                            TONE_CURVE_SIZE - 1 );
+                    out[x] = mToneCurve[i];
+                }
+            }
+        }, mOptions.maxThreads );
+    }
+    else
+    {
+        ThreadPool::instance().parallelFor( bands, [&]( unsigned band ) {
+            const int y1 = std::min( int( band + 1 ) * BAND, base.height );
+            for ( int y = band * BAND; y < y1; ++y )
+            {
+                const uint8_t* row0 = (const uint8_t*) plane.ptr +
+                        size_t(2*y) * plane.stride;
+                kernels.downsample( row0, row0 + plane.stride, base.width,
+                        &base.pixels[size_t(y) * base.width] );
+            }
+        }, mOptions.maxThreads );
+    }
+
+    for ( unsigned l = 1; l < levels; ++l )
+    {
+        const Level& src = pyramid[l - 1];
+        Level& dst = pyramid[l];
+        ThreadPool::instance().parallelFor( ( dst.height + BAND - 1 ) / BAND,
+                [&]( unsigned band ) {
+            const int y1 = std::min( int( band + 1 ) * BAND, dst.height );
+            for ( int y = band * BAND; y < y1; ++y )
+            {
+                const uint8_t* row0 = &src.pixels[size_t(2*y) * src.width];
+                kernels.downsample( row0, row0 + src.width, dst.width,
+                        &dst.pixels[size_t(y) * dst.width] );
+            }
+        }, mOptions.maxThreads );
+    }
+}
+
+bool BurstMerge::matches( CameraBuffer& frame ) const
+{
+    if ( frame.format() != mFormat ||
+         frame.numberOfPlanes() != mPlanes.size() )
+    {
+        return false;
+    }
+    for ( unsigned p = 0; p < mPlanes.size(); ++p )
+    {
+        const CameraBuffer::Data d = frame.data(p);
+        if ( !d.ptr || d.width != mPlanes[p].data.width ||
+             d.height != mPlanes[p].data.height )
+        {
+            return false;
+        }
+    }
+    return frame.data(0).channel_step <= 1;
+}
+
+bool BurstMerge::begin( CameraBuffer& reference )
+{
+    mFormat = UNKNOWN;
+    mPlanes.clear();
+    mStats = Stats();
+
+    const PixelFormat format = reference.format();
+    const unsigned planes = format == RAW16 ? 1 : 3;
+    if ( !mKernels || ( format != RAW16 && format != YCbCr_420_888 ) ||
+         reference.numberOfPlanes() < planes )
+    {
+        return false;
+    }
+
+    const CameraBuffer::Data luma = reference.data(0);
+    if ( !luma.ptr || luma.width < 2 * MIN_WINDOW ||
+         luma.height < 2 * MIN_WINDOW || luma.channel_step > 1 )
+    {
+        return false;
+    }
+
+    mFormat = format;
+    mPlanes.resize( planes );
+    for ( unsigned p = 0; p < planes; ++p )
+    {
+        mPlanes[p].data = reference.data(p);
+        const size_t samples = size_t(mPlanes[p].data.width) * mPlanes[p].data.height;
+        mPlanes[p].value.assign( samples, 0.0f );
+        mPlanes[p].weight.assign( samples, 0.0f );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    buildPyramid( reference, 1.0f, mReference );
+    mStats.pyramidUs = elapsedUs( start );
+
+    // The reference has weight 1 everywhere, clipped or not.
+    start = std::chrono::steady_clock::now();
+    const KernelSet& kernels = *static_cast<const KernelSet*>( mKernels );
+    for ( Plane& plane : mPlanes )
+    {
+        const CameraBuffer::Data& d = plane.data;
+        ThreadPool::instance().parallelFor( d.height, [&]( unsigned y ) {
+            const size_t row = size_t(y) * d.width;
+            if ( mFormat == RAW16 )
+            {
+                kernels.accumulate16( (const uint16_t*) d.ptr + size_t(y) * d.stride,
+                        d.width, &mBlack[2 * ( y & 1 )], 1.0f, 1.0f, INT32_MAX,
+                        &plane.value[row], &plane.weight[row] );
+            }
+            else if ( d.channel_step <= 1 )
+            {
+                kernels.accumulate8( (const uint8_t*) d.ptr + size_t(y) * d.stride,
+                        d.width, 1.0f, &plane.value[row], &plane.weight[row] );
+            }
+            else
+            {
+                const uint8_t* src = (const uint8_t*) d.ptr + size_t(y) * d.stride;
+                for ( int x = 0; x < d.width; ++x )
+                {
+                    plane.value[row + x] = src[x * d.channel_step];
+                    plane.weight[row + x] = 1.0f;
+                }
+            }
+        }, mOptions.maxThreads );
+    }
+    mStats.mergeUs = elapsedUs( start );
+    mStats.frames = 1;
+    return true;
+}
+
+bool BurstMerge::add( CameraBuffer& frame, float gain )
+{
+    if ( mFormat == UNKNOWN || !matches( frame ) || !( gain > 0.0f ) )
+    {
+        return false;
+    }
+    // The HAL's tone curve makes YCbCr_420_888 exposures incomparable.
+    if ( mFormat != RAW16 && gain != 1.0f ) return false;
+
+    const KernelSet& kernels = *static_cast<const KernelSet*>( mKernels );
+
+    auto start = std::chrono::steady_clock::now();
+    buildPyramid( frame, gain, mAlternate );
+    mStats.pyramidUs += elapsedUs( start );
+
+    std::vector<const uint8_t*> ref;
+    std::vector<const uint8_t*> alt;
+    std::vector<int> widths;
+    std::vector<int> heights;
+    for ( size_t l = 0; l < mReference.size(); ++l )
+    {
+        ref.push_back( mReference[l].pixels.data() );
+        alt.push_back( mAlternate[l].pixels.data() );
+        widths.push_back( mReference[l].width );
+        heights.push_back( mReference[l].height );
+    }
+
+    // The last tile of a row or column also takes the odd remainder.
+    const int tilesX = std::max( widths[0] / TILE, 1 );
+    const int tilesY = std::max( heights[0] / TILE, 1 );
+    std::vector<Motion> motion( size_t(tilesX) * tilesY );
+
+    start = std::chrono::steady_clock::now();
+    ThreadPool::instance().parallelFor( tilesY, [&]( unsigned tileY ) {
+        for ( int tileX = 0; tileX < tilesX; ++tileX )
+        {
+            motion[size_t(tileY) * tilesX + tileX] = alignTile( kernels, ref, alt,
+                    widths, heights, tileX, tileY, mOptions.searchRadius,
+                    mOptions.noiseLevel );
+        }
+    }, mOptions.maxThreads );
+    mStats.alignUs += elapsedUs( start );
+
+    start = std::chrono::steady_clock::now();
+    std::atomic<unsigned> rejected( 0 );
+    const CameraBuffer::Data luma = frame.data(0);
+    const float clipMargin = std::max( ( mWhite - mBlack[0] ) / 64.0f, 1.0f );
+    const int clip = int( mWhite - clipMargin );
+
+    ThreadPool::instance().parallelFor( tilesY, [&]( unsigned tileY ) {
+        // Chroma tiles are at most 2 * TILE - 1 wide.
+        float chroma[2 * TILE];
+        unsigned tileRejected = 0;
+
+        for ( int tileX = 0; tileX < tilesX; ++tileX )
+        {
+            const Motion& m = motion[size_t(tileY) * tilesX + tileX];
+
+            // Luma and RAW16 have two samples per base pixel. The tile is
+            // inside every plane or none, as chroma is half the luma size.
+            const int lumaSize = 2 * TILE;
+            const int lumaX0 = tileX * lumaSize + 2 * m.dx;
+            const int lumaY0 = int(tileY) * lumaSize + 2 * m.dy;
+            const int lumaX1 = tileX == tilesX - 1 ? luma.width + 2 * m.dx :
+                    lumaX0 + lumaSize;
+            const int lumaY1 = int(tileY) == tilesY - 1 ? luma.height + 2 * m.dy :
+                    lumaY0 + lumaSize;
+            if ( m.weight == 0.0f || lumaX0 < 0 || lumaY0 < 0 ||
+                 lumaX1 > luma.width || lumaY1 > luma.height )
+            {
+                ++tileRejected;
+                continue;
+            }
+
+            for ( unsigned p = 0; p < mPlanes.size(); ++p )
+            {
+                Plane& plane = mPlanes[p];
+                const CameraBuffer::Data src = frame.data(p);
+
+                const int scale = p == 0 ? 2 : 1;
+                const int size = TILE * scale;
+                const int x0 = tileX * size;
+                const int y0 = int(tileY) * size;
+                const int x1 = tileX == tilesX - 1 ? src.width : x0 + size;
+                const int y1 = int(tileY) == tilesY - 1 ? src.height : y0 + size;
+                const int dx = m.dx * scale;
+                const int dy = m.dy * scale;
+
+                for ( int y = y0; y < y1; ++y )
+                {
+                    const size_t row = size_t(y) * plane.data.width + x0;
+                    const size_t srcRow = size_t(y + dy) * src.stride;
+                    if ( mFormat == RAW16 )
+                    {
+                        kernels.accumulate16( (const uint16_t*) src.ptr + srcRow +
+                                x0 + dx, x1 - x0, &mBlack[2 * ( y & 1 )],
+                                m.weight * gain, m.weight, clip,
+                                &plane.value[row], &plane.weight[row] );
+                    }
+                    else if ( src.channel_step <= 1 )
+                    {
+                        kernels.accumulate8( (const uint8_t*) src.ptr + srcRow +
+                                x0 + dx, x1 - x0, m.weight,
+                                &plane.value[row], &plane.weight[row] );
+                    }
+                    else
+                    {
+                        const uint8_t* s = (const uint8_t*) src.ptr + srcRow +
+                                size_t( x0 + dx ) * src.channel_step;
+                        for ( int x = 0; x < x1 - x0; ++x )
+                        {
+                            chroma[x] = s[x * src.channel_step];
+                        }
+                        for ( int x = 0; x < x1 - x0; ++x )
+                        {
+                            plane.value[row + x] += chroma[x] * m.weight;
+                            plane.weight[row + x] += m.weight;
+                        }
+                    }
+                }
+            }
+        }
+        rejected += tileRejected;
+    }, mOptions.maxThreads );
+
+    mStats.mergeUs += elapsedUs( start );
+    mStats.tiles = tilesX * tilesY;
+    mStats.tilesRejected += rejected;
+    ++mStats.frames;
+    return true;
+}
+
+std::unique_ptr<CameraBuffer> BurstMerge::finish()
+{
+    if ( mFormat == UNKNOWN ) return nullptr;
+
+    const auto start = std::chrono::steady_clock::now();
+    const KernelSet& kernels = *static_cast<const KernelSet*>( mKernels );
+    const CameraBuffer::Data& luma = mPlanes[0].data;
+    std::unique_ptr<CameraBuffer> merged( new MergedBuffer( mFormat,
+            luma.width, luma.height ) );
+
+    for ( unsigned p = 0; p < mPlanes.size(); ++p )
+    {
+        const Plane& plane = mPlanes[p];
+        const CameraBuffer::Data out = merged->data(p);
+        ThreadPool::instance().parallelFor( out.height, [&]( unsigned y ) {
+            const size_t row = size_t(y) * plane.data.width;
+            if ( mFormat == RAW16 )
+            {
+                kernels.finish16( &plane.value[row], &plane.weight[row], out.width,
+                        &mBlack[2 * ( y & 1 )], float(mWhite),
+                        (uint16_t*) out.ptr + size_t(y) * out.stride );
+            }
+            else
+            {
+                kernels.finish8( &plane.value[row], &plane.weight[row], out.width,
+                        (uint8_t*) out.ptr + size_t(y) * out.stride );
+            }
+        }, mOptions.maxThreads );
+    }
+
+    mStats.mergeUs += elapsedUs( start );
+    mFormat = UNKNOWN;
+    return merged;
+}
@@ -0,0 +1,176 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef BurstMerge_H
+#define BurstMerge_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*!
+ * Merges a burst of RAW16 or YCbCr_420_888 frames into one frame with
+ * less noise. Frames are added one at a time, so only the reference and
+ * the frame being added have to be held, not the whole burst.
+ *
+ * Every frame is aligned to the reference with a coarse to fine block
+ * matcher: a luma pyramid is built from the 2x2 quads of the frame
+ * (the CFA quads for RAW16), and each 16x16 tile of the pyramid base is
+ * searched on every level around the offset found on the level above.
+ * Offsets are whole quads, so RAW16 frames keep their CFA phase.
+ *
+ * Aligned tiles are averaged, weighted down the more they still differ
+ * from the reference after alignment, so moving content is taken from
+ * the reference. A gain brings frames of another exposure to the
+ * exposure of the reference; their clipped samples are left out.
+ * Exposure gains need linear RAW16 data, YCbCr_420_888 frames must all
+ * have the same exposure.
+ *
+ * Pyramid levels, tile rows and merge rows run on the ThreadPool.
+ */
+class BurstMerge
+{
+public:
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSE2
+    };
+
+    struct Options
+    {
+        // Levels above the pyramid base.
+        unsigned pyramidLevels = 3;
+
+        // Search radius on the coarsest level, in its pixels.
+        int searchRadius = 4;
+
+        /*
+         * Mean absolute difference of an aligned tile to the reference,
+         * on the 8 bit square root scale of the pyramid, expected from
+         * noise alone. Tiles differing more get less weight.
+         */
+        float noiseLevel = 4.0f;
+
+        Kernel kernel = Kernel::AUTO;
+
+        // Threads of the ThreadPool, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    struct Stats
+    {
+        unsigned frames = 0;            //< Reference included.
+        unsigned tiles = 0;             //< Alignment tiles per frame.
+        unsigned tilesRejected = 0;     //< Tiles of added frames left out.
+        int64_t pyramidUs = 0;
+        int64_t alignUs = 0;
+        int64_t mergeUs = 0;
+    };
+
+    BurstMerge( const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    static bool isAvailable( Kernel kernel );
+
+    /*!
+     * Starts a merge on the reference frame, which has to stay valid
+     * until finish(). Returns false if the format is not supported or the
+     * kernel is not available.
+     */
+    bool begin( nv::camera2::CameraBuffer& reference );
+
+    /*!
+     * Aligns frame to the reference and adds it to the merge. gain
+     * multiplies the frame's samples, above the black level, to match
+     * the exposure of the reference. The frame is not used after the
+     * call returns. Returns false if it does not match the reference.
+     */
+    bool add( nv::camera2::CameraBuffer& frame, float gain = 1.0f );
+
+    /*!
+     * Returns the merged frame, in the format and size of the reference;
+     * YCbCr_420_888 comes out with planar chroma. Returns nullptr if no
+     * merge was started.
+     */
+    std::unique_ptr<nv::camera2::CameraBuffer> finish();
+
+    // Statistics of the current or last merge.
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    struct Level
+    {
+        std::vector<uint8_t> pixels;
+        int width = 0;
+        int height = 0;
+    };
+
+    typedef std::vector<Level> Pyramid;
+
+    struct Plane
+    {
+        nv::camera2::CameraBuffer::Data data;
+        std::vector<float> value;
+        std::vector<float> weight;
+    };
+
+    void buildPyramid( nv::camera2::CameraBuffer& frame, float gain,
+            Pyramid& pyramid );
+    bool matches( nv::camera2::CameraBuffer& frame ) const;
+
+    Options mOptions;
+    const void* mKernels = nullptr;
+
+    float mBlack[4];
+    int mWhite;
+    uint8_t mToneCurve[4096];
+
+    nv::camera2::PixelFormat mFormat = nv::camera2::UNKNOWN;
+    Pyramid mReference;
+    Pyramid mAlternate;
+
+    // Weighted sums and weights of every plane of the reference.
+    std::vector<Plane> mPlanes;
+
+    Stats mStats;
+};
+
+#endif
@@ -0,0 +1,599 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "CameraSession.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifdef __ANDROID__
+#include <sys/system_properties.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+const char CACHE_MAGIC[4] = { 'N', 'V', 'C', 'P' };
+
+// Bump when the fields visited by visitProperties() change.
+constexpr uint32_t CACHE_VERSION = 1;
+
+int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// Identifies the system build; properties cached under another build are
+// queried again.
+std::string buildFingerprint()
+{
+#ifdef __ANDROID__
+    char value[PROP_VALUE_MAX] = "";
+    __system_property_get( "ro.build.fingerprint", value );
+    return value;
+#else
+    return std::string();
+#endif
+}
+
+// Appends values to a byte buffer in native byte order; the cache never
+// leaves the device.
+class Writer
+{
+public:
+
+    explicit Writer( std::vector<uint8_t>& out ) :
+        mOut(out)
+    {
+    }
+
+    template <typename T>
+    void operator()( T& value )
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>( &value );
+        mOut.insert( mOut.end(), bytes, bytes + sizeof(T) );
+    }
+
+    template <typename T>
+    void operator()( std::vector<T>& values )
+    {
+        uint32_t count = values.size();
+        (*this)( count );
+        for ( auto& value : values )
+        {
+            (*this)( value );
+        }
+    }
+
+    void operator()( std::string& value )
+    {
+        uint32_t length = value.size();
+        (*this)( length );
+        mOut.insert( mOut.end(), value.begin(), value.end() );
+    }
+
+private:
+
+    std::vector<uint8_t>& mOut;
+};
+
+// Reads what Writer wrote; any read past the end fails the whole file.
+class Reader
+{
+public:
+
+    Reader( const uint8_t* data, size_t size ) :
+        mData(data),
+        mSize(size)
+    {
+    }
+
+    template <typename T>
+    void operator()( T& value )
+    {
+        if ( !take( sizeof(T) ) ) return;
+        memcpy( &value, mData + mPos - sizeof(T), sizeof(T) );
+    }
+
+    void operator()( bool& value )
+    {
+        uint8_t byte = 0;
+        (*this)( byte );
+        value = byte != 0;
+    }
+
+    template <typename T>
+    void operator()( std::vector<T>& values )
+    {
+        uint32_t count = 0;
+        (*this)( count );
+        if ( mFailed || count > ( mSize - mPos ) / sizeof(T) )
+        {
+            mFailed = true;
+            return;
+        }
+        values.resize( count );
+        for ( auto& value : values )
+        {
+            (*this)( value );
+        }
+    }
+
+    void operator()( std::string& value )
+    {
+        uint32_t length = 0;
+        (*this)( length );
+        if ( !take( length ) ) return;
+        value.assign( reinterpret_cast<const char*>( mData + mPos - length ),
+                length );
+    }
+
+    bool failed() const
+    {
+        return mFailed;
+    }
+
+    bool atEnd() const
+    {
+        return mPos == mSize;
+    }
+
+private:
+
+    bool take( size_t bytes )
+    {
+        if ( mFailed || mSize - mPos < bytes )
+        {
+            mFailed = true;
+            return false;
+        }
+        mPos += bytes;
+        return true;
+    }
+
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mPos = 0;
+    bool mFailed = false;
+};
+
+// Visits every field of the properties, in file order.
+template <typename Archive>
+void visitProperties( Archive& archive, StaticProperties& p )
+{
+    archive( p.cameraId );
+
+    archive( p.scaler.availablePixelFormats );
+    archive( p.scaler.availableYUVSizes );
+    archive( p.scaler.availableRAWSizes );
+    archive( p.scaler.availableJPGSizes );
+    archive( p.scaler.availableYUVMinFrameTimes );
+    archive( p.scaler.availableRAWMinFrameTimes );
+    archive( p.scaler.availableJPGMinFrameTimes );
+    archive( p.scaler.availableMaxDigitalZoom );
+
+    archive( p.sensor.minExposure );
+    archive( p.sensor.maxExposure );
+    archive( p.sensor.minSensitivity );
+    archive( p.sensor.maxSensitivity );
+    archive( p.sensor.maxFrameDuration );
+    archive( p.sensor.activeArraySize );
+    archive( p.sensor.whiteLevel );
+    archive( p.sensor.blackLevelPattern );
+    archive( p.sensor.colorTransformIlluminant1 );
+    archive( p.sensor.colorTransformIlluminant2 );
+    archive( p.sensor.illuminant1 );
+    archive( p.sensor.illuminant2 );
+
+    archive( p.statistics.histogramBucketCount );
+    archive( p.statistics.maxHistogramCount );
+    archive( p.statistics.maxSharpnessMapValue );
+    archive( p.statistics.sharpnessMapSize );
+
+    archive( p.lens.availableApertures );
+    archive( p.lens.availableFocalLengths );
+    archive( p.lens.hyperFocalDistance );
+    archive( p.lens.minimumFocusDistance );
+
+    archive( p.flash.available );
+
+    archive( p.request.maxNumRAWStreams );
+    archive( p.request.maxNumYUVStreams );
+    archive( p.request.maxNumJPGStreams );
+
+    archive( p.control.aeAvailableModes );
+    archive( p.control.aeMinExposureCompensation );
+    archive( p.control.aeMaxExposureCompensation );
+    archive( p.control.aeExposureCompensationStep );
+    archive( p.control.afAvailableModes );
+    archive( p.control.awbAvailableModes );
+}
+
+}
+
+CameraSession::CameraSession( const Options& options,
+        ExpiryCallback callback ) :
+    mOptions(options),
+    mCallback(callback),
+    mStartTime(0),
+    mStreamingId(-1)
+{
+    mTimer = std::thread( &CameraSession::timerLoop, this );
+}
+
+CameraSession::~CameraSession()
+{
+    shutdown();
+    close();
+}
+
+void CameraSession::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mQuit = true;
+    }
+    mTimerWake.notify_all();
+    if ( mTimer.joinable() ) mTimer.join();
+}
+
+bool CameraSession::open()
+{
+    if ( state() != State::CLOSED ) return false;
+
+    const int64_t start = now();
+    mManager = mOptions.manager;
+    if ( !mManager ) mManager = CameraManager::createCameraManager();
+    if ( !mManager ) return false;
+
+    const int64_t managerDone = now();
+    bool cached = false;
+    if ( !loadProperties( cached ) )
+    {
+        mManager = nullptr;
+        return false;
+    }
+
+    const int64_t propertiesDone = now();
+    mDevice = mManager->createCameraDevice( mOptions.cameraId, nullptr );
+    if ( !mDevice )
+    {
+        mManager = nullptr;
+        return false;
+    }
+    const int64_t end = now();
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    mState = State::OPEN;
+    mCounters.lastStartWarm = false;
+    mStartTime = start;
+    ++mCounters.coldStarts;
+    if ( cached ) ++mCounters.cachedProperties;
+    mCounters.lastCached = cached;
+    mCounters.managerUs = ( managerDone - start ) / 1000;
+    mCounters.propertiesUs = ( propertiesDone - managerDone ) / 1000;
+    mCounters.deviceUs = ( end - propertiesDone ) / 1000;
+    return true;
+}
+
+bool CameraSession::startStreaming( CaptureRequest& request )
+{
+    if ( state() != State::OPEN ) return false;
+    if ( mDevice->capture( request ) < 0 ) return false;
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    mRequest = request;
+    mStreamingId = request.requestId;
+    mState = State::STREAMING;
+    return true;
+}
+
+bool CameraSession::updateStreaming( CaptureRequest& request )
+{
+    const State current = state();
+    if ( current == State::STREAMING )
+    {
+        // The new request takes over from the repeating one; keep its id
+        // for pause().
+        if ( mDevice->capture( request ) < 0 ) return false;
+    }
+    else if ( current != State::PAUSED )
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    mRequest = request;
+    return true;
+}
+
+void CameraSession::pause()
+{
+    if ( state() != State::STREAMING ) return;
+    mDevice->cancelRequest( mRequest.requestId );
+
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mState = State::PAUSED;
+        mPausedAt = now();
+        mExpiryPending = true;
+        mStartTime = 0;
+    }
+    mTimerWake.notify_all();
+}
+
+bool CameraSession::resume()
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        if ( mState != State::PAUSED ) return false;
+        mExpiryPending = false;
+    }
+
+    const int64_t start = now();
+    if ( mDevice->capture( mRequest ) < 0 )
+    {
+        // Still paused; let it expire as if resume() had not been called.
+        {
+            std::lock_guard<std::mutex> lk( mMutex );
+            mExpiryPending = true;
+        }
+        mTimerWake.notify_all();
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    mState = State::STREAMING;
+    mStreamingId = mRequest.requestId;
+    mCounters.lastStartWarm = true;
+    mStartTime = start;
+    ++mCounters.warmStarts;
+    return true;
+}
+
+bool CameraSession::frameArrived( const CameraFrame& frame )
+{
+    int64_t start = mStartTime.load( std::memory_order_relaxed );
+    if ( start == 0 ) return false;
+
+    // Frames of the request before a pause may still be queued.
+    if ( frame.requestId != mStreamingId.load( std::memory_order_relaxed ) )
+    {
+        return false;
+    }
+    if ( !mStartTime.compare_exchange_strong( start, 0 ) ) return false;
+
+    const int64_t us = ( now() - start ) / 1000;
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    if ( mCounters.lastStartWarm )
+    {
+        mTotalWarmUs += us;
+        mCounters.lastWarmUs = us;
+        mCounters.meanWarmUs = mTotalWarmUs / int64_t( mCounters.warmStarts );
+    }
+    else
+    {
+        mTotalColdUs += us;
+        mCounters.lastColdUs = us;
+        mCounters.meanColdUs = mTotalColdUs / int64_t( mCounters.coldStarts );
+    }
+    return true;
+}
+
+bool CameraSession::expired() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mState == State::PAUSED &&
+            now() - mPausedAt >= int64_t( mOptions.warmTimeoutMs ) * 1000000;
+}
+
+void CameraSession::close()
+{
+    State previous;
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        previous = mState;
+        mState = State::CLOSED;
+        mExpiryPending = false;
+        mStartTime = 0;
+    }
+
+    if ( previous == State::STREAMING )
+    {
+        mDevice->cancelRequest( mRequest.requestId );
+    }
+    mRequest = CaptureRequest();
+    mDevice = nullptr;
+    mManager = nullptr;
+}
+
+CameraSession::State CameraSession::state() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mState;
+}
+
+CameraSession::Counters CameraSession::counters() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mCounters;
+}
+
+void CameraSession::clearCache()
+{
+    mCache.clear();
+    mCacheLoaded = true;
+    if ( !mOptions.cacheFile.empty() )
+    {
+        std::remove( mOptions.cacheFile.c_str() );
+    }
+}
+
+bool CameraSession::loadProperties( bool& cached )
+{
+    if ( !mCacheLoaded )
+    {
+        mFingerprint = buildFingerprint();
+        loadCache();
+        mCacheLoaded = true;
+    }
+
+    auto entry = mCache.find( mOptions.cameraId );
+    if ( entry != mCache.end() )
+    {
+        mProperties = entry->second;
+        cached = true;
+        return true;
+    }
+
+    StaticProperties properties;
+    if ( mManager->queryStaticProperties( mOptions.cameraId, properties ) < 0 )
+    {
+        return false;
+    }
+    mProperties = properties;
+    mCache[mOptions.cameraId] = properties;
+    cached = false;
+    saveCache();
+    return true;
+}
+
+void CameraSession::loadCache()
+{
+    if ( mOptions.cacheFile.empty() ) return;
+
+    std::ifstream in( mOptions.cacheFile, std::ifstream::binary );
+    if ( !in ) return;
+    const std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( in ) ),
+            std::istreambuf_iterator<char>() );
+
+    Reader reader( data.data(), data.size() );
+    char magic[4] = {};
+    uint32_t version = 0;
+    std::string fingerprint;
+    uint32_t count = 0;
+    reader( magic );
+    reader( version );
+    reader( fingerprint );
+    reader( count );
+    if ( reader.failed() || memcmp( magic, CACHE_MAGIC, sizeof(magic) ) != 0 ||
+         version != CACHE_VERSION || fingerprint != mFingerprint )
+    {
+        return;
+    }
+
+    std::map<int, StaticProperties> cache;
+    for ( uint32_t i = 0; i < count && !reader.failed(); ++i )
+    {
+        int32_t cameraId = 0;
+        reader( cameraId );
+        visitProperties( reader, cache[cameraId] );
+    }
+
+    // A damaged file is ignored as a whole and rewritten on the next query.
+    if ( !reader.failed() && reader.atEnd() )
+    {
+        mCache.swap( cache );
+    }
+}
+
+void CameraSession::saveCache() const
+{
+    if ( mOptions.cacheFile.empty() ) return;
+
+    std::vector<uint8_t> data;
+    Writer writer( data );
+    char magic[4];
+    memcpy( magic, CACHE_MAGIC, sizeof(magic) );
+    uint32_t version = CACHE_VERSION;
+    std::string fingerprint = mFingerprint;
+    uint32_t count = mCache.size();
+    writer( magic );
+    writer( version );
+    writer( fingerprint );
+    writer( count );
+    for ( const auto& entry : mCache )
+    {
+        int32_t cameraId = entry.first;
+        StaticProperties properties = entry.second;
+        writer( cameraId );
+        visitProperties( writer, properties );
+    }
+
+    // Written under another name and renamed, so a launch never reads a
+    // partly written cache.
+    const std::string temporary = mOptions.cacheFile + ".tmp";
+    {
+        std::ofstream out( temporary, std::ofstream::binary );
+        out.write( reinterpret_cast<const char*>( data.data() ), data.size() );
+        if ( !out ) return;
+    }
+    std::rename( temporary.c_str(), mOptions.cacheFile.c_str() );
+}
+
+void CameraSession::timerLoop()
+{
+    std::unique_lock<std::mutex> lk( mMutex );
+
+    while ( !mQuit )
+    {
+        if ( !mExpiryPending )
+        {
+            mTimerWake.wait( lk );
+            continue;
+        }
+
+        const int64_t left = mPausedAt +
+                int64_t( mOptions.warmTimeoutMs ) * 1000000 - now();
+        if ( left > 0 )
+        {
+            mTimerWake.wait_for( lk, std::chrono::nanoseconds( left ) );
+            continue;
+        }
+
+        mExpiryPending = false;
+        ++mCounters.expiries;
+        if ( mCallback )
+        {
+            lk.unlock();
+            mCallback();
+            lk.lock();
+        }
+    }
+}
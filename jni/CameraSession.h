@@ -0,0 +1,237 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef CameraSession_H
+#define CameraSession_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*!
+ * Keeps a camera device and its streams open across focus changes, so
+ * that getting the focus back costs one capture() call instead of a cold
+ * start with a blocking createStream() for every stream.
+ *
+ * open() connects to the camera. Its StaticProperties come from a cache
+ * held in memory and in Options::cacheFile, keyed by camera id and the
+ * system build, so only the first launch after a system update queries
+ * them. pause() cancels the streaming request and leaves the device and
+ * the streams created on it as they are; resume() submits the request
+ * again. Once the session has been paused for Options::warmTimeoutMs the
+ * expiry callback runs on the session's timer thread; it tears down the
+ * streams and calls close() if expired() still holds.
+ *
+ * Time to first frame runs from open() or resume() to the next
+ * frameArrived() and is kept separately for cold and warm starts.
+ */
+class CameraSession
+{
+public:
+
+    enum class State
+    {
+        CLOSED,
+        OPEN,           //< Connected, the request is not submitted yet.
+        STREAMING,
+        PAUSED          //< Device and streams are kept warm.
+    };
+
+    struct Options
+    {
+        int cameraId = 0;
+
+        // File the properties cache is kept in across launches, empty to
+        // keep it in memory only.
+        std::string cacheFile;
+
+        // Time a paused session stays warm, 0 to expire right away.
+        unsigned warmTimeoutMs = 30000;
+
+        // Manager to connect through, such as a ReplayCamera one, shared by
+        // the sessions of all cameras; empty to create the camera HAL's at
+        // open().
+        std::shared_ptr<nv::camera2::CameraManager> manager;
+    };
+
+    struct Counters
+    {
+        uint64_t coldStarts = 0;
+        uint64_t warmStarts = 0;
+        uint64_t expiries = 0;
+        uint64_t cachedProperties = 0;  //< Cold starts without a query.
+
+        // Time to first frame.
+        bool lastStartWarm = false;
+        int64_t lastColdUs = 0;
+        int64_t lastWarmUs = 0;
+        int64_t meanColdUs = 0;
+        int64_t meanWarmUs = 0;
+
+        // Steps of the last open().
+        bool lastCached = false;
+        int64_t managerUs = 0;
+        int64_t propertiesUs = 0;
+        int64_t deviceUs = 0;
+    };
+
+    /*!
+     * Called once per pause that outlasts the warm timeout, from the
+     * session's timer thread and without its lock held.
+     */
+    typedef std::function<void()> ExpiryCallback;
+
+    CameraSession( const Options& options, ExpiryCallback callback );
+
+    // Closes the session without calling the expiry callback.
+    ~CameraSession();
+
+    /*!
+     * Stops the timer thread: an expiry callback already running is
+     * waited for, and none runs after. The owner calls it before tearing
+     * down what the callback uses, without holding the callback's locks
+     * and never from the callback itself.
+     */
+    void shutdown();
+
+    /*!
+     * Connects to the camera, from the CLOSED state only. Returns false if
+     * the camera cannot be opened.
+     */
+    bool open();
+
+    nv::camera2::CameraDevice* device() const
+    {
+        return mDevice.get();
+    }
+
+    // Valid once open() succeeded.
+    const nv::camera2::StaticProperties& properties() const
+    {
+        return mProperties;
+    }
+
+    // Cameras the manager knows of, 0 while the session is closed.
+    int numberOfCameras() const
+    {
+        return mManager ? mManager->getNumberOfCameras() : 0;
+    }
+
+    /*!
+     * Submits the repeating request of an OPEN session. The session keeps
+     * a copy for resume(), so the streams in request.outputs have to stay
+     * alive until close().
+     */
+    bool startStreaming( nv::camera2::CaptureRequest& request );
+
+    /*!
+     * Replaces the streaming request, e.g. with another frame duration. A
+     * STREAMING session submits it right away, a PAUSED one keeps it for
+     * resume(). Returns false in other states or if the device refused it.
+     */
+    bool updateStreaming( nv::camera2::CaptureRequest& request );
+
+    // Cancels the streaming request and starts the warm timeout.
+    void pause();
+
+    /*!
+     * Submits the streaming request again. Returns false if the session
+     * was not paused, typically because it expired; the caller then does
+     * a cold start.
+     */
+    bool resume();
+
+    /*!
+     * Call for every preview frame, from any thread; after the first
+     * frame of a start it is a single atomic load. Returns true for that
+     * first frame.
+     */
+    bool frameArrived( const nv::camera2::CameraFrame& frame );
+
+    // True while the session is paused and past its warm timeout.
+    bool expired() const;
+
+    // Disconnects; streams created on the device have to be gone.
+    void close();
+
+    State state() const;
+    Counters counters() const;
+
+    // Forgets the cached properties, in memory and on disk.
+    void clearCache();
+
+private:
+
+    bool loadProperties( bool& cached );
+    void loadCache();
+    void saveCache() const;
+    void timerLoop();
+
+    const Options mOptions;
+    ExpiryCallback mCallback;
+
+    std::shared_ptr<nv::camera2::CameraManager> mManager;
+    std::unique_ptr<nv::camera2::CameraDevice> mDevice;
+    nv::camera2::StaticProperties mProperties;
+    nv::camera2::CaptureRequest mRequest;
+
+    std::map<int, nv::camera2::StaticProperties> mCache;
+    std::string mFingerprint;
+    bool mCacheLoaded = false;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mTimerWake;
+    State mState = State::CLOSED;
+    int64_t mPausedAt = 0;
+    bool mExpiryPending = false;
+    bool mQuit = false;
+
+    // Start time of the start waiting for its first frame, 0 if none,
+    // and the request its frames come from.
+    std::atomic<int64_t> mStartTime;
+    std::atomic<int> mStreamingId;
+
+    Counters mCounters;
+    int64_t mTotalColdUs = 0;
+    int64_t mTotalWarmUs = 0;
+
+    std::thread mTimer;
+};
+
+#endif
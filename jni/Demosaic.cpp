@@ -0,0 +1,789 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "Demosaic.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define DEMOSAIC_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define DEMOSAIC_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Tiles are TILE x TILE output pixels, i.e. TILE_QUADS x TILE_QUADS CFA
+// quads for the full size methods. Color planes carry one quad of apron
+// on each side and are padded to a multiple of the vector width.
+constexpr int TILE = 64;
+constexpr int TILE_QUADS = TILE / 2;
+constexpr int PLANE_ROWS = TILE_QUADS + 2;
+constexpr int PLANE_STRIDE = TILE_QUADS + 8;
+
+constexpr int MAX_VALUE = 4095;
+
+// CFA colors of the 2x2 pattern in raster order: 0 red, 1 green, 2 blue.
+const int CFA_COLORS[4][4] = {
+    { 0, 1, 1, 2 }, { 1, 0, 2, 1 }, { 1, 2, 0, 1 }, { 2, 1, 1, 0 } };
+
+struct Normalization
+{
+    // Indexed by CFA position ( y & 1 ) * 2 + ( x & 1 ).
+    const uint16_t* black;
+    const uint16_t* range;
+    const uint16_t* scale;
+    unsigned shift;
+};
+
+inline int16_t normalize( uint16_t raw, int position, const Normalization& n )
+{
+    unsigned v = raw > n.black[position] ? raw - n.black[position] : 0;
+    v = std::min( v, unsigned( n.range[position] ) );
+    return int16_t( ( ( v << n.shift ) * n.scale[position] ) >> 16 );
+}
+
+// Reflects coordinates outside [0, size) back in, keeping their CFA
+// parity; size is even.
+inline int mirror( int x, int size )
+{
+    if ( x < 0 ) return x & 1;
+    if ( x >= size ) return size - 2 + ( ( x - size ) & 1 );
+    return x;
+}
+
+/*
+ * A row of RAW16 pixels split into quad columns: even receives the first
+ * and odd the second pixel of each quad. Quads start at pixel x0, which
+ * may lie outside the image.
+ */
+struct SourceRow
+{
+    const uint16_t* pixels;
+    int y;
+    int x0;
+    int width;
+};
+
+typedef int (*NormalizeKernel)( const SourceRow& row, int quad, int count,
+        const Normalization& n, int16_t* even, int16_t* odd );
+
+// Normalizes quads [quad, count) of the row, returns count.
+int normalizeScalar( const SourceRow& row, int quad, int count,
+        const Normalization& n, int16_t* even, int16_t* odd )
+{
+    const int rowPosition = ( row.y & 1 ) * 2;
+    for ( ; quad < count; ++quad )
+    {
+        const int x = mirror( row.x0 + 2 * quad, row.width );
+        const int x1 = mirror( row.x0 + 2 * quad + 1, row.width );
+        even[quad] = normalize( row.pixels[x], rowPosition + ( x & 1 ), n );
+        odd[quad] = normalize( row.pixels[x1], rowPosition + ( x1 & 1 ), n );
+    }
+    return count;
+}
+
+#if DEMOSAIC_HAVE_NEON
+
+inline uint16x8_t normalizeNeon( uint16x8_t v, int position, const Normalization& n )
+{
+    v = vqsubq_u16( v, vdupq_n_u16( n.black[position] ) );
+    v = vminq_u16( v, vdupq_n_u16( n.range[position] ) );
+    v = vshlq_u16( v, vdupq_n_s16( n.shift ) );
+
+    const uint16x4_t scale = vdup_n_u16( n.scale[position] );
+    return vcombine_u16(
+            vshrn_n_u32( vmull_u16( vget_low_u16( v ), scale ), 16 ),
+            vshrn_n_u32( vmull_u16( vget_high_u16( v ), scale ), 16 ) );
+}
+
+int normalizeNeon( const SourceRow& row, int quad, int count,
+        const Normalization& n, int16_t* even, int16_t* odd )
+{
+    const int rowPosition = ( row.y & 1 ) * 2;
+    const int evenPosition = rowPosition + ( row.x0 & 1 );
+    const int oddPosition = rowPosition + ( ~row.x0 & 1 );
+
+    // Quads left of the image.
+    int end = std::min( count, std::max( 0, ( 1 - row.x0 ) / 2 ) );
+    quad = normalizeScalar( row, quad, end, n, even, odd );
+
+    for ( ; quad + 8 <= count && row.x0 + 2 * ( quad + 8 ) <= row.width; quad += 8 )
+    {
+        const uint16x8x2_t pixels = vld2q_u16( row.pixels + row.x0 + 2 * quad );
+        vst1q_s16( even + quad, vreinterpretq_s16_u16(
+                normalizeNeon( pixels.val[0], evenPosition, n ) ) );
+        vst1q_s16( odd + quad, vreinterpretq_s16_u16(
+                normalizeNeon( pixels.val[1], oddPosition, n ) ) );
+    }
+
+    return normalizeScalar( row, quad, count, n, even, odd );
+}
+
+#endif
+
+#if DEMOSAIC_HAVE_SSE2
+
+inline __m128i normalizeSse2( __m128i v, __m128i black, __m128i range,
+        __m128i scale, __m128i shift )
+{
+    v = _mm_subs_epu16( v, black );
+    v = _mm_sub_epi16( v, _mm_subs_epu16( v, range ) );
+    v = _mm_sll_epi16( v, shift );
+    return _mm_mulhi_epu16( v, scale );
+}
+
+int normalizeSse2( const SourceRow& row, int quad, int count,
+        const Normalization& n, int16_t* even, int16_t* odd )
+{
+    const int rowPosition = ( row.y & 1 ) * 2;
+    const int e = rowPosition + ( row.x0 & 1 );
+    const int o = rowPosition + ( ~row.x0 & 1 );
+
+    // Lanes alternate between the two CFA positions of the row.
+    const __m128i black = _mm_set1_epi32( n.black[e] | ( n.black[o] << 16 ) );
+    const __m128i range = _mm_set1_epi32( n.range[e] | ( n.range[o] << 16 ) );
+    const __m128i scale = _mm_set1_epi32( n.scale[e] | ( n.scale[o] << 16 ) );
+    const __m128i shift = _mm_cvtsi32_si128( n.shift );
+    const __m128i low = _mm_set1_epi32( 0xffff );
+
+    // Quads left of the image.
+    int end = std::min( count, std::max( 0, ( 1 - row.x0 ) / 2 ) );
+    quad = normalizeScalar( row, quad, end, n, even, odd );
+
+    for ( ; quad + 8 <= count && row.x0 + 2 * ( quad + 8 ) <= row.width; quad += 8 )
+    {
+        const uint16_t* src = row.pixels + row.x0 + 2 * quad;
+        const __m128i a = normalizeSse2( _mm_loadu_si128( (const __m128i*) src ),
+                black, range, scale, shift );
+        const __m128i b = normalizeSse2( _mm_loadu_si128( (const __m128i*)( src + 8 ) ),
+                black, range, scale, shift );
+
+        // Values are below 2^12, so the signed packs do not saturate.
+        _mm_storeu_si128( (__m128i*)( even + quad ), _mm_packs_epi32(
+                _mm_and_si128( a, low ), _mm_and_si128( b, low ) ) );
+        _mm_storeu_si128( (__m128i*)( odd + quad ), _mm_packs_epi32(
+                _mm_srli_epi32( a, 16 ), _mm_srli_epi32( b, 16 ) ) );
+    }
+
+    return normalizeScalar( row, quad, count, n, even, odd );
+}
+
+#endif
+
+/*
+ * Vector operations on 16 bit lanes used by the interpolation filters.
+ * Intermediate values stay within 16 bits for 12 bit input, so every
+ * implementation gives the same result.
+ */
+struct ScalarOps
+{
+    typedef int16_t V;
+    enum { WIDTH = 1 };
+
+    static V load( const int16_t* p ) { return *p; }
+    static void store( int16_t* p, V v ) { *p = v; }
+    static V add( V a, V b ) { return a + b; }
+    static V sub( V a, V b ) { return a - b; }
+    template <int N> static V sra( V a ) { return a >> N; }
+    template <int N> static V shl( V a ) { return a << N; }
+    static V clamp( V a ) { return std::min<V>( std::max<V>( a, 0 ), MAX_VALUE ); }
+};
+
+#if DEMOSAIC_HAVE_NEON
+
+struct NeonOps
+{
+    typedef int16x8_t V;
+    enum { WIDTH = 8 };
+
+    static V load( const int16_t* p ) { return vld1q_s16( p ); }
+    static void store( int16_t* p, V v ) { vst1q_s16( p, v ); }
+    static V add( V a, V b ) { return vaddq_s16( a, b ); }
+    static V sub( V a, V b ) { return vsubq_s16( a, b ); }
+    template <int N> static V sra( V a ) { return vshrq_n_s16( a, N ); }
+    template <int N> static V shl( V a ) { return vshlq_n_s16( a, N ); }
+    static V clamp( V a )
+    {
+        return vminq_s16( vmaxq_s16( a, vdupq_n_s16( 0 ) ), vdupq_n_s16( MAX_VALUE ) );
+    }
+};
+
+#endif
+
+#if DEMOSAIC_HAVE_SSE2
+
+struct Sse2Ops
+{
+    typedef __m128i V;
+    enum { WIDTH = 8 };
+
+    static V load( const int16_t* p ) { return _mm_loadu_si128( (const __m128i*) p ); }
+    static void store( int16_t* p, V v ) { _mm_storeu_si128( (__m128i*) p, v ); }
+    static V add( V a, V b ) { return _mm_add_epi16( a, b ); }
+    static V sub( V a, V b ) { return _mm_sub_epi16( a, b ); }
+    template <int N> static V sra( V a ) { return _mm_srai_epi16( a, N ); }
+    template <int N> static V shl( V a ) { return _mm_slli_epi16( a, N ); }
+    static V clamp( V a )
+    {
+        return _mm_min_epi16( _mm_max_epi16( a, _mm_setzero_si128() ),
+                _mm_set1_epi16( MAX_VALUE ) );
+    }
+};
+
+#endif
+
+enum Plane { R, GR, GB, B };
+
+// Interpolated colors of the quads of one row, per CFA site.
+struct QuadRow
+{
+    int16_t site[4][3][TILE_QUADS];
+};
+
+/*
+ * Interpolates a row of quads. planes[p] points at the plane sample of
+ * the row's first quad; neighbors are one plane row or column away.
+ */
+template <class Ops, bool MALVAR>
+void interpolateRow( const int16_t* const planes[4], QuadRow& out )
+{
+    typedef typename Ops::V V;
+
+    for ( int q = 0; q < TILE_QUADS; q += Ops::WIDTH )
+    {
+        auto at = [&]( int plane, int dy, int dx ) {
+            return Ops::load( planes[plane] + dy * PLANE_STRIDE + dx + q );
+        };
+        auto sum4 = [&]( V a, V b, V c, V d ) {
+            return Ops::add( Ops::add( a, b ), Ops::add( c, d ) );
+        };
+        auto five = [&]( V g ) {
+            return Ops::add( Ops::template shl<2>( g ), g );
+        };
+
+        // Red site: green from the four neighbors, blue from the diagonals.
+        {
+            const V r = at( R, 0, 0 );
+            V g = Ops::template sra<2>( sum4( at( GR, 0, -1 ), at( GR, 0, 0 ),
+                    at( GB, -1, 0 ), at( GB, 0, 0 ) ) );
+            V b = Ops::template sra<2>( sum4( at( B, -1, -1 ), at( B, -1, 0 ),
+                    at( B, 0, -1 ), at( B, 0, 0 ) ) );
+            if ( MALVAR )
+            {
+                const V d = Ops::sub( Ops::template shl<2>( r ), sum4( at( R, 0, -1 ),
+                        at( R, 0, 1 ), at( R, -1, 0 ), at( R, 1, 0 ) ) );
+                g = Ops::add( g, Ops::template sra<3>( d ) );
+                b = Ops::add( b, Ops::template sra<4>(
+                        Ops::add( d, Ops::template sra<1>( d ) ) ) );
+            }
+            Ops::store( out.site[0][0] + q, r );
+            Ops::store( out.site[0][1] + q, Ops::clamp( g ) );
+            Ops::store( out.site[0][2] + q, Ops::clamp( b ) );
+        }
+
+        // Green site in a red row: red left and right, blue above and below.
+        {
+            const V g = at( GR, 0, 0 );
+            V r = Ops::template sra<1>( Ops::add( at( R, 0, 0 ), at( R, 0, 1 ) ) );
+            V b = Ops::template sra<1>( Ops::add( at( B, -1, 0 ), at( B, 0, 0 ) ) );
+            if ( MALVAR )
+            {
+                const V h = Ops::add( at( GR, 0, -1 ), at( GR, 0, 1 ) );
+                const V v = Ops::add( at( GR, -1, 0 ), at( GR, 1, 0 ) );
+                const V d = sum4( at( GB, -1, 0 ), at( GB, -1, 1 ),
+                        at( GB, 0, 0 ), at( GB, 0, 1 ) );
+                const V c = Ops::sub( five( g ), d );
+                r = Ops::add( r, Ops::template sra<3>( Ops::sub(
+                        Ops::add( c, Ops::template sra<1>( v ) ), h ) ) );
+                b = Ops::add( b, Ops::template sra<3>( Ops::sub(
+                        Ops::add( c, Ops::template sra<1>( h ) ), v ) ) );
+            }
+            Ops::store( out.site[1][0] + q, Ops::clamp( r ) );
+            Ops::store( out.site[1][1] + q, g );
+            Ops::store( out.site[1][2] + q, Ops::clamp( b ) );
+        }
+
+        // Green site in a blue row: blue left and right, red above and below.
+        {
+            const V g = at( GB, 0, 0 );
+            V r = Ops::template sra<1>( Ops::add( at( R, 0, 0 ), at( R, 1, 0 ) ) );
+            V b = Ops::template sra<1>( Ops::add( at( B, 0, -1 ), at( B, 0, 0 ) ) );
+            if ( MALVAR )
+            {
+                const V h = Ops::add( at( GB, 0, -1 ), at( GB, 0, 1 ) );
+                const V v = Ops::add( at( GB, -1, 0 ), at( GB, 1, 0 ) );
+                const V d = sum4( at( GR, 0, -1 ), at( GR, 0, 0 ),
+                        at( GR, 1, -1 ), at( GR, 1, 0 ) );
+                const V c = Ops::sub( five( g ), d );
+                r = Ops::add( r, Ops::template sra<3>( Ops::sub(
+                        Ops::add( c, Ops::template sra<1>( h ) ), v ) ) );
+                b = Ops::add( b, Ops::template sra<3>( Ops::sub(
+                        Ops::add( c, Ops::template sra<1>( v ) ), h ) ) );
+            }
+            Ops::store( out.site[2][0] + q, Ops::clamp( r ) );
+            Ops::store( out.site[2][1] + q, g );
+            Ops::store( out.site[2][2] + q, Ops::clamp( b ) );
+        }
+
+        // Blue site: green from the four neighbors, red from the diagonals.
+        {
+            const V b = at( B, 0, 0 );
+            V g = Ops::template sra<2>( sum4( at( GB, 0, 0 ), at( GB, 0, 1 ),
+                    at( GR, 0, 0 ), at( GR, 1, 0 ) ) );
+            V r = Ops::template sra<2>( sum4( at( R, 0, 0 ), at( R, 0, 1 ),
+                    at( R, 1, 0 ), at( R, 1, 1 ) ) );
+            if ( MALVAR )
+            {
+                const V d = Ops::sub( Ops::template shl<2>( b ), sum4( at( B, 0, -1 ),
+                        at( B, 0, 1 ), at( B, -1, 0 ), at( B, 1, 0 ) ) );
+                g = Ops::add( g, Ops::template sra<3>( d ) );
+                r = Ops::add( r, Ops::template sra<4>(
+                        Ops::add( d, Ops::template sra<1>( d ) ) ) );
+            }
+            Ops::store( out.site[3][0] + q, Ops::clamp( r ) );
+            Ops::store( out.site[3][1] + q, Ops::clamp( g ) );
+            Ops::store( out.site[3][2] + q, b );
+        }
+    }
+}
+
+// Averages the two green planes of a row of quads for the half size output.
+template <class Ops>
+void averageGreen( const int16_t* g0, const int16_t* g1, int16_t* out, int count )
+{
+    int q = 0;
+    for ( ; q + Ops::WIDTH <= count; q += Ops::WIDTH )
+    {
+        Ops::store( out + q, Ops::template sra<1>(
+                Ops::add( Ops::load( g0 + q ), Ops::load( g1 + q ) ) ) );
+    }
+    for ( ; q < count; ++q )
+    {
+        out[q] = ( g0[q] + g1[q] ) >> 1;
+    }
+}
+
+struct KernelSet
+{
+    NormalizeKernel normalize;
+    void (*bilinear)( const int16_t* const planes[4], QuadRow& out );
+    void (*malvar)( const int16_t* const planes[4], QuadRow& out );
+    void (*averageGreen)( const int16_t* g0, const int16_t* g1, int16_t* out, int count );
+};
+
+template <class Ops>
+KernelSet makeKernelSet( NormalizeKernel normalize )
+{
+    KernelSet set;
+    set.normalize = normalize;
+    set.bilinear = interpolateRow<Ops, false>;
+    set.malvar = interpolateRow<Ops, true>;
+    set.averageGreen = averageGreen<Ops>;
+    return set;
+}
+
+const KernelSet* selectKernel( Demosaic::Kernel kernel )
+{
+    static const KernelSet scalar = makeKernelSet<ScalarOps>( normalizeScalar );
+#if DEMOSAIC_HAVE_NEON
+    static const KernelSet neon = makeKernelSet<NeonOps>( normalizeNeon );
+#endif
+#if DEMOSAIC_HAVE_SSE2
+    static const KernelSet sse2 = makeKernelSet<Sse2Ops>( normalizeSse2 );
+#endif
+
+    switch ( kernel )
+    {
+    case Demosaic::Kernel::AUTO:
+#if DEMOSAIC_HAVE_NEON
+        return &neon;
+#elif DEMOSAIC_HAVE_SSE2
+        return &sse2;
+#endif
+        return &scalar;
+
+    case Demosaic::Kernel::SCALAR:
+        return &scalar;
+
+#if DEMOSAIC_HAVE_NEON
+    case Demosaic::Kernel::NEON:
+        return &neon;
+#endif
+
+#if DEMOSAIC_HAVE_SSE2
+    case Demosaic::Kernel::SSE2:
+        return &sse2;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+// Writes 12 bit colors as output pixels.
+template <Demosaic::OutputFormat FORMAT>
+inline void writePixel( uint8_t* dst, int x, int r, int g, int b, const uint8_t* gamma )
+{
+    if ( FORMAT == Demosaic::OutputFormat::RGB161616 )
+    {
+        uint16_t* out = (uint16_t*) dst + 3 * x;
+        out[0] = ( r << 4 ) | ( r >> 8 );
+        out[1] = ( g << 4 ) | ( g >> 8 );
+        out[2] = ( b << 4 ) | ( b >> 8 );
+    }
+    else
+    {
+        const unsigned bpp = FORMAT == Demosaic::OutputFormat::RGBA8888 ? 4 : 3;
+        dst += bpp * x;
+        dst[0] = gamma[r];
+        dst[1] = gamma[g];
+        dst[2] = gamma[b];
+        if ( bpp == 4 ) dst[3] = 255;
+    }
+}
+
+/*
+ * Writes pixels [begin, end) of an output row. With a quad shift of 1,
+ * pixel x takes its colors from quad ( x - x0 ) / 2 of the even or odd
+ * site; with 0 every pixel is a quad of site 0.
+ */
+struct OutputRow
+{
+    const int16_t* sites[2][3];
+    int quadShift;
+    uint8_t* dst;
+    int x0;
+    int begin;
+    int end;
+    const uint8_t* gamma;
+};
+
+typedef void (*RowWriter)( const OutputRow& row );
+
+template <Demosaic::OutputFormat FORMAT>
+void writeRow( const OutputRow& row )
+{
+    const int16_t* const* even = row.sites[0];
+    const int16_t* const* odd = row.sites[1];
+    int x = row.begin;
+
+    if ( row.quadShift == 0 )
+    {
+        for ( ; x < row.end; ++x )
+        {
+            const int q = x - row.x0;
+            writePixel<FORMAT>( row.dst, x, even[0][q], even[1][q], even[2][q], row.gamma );
+        }
+        return;
+    }
+
+    if ( ( x - row.x0 ) & 1 )
+    {
+        const int q = ( x - row.x0 ) >> 1;
+        writePixel<FORMAT>( row.dst, x, odd[0][q], odd[1][q], odd[2][q], row.gamma );
+        ++x;
+    }
+    for ( ; x + 1 < row.end; x += 2 )
+    {
+        const int q = ( x - row.x0 ) >> 1;
+        writePixel<FORMAT>( row.dst, x, even[0][q], even[1][q], even[2][q], row.gamma );
+        writePixel<FORMAT>( row.dst, x + 1, odd[0][q], odd[1][q], odd[2][q], row.gamma );
+    }
+    if ( x < row.end )
+    {
+        const int q = ( x - row.x0 ) >> 1;
+        writePixel<FORMAT>( row.dst, x, even[0][q], even[1][q], even[2][q], row.gamma );
+    }
+}
+
+RowWriter selectRowWriter( Demosaic::OutputFormat format )
+{
+    switch ( format )
+    {
+    case Demosaic::OutputFormat::RGB888:
+        return writeRow<Demosaic::OutputFormat::RGB888>;
+    case Demosaic::OutputFormat::RGBA8888:
+        return writeRow<Demosaic::OutputFormat::RGBA8888>;
+    case Demosaic::OutputFormat::RGB161616:
+        return writeRow<Demosaic::OutputFormat::RGB161616>;
+    }
+    return nullptr;
+}
+
+struct Frame
+{
+    const CameraBuffer::Data* plane;
+    uint8_t* dst;
+    size_t dstStride;
+    int originX;    //< Position of the red pixel within the pattern.
+    int originY;
+    int green0;     //< CFA positions of the green pixels.
+    int green1;
+    int red;
+    int blue;
+    Normalization normalization;
+    RowWriter writeRow;
+    const uint8_t* gamma;
+    const KernelSet* kernels;
+};
+
+void processTile( const Frame& frame, int quadX0, int quadY0, bool malvar )
+{
+    const CameraBuffer::Data& plane = *frame.plane;
+
+    int16_t planes[4][PLANE_ROWS * PLANE_STRIDE];
+    QuadRow row;
+
+    // Quad q covers pixels 2q - origin and 2q - origin + 1, so that its
+    // top left pixel is red.
+    SourceRow src;
+    src.width = plane.width;
+    src.x0 = 2 * ( quadX0 - 1 ) - frame.originX;
+
+    for ( int p = 0; p < PLANE_ROWS; ++p )
+    {
+        const int y = 2 * ( quadY0 - 1 + p ) - frame.originY;
+        for ( int dy = 0; dy < 2; ++dy )
+        {
+            src.y = mirror( y + dy, plane.height );
+            src.pixels = (const uint16_t*) plane.ptr + size_t(src.y) * plane.stride;
+            frame.kernels->normalize( src, 0, TILE_QUADS + 2, frame.normalization,
+                    planes[2 * dy] + p * PLANE_STRIDE,
+                    planes[2 * dy + 1] + p * PLANE_STRIDE );
+        }
+    }
+
+    const int x0 = 2 * quadX0 - frame.originX;
+    const int xBegin = std::max( 0, x0 );
+    const int xEnd = std::min( plane.width, x0 + TILE );
+
+    for ( int q = 0; q < TILE_QUADS; ++q )
+    {
+        const int y0 = 2 * ( quadY0 + q ) - frame.originY;
+        if ( y0 + 1 < 0 ) continue;
+        if ( y0 >= plane.height ) break;
+
+        const int16_t* const rowPlanes[4] = {
+            planes[R] + ( q + 1 ) * PLANE_STRIDE + 1,
+            planes[GR] + ( q + 1 ) * PLANE_STRIDE + 1,
+            planes[GB] + ( q + 1 ) * PLANE_STRIDE + 1,
+            planes[B] + ( q + 1 ) * PLANE_STRIDE + 1 };
+
+        if ( malvar ) frame.kernels->malvar( rowPlanes, row );
+        else          frame.kernels->bilinear( rowPlanes, row );
+
+        OutputRow out;
+        out.quadShift = 1;
+        out.x0 = x0;
+        out.begin = xBegin;
+        out.end = xEnd;
+        out.gamma = frame.gamma;
+
+        for ( int dy = 0; dy < 2; ++dy )
+        {
+            const int y = y0 + dy;
+            if ( y < 0 || y >= plane.height ) continue;
+
+            for ( int c = 0; c < 3; ++c )
+            {
+                out.sites[0][c] = row.site[2 * dy][c];
+                out.sites[1][c] = row.site[2 * dy + 1][c];
+            }
+            out.dst = frame.dst + size_t(y) * frame.dstStride;
+            frame.writeRow( out );
+        }
+    }
+}
+
+void processHalfTile( const Frame& frame, int quadX0, int quadY0 )
+{
+    const CameraBuffer::Data& plane = *frame.plane;
+    const int width = std::min( TILE, plane.width / 2 - quadX0 );
+    const int height = std::min( TILE, plane.height / 2 - quadY0 );
+
+    int16_t samples[4][TILE];
+    int16_t green[TILE];
+
+    SourceRow src;
+    src.width = plane.width;
+    src.x0 = 2 * quadX0;
+
+    for ( int q = 0; q < height; ++q )
+    {
+        for ( int dy = 0; dy < 2; ++dy )
+        {
+            src.y = 2 * ( quadY0 + q ) + dy;
+            src.pixels = (const uint16_t*) plane.ptr + size_t(src.y) * plane.stride;
+            frame.kernels->normalize( src, 0, width, frame.normalization,
+                    samples[2 * dy], samples[2 * dy + 1] );
+        }
+
+        frame.kernels->averageGreen( samples[frame.green0], samples[frame.green1],
+                green, width );
+
+        OutputRow out;
+        out.sites[0][0] = samples[frame.red];
+        out.sites[0][1] = green;
+        out.sites[0][2] = samples[frame.blue];
+        out.quadShift = 0;
+        out.dst = frame.dst + size_t( quadY0 + q ) * frame.dstStride;
+        out.x0 = quadX0;
+        out.begin = quadX0;
+        out.end = quadX0 + width;
+        out.gamma = frame.gamma;
+        frame.writeRow( out );
+    }
+}
+
+}
+
+Demosaic::Demosaic( const StaticProperties& properties, const Options& options ) :
+    mOptions(options)
+{
+    const auto& sensor = properties.sensor;
+    const int white = sensor.whiteLevel > 0 ? std::min( sensor.whiteLevel, 65535 ) : 65535;
+
+    unsigned maxRange = 1;
+    for ( int i = 0; i < 4; ++i )
+    {
+        mBlack[i] = std::min( std::max( sensor.blackLevelPattern[i], 0 ), white - 1 );
+        mRange[i] = white - mBlack[i];
+        maxRange = std::max( maxRange, unsigned( mRange[i] ) );
+    }
+
+    // Scale to 16 bits before the multiply to keep the precision of the
+    // 16 bit high half product.
+    mShift = 0;
+    while ( ( maxRange << ( mShift + 1 ) ) <= 65535 ) ++mShift;
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        const uint32_t range = uint32_t( mRange[i] ) << mShift;
+        mScale[i] = std::min<uint32_t>( 65535,
+                ( ( uint32_t( MAX_VALUE ) << 16 ) + range - 1 ) / range );
+    }
+
+    for ( int i = 0; i <= MAX_VALUE; ++i )
+    {
+        const float v = float(i) / MAX_VALUE;
+        const float srgb = v <= 0.0031308f ? 12.92f * v :
+                1.055f * std::pow( v, 1.0f / 2.4f ) - 0.055f;
+        mGamma[i] = uint8_t( std::lround( 255.0f * srgb ) );
+    }
+}
+
+bool Demosaic::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+Size Demosaic::outputSize( Size size, Method method )
+{
+    return method == Method::HALF_SIZE ? Size( size.width / 2, size.height / 2 ) : size;
+}
+
+bool Demosaic::process( CameraBuffer& img, void* dst, size_t dstStride )
+{
+    if ( img.format() != RAW16 ) return false;
+
+    return process( img.data(0), dst, dstStride );
+}
+
+bool Demosaic::process( const CameraBuffer::Data& plane,
+        void* dst, size_t dstStride )
+{
+    const auto start = std::chrono::steady_clock::now();
+    mStats = Stats();
+
+    const KernelSet* kernels = selectKernel( mOptions.kernel );
+    const bool half = mOptions.method == Method::HALF_SIZE;
+    const Size size = outputSize( Size( plane.width, plane.height ), mOptions.method );
+
+    if ( !kernels || !dst || !plane.ptr ||
+         plane.width < 2 || plane.height < 2 ||
+         ( plane.width & 1 ) || ( plane.height & 1 ) ||
+         dstStride < size_t( size.width ) * bytesPerPixel( mOptions.format ) )
+    {
+        return false;
+    }
+
+    Frame frame;
+    frame.plane = &plane;
+    frame.dst = (uint8_t*) dst;
+    frame.dstStride = dstStride;
+    frame.normalization.black = mBlack;
+    frame.normalization.range = mRange;
+    frame.normalization.scale = mScale;
+    frame.normalization.shift = mShift;
+    frame.writeRow = selectRowWriter( mOptions.format );
+    frame.gamma = mGamma;
+    frame.kernels = kernels;
+
+    const int* colors = CFA_COLORS[int( mOptions.cfaPattern )];
+    const int red = std::find( colors, colors + 4, 0 ) - colors;
+    frame.red = red;
+    frame.blue = std::find( colors, colors + 4, 2 ) - colors;
+    frame.green0 = std::find( colors, colors + 4, 1 ) - colors;
+    frame.green1 = std::find( colors + frame.green0 + 1, colors + 4, 1 ) - colors;
+    frame.originX = red & 1;
+    frame.originY = red >> 1;
+
+    // Quads cover the image from the pixel left of and above the red
+    // pixel of the first pattern when it is not at the origin.
+    const int tileQuads = half ? TILE : TILE_QUADS;
+    const int quadsX = half ? size.width : ( plane.width + frame.originX + 1 ) / 2;
+    const int quadsY = half ? size.height : ( plane.height + frame.originY + 1 ) / 2;
+    const unsigned tilesX = ( quadsX + tileQuads - 1 ) / tileQuads;
+    const unsigned tilesY = ( quadsY + tileQuads - 1 ) / tileQuads;
+    const bool malvar = mOptions.method == Method::MALVAR;
+
+    ThreadPool::instance().parallelFor( tilesX * tilesY, [&]( unsigned tile ) {
+        const int quadX0 = ( tile % tilesX ) * tileQuads;
+        const int quadY0 = ( tile / tilesX ) * tileQuads;
+
+        if ( half ) processHalfTile( frame, quadX0, quadY0 );
+        else        processTile( frame, quadX0, quadY0, malvar );
+    }, mOptions.maxThreads );
+
+    mStats.tiles = tilesX * tilesY;
+    mStats.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+    return true;
+}
@@ -0,0 +1,140 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef Demosaic_H
+#define Demosaic_H
+
+#include "DngWriter.h"
+#include "native_camera2/native_camera2.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * CPU demosaic of RAW16 Bayer buffers into packed RGB. Samples are
+ * black level corrected with StaticProperties::sensor.blackLevelPattern,
+ * normalized to 12 bits by whiteLevel, interpolated and written either
+ * linear at 16 bits or through an sRGB curve at 8 bits.
+ *
+ * The image is processed in 64x64 tiles on the ThreadPool. Each tile is
+ * split into one plane per CFA color, so the interpolation filters run
+ * on contiguous 16 bit lanes; all kernels give identical results.
+ */
+class Demosaic
+{
+public:
+
+    typedef DngWriter::CfaPattern CfaPattern;
+
+    enum class Method
+    {
+        BILINEAR,
+        MALVAR,     //< Gradient corrected bilinear (Malvar, He, Cutler).
+        HALF_SIZE   //< One pixel per 2x2 quad, for previews.
+    };
+
+    enum class OutputFormat
+    {
+        RGB888,
+        RGBA8888,
+        RGB161616   //< Linear, native endian.
+    };
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSE2
+    };
+
+    struct Options
+    {
+        Method method = Method::MALVAR;
+        CfaPattern cfaPattern = CfaPattern::RGGB;
+        OutputFormat format = OutputFormat::RGBA8888;
+        Kernel kernel = Kernel::AUTO;
+
+        // Threads of the ThreadPool used for tiles, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    struct Stats
+    {
+        int64_t timeUs = 0;
+        unsigned tiles = 0;
+    };
+
+    Demosaic( const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    static unsigned bytesPerPixel( OutputFormat format )
+    {
+        return format == OutputFormat::RGB888 ? 3 :
+               format == OutputFormat::RGBA8888 ? 4 : 6;
+    }
+
+    static bool isAvailable( Kernel kernel );
+
+    // Size of the output for a RAW16 buffer of the given size.
+    static nv::camera2::Size outputSize( nv::camera2::Size size, Method method );
+
+    /*!
+     * Demosaics the buffer into dst, which must hold outputSize() pixels
+     * with rows dstStride bytes apart. Returns false if the buffer is not
+     * RAW16, has odd dimensions, or the kernel is not available.
+     */
+    bool process( nv::camera2::CameraBuffer& img, void* dst, size_t dstStride );
+
+    bool process( const nv::camera2::CameraBuffer::Data& plane,
+            void* dst, size_t dstStride );
+
+    // Statistics of the last process() call.
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    Options mOptions;
+    Stats mStats;
+
+    // Per CFA position, in raster order of the 2x2 pattern.
+    uint16_t mBlack[4];
+    uint16_t mRange[4];
+    uint16_t mScale[4];
+    unsigned mShift;
+
+    uint8_t mGamma[4096];
+};
+
+#endif
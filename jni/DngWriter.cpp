@@ -0,0 +1,658 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "DngWriter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+enum TiffType : uint16_t
+{
+    TIFF_BYTE = 1,
+    TIFF_ASCII = 2,
+    TIFF_SHORT = 3,
+    TIFF_LONG = 4,
+    TIFF_RATIONAL = 5,
+    TIFF_SRATIONAL = 10
+};
+
+enum TiffTag : uint16_t
+{
+    NEW_SUBFILE_TYPE = 254,
+    IMAGE_WIDTH = 256,
+    IMAGE_LENGTH = 257,
+    BITS_PER_SAMPLE = 258,
+    COMPRESSION = 259,
+    PHOTOMETRIC = 262,
+    MODEL = 272,
+    ORIENTATION = 274,
+    SAMPLES_PER_PIXEL = 277,
+    PLANAR_CONFIG = 284,
+    SOFTWARE = 305,
+    TILE_WIDTH = 322,
+    TILE_LENGTH = 323,
+    TILE_OFFSETS = 324,
+    TILE_BYTE_COUNTS = 325,
+    CFA_REPEAT_PATTERN_DIM = 33421,
+    CFA_PATTERN = 33422,
+    EXPOSURE_TIME = 33434,
+    ISO_SPEED_RATINGS = 34855,
+    DNG_VERSION = 50706,
+    DNG_BACKWARD_VERSION = 50707,
+    UNIQUE_CAMERA_MODEL = 50708,
+    BLACK_LEVEL_REPEAT_DIM = 50713,
+    BLACK_LEVEL = 50714,
+    WHITE_LEVEL = 50717,
+    COLOR_MATRIX_1 = 50721,
+    COLOR_MATRIX_2 = 50722,
+    CALIBRATION_ILLUMINANT_1 = 50778,
+    CALIBRATION_ILLUMINANT_2 = 50779,
+    ACTIVE_AREA = 50829
+};
+
+constexpr uint16_t PHOTOMETRIC_CFA = 32803;
+constexpr uint16_t COMPRESSION_NONE = 1;
+constexpr uint16_t COMPRESSION_LOSSLESS_JPEG = 7;
+constexpr uint16_t ILLUMINANT_D65 = 21;
+
+/*
+ * Builds a little endian TIFF header with a single IFD. Values that do
+ * not fit in an entry are stored after the IFD, the image data follows.
+ */
+class IfdBuilder
+{
+public:
+
+    void add( uint16_t tag, uint16_t type, uint32_t count,
+            const void* data, size_t bytes )
+    {
+        Entry entry;
+        entry.tag = tag;
+        entry.type = type;
+        entry.count = count;
+        entry.value.assign( (const uint8_t*) data, (const uint8_t*) data + bytes );
+        mEntries.push_back( entry );
+    }
+
+    void addBytes( uint16_t tag, const std::vector<uint8_t>& values )
+    {
+        add( tag, TIFF_BYTE, values.size(), values.data(), values.size() );
+    }
+
+    void addShorts( uint16_t tag, const std::vector<uint16_t>& values )
+    {
+        add( tag, TIFF_SHORT, values.size(), values.data(), 2 * values.size() );
+    }
+
+    void addLongs( uint16_t tag, const std::vector<uint32_t>& values )
+    {
+        add( tag, TIFF_LONG, values.size(), values.data(), 4 * values.size() );
+    }
+
+    void addAscii( uint16_t tag, const std::string& value )
+    {
+        add( tag, TIFF_ASCII, value.size() + 1, value.c_str(), value.size() + 1 );
+    }
+
+    void addRational( uint16_t tag, uint32_t numerator, uint32_t denominator )
+    {
+        const uint32_t value[2] = { numerator, denominator };
+        add( tag, TIFF_RATIONAL, 1, value, sizeof(value) );
+    }
+
+    void addSRationals( uint16_t tag, const float* values, unsigned count )
+    {
+        std::vector<int32_t> rationals;
+        for ( unsigned i = 0; i < count; ++i )
+        {
+            rationals.push_back( (int32_t) std::lround( values[i] * 10000.0f ) );
+            rationals.push_back( 10000 );
+        }
+        add( tag, TIFF_SRATIONAL, count, rationals.data(), 4 * rationals.size() );
+    }
+
+    // Replaces the values of an entry, keeping its size.
+    void setLongs( uint16_t tag, const std::vector<uint32_t>& values )
+    {
+        for ( auto& entry : mEntries )
+        {
+            if ( entry.tag == tag )
+            {
+                memcpy( entry.value.data(), values.data(), entry.value.size() );
+            }
+        }
+    }
+
+    // Size of the header, IFD and out of line values.
+    size_t size()
+    {
+        std::sort( mEntries.begin(), mEntries.end(),
+                []( const Entry& a, const Entry& b ) { return a.tag < b.tag; } );
+
+        size_t size = 8 + 2 + 12 * mEntries.size() + 4;
+        for ( const auto& entry : mEntries )
+        {
+            if ( entry.value.size() > 4 )
+            {
+                size += ( entry.value.size() + 1 ) & ~size_t(1);
+            }
+        }
+        return size;
+    }
+
+    std::vector<uint8_t> serialize()
+    {
+        std::vector<uint8_t> out( size() );
+        uint8_t* p = out.data();
+
+        const uint8_t header[8] = { 'I', 'I', 42, 0, 8, 0, 0, 0 };
+        memcpy( p, header, sizeof(header) );
+
+        const uint16_t count = mEntries.size();
+        memcpy( p + 8, &count, 2 );
+
+        size_t entryPos = 10;
+        size_t dataPos = 10 + 12 * mEntries.size() + 4;
+        for ( const auto& entry : mEntries )
+        {
+            memcpy( p + entryPos, &entry.tag, 2 );
+            memcpy( p + entryPos + 2, &entry.type, 2 );
+            memcpy( p + entryPos + 4, &entry.count, 4 );
+
+            if ( entry.value.size() <= 4 )
+            {
+                memcpy( p + entryPos + 8, entry.value.data(), entry.value.size() );
+            }
+            else
+            {
+                const uint32_t offset = dataPos;
+                memcpy( p + entryPos + 8, &offset, 4 );
+                memcpy( p + dataPos, entry.value.data(), entry.value.size() );
+                dataPos += ( entry.value.size() + 1 ) & ~size_t(1);
+            }
+            entryPos += 12;
+        }
+        return out;
+    }
+
+private:
+
+    struct Entry
+    {
+        uint16_t tag;
+        uint16_t type;
+        uint32_t count;
+        std::vector<uint8_t> value;
+    };
+
+    std::vector<Entry> mEntries;
+};
+
+/*
+ * Lossless JPEG (ITU T.81 process 14, predictor 1) for one tile. The
+ * tile is coded as two interleaved components of half the width, so that
+ * each sample is predicted from the nearest sample of the same CFA color.
+ */
+class LosslessJpeg
+{
+public:
+
+    static void encode( const uint16_t* tile, int width, int height,
+            std::vector<uint8_t>& out )
+    {
+        // Category frequencies, then a Huffman table fitted to the tile.
+        long freq[17] = { 0 };
+        forEachDiff( tile, width, height, [&]( int diff ) {
+            ++freq[category( diff )];
+        } );
+
+        uint8_t bits[17];
+        uint8_t values[17];
+        int numValues;
+        optimalTable( freq, bits, values, numValues );
+
+        uint16_t codes[17];
+        uint8_t lengths[17];
+        canonicalCodes( bits, values, codes, lengths );
+
+        out.clear();
+        out.reserve( size_t(width) * height * 2 );
+
+        const uint8_t soi[2] = { 0xff, 0xd8 };
+        out.insert( out.end(), soi, soi + 2 );
+
+        const int columns = width / 2;
+        const uint8_t sof[16] = { 0xff, 0xc3, 0, 14, 16,
+                uint8_t( height >> 8 ), uint8_t( height ),
+                uint8_t( columns >> 8 ), uint8_t( columns ),
+                2, 1, 0x11, 0, 2, 0x11, 0 };
+        out.insert( out.end(), sof, sof + sizeof(sof) );
+
+        const int dhtLength = 2 + 1 + 16 + numValues;
+        const uint8_t dht[5] = { 0xff, 0xc4, uint8_t( dhtLength >> 8 ),
+                uint8_t( dhtLength ), 0x00 };
+        out.insert( out.end(), dht, dht + sizeof(dht) );
+        out.insert( out.end(), bits + 1, bits + 17 );
+        out.insert( out.end(), values, values + numValues );
+
+        const uint8_t sos[12] = { 0xff, 0xda, 0, 10, 2, 1, 0x00, 2, 0x00,
+                1, 0, 0 };
+        out.insert( out.end(), sos, sos + sizeof(sos) );
+
+        BitWriter writer( out );
+        forEachDiff( tile, width, height, [&]( int diff ) {
+            const int ssss = category( diff );
+            writer.put( codes[ssss], lengths[ssss] );
+            if ( ssss > 0 && ssss < 16 )
+            {
+                const int value = diff < 0 ? diff - 1 : diff;
+                writer.put( value & ( ( 1 << ssss ) - 1 ), ssss );
+            }
+        } );
+        writer.flush();
+
+        const uint8_t eoi[2] = { 0xff, 0xd9 };
+        out.insert( out.end(), eoi, eoi + 2 );
+    }
+
+private:
+
+    class BitWriter
+    {
+    public:
+
+        explicit BitWriter( std::vector<uint8_t>& out ) : mOut(out) {}
+
+        void put( uint32_t code, int length )
+        {
+            mBits = ( mBits << length ) | code;
+            mCount += length;
+            while ( mCount >= 8 )
+            {
+                mCount -= 8;
+                const uint8_t byte = mBits >> mCount;
+                mOut.push_back( byte );
+                if ( byte == 0xff ) mOut.push_back( 0 );
+            }
+        }
+
+        // Pads the last byte with ones.
+        void flush()
+        {
+            if ( mCount > 0 ) put( ( 1 << ( 8 - mCount ) ) - 1, 8 - mCount );
+        }
+
+    private:
+
+        std::vector<uint8_t>& mOut;
+        uint64_t mBits = 0;
+        int mCount = 0;
+    };
+
+    static int category( int diff )
+    {
+        int magnitude = diff < 0 ? -diff : diff;
+        int ssss = 0;
+        while ( magnitude )
+        {
+            ++ssss;
+            magnitude >>= 1;
+        }
+        return ssss;
+    }
+
+    // Calls fn with the prediction difference of every sample, in the
+    // order they are coded.
+    template <typename Fn>
+    static void forEachDiff( const uint16_t* tile, int width, int height, Fn fn )
+    {
+        for ( int y = 0; y < height; ++y )
+        {
+            const uint16_t* row = tile + size_t(y) * width;
+            const uint16_t* above = row - width;
+
+            for ( int x = 0; x < width; ++x )
+            {
+                int predictor;
+                if ( x >= 2 )       predictor = row[x - 2];
+                else if ( y > 0 )   predictor = above[x];
+                else                predictor = 1 << 15;
+
+                // Differences are taken modulo 2^16; -32768 is coded as
+                // category 16, which stands for +32768.
+                fn( int( int16_t( uint16_t( row[x] - predictor ) ) ) );
+            }
+        }
+    }
+
+    // Huffman code lengths limited to 16 bits, as in ITU T.81 annex K.2.
+    static void optimalTable( const long* frequencies, uint8_t* bits,
+            uint8_t* values, int& numValues )
+    {
+        // Symbol 17 is reserved so that no code consists of all ones.
+        long freq[18];
+        int codeSize[18] = { 0 };
+        int others[18];
+        std::copy( frequencies, frequencies + 17, freq );
+        freq[17] = 1;
+        std::fill( others, others + 18, -1 );
+
+        for (;;)
+        {
+            int c1 = -1, c2 = -1;
+            for ( int i = 0; i < 18; ++i )
+            {
+                if ( freq[i] && ( c1 < 0 || freq[i] <= freq[c1] ) ) c1 = i;
+            }
+            for ( int i = 0; i < 18; ++i )
+            {
+                if ( freq[i] && i != c1 && ( c2 < 0 || freq[i] <= freq[c2] ) ) c2 = i;
+            }
+            if ( c2 < 0 ) break;
+
+            freq[c1] += freq[c2];
+            freq[c2] = 0;
+
+            ++codeSize[c1];
+            while ( others[c1] >= 0 )
+            {
+                c1 = others[c1];
+                ++codeSize[c1];
+            }
+            others[c1] = c2;
+
+            ++codeSize[c2];
+            while ( others[c2] >= 0 )
+            {
+                c2 = others[c2];
+                ++codeSize[c2];
+            }
+        }
+
+        int count[33] = { 0 };
+        for ( int i = 0; i < 18; ++i )
+        {
+            if ( codeSize[i] ) ++count[codeSize[i]];
+        }
+
+        for ( int i = 32; i > 16; --i )
+        {
+            while ( count[i] > 0 )
+            {
+                int j = i - 2;
+                while ( count[j] == 0 ) --j;
+                count[i] -= 2;
+                ++count[i - 1];
+                count[j + 1] += 2;
+                --count[j];
+            }
+        }
+
+        // Drop the reserved symbol from the longest codes.
+        int longest = 16;
+        while ( count[longest] == 0 ) --longest;
+        --count[longest];
+
+        bits[0] = 0;
+        for ( int i = 1; i <= 16; ++i )
+        {
+            bits[i] = count[i];
+        }
+
+        numValues = 0;
+        for ( int length = 1; length <= 32; ++length )
+        {
+            for ( int i = 0; i < 17; ++i )
+            {
+                if ( codeSize[i] == length ) values[numValues++] = i;
+            }
+        }
+    }
+
+    static void canonicalCodes( const uint8_t* bits, const uint8_t* values,
+            uint16_t* codes, uint8_t* lengths )
+    {
+        std::fill( lengths, lengths + 17, 0 );
+
+        uint16_t code = 0;
+        int k = 0;
+        for ( int length = 1; length <= 16; ++length )
+        {
+            for ( int i = 0; i < bits[length]; ++i )
+            {
+                codes[values[k]] = code++;
+                lengths[values[k]] = length;
+                ++k;
+            }
+            code <<= 1;
+        }
+    }
+};
+
+}
+
+DngWriter::DngWriter( const StaticProperties& properties,
+        const Options& options ) :
+    mProperties(properties), mOptions(options)
+{
+    mOptions.tileSize = std::max( 16u, ( options.tileSize + 15 ) / 16 * 16 );
+}
+
+bool DngWriter::write( const CameraFrame& frame, const std::string& path )
+{
+    const auto start = std::chrono::steady_clock::now();
+    mStats = Stats();
+
+    if ( !frame.imageBuffer || frame.imageBuffer->format() != RAW16 )
+    {
+        return false;
+    }
+
+    const CameraBuffer::Data plane = frame.imageBuffer->data(0);
+    const int width = plane.width;
+    const int height = plane.height;
+    const int tileSize = mOptions.tileSize;
+    const unsigned tilesAcross = ( width + tileSize - 1 ) / tileSize;
+    const unsigned tilesDown = ( height + tileSize - 1 ) / tileSize;
+    const unsigned numTiles = tilesAcross * tilesDown;
+    const bool compress = mOptions.compression == Compression::LOSSLESS_JPEG;
+
+    if ( width <= 0 || height <= 0 ) return false;
+
+    mTiles.resize( numTiles );
+    ThreadPool& pool = ThreadPool::instance();
+
+    // Tiles are full size; samples past the image edge repeat the last
+    // row and column.
+    pool.parallelFor( numTiles, [&]( unsigned i ) {
+        const int x0 = ( i % tilesAcross ) * tileSize;
+        const int y0 = ( i / tilesAcross ) * tileSize;
+
+        std::vector<uint8_t>& out = mTiles[i];
+        std::vector<uint16_t> samples( size_t(tileSize) * tileSize );
+
+        for ( int y = 0; y < tileSize; ++y )
+        {
+            const uint16_t* src = (const uint16_t*) plane.ptr +
+                    size_t( std::min( y0 + y, height - 1 ) ) * plane.stride;
+            uint16_t* dst = samples.data() + size_t(y) * tileSize;
+
+            const int count = std::min( tileSize, width - x0 );
+            std::copy( src + x0, src + x0 + count, dst );
+            std::fill( dst + count, dst + tileSize, src[width - 1] );
+        }
+
+        if ( compress )
+        {
+            LosslessJpeg::encode( samples.data(), tileSize, tileSize, out );
+        }
+        else
+        {
+            out.resize( samples.size() * 2 );
+            memcpy( out.data(), samples.data(), out.size() );
+        }
+    }, mOptions.maxThreads );
+
+    const StaticProperties::SensorProperties& sensor = mProperties.sensor;
+    const Request::Sensor& settings = frame.resultSettings.sensor;
+
+    IfdBuilder ifd;
+    ifd.addLongs( NEW_SUBFILE_TYPE, { 0 } );
+    ifd.addLongs( IMAGE_WIDTH, { uint32_t(width) } );
+    ifd.addLongs( IMAGE_LENGTH, { uint32_t(height) } );
+    ifd.addShorts( BITS_PER_SAMPLE, { 16 } );
+    ifd.addShorts( COMPRESSION, { compress ? COMPRESSION_LOSSLESS_JPEG :
+            COMPRESSION_NONE } );
+    ifd.addShorts( PHOTOMETRIC, { PHOTOMETRIC_CFA } );
+    ifd.addAscii( MODEL, mOptions.cameraModel );
+    ifd.addShorts( ORIENTATION, { 1 } );
+    ifd.addShorts( SAMPLES_PER_PIXEL, { 1 } );
+    ifd.addShorts( PLANAR_CONFIG, { 1 } );
+    ifd.addAscii( SOFTWARE, "NativeCamera" );
+    ifd.addLongs( TILE_WIDTH, { uint32_t(tileSize) } );
+    ifd.addLongs( TILE_LENGTH, { uint32_t(tileSize) } );
+    ifd.addLongs( TILE_OFFSETS, std::vector<uint32_t>( numTiles ) );
+    ifd.addLongs( TILE_BYTE_COUNTS, std::vector<uint32_t>( numTiles ) );
+
+    // CFA colors: 0 red, 1 green, 2 blue.
+    static const uint8_t cfaColors[4][4] = {
+        { 0, 1, 1, 2 }, { 1, 0, 2, 1 }, { 1, 2, 0, 1 }, { 2, 1, 1, 0 } };
+    const uint8_t* cfa = cfaColors[int( mOptions.cfaPattern )];
+    ifd.addShorts( CFA_REPEAT_PATTERN_DIM, { 2, 2 } );
+    ifd.addBytes( CFA_PATTERN, { cfa[0], cfa[1], cfa[2], cfa[3] } );
+
+    if ( settings.exposure > 0 )
+    {
+        ifd.addRational( EXPOSURE_TIME, settings.exposure, 1000000 );
+    }
+    if ( settings.sensitivity > 0 )
+    {
+        ifd.addShorts( ISO_SPEED_RATINGS,
+                { uint16_t( std::min( settings.sensitivity, 65535 ) ) } );
+    }
+
+    ifd.addBytes( DNG_VERSION, { 1, 4, 0, 0 } );
+    ifd.addBytes( DNG_BACKWARD_VERSION, { 1, 1, 0, 0 } );
+    ifd.addAscii( UNIQUE_CAMERA_MODEL, mOptions.cameraModel );
+
+    std::vector<uint32_t> blackLevel( 4 );
+    for ( int i = 0; i < 4; ++i )
+    {
+        blackLevel[i] = std::max( sensor.blackLevelPattern[i], 0 );
+    }
+    ifd.addShorts( BLACK_LEVEL_REPEAT_DIM, { 2, 2 } );
+    ifd.addLongs( BLACK_LEVEL, blackLevel );
+    ifd.addLongs( WHITE_LEVEL, { uint32_t( sensor.whiteLevel > 0 ?
+            sensor.whiteLevel : 65535 ) } );
+
+    // DNG requires a color matrix; without sensor calibration fall back
+    // to the identity for D65.
+    static const float identity[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+    if ( sensor.illuminant1 >= 0 )
+    {
+        ifd.addSRationals( COLOR_MATRIX_1, sensor.colorTransformIlluminant1, 9 );
+        ifd.addShorts( CALIBRATION_ILLUMINANT_1, { uint16_t( sensor.illuminant1 ) } );
+    }
+    else
+    {
+        ifd.addSRationals( COLOR_MATRIX_1, identity, 9 );
+        ifd.addShorts( CALIBRATION_ILLUMINANT_1, { ILLUMINANT_D65 } );
+    }
+    if ( sensor.illuminant1 >= 0 && sensor.illuminant2 >= 0 )
+    {
+        ifd.addSRationals( COLOR_MATRIX_2, sensor.colorTransformIlluminant2, 9 );
+        ifd.addShorts( CALIBRATION_ILLUMINANT_2, { uint16_t( sensor.illuminant2 ) } );
+    }
+
+    // The active array is relative to the full pixel array; a buffer of
+    // exactly the active array size is all active.
+    const int32_t* active = sensor.activeArraySize;
+    if ( active[2] > 0 && active[3] > 0 &&
+         active[0] + active[2] <= width && active[1] + active[3] <= height &&
+         ( active[2] < width || active[3] < height ) )
+    {
+        ifd.addLongs( ACTIVE_AREA, { uint32_t( active[1] ), uint32_t( active[0] ),
+                uint32_t( active[1] + active[3] ), uint32_t( active[0] + active[2] ) } );
+    }
+    else
+    {
+        ifd.addLongs( ACTIVE_AREA, { 0, 0, uint32_t(height), uint32_t(width) } );
+    }
+
+    std::vector<uint32_t> offsets( numTiles );
+    std::vector<uint32_t> byteCounts( numTiles );
+    size_t offset = ifd.size();
+    for ( unsigned i = 0; i < numTiles; ++i )
+    {
+        offsets[i] = offset;
+        byteCounts[i] = mTiles[i].size();
+        offset += ( mTiles[i].size() + 1 ) & ~size_t(1);
+    }
+    ifd.setLongs( TILE_OFFSETS, offsets );
+    ifd.setLongs( TILE_BYTE_COUNTS, byteCounts );
+    const std::vector<uint8_t> header = ifd.serialize();
+
+    const int fd = open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 ) return false;
+
+    bool ok = pwrite( fd, header.data(), header.size(), 0 ) == ssize_t( header.size() );
+
+    std::atomic<bool> failed( false );
+    pool.parallelFor( numTiles, [&]( unsigned i ) {
+        const std::vector<uint8_t>& tile = mTiles[i];
+        if ( pwrite( fd, tile.data(), tile.size(), offsets[i] ) != ssize_t( tile.size() ) )
+        {
+            failed = true;
+        }
+    }, mOptions.maxThreads );
+
+    ok = ok && !failed && ftruncate( fd, offset ) == 0;
+    ok = ( close( fd ) == 0 ) && ok;
+    if ( !ok ) return false;
+
+    mStats.tiles = numTiles;
+    mStats.bytes = offset;
+    mStats.writeTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+    return true;
+}
@@ -0,0 +1,119 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef DngWriter_H
+#define DngWriter_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * Writes RAW16 frames as tiled DNG files that raw converters can open
+ * without side information. The CFA layout, black and white levels, color
+ * matrices and active area come from StaticProperties::sensor, exposure
+ * time and sensitivity from the frame's resultSettings.
+ *
+ * Tiles are prepared and written in parallel on the ThreadPool, each at
+ * its own offset in the file, optionally compressed with lossless JPEG
+ * (DNG compression 7).
+ *
+ * A writer keeps its tile buffers between frames; use one per thread.
+ */
+class DngWriter
+{
+public:
+
+    enum class Compression
+    {
+        NONE,
+        LOSSLESS_JPEG
+    };
+
+    // Color filter arrangement of the top-left 2x2 pixels.
+    enum class CfaPattern
+    {
+        RGGB,
+        GRBG,
+        GBRG,
+        BGGR
+    };
+
+    struct Options
+    {
+        Compression compression = Compression::LOSSLESS_JPEG;
+        CfaPattern cfaPattern = CfaPattern::RGGB;
+
+        // Tile width and height, rounded up to a multiple of 16.
+        unsigned tileSize = 256;
+
+        // Threads of the ThreadPool to use, 0 for all.
+        unsigned maxThreads = 0;
+
+        std::string cameraModel = "NativeCamera";
+    };
+
+    struct Stats
+    {
+        int64_t writeTimeUs = 0;
+        size_t bytes = 0;
+        unsigned tiles = 0;
+    };
+
+    DngWriter( const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    explicit DngWriter( const nv::camera2::StaticProperties& properties ) :
+        DngWriter( properties, Options() ) {}
+
+    /*!
+     * Writes the frame's RAW16 image to path. Returns false if the frame
+     * is not RAW16 or the file could not be written.
+     */
+    bool write( const nv::camera2::CameraFrame& frame, const std::string& path );
+
+    // Statistics of the last write() call.
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    nv::camera2::StaticProperties mProperties;
+    Options mOptions;
+    Stats mStats;
+    std::vector< std::vector<uint8_t> > mTiles;
+};
+
+#endif
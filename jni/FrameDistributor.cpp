@@ -0,0 +1,389 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "FrameDistributor.h"
+#include "FrameTracer.h"
+
+#include <chrono>
+
+#include <sched.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Frames the capture thread waits for before checking for stop().
+constexpr int DEQUEUE_TIMEOUT_US = 100000;
+
+}
+
+struct FrameDistributor::Slot
+{
+    FramePool::Frame frame;
+    std::atomic<unsigned> refs;
+    Table* table = nullptr;
+};
+
+/*
+ * Shared by the distributor and the slots in use, so FrameRefs may outlive
+ * the distributor. The last of them deletes the table.
+ */
+struct FrameDistributor::Table
+{
+    explicit Table( unsigned numSlots ) :
+        slots( numSlots ),
+        free( numSlots ),
+        users(1)
+    {
+        for ( auto& slot : slots )
+        {
+            slot.refs.store( 0, std::memory_order_relaxed );
+            slot.table = this;
+            Slot* ptr = &slot;
+            free.tryPush( std::move( ptr ) );
+        }
+    }
+
+    void release()
+    {
+        if ( users.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+        {
+            delete this;
+        }
+    }
+
+    std::vector<Slot> slots;
+    MpmcQueue<Slot*> free;
+    std::atomic<unsigned> users;
+};
+
+FrameDistributor::FrameRef::FrameRef( const FrameRef& other ) :
+    mSlot(other.mSlot)
+{
+    if ( mSlot ) mSlot->refs.fetch_add( 1, std::memory_order_relaxed );
+}
+
+FrameDistributor::FrameRef::FrameRef( FrameRef&& other ) :
+    mSlot(other.mSlot)
+{
+    other.mSlot = nullptr;
+}
+
+FrameDistributor::FrameRef& FrameDistributor::FrameRef::operator=(
+        const FrameRef& other )
+{
+    if ( other.mSlot ) other.mSlot->refs.fetch_add( 1, std::memory_order_relaxed );
+    reset();
+    mSlot = other.mSlot;
+    return *this;
+}
+
+FrameDistributor::FrameRef& FrameDistributor::FrameRef::operator=(
+        FrameRef&& other )
+{
+    if ( this != &other )
+    {
+        reset();
+        mSlot = other.mSlot;
+        other.mSlot = nullptr;
+    }
+    return *this;
+}
+
+FrameDistributor::FrameRef::~FrameRef()
+{
+    reset();
+}
+
+const CameraFrame* FrameDistributor::FrameRef::get() const
+{
+    return mSlot ? mSlot->frame.get() : nullptr;
+}
+
+void FrameDistributor::FrameRef::reset()
+{
+    Slot* slot = mSlot;
+    mSlot = nullptr;
+    if ( !slot || slot->refs.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+    {
+        return;
+    }
+
+    // Last reference: the frame goes back to its pool and the slot to the
+    // free list. The free list holds every slot, so the push cannot fail.
+    slot->frame.reset();
+    Table* table = slot->table;
+    table->free.tryPush( std::move( slot ) );
+    table->release();
+}
+
+FrameDistributor::Consumer::Consumer( const ConsumerOptions& options ) :
+    mOptions(options),
+    mFramesQueued(0),
+    mFramesDropped(0),
+    mWaiters(0)
+{
+    const unsigned depth = std::max( options.depth, 1u );
+    if ( options.dropPolicy == DropPolicy::DROP_NEWEST && !options.multipleReaders )
+    {
+        mSpsc.reset( new SpscQueue<FrameRef>( depth ) );
+    }
+    else
+    {
+        mMpmc.reset( new MpmcQueue<FrameRef>( depth ) );
+    }
+}
+
+bool FrameDistributor::Consumer::tryPop( FrameRef& frame )
+{
+    return mSpsc ? mSpsc->tryPop( frame ) : mMpmc->tryPop( frame );
+}
+
+bool FrameDistributor::Consumer::pop( FrameRef& frame, int timeoutUs )
+{
+    if ( tryPop( frame ) ) return true;
+    if ( timeoutUs == 0 ) return false;
+
+    const auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds( timeoutUs );
+
+    std::unique_lock<std::mutex> lk( mWaitMutex );
+    mWaiters.fetch_add( 1 );
+    bool popped;
+    for (;;)
+    {
+        // Pairs with the fence in publish(): either the capture thread sees
+        // the waiter, or this thread sees the frame.
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+        popped = tryPop( frame );
+        if ( popped ) break;
+
+        if ( timeoutUs == WAIT_FOREVER )
+        {
+            mWait.wait( lk );
+        }
+        else if ( mWait.wait_until( lk, deadline ) == std::cv_status::timeout )
+        {
+            popped = tryPop( frame );
+            break;
+        }
+    }
+    mWaiters.fetch_sub( 1 );
+    return popped;
+}
+
+FrameDistributor::FrameRef FrameDistributor::Consumer::popNewest()
+{
+    FrameRef newest;
+    FrameRef frame;
+    uint64_t skipped = 0;
+    while ( tryPop( frame ) )
+    {
+        if ( newest ) ++skipped;
+        newest = std::move( frame );
+    }
+    if ( skipped )
+    {
+        mFramesDropped += skipped;
+    }
+    return newest;
+}
+
+FrameDistributor::ConsumerCounters FrameDistributor::Consumer::counters() const
+{
+    ConsumerCounters c;
+    c.framesQueued = mFramesQueued;
+    c.framesDropped = mFramesDropped;
+    c.queueDepth = mSpsc ? mSpsc->size() : mMpmc->size();
+    return c;
+}
+
+bool FrameDistributor::Consumer::tryPush( FrameRef& frame )
+{
+    // The queues round their capacity up to a power of two; the slots are
+    // sized from the depth, so that is what is held. The capture thread is
+    // the only producer and readers only shrink the queue, so the check
+    // holds until the push.
+    const size_t queued = mSpsc ? mSpsc->size() : mMpmc->size();
+    if ( queued >= std::max( mOptions.depth, 1u ) ) return false;
+
+    return mSpsc ? mSpsc->tryPush( std::move( frame ) ) :
+                   mMpmc->tryPush( std::move( frame ) );
+}
+
+void FrameDistributor::Consumer::publish( FrameRef frame )
+{
+    if ( !tryPush( frame ) )
+    {
+        if ( mOptions.dropPolicy == DropPolicy::DROP_NEWEST )
+        {
+            ++mFramesDropped;
+            return;
+        }
+
+        // Readers may take frames at the same time, so the queue can have
+        // room again before anything was displaced.
+        FrameRef oldest;
+        do
+        {
+            if ( mMpmc->tryPop( oldest ) )
+            {
+                oldest.reset();
+                ++mFramesDropped;
+            }
+        }
+        while ( !tryPush( frame ) );
+    }
+    ++mFramesQueued;
+
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if ( mWaiters.load( std::memory_order_relaxed ) > 0 )
+    {
+        std::lock_guard<std::mutex> lk( mWaitMutex );
+        mWait.notify_all();
+    }
+}
+
+FrameDistributor::FrameDistributor( CameraStream& stream,
+        const StaticProperties& properties ) :
+    mStream(stream),
+    mProperties(properties),
+    mFramesCaptured(0),
+    mFramesStarved(0),
+    mRunning(false)
+{
+}
+
+FrameDistributor::~FrameDistributor()
+{
+    stop();
+
+    // Queued frames are released with the consumers.
+    mConsumers.clear();
+    if ( mTable ) mTable->release();
+}
+
+FrameDistributor::Consumer* FrameDistributor::addConsumer(
+        const ConsumerOptions& options )
+{
+    if ( mTable ) return nullptr;
+
+    mConsumers.push_back( std::unique_ptr<Consumer>( new Consumer( options ) ) );
+    return mConsumers.back().get();
+}
+
+void FrameDistributor::setCpu( int cpu )
+{
+    mCpu = cpu;
+}
+
+void FrameDistributor::start()
+{
+    if ( mRunning ) return;
+
+    if ( !mTable )
+    {
+        // Every consumer can have its queue full and hold some frames, and
+        // the capture thread has one on the way.
+        unsigned numSlots = 1;
+        for ( const auto& consumer : mConsumers )
+        {
+            numSlots += std::max( consumer->mOptions.depth, 1u ) +
+                        consumer->mOptions.held;
+        }
+        mTable = new Table( numSlots );
+        mPooled.reset( new PooledStream( mStream, mProperties, numSlots ) );
+    }
+
+    mRunning = true;
+    mThread = std::thread( &FrameDistributor::captureLoop, this );
+}
+
+void FrameDistributor::stop()
+{
+    if ( !mRunning ) return;
+
+    mRunning = false;
+    mThread.join();
+}
+
+FrameDistributor::Counters FrameDistributor::counters() const
+{
+    Counters c;
+    c.framesCaptured = mFramesCaptured;
+    c.framesStarved = mFramesStarved;
+    c.slots = mTable ? mTable->slots.size() : 0;
+    return c;
+}
+
+void FrameDistributor::captureLoop()
+{
+    FrameTracer& tracer = FrameTracer::instance();
+
+    // Best effort; the CPU may be offline or reserved.
+    if ( mCpu >= 0 )
+    {
+        cpu_set_t cpus;
+        CPU_ZERO( &cpus );
+        CPU_SET( mCpu, &cpus );
+        sched_setaffinity( 0, sizeof(cpus), &cpus );
+    }
+
+    while ( mRunning )
+    {
+        FramePool::Frame frame = mPooled->dequeue( DEQUEUE_TIMEOUT_US );
+        if ( !frame ) continue;
+
+        ++mFramesCaptured;
+        tracer.record( FrameTracer::Stage::CAPTURE, frame->captureTime,
+                frame->requestId, frame->captureTime, frame->captureTime );
+        tracer.record( FrameTracer::Stage::DEQUEUE, *frame );
+
+        Slot* slot = nullptr;
+        if ( mConsumers.empty() || !mTable->free.tryPop( slot ) )
+        {
+            ++mFramesStarved;
+            tracer.recordDrop( FrameTracer::Stage::DEQUEUE );
+            continue;
+        }
+
+        // One reference per consumer, handed over by publish().
+        slot->frame = std::move( frame );
+        slot->refs.store( mConsumers.size(), std::memory_order_relaxed );
+        mTable->users.fetch_add( 1, std::memory_order_relaxed );
+
+        for ( auto& consumer : mConsumers )
+        {
+            consumer->publish( FrameRef( slot ) );
+        }
+    }
+}
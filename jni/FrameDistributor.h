@@ -0,0 +1,236 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef FrameDistributor_H
+#define FrameDistributor_H
+
+#include "FramePool.h"
+#include "LockFreeQueue.h"
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Runs a capture thread on one stream and hands every frame to all
+ * registered consumers, without copying it. Consumers get read-only,
+ * reference counted FrameRefs through a lock-free queue of their own;
+ * the frame goes back to the stream once the last FrameRef is released.
+ *
+ * Frames live in a fixed table of slots sized from the consumer queue
+ * depths, so publishing a frame does not allocate. If every slot is still
+ * referenced the new frame is released right away and counted as starved.
+ *
+ * Consumers are added before start(). Each one is read by a single
+ * thread, unless ConsumerOptions::multipleReaders is set.
+ *
+ * With several cameras, each stream gets its own distributor, and with
+ * setCpu() its capture thread gets a core of its own.
+ */
+class FrameDistributor
+{
+    struct Slot;
+    struct Table;
+
+public:
+
+    /*!
+     * Shared handle to a distributed frame. Copies share the frame; it is
+     * recycled when the last copy is released, from whichever thread.
+     */
+    class FrameRef
+    {
+    public:
+
+        FrameRef() = default;
+        FrameRef( const FrameRef& other );
+        FrameRef( FrameRef&& other );
+        FrameRef& operator=( const FrameRef& other );
+        FrameRef& operator=( FrameRef&& other );
+        ~FrameRef();
+
+        const nv::camera2::CameraFrame* get() const;
+
+        const nv::camera2::CameraFrame* operator->() const
+        {
+            return get();
+        }
+
+        const nv::camera2::CameraFrame& operator*() const
+        {
+            return *get();
+        }
+
+        explicit operator bool() const
+        {
+            return mSlot != nullptr;
+        }
+
+        void reset();
+
+    private:
+
+        friend class FrameDistributor;
+
+        // Takes over a reference already counted on the slot.
+        explicit FrameRef( Slot* slot ) :
+            mSlot(slot)
+        {
+        }
+
+        Slot* mSlot = nullptr;
+    };
+
+    enum class DropPolicy
+    {
+        DROP_OLDEST,    //< The oldest queued frame makes room for the new one.
+        DROP_NEWEST     //< The new frame is not queued.
+    };
+
+    struct ConsumerOptions
+    {
+        // Frames queued for the consumer, at most; at least 1.
+        unsigned depth = 2;
+        DropPolicy dropPolicy = DropPolicy::DROP_OLDEST;
+
+        // Frames the consumer keeps after taking them off its queue.
+        unsigned held = 1;
+
+        // Allows several threads to take frames from the queue.
+        bool multipleReaders = false;
+    };
+
+    struct ConsumerCounters
+    {
+        uint64_t framesQueued = 0;
+        uint64_t framesDropped = 0;     //< Displaced or skipped by popNewest().
+        unsigned queueDepth = 0;
+    };
+
+    class Consumer
+    {
+    public:
+
+        // Takes the oldest queued frame. Never blocks.
+        bool tryPop( FrameRef& frame );
+
+        /*!
+         * Takes the oldest queued frame, waiting up to timeoutUs for one;
+         * nv::camera2::WAIT_FOREVER waits until a frame is queued.
+         */
+        bool pop( FrameRef& frame, int timeoutUs );
+
+        // Empties the queue and returns the newest frame, if any.
+        FrameRef popNewest();
+
+        ConsumerCounters counters() const;
+
+    private:
+
+        friend class FrameDistributor;
+
+        explicit Consumer( const ConsumerOptions& options );
+
+        void publish( FrameRef frame );
+        bool tryPush( FrameRef& frame );
+
+        const ConsumerOptions mOptions;
+
+        // Single reader queues dropping new frames take the SPSC queue;
+        // dropping the oldest frame makes the capture thread a reader too.
+        std::unique_ptr<SpscQueue<FrameRef>> mSpsc;
+        std::unique_ptr<MpmcQueue<FrameRef>> mMpmc;
+
+        std::atomic<uint64_t> mFramesQueued;
+        std::atomic<uint64_t> mFramesDropped;
+
+        // Only used to sleep in pop().
+        std::mutex mWaitMutex;
+        std::condition_variable mWait;
+        std::atomic<unsigned> mWaiters;
+    };
+
+    struct Counters
+    {
+        uint64_t framesCaptured = 0;
+        uint64_t framesStarved = 0;     //< Released for lack of a free slot.
+        unsigned slots = 0;
+    };
+
+    FrameDistributor( nv::camera2::CameraStream& stream,
+            const nv::camera2::StaticProperties& properties );
+
+    // Stops the capture thread. Consumers must no longer be read from;
+    // FrameRefs still held stay valid.
+    ~FrameDistributor();
+
+    /*!
+     * Registers a consumer; must be called before start(). The consumer
+     * is owned by the distributor.
+     */
+    Consumer* addConsumer( const ConsumerOptions& options );
+
+    /*!
+     * Pins the capture thread to one CPU, -1 to let the scheduler pick.
+     * Applies from the next start().
+     */
+    void setCpu( int cpu );
+
+    // Starts and stops the capture thread.
+    void start();
+    void stop();
+
+    Counters counters() const;
+
+private:
+
+    void captureLoop();
+
+    nv::camera2::CameraStream& mStream;
+    const nv::camera2::StaticProperties mProperties;
+
+    std::vector<std::unique_ptr<Consumer>> mConsumers;
+    std::unique_ptr<PooledStream> mPooled;
+    Table* mTable = nullptr;
+
+    std::atomic<uint64_t> mFramesCaptured;
+    std::atomic<uint64_t> mFramesStarved;
+
+    int mCpu = -1;
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+};
+
+#endif
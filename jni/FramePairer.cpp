@@ -0,0 +1,142 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "FramePairer.h"
+
+#include <algorithm>
+
+FramePairer::FramePairer( const Options& options ) :
+    mOptions(options),
+    mQueues( options.inputs )
+{
+    for ( auto& queue : mQueues )
+    {
+        queue.ring.resize( std::max( options.window, 1u ) );
+    }
+    mCounters.framesPushed.resize( options.inputs );
+    mCounters.framesUnmatched.resize( options.inputs );
+}
+
+bool FramePairer::push( unsigned input, Frame frame )
+{
+    if ( input >= mQueues.size() || !frame ) return false;
+
+    // A full window makes room by releasing its oldest frame.
+    std::lock_guard<std::mutex> lk( mMutex );
+    Queue& queue = mQueues[input];
+    ++mCounters.framesPushed[input];
+    if ( queue.count == queue.ring.size() )
+    {
+        ++mCounters.framesUnmatched[input];
+        queue.take();
+    }
+    queue.ring[( queue.head + queue.count ) % queue.ring.size()] =
+            std::move( frame );
+    ++queue.count;
+    return true;
+}
+
+bool FramePairer::pop( std::vector<Frame>& set )
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    if ( mQueues.empty() ) return false;
+
+    for (;;)
+    {
+        int64_t newest = INT64_MIN;
+        for ( auto& queue : mQueues )
+        {
+            if ( queue.count == 0 ) return false;
+            newest = std::max( newest, queue.front()->captureTime );
+        }
+
+        // Frames older than the tolerance before the newest head can only
+        // pair with frames that have already gone.
+        bool dropped = false;
+        for ( unsigned i = 0; i < mQueues.size(); ++i )
+        {
+            Queue& queue = mQueues[i];
+            while ( queue.count > 0 &&
+                    queue.front()->captureTime < newest - mOptions.toleranceNs )
+            {
+                queue.take();
+                ++mCounters.framesUnmatched[i];
+                dropped = true;
+            }
+        }
+        if ( dropped ) continue;
+
+        int64_t oldest = newest;
+        set.resize( mQueues.size() );
+        for ( unsigned i = 0; i < mQueues.size(); ++i )
+        {
+            oldest = std::min( oldest, mQueues[i].front()->captureTime );
+            set[i] = mQueues[i].take();
+        }
+
+        const int64_t skewUs = ( newest - oldest ) / 1000;
+        ++mCounters.sets;
+        mTotalSkewUs += skewUs;
+        mCounters.lastSkewUs = skewUs;
+        mCounters.meanSkewUs = mTotalSkewUs / int64_t( mCounters.sets );
+        mCounters.maxSkewUs = std::max( mCounters.maxSkewUs, skewUs );
+        return true;
+    }
+}
+
+unsigned FramePairer::waitingInput() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    for ( unsigned i = 0; i < mQueues.size(); ++i )
+    {
+        if ( mQueues[i].count == 0 ) return i;
+    }
+    return mQueues.size();
+}
+
+void FramePairer::clear()
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    for ( auto& queue : mQueues )
+    {
+        while ( queue.count > 0 )
+        {
+            queue.take();
+        }
+        queue.head = 0;
+    }
+}
+
+FramePairer::Counters FramePairer::counters() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mCounters;
+}
@@ -0,0 +1,140 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef FramePairer_H
+#define FramePairer_H
+
+#include "FrameDistributor.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*!
+ * Matches the frames of several cameras by captureTime, for rigs whose
+ * sensors run at the same frame rate and share a clock. A set is complete
+ * when every input has a frame within Options::toleranceNs of the newest
+ * of them; frames too old to be part of any set are released and counted
+ * as unmatched.
+ *
+ * Each input keeps up to Options::window frames while it waits for the
+ * others, so a camera that stops delivering does not hold on to the
+ * frames of the rest. Frames of one input have to be pushed in capture
+ * order. All calls are thread safe.
+ */
+class FramePairer
+{
+public:
+
+    typedef FrameDistributor::FrameRef Frame;
+
+    struct Options
+    {
+        unsigned inputs = 2;
+
+        // Largest difference between the capture times of a set.
+        int64_t toleranceNs = 2000000;
+
+        // Frames held per input while waiting for the others.
+        unsigned window = 4;
+    };
+
+    struct Counters
+    {
+        uint64_t sets = 0;
+        int64_t lastSkewUs = 0;     //< Newest minus oldest frame of a set.
+        int64_t meanSkewUs = 0;
+        int64_t maxSkewUs = 0;
+
+        // Per input.
+        std::vector<uint64_t> framesPushed;
+        std::vector<uint64_t> framesUnmatched;
+    };
+
+    explicit FramePairer( const Options& options );
+
+    // Returns false if input is out of range.
+    bool push( unsigned input, Frame frame );
+
+    /*!
+     * Takes the oldest complete set; set[i] is the frame of input i.
+     * Returns false if no set is complete yet.
+     */
+    bool pop( std::vector<Frame>& set );
+
+    /*!
+     * An input without a frame pending, which the next set waits for, or
+     * Options::inputs if every input has one.
+     */
+    unsigned waitingInput() const;
+
+    // Releases the pending frames.
+    void clear();
+
+    Counters counters() const;
+
+    const Options& options() const
+    {
+        return mOptions;
+    }
+
+private:
+
+    // Pending frames of one input, oldest first.
+    struct Queue
+    {
+        std::vector<Frame> ring;
+        unsigned head = 0;
+        unsigned count = 0;
+
+        Frame& front()
+        {
+            return ring[head];
+        }
+
+        Frame take()
+        {
+            Frame frame = std::move( ring[head] );
+            head = ( head + 1 ) % ring.size();
+            --count;
+            return frame;
+        }
+    };
+
+    const Options mOptions;
+
+    mutable std::mutex mMutex;
+    std::vector<Queue> mQueues;
+    Counters mCounters;
+    int64_t mTotalSkewUs = 0;
+};
+
+#endif
@@ -0,0 +1,258 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "FramePool.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+class PooledFrame : public CameraFrame
+{
+public:
+
+    // The image buffer belongs to a stream and must be released when the
+    // frame is recycled.
+    bool adopted = false;
+};
+
+}
+
+struct FramePool::State
+{
+    mutable std::mutex mutex;
+    std::vector< std::unique_ptr<PooledFrame> > freeList;
+    unsigned capacity = 0;
+    size_t histogramSize = 0;
+    size_t sharpnessMapSize = 0;
+
+    uint64_t acquired = 0;
+    uint64_t allocations = 0;
+    uint64_t adopted = 0;
+
+    void recycle( PooledFrame* frame )
+    {
+        std::unique_ptr<PooledFrame> owned( frame );
+
+        if ( frame->adopted )
+        {
+            frame->imageBuffer.reset();
+            frame->adopted = false;
+        }
+        frame->statistics.histogram.data.clear();
+        frame->statistics.histogram.numBuckets = 0;
+        frame->statistics.sharpnessMap.clear();
+
+        std::lock_guard<std::mutex> lk( mutex );
+        if ( freeList.size() < capacity )
+        {
+            freeList.push_back( std::move(owned) );
+        }
+    }
+};
+
+void FramePool::Recycler::operator()( CameraFrame* frame ) const
+{
+    if ( pool )
+    {
+        pool->recycle( static_cast<PooledFrame*>( frame ) );
+    }
+    else
+    {
+        delete frame;
+    }
+}
+
+FramePool::FramePool( const StaticProperties::StatisticsProperties& stats,
+        unsigned capacity ) :
+    mState( std::make_shared<State>() )
+{
+    // The HAL reports a histogram per color channel and sharpness values
+    // for each channel of every map cell.
+    mState->capacity = std::max( capacity, 1u );
+    mState->histogramSize = 3 * std::max( stats.histogramBucketCount, 0 );
+    mState->sharpnessMapSize = 3 * size_t(stats.sharpnessMapSize.width) *
+            stats.sharpnessMapSize.height;
+
+    mState->freeList.reserve( mState->capacity );
+    for ( unsigned i = 0; i < mState->capacity; ++i )
+    {
+        std::unique_ptr<PooledFrame> frame( new PooledFrame );
+        frame->statistics.histogram.data.reserve( mState->histogramSize );
+        frame->statistics.sharpnessMap.reserve( mState->sharpnessMapSize );
+        mState->freeList.push_back( std::move(frame) );
+    }
+    mState->allocations = 1 + mState->capacity;
+}
+
+FramePool::Frame FramePool::acquire()
+{
+    std::unique_ptr<PooledFrame> frame;
+    {
+        std::lock_guard<std::mutex> lk( mState->mutex );
+        ++mState->acquired;
+
+        if ( !mState->freeList.empty() )
+        {
+            frame = std::move( mState->freeList.back() );
+            mState->freeList.pop_back();
+        }
+        else
+        {
+            ++mState->allocations;
+        }
+    }
+
+    if ( !frame )
+    {
+        frame.reset( new PooledFrame );
+        frame->statistics.histogram.data.reserve( mState->histogramSize );
+        frame->statistics.sharpnessMap.reserve( mState->sharpnessMapSize );
+    }
+
+    Recycler recycler;
+    recycler.pool = mState;
+    return Frame( frame.release(), recycler );
+}
+
+FramePool::Frame FramePool::adopt( std::unique_ptr<CameraFrame> source )
+{
+    if ( !source ) return Frame( nullptr, Recycler() );
+
+    Frame frame = acquire();
+
+    frame->requestId = source->requestId;
+    frame->streaming = source->streaming;
+    frame->captureTime = source->captureTime;
+    frame->requestSettings = source->requestSettings;
+    frame->resultSettings = source->resultSettings;
+    frame->autoControlState = source->autoControlState;
+
+    Statistics& stats = frame->statistics;
+    const size_t histogramCapacity = stats.histogram.data.capacity();
+    const size_t sharpnessCapacity = stats.sharpnessMap.capacity();
+
+    stats.histogram.numBuckets = source->statistics.histogram.numBuckets;
+    stats.histogram.data.assign( source->statistics.histogram.data.begin(),
+            source->statistics.histogram.data.end() );
+    stats.sharpnessMap.assign( source->statistics.sharpnessMap.begin(),
+            source->statistics.sharpnessMap.end() );
+
+    {
+        std::lock_guard<std::mutex> lk( mState->mutex );
+        ++mState->adopted;
+        if ( stats.histogram.data.capacity() != histogramCapacity ||
+             stats.sharpnessMap.capacity() != sharpnessCapacity )
+        {
+            ++mState->allocations;
+        }
+    }
+
+    frame->imageBuffer = std::move( source->imageBuffer );
+    static_cast<PooledFrame*>( frame.get() )->adopted = true;
+
+    return frame;
+}
+
+FramePool::Counters FramePool::counters() const
+{
+    std::lock_guard<std::mutex> lk( mState->mutex );
+
+    Counters c;
+    c.acquired = mState->acquired;
+    c.allocations = mState->allocations;
+    c.adopted = mState->adopted;
+    c.available = mState->freeList.size();
+    return c;
+}
+
+namespace
+{
+
+// Streams with a PooledFrameSource; there are only ever a few.
+std::mutex sourcesMutex;
+std::vector<std::pair<const CameraStream*, PooledFrameSource*>> sources;
+
+}
+
+PooledFrameSource::PooledFrameSource( const CameraStream& stream ) :
+    mStream(stream)
+{
+    std::lock_guard<std::mutex> lk( sourcesMutex );
+    sources.push_back( std::make_pair( &stream, this ) );
+}
+
+PooledFrameSource::~PooledFrameSource()
+{
+    std::lock_guard<std::mutex> lk( sourcesMutex );
+    sources.erase( std::find( sources.begin(), sources.end(),
+            std::make_pair( &mStream, this ) ) );
+}
+
+PooledFrameSource* PooledFrameSource::find( const CameraStream& stream )
+{
+    std::lock_guard<std::mutex> lk( sourcesMutex );
+    for ( const auto& source : sources )
+    {
+        if ( source.first == &stream ) return source.second;
+    }
+    return nullptr;
+}
+
+PooledStream::PooledStream( CameraStream& stream,
+        const StaticProperties& properties, unsigned capacity ) :
+    mStream(stream),
+    mSource( PooledFrameSource::find( stream ) )
+{
+    if ( !mSource )
+    {
+        mPool.reset( new FramePool( properties.statistics, capacity ) );
+    }
+}
+
+FramePool::Frame PooledStream::dequeue( int timeoutUs )
+{
+    if ( mSource )
+    {
+        return mSource->dequeuePooled( timeoutUs );
+    }
+    return mPool->adopt( mStream.dequeue( timeoutUs ) );
+}
+
+FramePool::Counters PooledStream::counters() const
+{
+    return mSource ? mSource->poolCounters() : mPool->counters();
+}
@@ -0,0 +1,161 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef FramePool_H
+#define FramePool_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <memory>
+
+/*!
+ * A per-stream free list of CameraFrames. Frames come back to the pool
+ * when their handle is released instead of being deleted, together with
+ * their statistics storage, which is sized once from
+ * StaticProperties::statistics. After warm-up a PooledFrameSource stream
+ * running through a pool performs no heap allocation per frame;
+ * counters().allocations stops moving once that is the case.
+ *
+ * Other streams, the HAL's among them, allocate a CameraFrame and its
+ * buffer in every dequeue(). adopt() cannot avoid that, only the pool's
+ * own allocations stay flat; counters().adopted counts those frames.
+ *
+ * Frames may be released from any thread, and may outlive the pool.
+ */
+class FramePool
+{
+    struct State;
+
+public:
+
+    // Without a pool the frame is deleted.
+    struct Recycler
+    {
+        std::shared_ptr<State> pool;
+        void operator()( nv::camera2::CameraFrame* frame ) const;
+    };
+
+    typedef std::unique_ptr<nv::camera2::CameraFrame, Recycler> Frame;
+
+    struct Counters
+    {
+        uint64_t acquired = 0;      //< Frames handed out.
+        uint64_t allocations = 0;   //< Heap allocations made by the pool.
+        uint64_t adopted = 0;       //< Frames the stream allocated, see adopt().
+        unsigned available = 0;     //< Frames on the free list.
+    };
+
+    /*!
+     * capacity is the number of frames kept on the free list; it should
+     * cover the stream queue depth plus the frames held by consumers.
+     */
+    FramePool( const nv::camera2::StaticProperties::StatisticsProperties& stats,
+            unsigned capacity );
+
+    /*!
+     * Returns a frame from the free list, or a new one if the list is
+     * empty. The image buffer of a recycled frame is kept so the owner of
+     * the pool can reuse it, unless it came in through adopt().
+     */
+    Frame acquire();
+
+    /*!
+     * Moves a frame obtained from CameraStream::dequeue() into a pooled
+     * frame. Metadata is copied into the preallocated storage and the image
+     * buffer is taken over; it is released when the frame is recycled.
+     */
+    Frame adopt( std::unique_ptr<nv::camera2::CameraFrame> frame );
+
+    Counters counters() const;
+
+private:
+
+    std::shared_ptr<State> mState;
+};
+
+/*!
+ * Implemented by streams that hand out pooled frames themselves. The NDK
+ * builds without RTTI, so a source registers the CameraStream it is part
+ * of and PooledStream finds it with find() instead of a dynamic_cast.
+ */
+class PooledFrameSource
+{
+public:
+
+    virtual FramePool::Frame dequeuePooled( int timeoutUs ) = 0;
+
+    virtual FramePool::Counters poolCounters() const = 0;
+
+    // The source registered for stream, nullptr if there is none.
+    static PooledFrameSource* find( const nv::camera2::CameraStream& stream );
+
+protected:
+
+    // Registers the source for stream until it is destroyed.
+    explicit PooledFrameSource( const nv::camera2::CameraStream& stream );
+
+    ~PooledFrameSource();
+
+private:
+
+    const nv::camera2::CameraStream& mStream;
+};
+
+/*!
+ * Dequeues pooled frames from any CameraStream. Streams implementing
+ * PooledFrameSource are used directly, frames of other streams are adopted
+ * into a pool owned by this object.
+ */
+class PooledStream
+{
+public:
+
+    PooledStream( nv::camera2::CameraStream& stream,
+            const nv::camera2::StaticProperties& properties,
+            unsigned capacity );
+
+    nv::camera2::CameraStream& stream() const
+    {
+        return mStream;
+    }
+
+    FramePool::Frame dequeue( int timeoutUs );
+
+    FramePool::Counters counters() const;
+
+private:
+
+    nv::camera2::CameraStream& mStream;
+    PooledFrameSource* mSource;
+    std::unique_ptr<FramePool> mPool;
+};
+
+#endif
@@ -0,0 +1,341 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "FrameTracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+namespace
+{
+
+constexpr unsigned DEFAULT_RING_CAPACITY = 16384;
+constexpr int STAGE_COUNT = int( FrameTracer::Stage::COUNT );
+
+const char* const STAGE_NAMES[STAGE_COUNT] = {
+    "capture", "dequeue", "upload", "draw", "save enqueue", "save complete" };
+
+}
+
+/*
+ * A ring slot, written like a seqlock: sequence is odd while the event
+ * is being written and 2 * index + 2 once it is complete, so readers can
+ * detect events that were overwritten while they copied them.
+ */
+struct FrameTracer::Event
+{
+    std::atomic<uint64_t> sequence;
+    std::atomic<int64_t> start;
+    std::atomic<int64_t> end;
+    std::atomic<int64_t> captureTime;
+    std::atomic<int32_t> requestId;
+    std::atomic<uint8_t> stage;
+};
+
+/*
+ * Log-linear histogram of microsecond values: exact below 16 us, then 8
+ * buckets per power of two, i.e. within 12.5% of the true value.
+ */
+struct FrameTracer::Histogram
+{
+    enum
+    {
+        LINEAR = 16,
+        SUB_BUCKETS = 8,
+        BUCKETS = LINEAR + ( 40 - 4 ) * SUB_BUCKETS
+    };
+
+    std::atomic<uint32_t> buckets[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<int64_t> max;
+
+    static int bucket( int64_t value )
+    {
+        if ( value < LINEAR ) return std::max<int64_t>( value, 0 );
+
+        const int exponent = 63 - __builtin_clzll( value );
+        const int index = LINEAR + ( exponent - 4 ) * SUB_BUCKETS +
+                int( ( value >> ( exponent - 3 ) ) & ( SUB_BUCKETS - 1 ) );
+        return std::min<int>( index, BUCKETS - 1 );
+    }
+
+    // Largest value falling into the bucket.
+    static int64_t upperBound( int index )
+    {
+        if ( index < LINEAR ) return index;
+
+        const int exponent = ( index - LINEAR ) / SUB_BUCKETS + 4;
+        const int64_t sub = ( index - LINEAR ) % SUB_BUCKETS;
+        return ( ( SUB_BUCKETS + sub + 1 ) << ( exponent - 3 ) ) - 1;
+    }
+
+    void add( int64_t value )
+    {
+        buckets[bucket( value )].fetch_add( 1, std::memory_order_relaxed );
+        count.fetch_add( 1, std::memory_order_relaxed );
+
+        int64_t current = max.load( std::memory_order_relaxed );
+        while ( value > current &&
+                !max.compare_exchange_weak( current, value, std::memory_order_relaxed ) ) {}
+    }
+
+    int64_t percentile( double fraction ) const
+    {
+        uint64_t total = 0;
+        for ( const auto& b : buckets )
+        {
+            total += b.load( std::memory_order_relaxed );
+        }
+        if ( total == 0 ) return 0;
+
+        const uint64_t rank = std::max<uint64_t>( 1, uint64_t( fraction * total + 0.5 ) );
+        uint64_t seen = 0;
+        for ( int i = 0; i < BUCKETS; ++i )
+        {
+            seen += buckets[i].load( std::memory_order_relaxed );
+            if ( seen >= rank )
+            {
+                return std::min( upperBound( i ), max.load( std::memory_order_relaxed ) );
+            }
+        }
+        return max.load( std::memory_order_relaxed );
+    }
+
+    void reset()
+    {
+        for ( auto& b : buckets )
+        {
+            b.store( 0, std::memory_order_relaxed );
+        }
+        count.store( 0, std::memory_order_relaxed );
+        max.store( 0, std::memory_order_relaxed );
+    }
+};
+
+FrameTracer& FrameTracer::instance()
+{
+    static FrameTracer tracer( DEFAULT_RING_CAPACITY );
+    return tracer;
+}
+
+FrameTracer::FrameTracer( unsigned ringCapacity ) :
+    mEnabled(true),
+    mNextEvent(0),
+    mLatency( new Histogram[STAGE_COUNT] ),
+    mDuration( new Histogram[STAGE_COUNT] ),
+    mDropped( new std::atomic<uint64_t>[STAGE_COUNT] )
+{
+    // Round up to a power of two so the slot is a mask away.
+    unsigned capacity = 1;
+    while ( capacity < std::max( ringCapacity, 1u ) ) capacity <<= 1;
+
+    mEvents.reset( new Event[capacity] );
+    mMask = capacity - 1;
+
+    reset();
+}
+
+FrameTracer::~FrameTracer()
+{
+}
+
+int64_t FrameTracer::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+const char* FrameTracer::stageName( Stage stage )
+{
+    return int(stage) < STAGE_COUNT ? STAGE_NAMES[int(stage)] : "";
+}
+
+void FrameTracer::record( Stage stage, int64_t captureTime, int32_t requestId,
+        int64_t start, int64_t end )
+{
+    if ( !enabled() || int(stage) >= STAGE_COUNT ) return;
+
+    const uint64_t index = mNextEvent.fetch_add( 1, std::memory_order_relaxed );
+    Event& event = mEvents[index & mMask];
+
+    event.sequence.store( 2 * index + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    event.start.store( start, std::memory_order_relaxed );
+    event.end.store( end, std::memory_order_relaxed );
+    event.captureTime.store( captureTime, std::memory_order_relaxed );
+    event.requestId.store( requestId, std::memory_order_relaxed );
+    event.stage.store( uint8_t(stage), std::memory_order_relaxed );
+    event.sequence.store( 2 * index + 2, std::memory_order_release );
+
+    mLatency[int(stage)].add( ( end - captureTime ) / 1000 );
+    if ( end > start )
+    {
+        mDuration[int(stage)].add( ( end - start ) / 1000 );
+    }
+}
+
+void FrameTracer::recordDrop( Stage stage )
+{
+    if ( !enabled() || int(stage) >= STAGE_COUNT ) return;
+
+    mDropped[int(stage)].fetch_add( 1, std::memory_order_relaxed );
+}
+
+FrameTracer::StageSummary FrameTracer::summary( Stage stage ) const
+{
+    StageSummary s;
+    if ( int(stage) >= STAGE_COUNT ) return s;
+
+    const Histogram& latency = mLatency[int(stage)];
+    const Histogram& duration = mDuration[int(stage)];
+
+    s.count = latency.count.load( std::memory_order_relaxed );
+    s.dropped = mDropped[int(stage)].load( std::memory_order_relaxed );
+    s.latencyP50 = latency.percentile( 0.50 );
+    s.latencyP99 = latency.percentile( 0.99 );
+    s.latencyMax = latency.max.load( std::memory_order_relaxed );
+    s.durationP50 = duration.percentile( 0.50 );
+    s.durationP99 = duration.percentile( 0.99 );
+    s.durationMax = duration.max.load( std::memory_order_relaxed );
+    return s;
+}
+
+void FrameTracer::reset()
+{
+    for ( int i = 0; i < STAGE_COUNT; ++i )
+    {
+        mLatency[i].reset();
+        mDuration[i].reset();
+        mDropped[i].store( 0, std::memory_order_relaxed );
+    }
+    for ( unsigned i = 0; i <= mMask; ++i )
+    {
+        mEvents[i].sequence.store( 0, std::memory_order_relaxed );
+    }
+    mNextEvent.store( 0, std::memory_order_release );
+}
+
+// Calls fn with a consistent copy of every event in the ring, oldest first.
+template <typename Fn>
+void FrameTracer::forEachEvent( Fn fn ) const
+{
+    const uint64_t next = mNextEvent.load( std::memory_order_acquire );
+    const uint64_t first = next > mMask + 1 ? next - ( mMask + 1 ) : 0;
+
+    for ( uint64_t index = first; index < next; ++index )
+    {
+        const Event& event = mEvents[index & mMask];
+        if ( event.sequence.load( std::memory_order_acquire ) != 2 * index + 2 ) continue;
+
+        Snapshot s;
+        s.start = event.start.load( std::memory_order_relaxed );
+        s.end = event.end.load( std::memory_order_relaxed );
+        s.captureTime = event.captureTime.load( std::memory_order_relaxed );
+        s.requestId = event.requestId.load( std::memory_order_relaxed );
+        s.stage = Stage( event.stage.load( std::memory_order_relaxed ) );
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( event.sequence.load( std::memory_order_relaxed ) != 2 * index + 2 ) continue;
+
+        fn( s );
+    }
+}
+
+bool FrameTracer::writeChromeTrace( const std::string& path ) const
+{
+    std::ofstream out( path );
+    if ( !out ) return false;
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    // Name the per-stage tracks.
+    for ( int i = 0; i < STAGE_COUNT; ++i )
+    {
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i
+            << ",\"args\":{\"name\":\"" << STAGE_NAMES[i] << "\"}},\n";
+    }
+
+    bool first = true;
+    forEachEvent( [&]( const Snapshot& s ) {
+        if ( !first ) out << ",\n";
+        first = false;
+
+        out << "{\"name\":\"" << stageName( s.stage ) << "\",\"pid\":1,\"tid\":"
+            << int( s.stage ) << ",\"ts\":" << s.start / 1000.0;
+        if ( s.end > s.start )
+        {
+            out << ",\"ph\":\"X\",\"dur\":" << ( s.end - s.start ) / 1000.0;
+        }
+        else
+        {
+            out << ",\"ph\":\"i\",\"s\":\"t\"";
+        }
+        out << ",\"args\":{\"captureTime\":" << s.captureTime
+            << ",\"requestId\":" << s.requestId
+            << ",\"latencyUs\":" << ( s.end - s.captureTime ) / 1000.0 << "}}";
+    } );
+
+    out << "\n]}\n";
+    return bool( out );
+}
+
+bool FrameTracer::writeBinaryLog( const std::string& path ) const
+{
+    std::vector<uint8_t> records;
+    records.reserve( size_t( mMask + 1 ) * 32 );
+
+    // The supported targets are little endian, so fields are copied as is.
+    forEachEvent( [&]( const Snapshot& s ) {
+        uint8_t record[32] = { 0 };
+        memcpy( record, &s.start, 8 );
+        memcpy( record + 8, &s.end, 8 );
+        memcpy( record + 16, &s.captureTime, 8 );
+        memcpy( record + 24, &s.requestId, 4 );
+        record[28] = uint8_t( s.stage );
+        records.insert( records.end(), record, record + sizeof(record) );
+    } );
+
+    std::ofstream out( path, std::ofstream::binary );
+    if ( !out ) return false;
+
+    const uint32_t version = 1;
+    const uint32_t count = records.size() / 32;
+    out.write( "FTRC", 4 );
+    out.write( (const char*) &version, 4 );
+    out.write( (const char*) &count, 4 );
+    out.write( (const char*) records.data(), records.size() );
+    return bool( out );
+}
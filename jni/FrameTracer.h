@@ -0,0 +1,173 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef FrameTracer_H
+#define FrameTracer_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*!
+ * Per-frame latency tracing. Each stage a frame goes through records an
+ * event with the frame's captureTime; the tracer keeps per-stage
+ * histograms of the latency since capture and of the stage's own
+ * duration, plus a ring of the most recent events for export.
+ *
+ * Recording is lock-free and allocation-free: an event costs a clock
+ * read and a handful of relaxed atomic operations, so tracing can stay
+ * enabled in production builds.
+ *
+ * Timestamps are nanoseconds on the clock of CameraFrame::captureTime.
+ */
+class FrameTracer
+{
+public:
+
+    enum class Stage : uint8_t
+    {
+        CAPTURE,        //< Start of exposure, as reported by the HAL.
+        DEQUEUE,
+        UPLOAD,
+        DRAW,
+        SAVE_ENQUEUE,
+        SAVE_COMPLETE,
+        COUNT
+    };
+
+    struct StageSummary
+    {
+        uint64_t count = 0;
+        uint64_t dropped = 0;
+
+        // Microseconds since captureTime.
+        int64_t latencyP50 = 0;
+        int64_t latencyP99 = 0;
+        int64_t latencyMax = 0;
+
+        // Microseconds spent in the stage, 0 for instant events.
+        int64_t durationP50 = 0;
+        int64_t durationP99 = 0;
+        int64_t durationMax = 0;
+    };
+
+    // Process-wide tracer keeping the last 16384 events.
+    static FrameTracer& instance();
+
+    explicit FrameTracer( unsigned ringCapacity );
+    ~FrameTracer();
+
+    static int64_t now();
+
+    static const char* stageName( Stage stage );
+
+    void setEnabled( bool enabled )
+    {
+        mEnabled.store( enabled, std::memory_order_relaxed );
+    }
+
+    bool enabled() const
+    {
+        return mEnabled.load( std::memory_order_relaxed );
+    }
+
+    /*!
+     * Records a stage of a frame that started at start and ends now;
+     * pass start = 0 for an instant event.
+     */
+    void record( Stage stage, const nv::camera2::CameraFrame& frame,
+            int64_t start = 0 )
+    {
+        if ( enabled() )
+        {
+            const int64_t end = now();
+            record( stage, frame.captureTime, frame.requestId,
+                    start ? start : end, end );
+        }
+    }
+
+    void record( Stage stage, int64_t captureTime, int32_t requestId,
+            int64_t start, int64_t end );
+
+    // Counts a frame lost at the stage.
+    void recordDrop( Stage stage );
+
+    StageSummary summary( Stage stage ) const;
+
+    // Clears the histograms, counters and the event ring.
+    void reset();
+
+    /*!
+     * Writes the events in the ring as Chrome trace-event JSON, which
+     * chrome://tracing and Perfetto open directly. One track per stage.
+     */
+    bool writeChromeTrace( const std::string& path ) const;
+
+    /*!
+     * Writes the events in the ring as a binary log: the magic "FTRC",
+     * a uint32 version (1) and a uint32 event count, followed by one
+     * 32 byte record per event, all little endian:
+     *   int64 start, int64 end, int64 captureTime, int32 requestId,
+     *   uint8 stage, 3 bytes padding.
+     */
+    bool writeBinaryLog( const std::string& path ) const;
+
+private:
+
+    struct Event;
+    struct Histogram;
+
+    struct Snapshot
+    {
+        int64_t start;
+        int64_t end;
+        int64_t captureTime;
+        int32_t requestId;
+        Stage stage;
+    };
+
+    template <typename Fn>
+    void forEachEvent( Fn fn ) const;
+
+    std::atomic<bool> mEnabled;
+    std::atomic<uint64_t> mNextEvent;
+    std::unique_ptr<Event[]> mEvents;
+    unsigned mMask;
+
+    std::unique_ptr<Histogram[]> mLatency;
+    std::unique_ptr<Histogram[]> mDuration;
+    std::unique_ptr<std::atomic<uint64_t>[]> mDropped;
+};
+
+#endif
@@ -30,96 +30,242 @@
 //----------------------------------------------------------------------------------
 
 #include "ImageSave.h"
+#include "DngWriter.h"
+#include "JpegEncoder.h"
+#include "RawCodec.h"
 
+#include <algorithm>
 #include <fstream>
+#include <vector>
 
 const std::string ImageSave::OUTPUT_DIR = "/mnt/sdcard/native_camera2";
 
-void ImageSave::writePGM( nv::camera2::CameraBuffer &img,
+namespace
+{
+
+std::string& outputDirectory()
+{
+    static std::string dir = ImageSave::OUTPUT_DIR;
+    return dir;
+}
+
+// Bytes written so far to outfile, 0 if any write failed.
+size_t bytesWritten( std::ofstream& outfile )
+{
+    outfile.flush();
+    return outfile ? size_t( outfile.tellp() ) : 0;
+}
+
+/*
+ * Writes width samples of every row, so the stride padding, the other
+ * samples of interleaved chroma and, for a BufferView, the pixels around
+ * it are left out.
+ */
+void writePlane( std::ofstream& outfile,
+        const nv::camera2::CameraBuffer::Data& plane, size_t strideBytes )
+{
+    const size_t sampleBytes = std::max( plane.bytes_per_channel, 1 );
+    const size_t step = std::max( plane.channel_step, 1 );
+    const size_t rowBytes = plane.width * sampleBytes;
+    const char* row = (const char*) plane.ptr;
+
+    if ( step == 1 && strideBytes == rowBytes )
+    {
+        outfile.write( row, rowBytes * plane.height );
+        return;
+    }
+
+    std::vector<char> packed( step == 1 ? 0 : rowBytes );
+    for ( int y = 0; y < plane.height; ++y, row += strideBytes )
+    {
+        if ( step == 1 )
+        {
+            outfile.write( row, rowBytes );
+            continue;
+        }
+        for ( int x = 0; x < plane.width; ++x )
+        {
+            std::copy_n( row + x * step * sampleBytes, sampleBytes,
+                    &packed[x * sampleBytes] );
+        }
+        outfile.write( packed.data(), packed.size() );
+    }
+}
+
+}
+
+void ImageSave::setOutputDir( const std::string& dir )
+{
+    outputDirectory() = dir;
+}
+
+const std::string& ImageSave::outputDir()
+{
+    return outputDirectory();
+}
+
+size_t ImageSave::writePGM( nv::camera2::CameraBuffer &img,
+        const nv::camera2::StaticProperties& properties,
         const std::string& filename )
 {
+    size_t bytes = 0;
 
     if ( img.format() == nv::camera2::YCbCr_420_888 )
     {
-        std::string filenameY = OUTPUT_DIR + "/" + filename + "-Y.pgm";
-        std::string filenameU = OUTPUT_DIR + "/" + filename + "-U.pgm";
-        std::string filenameV = OUTPUT_DIR + "/" + filename + "-V.pgm";
+        std::string filenameY = outputDir() + "/" + filename + "-Y.pgm";
+        std::string filenameU = outputDir() + "/" + filename + "-U.pgm";
+        std::string filenameV = outputDir() + "/" + filename + "-V.pgm";
 
         std::ofstream outfile( filenameY, std::ofstream::binary );
 
         nv::camera2::CameraBuffer::Data imgPlane;
 
         imgPlane = img.data(0);
-        outfile << "P5 " << imgPlane.stride << " ";
+        outfile << "P5 " << imgPlane.width << " ";
         outfile << imgPlane.height << " " << 255 << std::endl;
-        outfile.write( (char* ) imgPlane.ptr,
-                imgPlane.stride * imgPlane.height );
+        writePlane( outfile, imgPlane, imgPlane.stride );
 
+        bytes += bytesWritten( outfile );
         outfile.close();
         outfile.open( filenameU, std::ofstream::binary );
 
         imgPlane = img.data(1);
-        outfile << "P5 " << imgPlane.stride << " ";
+        outfile << "P5 " << imgPlane.width << " ";
         outfile << imgPlane.height << " " << 255 << std::endl;
-        outfile.write( (char* ) imgPlane.ptr,
-                imgPlane.stride * imgPlane.height );
+        writePlane( outfile, imgPlane, imgPlane.stride );
 
+        bytes += bytesWritten( outfile );
         outfile.close();
         outfile.open( filenameV, std::ofstream::binary );
 
         imgPlane = img.data(2);
-        outfile << "P5 " << imgPlane.stride << " ";
+        outfile << "P5 " << imgPlane.width << " ";
         outfile << imgPlane.height << " " << 255 << std::endl;
-        outfile.write( (char* ) imgPlane.ptr,
-                imgPlane.stride * imgPlane.height );
+        writePlane( outfile, imgPlane, imgPlane.stride );
+
+        bytes += bytesWritten( outfile );
         outfile.close();
     }
     else if( img.format() == nv::camera2::RAW16 )
     {
-        std::string filepath = OUTPUT_DIR + "/" + filename + ".pgm";
+        std::string filepath = outputDir() + "/" + filename + ".pgm";
         std::ofstream outfile( filepath, std::ofstream::binary );
 
         nv::camera2::CameraBuffer::Data imgPlane;
 
+        // 16 bit PGM samples are big-endian and at most maxval, the
+        // white level if the camera reports one.
+        const int32_t whiteLevel = properties.sensor.whiteLevel;
+        const uint16_t maxval = whiteLevel > 0 ?
+                uint16_t( std::min( whiteLevel, 65535 ) ) : 65535;
+
+        // RAW16 strides are in pixels.
         imgPlane = img.data(0);
-        outfile << "P5 " << imgPlane.stride << " ";
-        outfile << imgPlane.height << " " << 16384 << std::endl;
-        outfile.write( (char* ) imgPlane.ptr,
-                imgPlane.stride * imgPlane.height * 2 );
+        outfile << "P5 " << imgPlane.width << " ";
+        outfile << imgPlane.height << " " << maxval << std::endl;
 
+        std::vector<uint8_t> row( size_t(imgPlane.width) * 2 );
+        for ( int y = 0; y < imgPlane.height; ++y )
+        {
+            const uint16_t* in = (const uint16_t*) imgPlane.ptr +
+                    size_t(y) * imgPlane.stride;
+            for ( int x = 0; x < imgPlane.width; ++x )
+            {
+                const uint16_t v = std::min( in[x], maxval );
+                row[2 * x] = uint8_t( v >> 8 );
+                row[2 * x + 1] = uint8_t( v );
+            }
+            outfile.write( (const char*) row.data(), row.size() );
+        }
+
+        bytes += bytesWritten( outfile );
         outfile.close();
 
     }
+
+    return bytes;
 }
 
-void ImageSave::writeJPG( nv::camera2::CameraBuffer &img,
-        const std::string& filename )
+size_t ImageSave::writeJPG( nv::camera2::CameraBuffer &img,
+        JpegEncoder& encoder, const std::string& filename )
 {
 
     if ( img.format() == nv::camera2::JPEG )
     {
-        std::string filepath = OUTPUT_DIR + "/" + filename + ".jpg";
+        std::string filepath = outputDir() + "/" + filename + ".jpg";
         std::ofstream outfile( filepath, std::ofstream::binary );
 
         nv::camera2::CameraBuffer::Data imgPlane;
         imgPlane = img.data(0);
         outfile.write( (char* ) imgPlane.ptr,
                 imgPlane.stride  );
+
+        return bytesWritten( outfile );
     }
+    else if ( img.format() == nv::camera2::YCbCr_420_888 )
+    {
+        std::vector<uint8_t> jpeg;
+        if ( !encoder.encode( img, jpeg ) ) return 0;
+
+        std::string filepath = outputDir() + "/" + filename + ".jpg";
+        std::ofstream outfile( filepath, std::ofstream::binary );
+        outfile.write( (char* ) jpeg.data(), jpeg.size() );
+
+        return bytesWritten( outfile );
+    }
+
+    return 0;
 }
 
-void ImageSave::writeRAW( nv::camera2::CameraBuffer &img,
+size_t ImageSave::writeRAW( nv::camera2::CameraBuffer &img,
         const std::string& filename )
 {
     if ( img.format() == nv::camera2::RAW16 )
     {
-        std::string filepath = OUTPUT_DIR + "/" + filename + ".raw";
+        std::string filepath = outputDir() + "/" + filename + ".raw";
         std::ofstream outfile( filepath, std::ofstream::binary );
 
         nv::camera2::CameraBuffer::Data imgPlane;
         imgPlane = img.data(0);
-        outfile.write( (char* ) imgPlane.ptr,
-                imgPlane.stride * imgPlane.height * 2 );
+        writePlane( outfile, imgPlane, size_t(imgPlane.stride) * 2 );
+
+        return bytesWritten( outfile );
     }
+
+    return 0;
+}
+
+size_t ImageSave::writeDNG( const nv::camera2::CameraFrame &frame,
+        const nv::camera2::StaticProperties& properties,
+        const std::string& filename )
+{
+    DngWriter::Options options;
+    options.compression = DngWriter::Compression::LOSSLESS_JPEG;
+
+    DngWriter writer( properties, options );
+    if ( writer.write( frame, outputDir() + "/" + filename + ".dng" ) )
+    {
+        return writer.lastStats().bytes;
+    }
+
+    return 0;
+}
+
+size_t ImageSave::writeNVRAW( const nv::camera2::CameraFrame &frame,
+        const nv::camera2::StaticProperties& properties,
+        const std::string& filename, bool lossless )
+{
+    RawCodec::Options options;
+    options.mode = lossless ? RawCodec::Mode::LOSSLESS : RawCodec::Mode::PACKED;
+
+    RawCodec codec( properties, options );
+    std::vector<uint8_t> data;
+    if ( !codec.encode( frame, data ) ) return 0;
+
+    std::string filepath = outputDir() + "/" + filename + ".nvraw";
+    std::ofstream outfile( filepath, std::ofstream::binary );
+    outfile.write( (const char*) data.data(), data.size() );
+
+    return bytesWritten( outfile );
 }
 
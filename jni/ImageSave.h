@@ -33,20 +33,49 @@
 
 #include <string>
 
+class JpegEncoder;
+
+/*
+ * The writers return the number of bytes written to disk, 0 if the
+ * buffer format is not supported or the file could not be written.
+ * Buffer writers take a BufferView as well and write only its pixels.
+ */
 class ImageSave
 {
 public:
 
-    static void writePGM( nv::camera2::CameraBuffer &img,
+    // RAW16 samples go up to the sensor's white level, big-endian.
+    static size_t writePGM( nv::camera2::CameraBuffer &img,
+            const nv::camera2::StaticProperties& properties,
             const std::string& filename);
 
-    static void writeJPG( nv::camera2::CameraBuffer &img,
+    // YCbCr_420_888 buffers are compressed by encoder; use one per thread.
+    static size_t writeJPG( nv::camera2::CameraBuffer &img,
+            JpegEncoder& encoder, const std::string& filename);
+
+    static size_t writeRAW( nv::camera2::CameraBuffer &img,
             const std::string& filename);
 
-    static void writeRAW( nv::camera2::CameraBuffer &img,
+    // Tiled, lossless JPEG compressed DNG of a RAW16 frame.
+    static size_t writeDNG( const nv::camera2::CameraFrame &frame,
+            const nv::camera2::StaticProperties& properties,
             const std::string& filename);
 
+    // RAW16 frame at the sensor's bit depth with RawCodec, ".nvraw".
+    static size_t writeNVRAW( const nv::camera2::CameraFrame &frame,
+            const nv::camera2::StaticProperties& properties,
+            const std::string& filename, bool lossless );
+
+    // Default directory of the files.
     static const std::string OUTPUT_DIR;
+
+    /*!
+     * Directory the writers put their files in, OUTPUT_DIR unless set.
+     * Set it before any writer runs; benches point it at a scratch
+     * directory.
+     */
+    static void setOutputDir( const std::string& dir );
+    static const std::string& outputDir();
 };
 
 
@@ -0,0 +1,382 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "JpegEncoder.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csetjmp>
+#include <cstdio>
+#include <cstring>
+
+extern "C"
+{
+#include "jpeglib.h"
+}
+
+using namespace nv::camera2;
+
+namespace
+{
+
+constexpr int MCU_ROWS = 16;            // Image rows per MCU row for 4:2:0.
+constexpr int MCU_COLUMNS = 16;
+constexpr size_t INITIAL_OUTPUT_SIZE = 64 * 1024;
+
+// libjpeg reports fatal errors through error_exit, which must not return.
+struct ErrorManager
+{
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+void errorExit( j_common_ptr cinfo )
+{
+    longjmp( reinterpret_cast<ErrorManager*>( cinfo->err )->jump, 1 );
+}
+
+void outputMessage( j_common_ptr ) {}
+
+// Compresses into a std::vector that keeps its capacity between frames.
+struct DestinationManager
+{
+    jpeg_destination_mgr pub;
+    std::vector<uint8_t>* out;
+};
+
+void initDestination( j_compress_ptr cinfo )
+{
+    DestinationManager* dest = reinterpret_cast<DestinationManager*>( cinfo->dest );
+    dest->out->resize( std::max( dest->out->capacity(), INITIAL_OUTPUT_SIZE ) );
+    dest->pub.next_output_byte = dest->out->data();
+    dest->pub.free_in_buffer = dest->out->size();
+}
+
+boolean emptyOutputBuffer( j_compress_ptr cinfo )
+{
+    DestinationManager* dest = reinterpret_cast<DestinationManager*>( cinfo->dest );
+    const size_t used = dest->out->size();
+    dest->out->resize( used * 2 );
+    dest->pub.next_output_byte = dest->out->data() + used;
+    dest->pub.free_in_buffer = dest->out->size() - used;
+    return TRUE;
+}
+
+void termDestination( j_compress_ptr cinfo )
+{
+    DestinationManager* dest = reinterpret_cast<DestinationManager*>( cinfo->dest );
+    dest->out->resize( dest->out->size() - dest->pub.free_in_buffer );
+}
+
+inline int alignUp( int value, int alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+/*
+ * Locates the SOF and SOS segments of a JPEG stream. Returns false if the
+ * stream does not look like the output of libjpeg.
+ */
+bool findSegments( const std::vector<uint8_t>& jpeg, size_t& sof,
+        size_t& sos, size_t& scanData )
+{
+    sof = 0;
+    size_t pos = 2;
+    while ( pos + 4 <= jpeg.size() && jpeg[pos] == 0xff )
+    {
+        const uint8_t marker = jpeg[pos + 1];
+        const size_t length = ( jpeg[pos + 2] << 8 ) | jpeg[pos + 3];
+
+        if ( marker == 0xc0 || marker == 0xc1 )
+        {
+            sof = pos;
+        }
+        else if ( marker == 0xda )
+        {
+            sos = pos;
+            scanData = pos + 2 + length;
+            return sof != 0 && scanData + 2 <= jpeg.size();
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+}
+
+struct JpegEncoder::Strip
+{
+    jpeg_compress_struct cinfo;
+    ErrorManager err;
+    DestinationManager dest;
+
+    std::vector<uint8_t> output;
+    std::vector<uint8_t> scratch;
+    bool ok = false;
+
+    Strip()
+    {
+        cinfo.err = jpeg_std_error( &err.pub );
+        err.pub.error_exit = errorExit;
+        err.pub.output_message = outputMessage;
+        jpeg_create_compress( &cinfo );
+
+        dest.pub.init_destination = initDestination;
+        dest.pub.empty_output_buffer = emptyOutputBuffer;
+        dest.pub.term_destination = termDestination;
+        dest.out = &output;
+        cinfo.dest = &dest.pub;
+    }
+
+    ~Strip()
+    {
+        jpeg_destroy_compress( &cinfo );
+    }
+
+    // Returns a row that libjpeg can read rowWidth samples from, copying
+    // it into scratch when the plane does not have that many.
+    JSAMPROW row( const CameraBuffer::Data& plane, int y, int rowWidth,
+            uint8_t* scratchRow )
+    {
+        y = std::min( y, plane.height - 1 );
+        const uint8_t* src = (const uint8_t*) plane.ptr + size_t(y) * plane.stride;
+        const int step = std::max( plane.channel_step, 1 );
+
+        // Stride padding may be read, but not past the end of the plane.
+        if ( step == 1 && ( rowWidth == plane.width ||
+             ( plane.stride >= rowWidth && y < plane.height - 1 ) ) )
+        {
+            return const_cast<JSAMPROW>( src );
+        }
+
+        for ( int x = 0; x < plane.width; ++x )
+        {
+            scratchRow[x] = src[x * step];
+        }
+        std::fill( scratchRow + plane.width, scratchRow + rowWidth,
+                scratchRow[plane.width - 1] );
+        return scratchRow;
+    }
+
+    bool encode( const CameraBuffer::Data* planes, int rowBegin, int rowEnd,
+            int quality )
+    {
+        ok = false;
+
+        const int width = planes[0].width;
+        const int yRowWidth = alignUp( width, 8 );
+        const int cRowWidth = alignUp( planes[1].width, 8 );
+
+        scratch.resize( MCU_ROWS * yRowWidth + MCU_ROWS * cRowWidth );
+        uint8_t* yScratch = scratch.data();
+        uint8_t* uScratch = yScratch + MCU_ROWS * yRowWidth;
+        uint8_t* vScratch = uScratch + MCU_ROWS / 2 * cRowWidth;
+
+        if ( setjmp( err.jump ) )
+        {
+            jpeg_abort_compress( &cinfo );
+            return false;
+        }
+
+        cinfo.image_width = width;
+        cinfo.image_height = rowEnd - rowBegin;
+        cinfo.input_components = 3;
+        cinfo.in_color_space = JCS_YCbCr;
+        jpeg_set_defaults( &cinfo );
+        jpeg_set_colorspace( &cinfo, JCS_YCbCr );
+        jpeg_set_quality( &cinfo, quality, TRUE );
+
+        cinfo.raw_data_in = TRUE;
+#if JPEG_LIB_VERSION >= 70
+        cinfo.do_fancy_downsampling = FALSE;
+#endif
+        cinfo.dct_method = JDCT_IFAST;
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 2;
+        cinfo.comp_info[1].h_samp_factor = 1;
+        cinfo.comp_info[1].v_samp_factor = 1;
+        cinfo.comp_info[2].h_samp_factor = 1;
+        cinfo.comp_info[2].v_samp_factor = 1;
+
+        // Every strip must produce identical tables.
+        jpeg_start_compress( &cinfo, TRUE );
+
+        JSAMPROW yRows[MCU_ROWS];
+        JSAMPROW uRows[MCU_ROWS / 2];
+        JSAMPROW vRows[MCU_ROWS / 2];
+        JSAMPARRAY data[3] = { yRows, uRows, vRows };
+
+        // Rows below the strip are padding, replicate its last row.
+        const int yLast = rowEnd - 1;
+        const int cLast = ( rowEnd - 1 ) / 2;
+
+        for ( int y = rowBegin; y < rowEnd; y += MCU_ROWS )
+        {
+            for ( int i = 0; i < MCU_ROWS; ++i )
+            {
+                yRows[i] = row( planes[0], std::min( y + i, yLast ), yRowWidth,
+                        yScratch + i * yRowWidth );
+            }
+            for ( int i = 0; i < MCU_ROWS / 2; ++i )
+            {
+                const int cy = std::min( y / 2 + i, cLast );
+                uRows[i] = row( planes[1], cy, cRowWidth, uScratch + i * cRowWidth );
+                vRows[i] = row( planes[2], cy, cRowWidth, vScratch + i * cRowWidth );
+            }
+            jpeg_write_raw_data( &cinfo, data, MCU_ROWS );
+        }
+
+        jpeg_finish_compress( &cinfo );
+        ok = true;
+        return true;
+    }
+};
+
+JpegEncoder::JpegEncoder() :
+    JpegEncoder( Options() ) {}
+
+JpegEncoder::JpegEncoder( const Options& options ) :
+    mOptions(options) {}
+
+JpegEncoder::~JpegEncoder() = default;
+
+bool JpegEncoder::encode( CameraBuffer& img, std::vector<uint8_t>& out )
+{
+    if ( img.format() != YCbCr_420_888 || img.numberOfPlanes() < 3 )
+    {
+        return false;
+    }
+
+    const CameraBuffer::Data planes[3] = { img.data(0), img.data(1), img.data(2) };
+    return encode( planes, out );
+}
+
+bool JpegEncoder::encode( const CameraBuffer::Data* planes,
+        std::vector<uint8_t>& out )
+{
+    const auto start = std::chrono::steady_clock::now();
+    mStats = Stats();
+
+    const int width = planes[0].width;
+    const int height = planes[0].height;
+    if ( width <= 0 || height <= 0 || planes[0].bytes_per_channel != 1 ||
+         planes[1].bytes_per_channel != 1 || planes[2].bytes_per_channel != 1 )
+    {
+        return false;
+    }
+
+    ThreadPool& pool = ThreadPool::instance();
+    const unsigned threads = mOptions.maxThreads ?
+            std::min( mOptions.maxThreads, pool.concurrency() ) :
+            pool.concurrency();
+
+    // A restart interval is limited to 65535 MCUs.
+    const unsigned mcusPerRow = ( width + MCU_COLUMNS - 1 ) / MCU_COLUMNS;
+    const unsigned mcuRows = ( height + MCU_ROWS - 1 ) / MCU_ROWS;
+    unsigned rowsPerStrip = mOptions.mcuRowsPerStrip ?
+            mOptions.mcuRowsPerStrip : ( mcuRows + threads - 1 ) / threads;
+    rowsPerStrip = std::max( 1u, std::min( rowsPerStrip, 65535u / mcusPerRow ) );
+
+    const unsigned numStrips = ( mcuRows + rowsPerStrip - 1 ) / rowsPerStrip;
+    while ( mStrips.size() < numStrips )
+    {
+        mStrips.push_back( std::unique_ptr<Strip>( new Strip ) );
+    }
+
+    const int quality = mOptions.quality;
+    pool.parallelFor( numStrips, [&]( unsigned i ) {
+        const int rowBegin = i * rowsPerStrip * MCU_ROWS;
+        const int rowEnd = std::min<int>( height, rowBegin + rowsPerStrip * MCU_ROWS );
+        mStrips[i]->encode( planes, rowBegin, rowEnd, quality );
+    }, threads );
+
+    for ( unsigned i = 0; i < numStrips; ++i )
+    {
+        if ( !mStrips[i]->ok ) return false;
+    }
+
+    if ( numStrips == 1 )
+    {
+        out.assign( mStrips[0]->output.begin(), mStrips[0]->output.end() );
+    }
+    else
+    {
+        // Header of the first strip, with the full image height and a
+        // restart interval of one strip.
+        const std::vector<uint8_t>& first = mStrips[0]->output;
+        size_t sof, sos, scanData;
+        if ( !findSegments( first, sof, sos, scanData ) ) return false;
+
+        size_t total = scanData + 6 + 2 * numStrips;
+        for ( unsigned i = 0; i < numStrips; ++i )
+        {
+            total += mStrips[i]->output.size();
+        }
+        out.clear();
+        out.reserve( total );
+
+        out.insert( out.end(), first.begin(), first.begin() + sos );
+        out[sof + 5] = height >> 8;
+        out[sof + 6] = height & 0xff;
+
+        const unsigned interval = rowsPerStrip * mcusPerRow;
+        const uint8_t dri[6] = { 0xff, 0xdd, 0x00, 0x04,
+                uint8_t( interval >> 8 ), uint8_t( interval & 0xff ) };
+        out.insert( out.end(), dri, dri + sizeof(dri) );
+        out.insert( out.end(), first.begin() + sos, first.begin() + scanData );
+
+        for ( unsigned i = 0; i < numStrips; ++i )
+        {
+            const std::vector<uint8_t>& strip = mStrips[i]->output;
+            size_t stripSof, stripSos, stripData;
+            if ( !findSegments( strip, stripSof, stripSos, stripData ) ) return false;
+
+            // Entropy coded data, without the trailing EOI.
+            out.insert( out.end(), strip.begin() + stripData, strip.end() - 2 );
+
+            if ( i + 1 < numStrips )
+            {
+                out.push_back( 0xff );
+                out.push_back( 0xd0 + ( i & 7 ) );
+            }
+        }
+
+        out.push_back( 0xff );
+        out.push_back( 0xd9 );
+    }
+
+    mStats.strips = numStrips;
+    mStats.bytes = out.size();
+    mStats.encodeTimeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+    return true;
+}
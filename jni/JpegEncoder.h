@@ -0,0 +1,109 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef JpegEncoder_H
+#define JpegEncoder_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*!
+ * Encodes YCbCr_420_888 frames to baseline JPEG with the bundled libjpeg.
+ *
+ * The planes are fed to libjpeg's raw data interface, so there is no RGB
+ * round trip and rows are read in place at their stride; only semi-planar
+ * chroma and rows at the image edges go through a small scratch buffer.
+ *
+ * The frame is cut into strips of whole MCU rows that are compressed in
+ * parallel on the ThreadPool, each by its own libjpeg instance. Every
+ * strip starts with fresh DC predictors, exactly like a restart interval,
+ * so the strips' entropy coded data is stitched into a single image with
+ * a DRI marker and RSTn markers between strips.
+ *
+ * An encoder keeps its libjpeg instances and buffers between frames; use
+ * one encoder per thread.
+ */
+class JpegEncoder
+{
+public:
+
+    struct Options
+    {
+        int quality = 90;
+
+        // MCU rows (16 image rows) per strip, 0 to spread the frame evenly
+        // over the ThreadPool.
+        unsigned mcuRowsPerStrip = 0;
+
+        // Threads of the ThreadPool to use, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    struct Stats
+    {
+        int64_t encodeTimeUs = 0;
+        unsigned strips = 0;
+        size_t bytes = 0;
+    };
+
+    JpegEncoder();
+    explicit JpegEncoder( const Options& options );
+    ~JpegEncoder();
+
+    /*!
+     * Encodes the buffer into out, replacing its content. out keeps its
+     * capacity, so reusing it avoids allocating per frame. Returns false
+     * if the buffer is not YCbCr_420_888 or libjpeg reports an error.
+     */
+    bool encode( nv::camera2::CameraBuffer& img, std::vector<uint8_t>& out );
+
+    bool encode( const nv::camera2::CameraBuffer::Data* planes,
+            std::vector<uint8_t>& out );
+
+    // Statistics of the last encode() call.
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    struct Strip;
+
+    Options mOptions;
+    Stats mStats;
+    std::vector< std::unique_ptr<Strip> > mStrips;
+};
+
+#endif
@@ -0,0 +1,244 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef LockFreeQueue_H
+#define LockFreeQueue_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace LockFreeQueueDetail
+{
+
+// Keeps the producer and consumer indices on separate cache lines.
+constexpr size_t CACHE_LINE = 64;
+
+inline size_t roundUpToPowerOfTwo( size_t n )
+{
+    size_t p = 1;
+    while ( p < n ) p <<= 1;
+    return p;
+}
+
+}
+
+/*!
+ * Bounded single producer, single consumer queue. tryPush() may only be
+ * called from one thread and tryPop() from one other thread at a time.
+ * The capacity is rounded up to a power of two. A failed tryPush() leaves
+ * the value untouched.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+
+    explicit SpscQueue( size_t capacity ) :
+        mSlots( LockFreeQueueDetail::roundUpToPowerOfTwo( capacity ) ),
+        mMask( mSlots.size() - 1 ),
+        mHead(0),
+        mTail(0)
+    {
+    }
+
+    bool tryPush( T&& value )
+    {
+        const size_t tail = mTail.load( std::memory_order_relaxed );
+        if ( tail - mHead.load( std::memory_order_acquire ) == mSlots.size() )
+        {
+            return false;
+        }
+        mSlots[tail & mMask] = std::move( value );
+        mTail.store( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    bool tryPop( T& value )
+    {
+        const size_t head = mHead.load( std::memory_order_relaxed );
+        if ( head == mTail.load( std::memory_order_acquire ) )
+        {
+            return false;
+        }
+        value = std::move( mSlots[head & mMask] );
+        mHead.store( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Only a snapshot while the other side is running.
+    size_t size() const
+    {
+        return mTail.load( std::memory_order_acquire ) -
+               mHead.load( std::memory_order_acquire );
+    }
+
+    size_t capacity() const
+    {
+        return mSlots.size();
+    }
+
+private:
+
+    std::vector<T> mSlots;
+    const size_t mMask;
+
+    char mPad0[LockFreeQueueDetail::CACHE_LINE];
+    std::atomic<size_t> mHead;
+    char mPad1[LockFreeQueueDetail::CACHE_LINE];
+    std::atomic<size_t> mTail;
+    char mPad2[LockFreeQueueDetail::CACHE_LINE];
+};
+
+/*!
+ * Bounded multiple producer, multiple consumer queue. Every cell carries
+ * a sequence number telling producers and consumers whose turn it is, so
+ * each operation is a single compare and swap on the uncontended path.
+ * The capacity is rounded up to a power of two. A failed tryPush() leaves
+ * the value untouched.
+ */
+template <typename T>
+class MpmcQueue
+{
+public:
+
+    explicit MpmcQueue( size_t capacity ) :
+        mCapacity( LockFreeQueueDetail::roundUpToPowerOfTwo(
+                std::max<size_t>( capacity, 2 ) ) ),
+        mMask( mCapacity - 1 ),
+        mCells( new Cell[mCapacity] ),
+        mEnqueuePos(0),
+        mDequeuePos(0)
+    {
+        for ( size_t i = 0; i < mCapacity; ++i )
+        {
+            mCells[i].sequence.store( i, std::memory_order_relaxed );
+        }
+    }
+
+    bool tryPush( T&& value )
+    {
+        size_t pos = mEnqueuePos.load( std::memory_order_relaxed );
+        Cell* cell;
+        for (;;)
+        {
+            cell = &mCells[pos & mMask];
+            const size_t seq = cell->sequence.load( std::memory_order_acquire );
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if ( diff == 0 )
+            {
+                if ( mEnqueuePos.compare_exchange_weak( pos, pos + 1,
+                        std::memory_order_relaxed ) )
+                {
+                    break;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = mEnqueuePos.load( std::memory_order_relaxed );
+            }
+        }
+        cell->value = std::move( value );
+        cell->sequence.store( pos + 1, std::memory_order_release );
+        return true;
+    }
+
+    bool tryPop( T& value )
+    {
+        size_t pos = mDequeuePos.load( std::memory_order_relaxed );
+        Cell* cell;
+        for (;;)
+        {
+            cell = &mCells[pos & mMask];
+            const size_t seq = cell->sequence.load( std::memory_order_acquire );
+            const intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+            if ( diff == 0 )
+            {
+                if ( mDequeuePos.compare_exchange_weak( pos, pos + 1,
+                        std::memory_order_relaxed ) )
+                {
+                    break;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                return false;
+            }
+            else
+            {
+                pos = mDequeuePos.load( std::memory_order_relaxed );
+            }
+        }
+        value = std::move( cell->value );
+        cell->sequence.store( pos + mCapacity, std::memory_order_release );
+        return true;
+    }
+
+    // Only a snapshot while other threads are running.
+    size_t size() const
+    {
+        const size_t enqueued = mEnqueuePos.load( std::memory_order_acquire );
+        const size_t dequeued = mDequeuePos.load( std::memory_order_acquire );
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+private:
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mCapacity;
+    const size_t mMask;
+    std::unique_ptr<Cell[]> mCells;
+
+    char mPad0[LockFreeQueueDetail::CACHE_LINE];
+    std::atomic<size_t> mEnqueuePos;
+    char mPad1[LockFreeQueueDetail::CACHE_LINE];
+    std::atomic<size_t> mDequeuePos;
+    char mPad2[LockFreeQueueDetail::CACHE_LINE];
+};
+
+#endif
@@ -0,0 +1,573 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "MetadataJournal.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+constexpr uint64_t PAGE = 4096;
+
+const char MAGIC[8] = { 'N', 'V', 'C', 'A', 'M', 'M', 'D', 'J' };
+constexpr uint32_t VERSION = 1;
+
+/*
+ * First page of the file. The counters are on cache lines of their own,
+ * as every append() changes them. On disk as is, little endian.
+ */
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint64_t capacity;
+    uint64_t sideOffset;        //< File offset of the statistics ring.
+    uint64_t sideBytes;
+    uint8_t reserved0[24];
+
+    std::atomic<uint64_t> nextSequence;
+    uint8_t reserved1[56];
+
+    // Bytes ever reserved in the statistics ring; the ring position is
+    // this modulo sideBytes.
+    std::atomic<uint64_t> sideCursor;
+};
+
+// RequestSettings with fixed sizes.
+struct Settings
+{
+    int64_t exposure;
+    int64_t frameDuration;
+    int32_t sensitivity;
+    float aeExposureCompensation;
+    float focusDistance;
+    uint8_t intent;
+    uint8_t controlMode;
+    uint8_t aeMode;
+    uint8_t afMode;
+    uint8_t awbMode;
+    uint8_t flashMode;
+    uint8_t aePrecaptureTrigger;
+    uint8_t afTrigger;
+    uint8_t flags;
+    uint8_t reserved[3];
+};
+
+enum SettingsFlags
+{
+    AE_LOCK             = 1 << 0,
+    AWB_LOCK            = 1 << 1,
+    FACE_DETECTION      = 1 << 2,
+    HISTOGRAM           = 1 << 3,
+    SHARPNESS_MAP       = 1 << 4
+};
+
+enum RecordFlags
+{
+    STREAMING           = 1 << 0,
+    STATISTICS_DROPPED  = 1 << 1
+};
+
+struct Record
+{
+    int64_t captureTime;
+    uint64_t sideStart;         //< sideCursor at the statistics.
+    int32_t requestId;
+    uint16_t stream;
+    uint16_t histogramBuckets;
+    uint32_t histogramValues;
+    uint32_t sharpnessValues;
+    uint8_t flags;
+    uint8_t aeState;
+    uint8_t afState;
+    uint8_t awbState;
+    uint8_t reserved[4];
+    Settings requestSettings;
+    Settings resultSettings;
+};
+
+/*
+ * A ring slot, written like a seqlock: sequence is odd while the record
+ * is being written and 2 * sequence + 2 once it is complete. The record
+ * itself is plain memory, as it is shared through the file.
+ */
+struct Slot
+{
+    std::atomic<uint64_t> sequence;
+    Record record;
+};
+
+static_assert( sizeof(Header) <= PAGE, "journal header exceeds a page" );
+static_assert( sizeof(Slot) == 128, "journal slots are two per 256 bytes" );
+
+uint64_t fileSize( const MetadataJournal::Options& options, uint64_t& capacity,
+        uint64_t& sideOffset )
+{
+    capacity = 1;
+    while ( capacity < std::max( options.capacity, 1u ) ) capacity <<= 1;
+    sideOffset = ( PAGE + capacity * sizeof(Slot) + PAGE - 1 ) & ~( PAGE - 1 );
+    return sideOffset + options.sideBytes;
+}
+
+void encode( const RequestSettings& in, Settings& out )
+{
+    memset( &out, 0, sizeof(out) );
+    out.exposure = in.sensor.exposure;
+    out.frameDuration = in.sensor.frameDuration;
+    out.sensitivity = in.sensor.sensitivity;
+    out.aeExposureCompensation = in.control.aeExposureCompensation;
+    out.focusDistance = in.lens.focusDistance;
+    out.intent = uint8_t( in.intent );
+    out.controlMode = uint8_t( in.control.mode );
+    out.aeMode = uint8_t( in.control.aeMode );
+    out.afMode = uint8_t( in.control.afMode );
+    out.awbMode = uint8_t( in.control.awbMode );
+    out.flashMode = uint8_t( in.flash.mode );
+    out.aePrecaptureTrigger = uint8_t( in.triggers.aePrecaptureTrigger );
+    out.afTrigger = uint8_t( in.triggers.afTrigger );
+    out.flags = ( in.control.aeLock ? AE_LOCK : 0 ) |
+                ( in.control.awbLock ? AWB_LOCK : 0 ) |
+                ( in.statistics.enableFaceDetection ? FACE_DETECTION : 0 ) |
+                ( in.statistics.enableHistogram ? HISTOGRAM : 0 ) |
+                ( in.statistics.enableSharpnessMap ? SHARPNESS_MAP : 0 );
+}
+
+void decode( const Settings& in, RequestSettings& out )
+{
+    out.sensor.exposure = in.exposure;
+    out.sensor.frameDuration = in.frameDuration;
+    out.sensor.sensitivity = in.sensitivity;
+    out.control.aeExposureCompensation = in.aeExposureCompensation;
+    out.lens.focusDistance = in.focusDistance;
+    out.intent = CAPTURE_INTENT( in.intent );
+    out.control.mode = CONTROL_MODE( in.controlMode );
+    out.control.aeMode = AE_MODE( in.aeMode );
+    out.control.afMode = AF_MODE( in.afMode );
+    out.control.awbMode = AWB_MODE( in.awbMode );
+    out.flash.mode = FLASH_MODE( in.flashMode );
+    out.triggers.aePrecaptureTrigger = AE_TRIGGER( in.aePrecaptureTrigger );
+    out.triggers.afTrigger = AF_TRIGGER( in.afTrigger );
+    out.control.aeLock = ( in.flags & AE_LOCK ) != 0;
+    out.control.awbLock = ( in.flags & AWB_LOCK ) != 0;
+    out.statistics.enableFaceDetection = ( in.flags & FACE_DETECTION ) != 0;
+    out.statistics.enableHistogram = ( in.flags & HISTOGRAM ) != 0;
+    out.statistics.enableSharpnessMap = ( in.flags & SHARPNESS_MAP ) != 0;
+}
+
+}
+
+MetadataJournal::MetadataJournal( const Options& options ) :
+    mOptions(options),
+    mRecords(0),
+    mStatisticsBytes(0),
+    mStatisticsDropped(0),
+    mFramesDropped(0)
+{
+    // Statistics are written in whole words.
+    mOptions.sideBytes &= ~uint64_t(7);
+}
+
+MetadataJournal::~MetadataJournal()
+{
+    close();
+}
+
+bool MetadataJournal::open( const std::string& path )
+{
+    close();
+
+    uint64_t capacity = 0;
+    uint64_t sideOffset = 0;
+    const uint64_t size = fileSize( mOptions, capacity, sideOffset );
+    if ( size != size_t( size ) ) return false;
+
+    const int fd = ::open( path.c_str(), O_RDWR | O_CREAT, 0644 );
+    if ( fd < 0 ) return false;
+
+    // Continue a journal of the same layout.
+    Header existing;
+    struct stat st;
+    const bool matches = fstat( fd, &st ) == 0 && uint64_t( st.st_size ) == size &&
+            pread( fd, &existing, sizeof(existing), 0 ) == ssize_t( sizeof(existing) ) &&
+            memcmp( existing.magic, MAGIC, sizeof(MAGIC) ) == 0 &&
+            existing.version == VERSION &&
+            existing.slotSize == sizeof(Slot) &&
+            existing.capacity == capacity &&
+            existing.sideOffset == sideOffset &&
+            existing.sideBytes == mOptions.sideBytes;
+
+    if ( !matches )
+    {
+        if ( ftruncate64( fd, 0 ) != 0 || ftruncate64( fd, size ) != 0 )
+        {
+            ::close( fd );
+            return false;
+        }
+    }
+
+    // Stores to a hole of a full file system would fault, so the blocks are
+    // allocated up front. Not supported by every file system.
+    fallocate64( fd, 0, 0, size );
+
+    void* base = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( base == MAP_FAILED ) return false;
+
+    mBase = (uint8_t*) base;
+    mSize = size;
+
+    // The file is zero filled, so the slots are empty; the magic goes last.
+    if ( !matches )
+    {
+        Header& header = *(Header*) mBase;
+        header.version = VERSION;
+        header.slotSize = sizeof(Slot);
+        header.capacity = capacity;
+        header.sideOffset = sideOffset;
+        header.sideBytes = mOptions.sideBytes;
+        header.nextSequence.store( 0, std::memory_order_relaxed );
+        header.sideCursor.store( 0, std::memory_order_relaxed );
+        std::atomic_thread_fence( std::memory_order_release );
+        memcpy( header.magic, MAGIC, sizeof(MAGIC) );
+    }
+
+    mRecords = 0;
+    mStatisticsBytes = 0;
+    mStatisticsDropped = 0;
+    mFramesDropped = 0;
+    return true;
+}
+
+bool MetadataJournal::append( const CameraFrame& frame, uint16_t stream )
+{
+    return append( frame, stream, frame.statistics );
+}
+
+bool MetadataJournal::append( const CameraFrame& frame, uint16_t stream,
+        const Statistics& statistics )
+{
+    if ( !mBase ) return false;
+
+    Header& header = *(Header*) mBase;
+    const uint64_t sideBytes = header.sideBytes;
+
+    const uint32_t histogramValues = statistics.histogram.data.size();
+    const uint32_t sharpnessValues = statistics.sharpnessMap.size();
+    uint64_t bytes = ( uint64_t( histogramValues ) + sharpnessValues ) * 4;
+    bytes = ( bytes + 7 ) & ~uint64_t(7);
+
+    // Reserve the statistics; a block never wraps, the end of the ring is
+    // skipped instead.
+    uint64_t sideStart = 0;
+    bool dropped = bytes > sideBytes / 4;
+    if ( bytes > 0 && !dropped )
+    {
+        uint64_t cursor = header.sideCursor.load( std::memory_order_relaxed );
+        uint64_t next;
+        do
+        {
+            const uint64_t offset = cursor % sideBytes;
+            sideStart = offset + bytes > sideBytes ? cursor + sideBytes - offset : cursor;
+            next = sideStart + bytes;
+        }
+        while ( !header.sideCursor.compare_exchange_weak( cursor, next,
+                std::memory_order_relaxed ) );
+
+        uint8_t* dst = mBase + header.sideOffset + sideStart % sideBytes;
+        memcpy( dst, statistics.histogram.data.data(), histogramValues * 4 );
+        memcpy( dst + histogramValues * 4, statistics.sharpnessMap.data(),
+                sharpnessValues * 4 );
+        mStatisticsBytes.fetch_add( bytes, std::memory_order_relaxed );
+    }
+    if ( dropped )
+    {
+        mStatisticsDropped.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    const uint64_t sequence = header.nextSequence.fetch_add( 1,
+            std::memory_order_relaxed );
+    Slot& slot = ( (Slot*)( mBase + PAGE ) )[sequence & ( header.capacity - 1 )];
+
+    slot.sequence.store( 2 * sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+
+    Record& record = slot.record;
+    memset( &record, 0, sizeof(record) );
+    record.captureTime = frame.captureTime;
+    record.requestId = frame.requestId;
+    record.stream = stream;
+    record.flags = ( frame.streaming ? STREAMING : 0 ) |
+                   ( dropped ? STATISTICS_DROPPED : 0 );
+    record.aeState = uint8_t( frame.autoControlState.aeState );
+    record.afState = uint8_t( frame.autoControlState.afState );
+    record.awbState = uint8_t( frame.autoControlState.awbState );
+    encode( frame.requestSettings, record.requestSettings );
+    encode( frame.resultSettings, record.resultSettings );
+    if ( bytes > 0 && !dropped )
+    {
+        record.sideStart = sideStart;
+        record.histogramBuckets = histogramValues > 0 ?
+                uint16_t( statistics.histogram.numBuckets ) : 0;
+        record.histogramValues = histogramValues;
+        record.sharpnessValues = sharpnessValues;
+    }
+
+    slot.sequence.store( 2 * sequence + 2, std::memory_order_release );
+    mRecords.fetch_add( 1, std::memory_order_relaxed );
+    return true;
+}
+
+void MetadataJournal::countDropped( uint64_t frames )
+{
+    mFramesDropped.fetch_add( frames, std::memory_order_relaxed );
+}
+
+void MetadataJournal::close()
+{
+    if ( !mBase ) return;
+
+    // The page cache writes the pages back, also after the app exits.
+    munmap( mBase, mSize );
+    mBase = nullptr;
+    mSize = 0;
+}
+
+MetadataJournal::Counters MetadataJournal::counters() const
+{
+    Counters c;
+    c.records = mRecords;
+    c.statisticsBytes = mStatisticsBytes;
+    c.statisticsDropped = mStatisticsDropped;
+    c.framesDropped = mFramesDropped;
+    return c;
+}
+
+//----------------------------------------------------------------------------------
+
+MetadataJournalReader::~MetadataJournalReader()
+{
+    close();
+}
+
+bool MetadataJournalReader::open( const std::string& path )
+{
+    close();
+
+    const int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) return false;
+
+    Header header;
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 ||
+         pread( fd, &header, sizeof(header), 0 ) != ssize_t( sizeof(header) ) ||
+         memcmp( header.magic, MAGIC, sizeof(MAGIC) ) != 0 ||
+         header.version != VERSION || header.slotSize != sizeof(Slot) ||
+         header.capacity == 0 || ( header.capacity & ( header.capacity - 1 ) ) != 0 ||
+         header.sideOffset < PAGE + header.capacity * sizeof(Slot) ||
+         uint64_t( st.st_size ) < header.sideOffset + header.sideBytes ||
+         uint64_t( st.st_size ) != size_t( st.st_size ) )
+    {
+        ::close( fd );
+        return false;
+    }
+
+    void* base = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close( fd );
+    if ( base == MAP_FAILED ) return false;
+
+    mBase = (const uint8_t*) base;
+    mSize = st.st_size;
+    return true;
+}
+
+void MetadataJournalReader::close()
+{
+    if ( mBase )
+    {
+        munmap( (void*) mBase, mSize );
+        mBase = nullptr;
+        mSize = 0;
+    }
+    mByTime.clear();
+    mByRequest.clear();
+}
+
+uint64_t MetadataJournalReader::begin() const
+{
+    if ( !mBase ) return 0;
+    const Header& header = *(const Header*) mBase;
+    const uint64_t last = end();
+    return last > header.capacity ? last - header.capacity : 0;
+}
+
+uint64_t MetadataJournalReader::end() const
+{
+    if ( !mBase ) return 0;
+    const Header& header = *(const Header*) mBase;
+    return header.nextSequence.load( std::memory_order_acquire );
+}
+
+bool MetadataJournalReader::read( uint64_t sequence, MetadataJournal::Entry& entry,
+        bool withStatistics ) const
+{
+    if ( !mBase ) return false;
+
+    const Header& header = *(const Header*) mBase;
+    const Slot& slot =
+            ( (const Slot*)( mBase + PAGE ) )[sequence & ( header.capacity - 1 )];
+
+    const uint64_t committed = 2 * sequence + 2;
+    if ( slot.sequence.load( std::memory_order_acquire ) != committed ) return false;
+
+    Record record;
+    memcpy( &record, &slot.record, sizeof(record) );
+
+    // Statistics are copied before the checks below, which tell if they
+    // were overwritten meanwhile.
+    const uint64_t sideBytes = header.sideBytes;
+    const uint64_t bytes = ( uint64_t( record.histogramValues ) +
+            record.sharpnessValues ) * 4;
+    const bool hasStatistics = bytes > 0 && bytes <= sideBytes / 4;
+    std::vector<unsigned>& histogram = entry.statistics.histogram.data;
+    std::vector<float>& sharpness = entry.statistics.sharpnessMap;
+    histogram.clear();
+    sharpness.clear();
+    if ( withStatistics && hasStatistics )
+    {
+        const uint8_t* src = mBase + header.sideOffset + record.sideStart % sideBytes;
+        histogram.resize( record.histogramValues );
+        sharpness.resize( record.sharpnessValues );
+        memcpy( histogram.data(), src, record.histogramValues * 4 );
+        memcpy( sharpness.data(), src + record.histogramValues * 4,
+                record.sharpnessValues * 4 );
+    }
+
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if ( slot.sequence.load( std::memory_order_relaxed ) != committed ) return false;
+
+    const uint64_t cursor = header.sideCursor.load( std::memory_order_relaxed );
+    const bool lost = ( record.flags & STATISTICS_DROPPED ) != 0 ||
+            ( hasStatistics && cursor - record.sideStart > sideBytes );
+    if ( lost )
+    {
+        histogram.clear();
+        sharpness.clear();
+    }
+
+    entry.sequence = sequence;
+    entry.stream = record.stream;
+    entry.requestId = record.requestId;
+    entry.streaming = ( record.flags & STREAMING ) != 0;
+    entry.captureTime = record.captureTime;
+    decode( record.requestSettings, entry.requestSettings );
+    decode( record.resultSettings, entry.resultSettings );
+    entry.autoControlState.aeState = AE_STATE( record.aeState );
+    entry.autoControlState.afState = AF_STATE( record.afState );
+    entry.autoControlState.awbState = AWB_STATE( record.awbState );
+    entry.statistics.histogram.numBuckets = lost ? 0 : record.histogramBuckets;
+    entry.statisticsLost = lost;
+    return true;
+}
+
+size_t MetadataJournalReader::index()
+{
+    mByTime.clear();
+    mByRequest.clear();
+    if ( !mBase ) return 0;
+
+    const Header& header = *(const Header*) mBase;
+    const Slot* slots = (const Slot*)( mBase + PAGE );
+    const uint64_t last = end();
+    mByTime.reserve( last - begin() );
+
+    // Only the fixed records are read; a record counts if it was complete
+    // before and after its keys were copied.
+    for ( uint64_t sequence = begin(); sequence < last; ++sequence )
+    {
+        const Slot& slot = slots[sequence & ( header.capacity - 1 )];
+        const uint64_t committed = 2 * sequence + 2;
+        if ( slot.sequence.load( std::memory_order_acquire ) != committed ) continue;
+
+        Key key;
+        key.captureTime = slot.record.captureTime;
+        key.requestId = slot.record.requestId;
+        key.stream = slot.record.stream;
+        key.sequence = sequence;
+
+        std::atomic_thread_fence( std::memory_order_acquire );
+        if ( slot.sequence.load( std::memory_order_relaxed ) != committed ) continue;
+        mByTime.push_back( key );
+    }
+
+    std::sort( mByTime.begin(), mByTime.end(), []( const Key& a, const Key& b )
+    {
+        return a.captureTime != b.captureTime ? a.captureTime < b.captureTime :
+                a.sequence < b.sequence;
+    } );
+    mByRequest = mByTime;
+    std::stable_sort( mByRequest.begin(), mByRequest.end(),
+            []( const Key& a, const Key& b ) { return a.requestId < b.requestId; } );
+    return mByTime.size();
+}
+
+void MetadataJournalReader::findRequest( int32_t requestId, int stream,
+        std::vector<uint64_t>& sequences ) const
+{
+    sequences.clear();
+    auto it = std::lower_bound( mByRequest.begin(), mByRequest.end(), requestId,
+            []( const Key& key, int32_t id ) { return key.requestId < id; } );
+    for ( ; it != mByRequest.end() && it->requestId == requestId; ++it )
+    {
+        if ( stream < 0 || it->stream == stream ) sequences.push_back( it->sequence );
+    }
+}
+
+void MetadataJournalReader::findTime( int64_t begin, int64_t end, int stream,
+        std::vector<uint64_t>& sequences ) const
+{
+    sequences.clear();
+    auto it = std::lower_bound( mByTime.begin(), mByTime.end(), begin,
+            []( const Key& key, int64_t time ) { return key.captureTime < time; } );
+    for ( ; it != mByTime.end() && it->captureTime < end; ++it )
+    {
+        if ( stream < 0 || it->stream == stream ) sequences.push_back( it->sequence );
+    }
+}
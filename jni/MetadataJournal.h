@@ -0,0 +1,217 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef MetadataJournal_H
+#define MetadataJournal_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*!
+ * Binary journal of the metadata of every frame: request and result
+ * settings, 3A state and statistics, for tuning AE, AF and AWB offline.
+ *
+ * The file is created at its full size with fallocate() and mapped, so
+ * append() is a few stores to memory and never a system call. Every frame
+ * takes one fixed size record in a ring of Options::capacity records; the
+ * histogram and sharpness map, whose size depends on the camera, go to a
+ * ring of bytes after the records that wraps independently. Once either
+ * ring is full the oldest entries are overwritten.
+ *
+ * append() takes no lock: a record is claimed with one atomic increment
+ * and written like a seqlock, as FrameTracer writes its events, so any
+ * number of streams can append at once and readers, in this process or
+ * another one, detect records that are incomplete or were overwritten
+ * while they read them. The page cache holds the data, so a journal
+ * survives the app crashing.
+ */
+class MetadataJournal
+{
+public:
+
+    struct Options
+    {
+        // Records in the ring, rounded up to a power of two; 128 bytes each.
+        unsigned capacity = 65536;
+
+        // Size of the statistics ring. Histograms and sharpness maps of one
+        // frame larger than a quarter of it are not written.
+        uint64_t sideBytes = 64ull << 20;
+    };
+
+    // A record as read back by MetadataJournalReader.
+    struct Entry
+    {
+        uint64_t sequence = 0;      //< Position in the journal, from 0.
+        uint16_t stream = 0;        //< As given to append().
+        int32_t requestId = 0;
+        bool streaming = false;
+        int64_t captureTime = 0;
+
+        nv::camera2::RequestSettings requestSettings;
+        nv::camera2::RequestSettings resultSettings;
+        nv::camera2::Request::ControlState autoControlState;
+
+        // Only filled in if asked for.
+        nv::camera2::Statistics statistics;
+
+        // The frame had statistics that were too large, or that have been
+        // overwritten since.
+        bool statisticsLost = false;
+    };
+
+    struct Counters
+    {
+        uint64_t records = 0;           //< Appended since open().
+        uint64_t statisticsBytes = 0;
+        uint64_t statisticsDropped = 0; //< Frames whose statistics did not fit.
+        uint64_t framesDropped = 0;     //< Not appended, see countDropped().
+    };
+
+    explicit MetadataJournal( const Options& options );
+
+    ~MetadataJournal();
+
+    /*!
+     * Maps the journal at path. A journal of the same capacity and
+     * statistics size is continued; anything else at path is replaced by
+     * an empty one. Returns false if the file cannot be created or mapped.
+     */
+    bool open( const std::string& path );
+
+    bool isOpen() const
+    {
+        return mBase != nullptr;
+    }
+
+    /*!
+     * Adds the metadata of a frame; stream tells the streams apart when
+     * reading. Can be called from any number of threads at once. Returns
+     * false if the journal is not open.
+     */
+    bool append( const nv::camera2::CameraFrame& frame, uint16_t stream );
+
+    // As above, with statistics such as StatisticsEngine's journaled in
+    // place of the HAL's frame.statistics.
+    bool append( const nv::camera2::CameraFrame& frame, uint16_t stream,
+            const nv::camera2::Statistics& statistics );
+
+    /*!
+     * Counts frames the caller dropped instead of appending, such as
+     * frames displaced from a full queue. Can be called from any thread.
+     */
+    void countDropped( uint64_t frames );
+
+    // Unmaps the journal. No append() may be running.
+    void close();
+
+    Counters counters() const;
+
+private:
+
+    Options mOptions;
+    uint8_t* mBase = nullptr;
+    size_t mSize = 0;
+
+    std::atomic<uint64_t> mRecords;
+    std::atomic<uint64_t> mStatisticsBytes;
+    std::atomic<uint64_t> mStatisticsDropped;
+    std::atomic<uint64_t> mFramesDropped;
+};
+
+/*!
+ * Reads a journal written by MetadataJournal, while it is being written or
+ * afterwards. The file is mapped, not read: index() only touches the fixed
+ * records, and read() the statistics of the records it returns.
+ */
+class MetadataJournalReader
+{
+public:
+
+    MetadataJournalReader() = default;
+
+    ~MetadataJournalReader();
+
+    bool open( const std::string& path );
+
+    void close();
+
+    // Sequences of the records still in the ring, end() exclusive.
+    uint64_t begin() const;
+    uint64_t end() const;
+
+    /*!
+     * Copies a record, and with withStatistics its histogram and sharpness
+     * map. Returns false if the record is not in the ring any more, or is
+     * being written.
+     */
+    bool read( uint64_t sequence, MetadataJournal::Entry& entry,
+            bool withStatistics ) const;
+
+    /*!
+     * Builds the index of the records in the ring for findRequest() and
+     * findTime(). Records appended later are not found until the next
+     * call. Returns the number of records indexed.
+     */
+    size_t index();
+
+    /*!
+     * Sequences of the records with the requestId, or with a captureTime
+     * in [begin, end), of one stream or of all with stream -1; in capture
+     * time order.
+     */
+    void findRequest( int32_t requestId, int stream,
+            std::vector<uint64_t>& sequences ) const;
+    void findTime( int64_t begin, int64_t end, int stream,
+            std::vector<uint64_t>& sequences ) const;
+
+private:
+
+    struct Key
+    {
+        int64_t captureTime;
+        int32_t requestId;
+        uint16_t stream;
+        uint64_t sequence;
+    };
+
+    const uint8_t* mBase = nullptr;
+    size_t mSize = 0;
+
+    std::vector<Key> mByTime;
+    std::vector<Key> mByRequest;
+};
+
+#endif
@@ -0,0 +1,547 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "MotionGate.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define MOTION_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define MOTION_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Blocks are BLOCK x BLOCK pixels of the reduced plane.
+constexpr int BLOCK = 8;
+
+// Fractional bits of the background.
+constexpr int BACKGROUND_SHIFT = 7;
+
+// The learning rate is applied in 1/512 steps.
+constexpr int RATE_SHIFT = 9;
+constexpr int MAX_RATE = 255;
+
+// Changed blocks learn this much slower, so moving objects leave no
+// trail in the background while parked ones are taken on eventually.
+constexpr int CHANGED_RATE_SHIFT = 3;
+
+// After a change over most of the frame everything learns this much
+// faster.
+constexpr int GLOBAL_RATE_SHIFT = 2;
+
+/*
+ * halve() writes count pixels, each the rounded average of a 2x2 block of
+ * row0 and row1, as two rounded pair averages.
+ * blockSad() adds to sums[b] the absolute differences of the BLOCK pixels
+ * of block b of one row to the background, for blocks whole blocks.
+ * learn() moves count background pixels towards the row by
+ * rate / 2^RATE_SHIFT of the difference, rounded down.
+ */
+typedef void (*HalveKernel)( const uint8_t* row0, const uint8_t* row1,
+        int count, uint8_t* out );
+typedef void (*BlockSadKernel)( const uint8_t* row, const uint16_t* background,
+        int blocks, uint32_t* sums );
+typedef void (*LearnKernel)( const uint8_t* row, uint16_t* background,
+        int count, int rate );
+
+struct KernelSet
+{
+    HalveKernel halve;
+    BlockSadKernel blockSad;
+    LearnKernel learn;
+};
+
+void halveScalar( const uint8_t* row0, const uint8_t* row1, int count,
+        uint8_t* out )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        const int left  = ( row0[2*x] + row1[2*x] + 1 ) >> 1;
+        const int right = ( row0[2*x + 1] + row1[2*x + 1] + 1 ) >> 1;
+        out[x] = uint8_t( ( left + right + 1 ) >> 1 );
+    }
+}
+
+void blockSadScalar( const uint8_t* row, const uint16_t* background,
+        int blocks, uint32_t* sums )
+{
+    for ( int b = 0; b < blocks; ++b )
+    {
+        uint32_t sum = 0;
+        for ( int x = b * BLOCK; x < ( b + 1 ) * BLOCK; ++x )
+        {
+            sum += std::abs( row[x] - ( background[x] >> BACKGROUND_SHIFT ) );
+        }
+        sums[b] += sum;
+    }
+}
+
+void learnScalar( const uint8_t* row, uint16_t* background, int count,
+        int rate )
+{
+    for ( int x = 0; x < count; ++x )
+    {
+        const int difference = ( row[x] << BACKGROUND_SHIFT ) - background[x];
+        background[x] = uint16_t( background[x] +
+                ( ( difference * rate ) >> RATE_SHIFT ) );
+    }
+}
+
+#if MOTION_HAVE_SSE2
+
+void halveSse2( const uint8_t* row0, const uint8_t* row1, int count,
+        uint8_t* out )
+{
+    const __m128i lowBytes = _mm_set1_epi16( 0xff );
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const __m128i v0 = _mm_avg_epu8(
+                _mm_loadu_si128( (const __m128i*) ( row0 + 2*x ) ),
+                _mm_loadu_si128( (const __m128i*) ( row1 + 2*x ) ) );
+        const __m128i v1 = _mm_avg_epu8(
+                _mm_loadu_si128( (const __m128i*) ( row0 + 2*x + 16 ) ),
+                _mm_loadu_si128( (const __m128i*) ( row1 + 2*x + 16 ) ) );
+
+        const __m128i h0 = _mm_avg_epu16( _mm_and_si128( v0, lowBytes ),
+                _mm_srli_epi16( v0, 8 ) );
+        const __m128i h1 = _mm_avg_epu16( _mm_and_si128( v1, lowBytes ),
+                _mm_srli_epi16( v1, 8 ) );
+        _mm_storeu_si128( (__m128i*) ( out + x ), _mm_packus_epi16( h0, h1 ) );
+    }
+    halveScalar( row0 + 2*x, row1 + 2*x, count - x, out + x );
+}
+
+// The background of 16 pixels as bytes.
+inline __m128i backgroundBytes( const uint16_t* background )
+{
+    return _mm_packus_epi16(
+            _mm_srli_epi16( _mm_loadu_si128( (const __m128i*) background ),
+                    BACKGROUND_SHIFT ),
+            _mm_srli_epi16( _mm_loadu_si128( (const __m128i*) ( background + 8 ) ),
+                    BACKGROUND_SHIFT ) );
+}
+
+void blockSadSse2( const uint8_t* row, const uint16_t* background,
+        int blocks, uint32_t* sums )
+{
+    // _mm_sad_epu8 sums each half of the register: two blocks at a time.
+    int b = 0;
+    for ( ; b + 2 <= blocks; b += 2 )
+    {
+        const __m128i sad = _mm_sad_epu8(
+                _mm_loadu_si128( (const __m128i*) ( row + b * BLOCK ) ),
+                backgroundBytes( background + b * BLOCK ) );
+        sums[b] += _mm_cvtsi128_si32( sad );
+        sums[b + 1] += _mm_cvtsi128_si32( _mm_srli_si128( sad, 8 ) );
+    }
+    blockSadScalar( row + b * BLOCK, background + b * BLOCK, blocks - b,
+            sums + b );
+}
+
+void learnSse2( const uint8_t* row, uint16_t* background, int count,
+        int rate )
+{
+    const __m128i zero = _mm_setzero_si128();
+    // mulhi keeps bits 16 and up: rate / 2^RATE_SHIFT = (rate << 7) / 2^16.
+    const __m128i factor = _mm_set1_epi16( short( rate << ( 16 - RATE_SHIFT ) ) );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const __m128i pixels = _mm_slli_epi16( _mm_unpacklo_epi8(
+                _mm_loadl_epi64( (const __m128i*) ( row + x ) ), zero ),
+                BACKGROUND_SHIFT );
+        const __m128i old = _mm_loadu_si128( (const __m128i*) ( background + x ) );
+        const __m128i step = _mm_mulhi_epi16( _mm_sub_epi16( pixels, old ), factor );
+        _mm_storeu_si128( (__m128i*) ( background + x ), _mm_add_epi16( old, step ) );
+    }
+    learnScalar( row + x, background + x, count - x, rate );
+}
+
+#endif
+
+#if MOTION_HAVE_NEON
+
+void halveNeon( const uint8_t* row0, const uint8_t* row1, int count,
+        uint8_t* out )
+{
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const uint8x16x2_t a = vld2q_u8( row0 + 2*x );
+        const uint8x16x2_t b = vld2q_u8( row1 + 2*x );
+        vst1q_u8( out + x, vrhaddq_u8( vrhaddq_u8( a.val[0], b.val[0] ),
+                                       vrhaddq_u8( a.val[1], b.val[1] ) ) );
+    }
+    halveScalar( row0 + 2*x, row1 + 2*x, count - x, out + x );
+}
+
+void blockSadNeon( const uint8_t* row, const uint16_t* background,
+        int blocks, uint32_t* sums )
+{
+    for ( int b = 0; b < blocks; ++b )
+    {
+        const uint16x8_t difference = vabdl_u8( vld1_u8( row + b * BLOCK ),
+                vshrn_n_u16( vld1q_u16( background + b * BLOCK ),
+                        BACKGROUND_SHIFT ) );
+        const uint64x2_t sum = vpaddlq_u32( vpaddlq_u16( difference ) );
+        sums[b] += uint32_t( vgetq_lane_u64( sum, 0 ) + vgetq_lane_u64( sum, 1 ) );
+    }
+}
+
+void learnNeon( const uint8_t* row, uint16_t* background, int count,
+        int rate )
+{
+    // vqdmulh keeps bits 15 and up of the product.
+    const int16x8_t factor = vdupq_n_s16( int16_t( rate << ( 15 - RATE_SHIFT ) ) );
+
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        const int16x8_t pixels = vreinterpretq_s16_u16(
+                vshll_n_u8( vld1_u8( row + x ), BACKGROUND_SHIFT ) );
+        const int16x8_t old = vreinterpretq_s16_u16( vld1q_u16( background + x ) );
+        const int16x8_t step = vqdmulhq_s16( vsubq_s16( pixels, old ), factor );
+        vst1q_u16( background + x, vreinterpretq_u16_s16( vaddq_s16( old, step ) ) );
+    }
+    learnScalar( row + x, background + x, count - x, rate );
+}
+
+#endif
+
+const KernelSet* selectKernel( MotionGate::Kernel kernel )
+{
+    static const KernelSet scalar = { halveScalar, blockSadScalar, learnScalar };
+#if MOTION_HAVE_NEON
+    static const KernelSet neon = { halveNeon, blockSadNeon, learnNeon };
+#endif
+#if MOTION_HAVE_SSE2
+    static const KernelSet sse2 = { halveSse2, blockSadSse2, learnSse2 };
+#endif
+
+    switch ( kernel )
+    {
+    case MotionGate::Kernel::AUTO:
+#if MOTION_HAVE_NEON
+        return &neon;
+#elif MOTION_HAVE_SSE2
+        return &sse2;
+#endif
+        return &scalar;
+
+    case MotionGate::Kernel::SCALAR:
+        return &scalar;
+
+#if MOTION_HAVE_NEON
+    case MotionGate::Kernel::NEON:
+        return &neon;
+#endif
+
+#if MOTION_HAVE_SSE2
+    case MotionGate::Kernel::SSE2:
+        return &sse2;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+}
+
+MotionGate::MotionGate( const Options& options ) :
+    mOptions(options)
+{
+    mKernels = selectKernel( mOptions.kernel );
+
+    while ( mHalvings < 3 && ( 2u << mHalvings ) <= mOptions.downscale )
+    {
+        ++mHalvings;
+    }
+    mReduced.resize( mHalvings );
+
+    mRate = std::min( std::max( int( mOptions.learningRate *
+            ( 1 << RATE_SHIFT ) + 0.5f ), 1 ), MAX_RATE );
+    mOptions.releaseBlocks = std::min( std::max( mOptions.releaseBlocks, 1u ),
+            std::max( mOptions.triggerBlocks, 1u ) );
+}
+
+bool MotionGate::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+void MotionGate::setSensitivity( float left, float top, float right,
+        float bottom, float sensitivity )
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    mRegions.push_back( Region{ left, top, right, bottom,
+            std::max( sensitivity, 0.0f ) } );
+    mRegionsChanged = true;
+}
+
+void MotionGate::clearSensitivity()
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    mRegions.clear();
+    mRegionsChanged = true;
+}
+
+void MotionGate::reset()
+{
+    mHasBackground = false;
+    mOpen = false;
+    mRun = 0;
+}
+
+MotionGate::Counters MotionGate::counters() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mCounters;
+}
+
+void MotionGate::updateThresholds()
+{
+    // Block sums are over BLOCK * BLOCK pixels.
+    const float base = mOptions.threshold * BLOCK * BLOCK;
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    for ( unsigned by = 0; by < mBlocksY; ++by )
+    {
+        for ( unsigned bx = 0; bx < mBlocksX; ++bx )
+        {
+            const float x = ( bx + 0.5f ) / mBlocksX;
+            const float y = ( by + 0.5f ) / mBlocksY;
+
+            float sensitivity = 1.0f;
+            for ( const Region& r : mRegions )
+            {
+                if ( x >= r.left && x < r.right && y >= r.top && y < r.bottom )
+                {
+                    sensitivity = r.sensitivity;
+                }
+            }
+
+            mBlockThresholds[by * mBlocksX + bx] = sensitivity > 0.0f ?
+                    uint32_t( std::min( base / sensitivity, 4294967040.0f ) ) :
+                    UINT32_MAX;
+        }
+    }
+    mRegionsChanged = false;
+}
+
+bool MotionGate::process( CameraBuffer& img, Decision& decision )
+{
+    if ( img.format() != YCbCr_420_888 ) return false;
+
+    return process( img.data(0), decision );
+}
+
+bool MotionGate::process( const CameraBuffer::Data& luma, Decision& decision )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const KernelSet* kernels = static_cast<const KernelSet*>( mKernels );
+    const int width = luma.width >> mHalvings;
+    const int height = luma.height >> mHalvings;
+    if ( !kernels || !luma.ptr || width < BLOCK || height < BLOCK ||
+         std::max( luma.channel_step, 1 ) != 1 )
+    {
+        return false;
+    }
+
+    // Reduce, the last plane is the one compared.
+    const uint8_t* plane = static_cast<const uint8_t*>( luma.ptr );
+    int stride = luma.stride;
+    for ( unsigned h = 0; h < mHalvings; ++h )
+    {
+        const int w = luma.width >> ( h + 1 );
+        const int rows = luma.height >> ( h + 1 );
+        std::vector<uint8_t>& out = mReduced[h];
+        out.resize( size_t(w) * rows );
+
+        ThreadPool::instance().parallelFor( ( rows + BLOCK - 1 ) / BLOCK,
+                [&]( unsigned band ) {
+            const int y1 = std::min( int( band + 1 ) * BLOCK, rows );
+            for ( int y = band * BLOCK; y < y1; ++y )
+            {
+                const uint8_t* row0 = plane + size_t(2*y) * stride;
+                kernels->halve( row0, row0 + stride, w, &out[size_t(y) * w] );
+            }
+        }, mOptions.maxThreads );
+
+        plane = out.data();
+        stride = w;
+    }
+
+    if ( width != mWidth || height != mHeight )
+    {
+        mWidth = width;
+        mHeight = height;
+        mBlocksX = width / BLOCK;
+        mBlocksY = height / BLOCK;
+        mBackground.resize( size_t(width) * height );
+        mBlockSums.resize( mBlocksX * mBlocksY );
+        mBlockThresholds.resize( mBlocksX * mBlocksY );
+        mChanged.assign( mBlocksX * mBlocksY, 0 );
+        mHasBackground = false;
+        mRegionsChanged = true;
+    }
+    {
+        bool changed;
+        {
+            std::lock_guard<std::mutex> lk( mMutex );
+            changed = mRegionsChanged;
+        }
+        if ( changed ) updateThresholds();
+    }
+
+    decision = Decision();
+
+    if ( !mHasBackground )
+    {
+        for ( int y = 0; y < height; ++y )
+        {
+            const uint8_t* row = plane + size_t(y) * stride;
+            uint16_t* background = &mBackground[size_t(y) * width];
+            for ( int x = 0; x < width; ++x )
+            {
+                background[x] = uint16_t( row[x] << BACKGROUND_SHIFT );
+            }
+        }
+        mHasBackground = true;
+    }
+    else
+    {
+        std::atomic<unsigned> changedBlocks( 0 );
+
+        ThreadPool::instance().parallelFor( mBlocksY, [&]( unsigned by ) {
+            uint32_t* sums = &mBlockSums[by * mBlocksX];
+            uint8_t* changed = &mChanged[by * mBlocksX];
+            const uint32_t* thresholds = &mBlockThresholds[by * mBlocksX];
+
+            std::fill_n( sums, mBlocksX, 0u );
+            for ( int y = by * BLOCK; y < int( by + 1 ) * BLOCK; ++y )
+            {
+                kernels->blockSad( plane + size_t(y) * stride,
+                        &mBackground[size_t(y) * width], mBlocksX, sums );
+            }
+
+            unsigned count = 0;
+            for ( unsigned bx = 0; bx < mBlocksX; ++bx )
+            {
+                changed[bx] = sums[bx] > thresholds[bx];
+                count += changed[bx];
+            }
+            changedBlocks += count;
+        }, mOptions.maxThreads );
+
+        // A change over most of the frame is lighting or exposure, which
+        // the background has to follow quickly everywhere.
+        const bool global = 2 * changedBlocks > mBlocksX * mBlocksY;
+        const int rate = global ?
+                std::min( mRate << GLOBAL_RATE_SHIFT, MAX_RATE ) : mRate;
+        const int changedRate = global ? rate :
+                std::max( mRate >> CHANGED_RATE_SHIFT, 1 );
+
+        // Learn in runs of blocks that changed or did not; the last block
+        // row also learns the rows below the last whole block.
+        ThreadPool::instance().parallelFor( mBlocksY, [&]( unsigned by ) {
+            const uint8_t* changed = &mChanged[by * mBlocksX];
+            const int y1 = by + 1 == mBlocksY ? height : int( by + 1 ) * BLOCK;
+            for ( int y = by * BLOCK; y < y1; ++y )
+            {
+                const uint8_t* row = plane + size_t(y) * stride;
+                uint16_t* background = &mBackground[size_t(y) * width];
+                unsigned bx = 0;
+                while ( bx < mBlocksX )
+                {
+                    unsigned end = bx + 1;
+                    while ( end < mBlocksX && changed[end] == changed[bx] ) ++end;
+                    const int x1 = end == mBlocksX ? width : int(end) * BLOCK;
+                    kernels->learn( row + bx * BLOCK, background + bx * BLOCK,
+                            x1 - int(bx) * BLOCK, changed[bx] ? changedRate : rate );
+                    bx = end;
+                }
+            }
+        }, mOptions.maxThreads );
+
+        decision.changedBlocks = changedBlocks;
+    }
+
+    // Hysteresis: fewer blocks keep the gate open than open it, and it
+    // switches only after a run of frames asking for it.
+    decision.motion = decision.changedBlocks >=
+            ( mOpen ? mOptions.releaseBlocks : mOptions.triggerBlocks );
+    bool opened = false;
+    if ( decision.motion != mOpen )
+    {
+        ++mRun;
+        if ( mRun >= ( mOpen ? mOptions.closeFrames : mOptions.openFrames ) )
+        {
+            mOpen = !mOpen;
+            opened = mOpen;
+            mRun = 0;
+        }
+    }
+    else
+    {
+        mRun = 0;
+    }
+    decision.open = mOpen;
+    decision.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    Counters& c = mCounters;
+    ++c.framesProcessed;
+    if ( decision.motion ) ++c.framesMoving;
+    if ( decision.open ) ++c.framesOpen;
+    if ( opened ) ++c.openings;
+    c.lastTimeUs = decision.timeUs;
+    c.maxTimeUs = std::max( c.maxTimeUs, decision.timeUs );
+    mTotalTimeUs += decision.timeUs;
+    c.meanTimeUs = mTotalTimeUs / int64_t( c.framesProcessed );
+    return true;
+}
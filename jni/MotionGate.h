@@ -0,0 +1,309 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef MotionGate_H
+#define MotionGate_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/*!
+ * Decides from the Y plane whether a frame shows motion, so a fixed
+ * camera only saves and analyses frames in which something happens.
+ *
+ * The plane is reduced by Options::downscale and compared in blocks of
+ * 8x8 reduced pixels against a background that slowly takes on every
+ * frame, so lighting changes are absorbed and only quick changes count.
+ * The gate opens after a few frames with enough changed blocks and closes
+ * after a longer run of still frames; while it is open fewer changed
+ * blocks keep it open.
+ *
+ * Reduction, block differences and the background update have SSE2 and
+ * NEON kernels; block rows run on the ThreadPool.
+ */
+class MotionGate
+{
+public:
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSE2
+    };
+
+    struct Options
+    {
+        // 1, 2, 4 or 8; the plane is halved that many times over.
+        unsigned downscale = 4;
+
+        /*
+         * Mean absolute difference to the background per pixel of a
+         * block, in 8 bit levels, for the block to count as changed at
+         * sensitivity 1.
+         */
+        float threshold = 10.0f;
+
+        // Changed blocks that make a frame moving while the gate is
+        // closed, and while it is open.
+        unsigned triggerBlocks = 3;
+        unsigned releaseBlocks = 1;
+
+        // Consecutive moving frames that open the gate and consecutive
+        // still frames that close it.
+        unsigned openFrames = 2;
+        unsigned closeFrames = 15;
+
+        // Share of the difference to each frame the background takes on,
+        // from 1/512 to 1/2.
+        float learningRate = 1.0f / 32;
+
+        Kernel kernel = Kernel::AUTO;
+
+        // Threads of the ThreadPool, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    struct Decision
+    {
+        bool motion = false;        //< The frame has enough changed blocks.
+        bool open = false;          //< Gate state after the frame.
+        unsigned changedBlocks = 0;
+        int64_t timeUs = 0;
+    };
+
+    struct Counters
+    {
+        uint64_t framesProcessed = 0;
+        uint64_t framesMoving = 0;
+        uint64_t framesOpen = 0;        //< Processed with the gate open.
+        uint64_t openings = 0;
+        int64_t lastTimeUs = 0;
+        int64_t maxTimeUs = 0;
+        int64_t meanTimeUs = 0;
+    };
+
+    explicit MotionGate( const Options& options );
+
+    static bool isAvailable( Kernel kernel );
+
+    /*!
+     * Compares a YCbCr_420_888 frame, or its Y plane, to the background
+     * and updates it. The first frame, and the first after a size change,
+     * only sets the background. Returns false if the plane or the kernel
+     * cannot be used; the gate is left as it was.
+     */
+    bool process( nv::camera2::CameraBuffer& img, Decision& decision );
+    bool process( const nv::camera2::CameraBuffer::Data& luma,
+            Decision& decision );
+
+    /*!
+     * Scales the sensitivity of the blocks whose centers lie in the
+     * rectangle, given as fractions of the frame size: 0 ignores them, 2
+     * halves their threshold. Later regions take precedence. Can be called
+     * from any thread; applies from the next process().
+     */
+    void setSensitivity( float left, float top, float right, float bottom,
+            float sensitivity );
+    void clearSensitivity();
+
+    // Lets the next frame set the background and closes the gate. Call
+    // from the thread that calls process().
+    void reset();
+
+    Counters counters() const;
+
+    // Changed blocks of the last frame, row by row, mapWidth() per row.
+    const std::vector<uint8_t>& changedMap() const
+    {
+        return mChanged;
+    }
+
+    unsigned mapWidth() const
+    {
+        return mBlocksX;
+    }
+
+    unsigned mapHeight() const
+    {
+        return mBlocksY;
+    }
+
+private:
+
+    struct Region
+    {
+        float left, top, right, bottom;
+        float sensitivity;
+    };
+
+    void updateThresholds();
+
+    Options mOptions;
+    const void* mKernels = nullptr;
+    unsigned mHalvings = 0;
+    int mRate = 0;
+
+    // Reduced planes after each halving, the last one is compared.
+    std::vector< std::vector<uint8_t> > mReduced;
+    std::vector<uint16_t> mBackground;      //< 8.7 fixed point.
+    int mWidth = 0;
+    int mHeight = 0;
+    unsigned mBlocksX = 0;
+    unsigned mBlocksY = 0;
+    bool mHasBackground = false;
+
+    std::vector<uint32_t> mBlockSums;
+    std::vector<uint32_t> mBlockThresholds;
+    std::vector<uint8_t> mChanged;
+
+    mutable std::mutex mMutex;
+    std::vector<Region> mRegions;
+    bool mRegionsChanged = true;
+    Counters mCounters;
+    int64_t mTotalTimeUs = 0;
+
+    bool mOpen = false;
+    unsigned mRun = 0;      //< Frames in a row that would switch the gate.
+};
+
+/*!
+ * Pre-roll and post-roll around a MotionGate. Frames pushed while the
+ * gate is open go to the sink, and so do the postRoll frames after it
+ * closes; of the frames before, the last preRoll are held and go to the
+ * sink when the gate opens.
+ *
+ * Frame is a movable handle such as FramePool::Frame or
+ * FrameDistributor::FrameRef. Held frames keep their buffers, so preRoll
+ * has to fit in the pool or the slots the frames come from.
+ */
+template <typename Frame>
+class MotionWindow
+{
+public:
+
+    typedef std::function<void( Frame&& )> Sink;
+
+    MotionWindow( unsigned preRoll, unsigned postRoll, Sink sink ) :
+        mRing( preRoll ),
+        mPostRoll( postRoll ),
+        mSink( sink )
+    {
+    }
+
+    void push( Frame frame, bool open )
+    {
+        if ( open )
+        {
+            for ( ; mCount > 0; --mCount )
+            {
+                pass( std::move( mRing[mHead] ) );
+                mHead = ( mHead + 1 ) % mRing.size();
+            }
+            mPostLeft = mPostRoll;
+            pass( std::move( frame ) );
+            return;
+        }
+
+        if ( mPostLeft > 0 )
+        {
+            --mPostLeft;
+            pass( std::move( frame ) );
+            return;
+        }
+
+        if ( mCount < mRing.size() )
+        {
+            mRing[( mHead + mCount ) % mRing.size()] = std::move( frame );
+            ++mCount;
+            return;
+        }
+
+        // Either frame or the oldest held one is released when frame goes
+        // out of scope.
+        ++mFramesSkipped;
+        if ( !mRing.empty() )
+        {
+            std::swap( mRing[mHead], frame );
+            mHead = ( mHead + 1 ) % mRing.size();
+        }
+    }
+
+    // Releases the held frames.
+    void clear()
+    {
+        for ( auto& frame : mRing )
+        {
+            frame = Frame();
+        }
+        mFramesSkipped += mCount;
+        mHead = 0;
+        mCount = 0;
+        mPostLeft = 0;
+    }
+
+    uint64_t framesPassed() const
+    {
+        return mFramesPassed;
+    }
+
+    // Released without reaching the sink.
+    uint64_t framesSkipped() const
+    {
+        return mFramesSkipped;
+    }
+
+private:
+
+    void pass( Frame&& frame )
+    {
+        ++mFramesPassed;
+        mSink( std::move( frame ) );
+    }
+
+    std::vector<Frame> mRing;
+    unsigned mHead = 0;
+    unsigned mCount = 0;
+    const unsigned mPostRoll;
+    unsigned mPostLeft = 0;
+    Sink mSink;
+
+    uint64_t mFramesPassed = 0;
+    uint64_t mFramesSkipped = 0;
+};
+
+#endif
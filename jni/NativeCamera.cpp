@@ -7,12 +7,121 @@
 #include "NV/NvLogs.h"
 #include "NvGLUtils/NvGLSLProgram.h"
 #include "ImageSave.h"
+#include "FrameTracer.h"
+#include "ReplayCamera.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+enum
+{
+    REACT_CAPTURE = 1,
+    REACT_BURST,
+    REACT_MOTION,
+    REACT_RECORD,
+    REACT_EXPORT_TRACE,
+    REACT_ZOOM
+};
+
+// Frames saved before the motion gate opens and after it closes.
+constexpr unsigned MOTION_PRE_ROLL = 3;
+constexpr unsigned MOTION_POST_ROLL = 15;
+
+// Cameras run at once, and the largest difference in capture time of
+// frames shown as one set; sensors without a common trigger can be up to
+// half a frame apart.
+constexpr unsigned MAX_CAMERAS = 4;
+constexpr int64_t PAIR_TOLERANCE_NS = 5000000;
+
+// CPU statistics kept per camera for the journal to find.
+constexpr unsigned STATISTICS_KEPT = 4;
+
+namespace
+{
+
+// Camera 0 feeds the still and video pipeline at 1080p; the others run at
+// 720p if they can, so several streams fit the memory bandwidth. Replayed
+// cameras only offer their recorded size.
+nv::camera2::Size previewSize( const nv::camera2::StaticProperties& properties,
+        unsigned index )
+{
+    const auto& sizes = properties.scaler.availableYUVSizes;
+    bool has1080p = sizes.empty();
+    for ( const auto& size : sizes )
+    {
+        if ( index > 0 && size.width == 1280 && size.height == 720 ) return size;
+        has1080p = has1080p || ( size.width == 1920 && size.height == 1080 );
+    }
+    return has1080p ? nv::camera2::Size( 1920, 1080 ) : sizes[0];
+}
+
+/*
+ * Recordings listed in NATIVE_CAMERA_REPLAY, separated by ':', take the
+ * place of the cameras, so that the app runs on a host; with
+ * NATIVE_CAMERA_FREE_RUN=1 they are replayed as fast as they are drained.
+ * Empty without recordings.
+ */
+std::shared_ptr<nv::camera2::CameraManager> replayManager()
+{
+    const char* list = getenv( "NATIVE_CAMERA_REPLAY" );
+    if ( !list || !*list ) return nullptr;
+
+    std::vector<std::string> recordings;
+    std::istringstream in( list );
+    std::string recording;
+    while ( std::getline( in, recording, ':' ) )
+    {
+        if ( !recording.empty() ) recordings.push_back( recording );
+    }
+
+    ReplayCamera::Options options;
+    const char* freeRun = getenv( "NATIVE_CAMERA_FREE_RUN" );
+    options.freeRun = freeRun && atoi( freeRun ) != 0;
+    return ReplayCamera::createCameraManager( recordings, options );
+}
+
+}
 
 NativeCamera::NativeCamera(NvPlatformContext* platform) :
     NvSampleApp(platform, "NativeCamera")
 {
     mFrameRate.reset( new NvFramerateCounter(this) );
     mViewAspectRatio = 1.0f;
+    std::fill( mPreviewTextures, mPreviewTextures + 4, 0 );
+    mViewWidth = 0;
+    mViewHeight = 0;
+    mStillCount = 0;
+    mZoom = 1.0f;
+    mStatisticsRunning = false;
+    mBurstRunning = false;
+    mBurstCount = 0;
+    mMotionQueue = nullptr;
+    mMotionRunning = false;
+    mMotionRecording = false;
+    mMotionCount = 0;
+    mRecordQueue = nullptr;
+    mRecordRunning = false;
+    mRecording = false;
+    mVideoCount = 0;
+    mPairRunning = false;
+    mFrameSetCount = 0;
+
+    // All sessions connect through one manager, created once for the app.
+    mManager = replayManager();
+    mReplaying = mManager != nullptr;
+    if ( mReplaying )
+    {
+        LOGI("Replaying %s", getenv( "NATIVE_CAMERA_REPLAY" ));
+    }
+    else
+    {
+        mManager = nv::camera2::CameraManager::createCameraManager();
+    }
+
+    // Sessions of the other cameras are added once the number of cameras
+    // is known.
+    addSession();
 
     // Required in all subclasses to avoid silent link issues
     forceLinkHack();
@@ -20,6 +129,24 @@ NativeCamera::NativeCamera(NvPlatformContext* platform) :
 
 NativeCamera::~NativeCamera()
 {
+    // Expiries run on the session timers and take the lock. Let one that
+    // is waiting for it finish, and stop the timers, before mSessions is
+    // torn down under them.
+    for ( auto& session : mSessions )
+    {
+        session->shutdown();
+    }
+
+    // A paused camera is still open.
+    {
+        std::lock_guard<std::mutex> lk( mCameraMutex );
+        if ( mSessions[0]->state() != CameraSession::State::CLOSED )
+        {
+            stopCamera();
+        }
+    }
+    mSessions.clear();
+
     LOGI("NativeCamera: destroyed\n");
 }
 
@@ -32,20 +159,128 @@ void NativeCamera::configurationCallback(NvEGLConfiguration& config)
 
 void NativeCamera::focusChanged( bool focused ) {
 
+    std::lock_guard<std::mutex> lk( mCameraMutex );
+
     if ( focused )
     {
+        // Streams and threads are still set up if the sessions are warm.
+        if ( resumeCamera() ) return;
+
+        if ( mSessions[0]->state() != CameraSession::State::CLOSED )
+        {
+            stopCamera();
+        }
         startCamera();
     }
     else
     {
-        stopCamera();
+        // Recordings are closed while paused; the other consumers just
+        // see no frames until the requests are submitted again.
+        mRecording = false;
+        for ( auto& view : mViews )
+        {
+            view->session->pause();
+        }
     }
 }
 
+bool NativeCamera::resumeCamera()
+{
+    if ( mViews.empty() ) return false;
+
+    for ( auto& view : mViews )
+    {
+        if ( !view->session->resume() ) return false;
+    }
+
+    // Frames from before the pause would make bad sets.
+    if ( mPairer ) mPairer->clear();
+    return true;
+}
+
+void NativeCamera::addSession()
+{
+    // Static properties are cached next to the saved images, so launches
+    // after the first skip the query.
+    CameraSession::Options sessionOptions;
+    sessionOptions.cameraId = mSessions.size();
+    sessionOptions.manager = mManager;
+
+    // Replayed properties stay in memory, they are not the device's.
+    if ( !mReplaying )
+    {
+        std::ostringstream cacheFile;
+        cacheFile << ImageSave::outputDir() << "/camera-properties-" <<
+                sessionOptions.cameraId << ".bin";
+        sessionOptions.cacheFile = cacheFile.str();
+    }
+
+    mSessions.push_back( std::unique_ptr<CameraSession>( new CameraSession(
+            sessionOptions, [this]{ expireCamera(); } ) ) );
+}
+
+void NativeCamera::expireCamera()
+{
+    std::lock_guard<std::mutex> lk( mCameraMutex );
+
+    // Focus may have come back while the expiry waited for the lock. The
+    // cameras were paused together, so any of them expiring closes all.
+    bool expired = false;
+    for ( auto& session : mSessions )
+    {
+        expired = expired || session->expired();
+    }
+    if ( !expired ) return;
+
+    LOGI("Camera: paused for too long, closing");
+    stopCamera();
+}
+
 void NativeCamera::initUI() {
     // sample apps automatically have a tweakbar they can use.
     if (mTweakBar) { // create our tweak ui
+        mTweakBar->addButton("Capture", REACT_CAPTURE);
+        mTweakBar->addButton("Burst", REACT_BURST);
+        mTweakBar->addButton("Motion recording", REACT_MOTION);
+        mTweakBar->addButton("Record video", REACT_RECORD);
+        mTweakBar->addButton("Export trace", REACT_EXPORT_TRACE);
+        mTweakBar->addButton("Zoom", REACT_ZOOM);
+    }
+}
+
+NvUIEventResponse NativeCamera::handleReaction(const NvUIReaction& react)
+{
+    if ( react.code == REACT_CAPTURE )
+    {
+        captureStill();
+        return nvuiEventHandled;
+    }
+    if ( react.code == REACT_BURST )
+    {
+        captureBurst();
+        return nvuiEventHandled;
+    }
+    if ( react.code == REACT_MOTION )
+    {
+        toggleMotionRecording();
+        return nvuiEventHandled;
     }
+    if ( react.code == REACT_RECORD )
+    {
+        mRecording = !mRecording;
+        return nvuiEventHandled;
+    }
+    if ( react.code == REACT_EXPORT_TRACE )
+    {
+        exportTrace();
+        return nvuiEventHandled;
+    }
+    if ( react.code == REACT_ZOOM )
+    {
+        cycleZoom();
+        return nvuiEventHandled;
+    }
+    return nvuiEventNotHandled;
 }
 
 void NativeCamera::initRendering(void) {
@@ -60,14 +295,25 @@ void NativeCamera::initRendering(void) {
     mProgYUV.reset(
             NvGLSLProgram::createFromFiles("shaders/plain.vert",
             "shaders/yuv.frag"));
+    mProgYUVSemiPlanar.reset(
+            NvGLSLProgram::createFromFiles("shaders/plain.vert",
+            "shaders/yuv_sp.frag"));
+    mProgRGB.reset(
+            NvGLSLProgram::createFromFiles("shaders/plain.vert",
+            "shaders/rgb.frag"));
 
-    setupStreamTextures( mPreviewStream.get(), mPreviewTextures);
+    // YCbCr_420_888 uploaders and the RAW16 preview texture are created by
+    // draw() once the cameras run; a new context has none of the old ones.
+    std::fill( mPreviewTextures, mPreviewTextures + 4, 0 );
+    mPreviewTextureSize = nv::camera2::Size();
 }
 
 void NativeCamera::reshape(int32_t width, int32_t height)
 {
     glViewport( 0, 0, (GLint) width, (GLint) height );
     mViewAspectRatio = (float)width/(float)height;
+    mViewWidth = width;
+    mViewHeight = height;
 
     CHECK_GL_ERROR();
 }
@@ -75,131 +321,652 @@ void NativeCamera::reshape(int32_t width, int32_t height)
 void NativeCamera::startCamera()
 {
 
-    // Create an instance of the camera manager.
-    mCameraManager = nv::camera2::CameraManager::createCameraManager();
-    if ( !mCameraManager ) return;
+    // Connect to the first camera (0); its static properties come from the
+    // session's cache once they have been queried.
+    if ( !mSessions[0]->open() ) return;
+    mStaticProperties = mSessions[0]->properties();
 
-    // Get the camera properties for the first camera (0)
-    mCameraManager->queryStaticProperties( 0, mStaticProperties );
+    // Every other camera runs next to it, each with a session of its own.
+    const unsigned numCameras = std::min( MAX_CAMERAS,
+            unsigned( std::max( mSessions[0]->numberOfCameras(), 1 ) ) );
+    while ( mSessions.size() < numCameras )
+    {
+        addSession();
+    }
 
-    // Create a camera device to refer to camera (0)
-    mCameraDevice = mCameraManager->createCameraDevice( 0, NULL);
-    if ( !mCameraDevice ) return;
+    for ( unsigned i = 0; i < numCameras; ++i )
+    {
+        CameraSession& session = *mSessions[i];
+        if ( i > 0 && !session.open() )
+        {
+            LOGI("Camera %u: not available", i);
+            continue;
+        }
+        nv::camera2::CameraDevice& device = *session.device();
+
+        std::unique_ptr<CameraView> view( new CameraView() );
+        view->cameraId = i;
+        view->session = &session;
+        view->properties = session.properties();
+
+        // Create a 1080p preview stream
+        // 1080p is a supported size. You can query for other supported sizes
+        // from mStaticProperties.availableYUVSizes
+        view->stream = device.createStream( nv::camera2::YCbCr_420_888,
+                previewSize( view->properties, i ) );
+
+        // Camera 0 falls back to a RAW16 preview, demosaiced at half size
+        // by draw(), when it has no YUV stream, such as a replayed RAW16
+        // recording. The statistics and the motion gate skip its frames.
+        const auto& rawSizes = view->properties.scaler.availableRAWSizes;
+        if ( !view->stream && i == 0 && !rawSizes.empty() )
+        {
+            view->stream = device.createStream( nv::camera2::RAW16,
+                    rawSizes[0] );
+        }
+        if ( !view->stream )
+        {
+            // Camera 0 feeds the stills, so the app needs it.
+            if ( i == 0 ) return;
+            session.close();
+            continue;
+        }
 
-    // Create a 1080p preview stream
-    // 1080p is a supported size. You can query for other supported sizes
-    // from mStaticProperties.availableYUVSizes
-    mPreviewStream = mCameraDevice->createStream( nv::camera2::YCbCr_420_888,
-            nv::camera2::Size(1920, 1080) );
-    if ( !mPreviewStream ) return;
+        // Initialize a request - the PREVIEW intent will initialize the request
+        // with the default settings for viewfinder requests.
+        device.initializeDefaultSettings(
+                nv::camera2::CAPTURE_INTENT::PREVIEW, view->request );
 
-    // Initialize a request - the PREVIEW intent will initialize the request
-    // with the default settings for viewfinder requests.
-    mCameraDevice->initializeDefaultSettings(
-            nv::camera2::CAPTURE_INTENT::PREVIEW, mRequest );
+        // Set the preview stream as output.
+        view->request.outputs.clear();
+        view->request.outputs.push_back( view->stream.get() );
 
-    // Set the preview stream as output.
-    mRequest.outputs.clear();
-    mRequest.outputs.push_back( mPreviewStream.get() );
+        mViews.push_back( std::move( view ) );
+    }
 
-    mCameraDevice->capture(mRequest);
+    CameraView& primary = *mViews[0];
+    nv::camera2::CameraDevice& device = *primary.session->device();
+
+    // Run a full resolution stream next to the preview for zero shutter
+    // lag stills, RAW16 if the camera can add one, YUV otherwise.
+    ZslCapture::Options zslOptions;
+    mZsl.reset( new ZslCapture( device, mStaticProperties, zslOptions ) );
+    if ( !mZsl->attach( primary.request ) )
+    {
+        zslOptions.format = nv::camera2::YCbCr_420_888;
+        mZsl.reset( new ZslCapture( device, mStaticProperties, zslOptions ) );
+        if ( !mZsl->attach( primary.request ) )
+        {
+            LOGI("ZSL stream not available");
+            mZsl = nullptr;
+        }
+    }
+
+    // Bursts go to the ZSL stream, which is paused while they run.
+    if ( mZsl )
+    {
+        mBurst.reset( new BurstCapture( device, *mZsl->stream(),
+                mStaticProperties, BurstCapture::Options() ) );
+    }
+
+    Demosaic::Options previewOptions;
+    previewOptions.method = Demosaic::Method::HALF_SIZE;
+    previewOptions.format = Demosaic::OutputFormat::RGBA8888;
+    mRawPreview.reset( new Demosaic( mStaticProperties, previewOptions ) );
+
+    AsyncImageSaver::Options saverOptions;
+    saverOptions.properties = mStaticProperties;
+    saverOptions.scaleRegions = true;
+    mSaver.reset( new AsyncImageSaver( saverOptions ) );
+
+    // The journal of the last run is continued.
+    mJournal.reset( new MetadataJournal( MetadataJournal::Options() ) );
+    if ( !mJournal->open( ImageSave::outputDir() + "/metadata.journal" ) )
+    {
+        LOGI("Metadata journal not available");
+    }
+
+    // With several cameras their frames are matched into sets. Each camera
+    // holds its pending frames, the set being matched, the last complete
+    // set and the one being saved.
+    if ( mViews.size() > 1 )
+    {
+        FramePairer::Options pairOptions;
+        pairOptions.inputs = mViews.size();
+        pairOptions.toleranceNs = PAIR_TOLERANCE_NS;
+        mPairer.reset( new FramePairer( pairOptions ) );
+    }
+
+    // Capture threads go to the last cores, which are the big ones on
+    // big.LITTLE systems, one core per camera as far as they go.
+    const int numCpus = std::max( int( std::thread::hardware_concurrency() ), 1 );
+
+    for ( unsigned i = 0; i < mViews.size(); ++i )
+    {
+        CameraView& view = *mViews[i];
+
+        // Preview frames are dequeued on a capture thread. The GL thread
+        // draws the newest one on every vsync; older frames are displaced from
+        // its queue instead of adding to the preview latency. The sensor is
+        // not slowed down while the preview lags: the repeating request also
+        // feeds the statistics, the journal, ZSL, recording and the motion
+        // gate, which would all lose frames with it.
+        view.fanout.reset( new FrameDistributor( *view.stream,
+                view.properties ) );
+        view.fanout->setCpu( numCpus - 1 - int( i ) % numCpus );
+        FrameDistributor::ConsumerOptions queueOptions;
+        queueOptions.depth = 2;
+        queueOptions.dropPolicy = FrameDistributor::DropPolicy::DROP_OLDEST;
+        view.previewQueue = view.fanout->addConsumer( queueOptions );
+        StreamConsumer::Options consumerOptions;
+        consumerOptions.policy = StreamConsumer::Policy::NEWEST_ONLY;
+        view.preview.reset( new StreamConsumer( *view.previewQueue,
+                view.request, StreamConsumer::SubmitFunction(),
+                consumerOptions ) );
+
+        // Histogram, sharpness map and metering from the same frames, on the
+        // CPU so they do not depend on the statistics the HAL supports. The
+        // queue holds the newest frame only.
+        queueOptions.depth = 1;
+        view.statisticsQueue = view.fanout->addConsumer( queueOptions );
+        view.statistics.reset( new StatisticsEngine( view.properties,
+                StatisticsEngine::Options() ) );
+        view.exchange.reset( new StatisticsExchange( STATISTICS_KEPT ) );
+
+        // The journal wants every frame; its thread blocks on the queue and
+        // waits at most for the statistics thread to settle the frame.
+        queueOptions.depth = 8;
+        view.journalQueue = view.fanout->addConsumer( queueOptions );
+
+        if ( mPairer )
+        {
+            queueOptions.depth = 2;
+            queueOptions.held = mPairer->options().window + 3;
+            view.pairQueue = view.fanout->addConsumer( queueOptions );
+        }
+    }
+
+    // The motion gate sees every frame. Frames before the gate opens are
+    // held for the pre-roll, and saved frames are held until written; add
+    // the frame being processed and the one being written.
+    FrameDistributor::ConsumerOptions queueOptions;
+    queueOptions.depth = 2;
+    queueOptions.held = MOTION_PRE_ROLL + saverOptions.queueCapacity + 2;
+    mMotionQueue = primary.fanout->addConsumer( queueOptions );
+    mMotionGate.reset( new MotionGate( MotionGate::Options() ) );
+
+    // Video recording copies every frame into its staging buffers, so a
+    // short queue is enough.
+    queueOptions.depth = 4;
+    queueOptions.held = 1;
+    mRecordQueue = primary.fanout->addConsumer( queueOptions );
+    VideoRecorder::Options recorderOptions;
+    recorderOptions.frameRate = 30;
+    mRecorder.reset( new VideoRecorder( recorderOptions ) );
+
+    // The sessions submit the requests again when the app is resumed.
+    mStatisticsRunning = true;
+    for ( auto& view : mViews )
+    {
+        view->session->startStreaming( view->request );
+        view->fanout->start();
+        view->statisticsThread = std::thread( &NativeCamera::statisticsLoop,
+                this, view.get() );
+        view->journalThread = std::thread( &NativeCamera::journalLoop,
+                this, view.get() );
+    }
+    if ( mPairer )
+    {
+        mPairRunning = true;
+        mPairThread = std::thread( &NativeCamera::pairLoop, this );
+    }
+    mMotionRunning = true;
+    mMotionThread = std::thread( &NativeCamera::motionLoop, this );
+    mRecordRunning = true;
+    mRecordThread = std::thread( &NativeCamera::recordLoop, this );
+    if ( mZsl ) mZsl->start();
 }
 
 void NativeCamera::stopCamera()
 {
-    // Cancel the streaming request
-    mCameraDevice->cancelRequest(mRequest.requestId);
+    // Cancel the streaming requests
+    for ( auto& session : mSessions )
+    {
+        session->pause();
+    }
+
+    if ( mBurstThread.joinable() )
+    {
+        mBurst->cancel();
+        mBurstThread.join();
+    }
+    mBurst = nullptr;
+
+    // The motion thread saves frames, so it stops before the saver.
+    if ( mMotionRunning )
+    {
+        mMotionRunning = false;
+        mMotionThread.join();
+    }
+    mMotionGate = nullptr;
+    mMotionQueue = nullptr;
+    if ( mRecordRunning )
+    {
+        mRecordRunning = false;
+        mRecordThread.join();
+    }
+    mRecorder = nullptr;
+    mRecordQueue = nullptr;
+
+    // Destroy the camera objects in reverse order; queued stills are
+    // written out first.
+    mSaver = nullptr;
+    mZsl = nullptr;
+    mRawPreview = nullptr;
+    if ( mPairRunning )
+    {
+        mPairRunning = false;
+        mPairThread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lk( mFrameSetMutex );
+        mFrameSet.clear();
+    }
+    mPairer = nullptr;
+    if ( mStatisticsRunning )
+    {
+        mStatisticsRunning = false;
+        for ( auto& view : mViews )
+        {
+            view->exchange->stop();
+            view->statisticsThread.join();
+            view->journalThread.join();
+        }
+    }
+    mJournal = nullptr;
 
-    // Destroy the camera objects in reverse order
-    mPreviewStream = nullptr;
-    mCameraDevice = nullptr;
-    mCameraManager = nullptr;
+    // Distributors stop before their streams go away.
+    mViews.clear();
+    for ( auto& session : mSessions )
+    {
+        session->close();
+    }
 }
 
-void NativeCamera::setupStreamTextures( const nv::camera2::CameraStream *stream,
-    GLuint *textures)
+void NativeCamera::captureStill()
 {
-    uint width, height;
-    width  = stream->size().width;
-    height = stream->size().height;
+    const int64_t pressTime = ZslCapture::now();
 
-    glActiveTexture( GL_TEXTURE0 );
+    // With several cameras the last matched set goes with every still.
+    saveFrameSet();
 
-    if ( stream->format() == nv::camera2::RAW16 )
+    if ( !mZsl || !mSaver ) return;
+
+    FramePool::Frame frame = mZsl->trigger( pressTime );
+    if ( !frame )
     {
-        glGenTextures(1, textures);
+        LOGI("ZSL: no frame available");
+        return;
+    }
 
-        // Setup texture for Y plane
-        glBindTexture( GL_TEXTURE_2D, textures[0] );
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height,
-                     0, GL_LUMINANCE, GL_UNSIGNED_SHORT, (GLvoid*) NULL);
+    const ZslCapture::Latency latency = mZsl->lastLatency();
+    LOGI("ZSL: shutter to frame %lld us, handoff %lld us",
+            (long long) latency.shutterToFrameUs, (long long) latency.handoffUs);
 
-        CHECK_GL_ERROR();
+    std::ostringstream name;
+    name << "still-" << mStillCount++;
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Zoomed JPEGs are the preview region at full size; DNGs stay whole.
+    const bool raw = frame->imageBuffer->format() == nv::camera2::RAW16;
+    const BufferView::Rect region = raw || mZoom <= 1.0f ?
+            BufferView::Rect() : zoomRect( *frame->imageBuffer );
+    mSaver->save( std::move(frame), raw ? AsyncImageSaver::FileType::DNG :
+            AsyncImageSaver::FileType::JPG, name.str(), region );
+}
+
+void NativeCamera::cycleZoom()
+{
+    // Doubles up to the largest zoom of camera 0, then back to none.
+    const float maxZoom = mStaticProperties.scaler.availableMaxDigitalZoom;
+    mZoom = mZoom >= maxZoom ? 1.0f : std::min( mZoom * 2.0f, maxZoom );
+    LOGI("Zoom: %.2fx, up to %.2fx", mZoom, maxZoom);
+}
 
+BufferView::Rect NativeCamera::zoomRect( nv::camera2::CameraBuffer& img ) const
+{
+    const nv::camera2::CameraBuffer::Data luma = img.data(0);
+    return BufferView::zoomRect( luma.width, luma.height, mZoom,
+            mStaticProperties.scaler.availableMaxDigitalZoom );
+}
+
+void NativeCamera::saveFrameSet()
+{
+    std::vector<FrameDistributor::FrameRef> set;
+    {
+        std::lock_guard<std::mutex> lk( mFrameSetMutex );
+        set = mFrameSet;
     }
-    else if ( stream->format() == nv::camera2::YCbCr_420_888 )
+    if ( set.empty() || !mSaver ) return;
+
+    int64_t oldest = set[0]->captureTime;
+    int64_t newest = oldest;
+    for ( const auto& frame : set )
     {
-        glGenTextures(3, textures);
+        oldest = std::min( oldest, frame->captureTime );
+        newest = std::max( newest, frame->captureTime );
+    }
 
-        // Setup texture for Y plane
-        glBindTexture( GL_TEXTURE_2D, textures[0] );
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height,
-                     0, GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*) NULL);
+    const uint32_t index = mFrameSetCount++;
+    for ( unsigned i = 0; i < set.size(); ++i )
+    {
+        std::ostringstream name;
+        name << "set-" << index << "-camera-" << mViews[i]->cameraId;
+        mSaver->save( std::move(set[i]), AsyncImageSaver::FileType::JPG,
+                name.str() );
+    }
+    LOGI("Frame set %u: %u cameras, skew %lld us", index,
+            (unsigned) set.size(), (long long) ( newest - oldest ) / 1000);
+}
 
-        CHECK_GL_ERROR();
+void NativeCamera::captureBurst()
+{
+    if ( !mBurst || !mSaver ) return;
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if ( mBurstRunning )
+    {
+        LOGI("Burst: still running");
+        return;
+    }
+    if ( mBurstThread.joinable() ) mBurstThread.join();
 
-        // Setup texture for U plane
-        glBindTexture( GL_TEXTURE_2D, textures[1] );
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width/2, height/2,
-                         0, GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*) NULL);
-        CHECK_GL_ERROR();
+    mBurstRunning = true;
+    mBurstThread = std::thread( &NativeCamera::burstLoop, this );
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+void NativeCamera::burstLoop()
+{
+    nv::camera2::RequestSettings base;
+    {
+        std::lock_guard<std::mutex> lk( mMeteringMutex );
+        base = mPreviewSettings;
+    }
+
+    mZsl->stop();
+    std::unique_ptr<nv::camera2::CameraFrame> frame = mBurst->capture( base );
+    mZsl->start();
+
+    const BurstCapture::Stats& stats = mBurst->lastStats();
+    LOGI("Burst: merged %u of %u frames, capture %lld us, align %lld us, "
+         "merge %lld us",
+         stats.framesMerged, stats.framesRequested, (long long) stats.captureUs,
+         (long long) stats.merge.alignUs, (long long) stats.merge.mergeUs);
+
+    if ( frame )
+    {
+        std::ostringstream name;
+        name << "burst-" << mBurstCount++;
+
+        const bool raw = frame->imageBuffer->format() == nv::camera2::RAW16;
+        mSaver->save( std::move(frame), raw ? AsyncImageSaver::FileType::DNG :
+                AsyncImageSaver::FileType::JPG, name.str() );
+    }
+
+    mBurstRunning = false;
+}
+
+void NativeCamera::toggleMotionRecording()
+{
+    mMotionRecording = !mMotionRecording;
+    LOGI("Motion recording %s", mMotionRecording ? "on" : "off");
+}
+
+void NativeCamera::motionLoop()
+{
+    MotionWindow<FrameDistributor::FrameRef> window( MOTION_PRE_ROLL,
+            MOTION_POST_ROLL, [this]( FrameDistributor::FrameRef&& frame )
+    {
+        // Frames passed while not recording are just released.
+        if ( !mMotionRecording ) return;
+
+        std::ostringstream name;
+        name << "motion-" << mMotionCount++;
+        mSaver->save( std::move(frame), AsyncImageSaver::FileType::JPG,
+                name.str() );
+    } );
+
+    MotionGate::Decision decision;
+    FrameDistributor::FrameRef frame;
+
+    while ( mMotionRunning )
+    {
+        // Wake up now and then to check for stopCamera().
+        if ( !mMotionQueue->pop( frame, nv::camera2::WaitTimeMs( 100 ) ) )
+        {
+            continue;
+        }
+
+        if ( !mMotionGate->process( *frame->imageBuffer, decision ) )
+        {
+            frame.reset();
+            continue;
+        }
+        window.push( std::move(frame), decision.open );
+    }
+}
+
+void NativeCamera::recordLoop()
+{
+    const nv::camera2::CameraStream& stream = *mViews[0]->stream;
+    FrameDistributor::FrameRef frame;
+
+    while ( mRecordRunning )
+    {
+        if ( mRecording && !mRecorder->isOpen() )
+        {
+            const bool raw = stream.format() == nv::camera2::RAW16;
+            std::ostringstream name;
+            name << ImageSave::outputDir() << "/video-" << mVideoCount++ <<
+                    ( raw ? ".raw16" : ".y4m" );
+            if ( !mRecorder->open( name.str(), stream.size(),
+                    stream.format() ) )
+            {
+                LOGI("Recording: cannot create %s", name.str().c_str());
+                mRecording = false;
+            }
+            else
+            {
+                LOGI("Recording to %s", name.str().c_str());
+            }
+        }
+        else if ( !mRecording && mRecorder->isOpen() )
+        {
+            const bool ok = mRecorder->close();
+            const VideoRecorder::Counters c = mRecorder->counters();
+            LOGI("Recording stopped: %llu frames, %llu dropped, %s",
+                    (unsigned long long) c.framesWritten,
+                    (unsigned long long) c.framesDropped,
+                    ok ? "done" : "failed");
+        }
+
+        // Wake up now and then to check for stopCamera().
+        if ( !mRecordQueue->pop( frame, nv::camera2::WaitTimeMs( 100 ) ) )
+        {
+            continue;
+        }
+        if ( mRecorder->isOpen() ) mRecorder->write( *frame );
+        frame.reset();
+    }
+
+    if ( mRecorder->isOpen() ) mRecorder->close();
+    mRecording = false;
+}
+
+void NativeCamera::statisticsLoop( CameraView* view )
+{
+    nv::camera2::Statistics statistics;
+    FrameDistributor::FrameRef frame;
+    const bool primary = view == mViews[0].get();
+
+    while ( mStatisticsRunning )
+    {
+        // Wake up now and then to check for stopCamera().
+        if ( !view->statisticsQueue->pop( frame, nv::camera2::WaitTimeMs( 100 ) ) )
+        {
+            continue;
+        }
+
+        // Always the newest frame, whatever the depth of the queue.
+        FrameDistributor::FrameRef newer = view->statisticsQueue->popNewest();
+        if ( newer ) frame = std::move( newer );
+        view->exchange->take( frame->captureTime );
+
+        const bool done = view->statistics->process( *frame->imageBuffer,
+                statistics );
+
+        {
+            std::lock_guard<std::mutex> lk( mMeteringMutex );
+            if ( primary ) mPreviewSettings = frame->resultSettings;
+            if ( done )
+            {
+                view->metering = view->statistics->lastMetering();
+                view->statisticsTimeUs = view->statistics->lastStats().timeUs;
+            }
+        }
+        if ( done ) view->exchange->publish( statistics );
+        else view->exchange->skip();
+        frame.reset();
+    }
+}
+
+void NativeCamera::journalLoop( CameraView* view )
+{
+    nv::camera2::Statistics statistics;
+    FrameDistributor::FrameRef frame;
+    uint64_t dropped = 0;
+
+    while ( mStatisticsRunning )
+    {
+        // Wake up now and then to check for stopCamera().
+        if ( !view->journalQueue->pop( frame, nv::camera2::WaitTimeMs( 100 ) ) )
+        {
+            continue;
+        }
+
+        // Frames displaced from the queue are missing from the journal.
+        const uint64_t queueDropped = view->journalQueue->counters().framesDropped;
+        if ( queueDropped != dropped )
+        {
+            mJournal->countDropped( queueDropped - dropped );
+            dropped = queueDropped;
+        }
+
+        // The statistics thread processes the frame or skips it for a later
+        // one; a processed frame goes in with its statistics. Only the frame
+        // being processed or the newest one waits, and a stalled statistics
+        // thread does not hold the journal up for long.
+        const bool found = view->exchange->wait( frame->captureTime,
+                100000, statistics );
+        mJournal->append( *frame, uint16_t( view->cameraId ),
+                found ? statistics : frame->statistics );
+        frame.reset();
+    }
+}
+
+void NativeCamera::pairLoop()
+{
+    std::vector<FrameDistributor::FrameRef> set;
+    FrameDistributor::FrameRef frame;
+
+    while ( mPairRunning )
+    {
+        // Take whatever the cameras have queued.
+        bool pushed = false;
+        for ( unsigned i = 0; i < mViews.size(); ++i )
+        {
+            while ( mViews[i]->pairQueue->tryPop( frame ) )
+            {
+                mPairer->push( i, std::move( frame ) );
+                pushed = true;
+            }
+        }
+
+        // A set needs a frame of every camera, so with nothing new wait
+        // for one that has none pending. Wake up now and then to check for
+        // stopCamera().
+        const unsigned waiting = mPairer->waitingInput();
+        if ( !pushed && waiting < mViews.size() )
+        {
+            if ( mViews[waiting]->pairQueue->pop( frame,
+                    nv::camera2::WaitTimeMs( 100 ) ) )
+            {
+                mPairer->push( waiting, std::move( frame ) );
+            }
+        }
+
+        while ( mPairer->pop( set ) )
+        {
+            std::lock_guard<std::mutex> lk( mFrameSetMutex );
+            mFrameSet.swap( set );
+        }
+
+        // The previous set is released outside the lock.
+        set.clear();
+    }
+}
+
+void NativeCamera::setupStreamTextures( const nv::camera2::CameraStream *stream,
+    GLuint *textures)
+{
+    uint width, height;
+    width  = stream->size().width;
+    height = stream->size().height;
+
+    glActiveTexture( GL_TEXTURE0 );
+
+    if ( stream->format() == nv::camera2::RAW16 )
+    {
+        // A texture set up before is resized.
+        if ( !textures[0] ) glGenTextures(1, textures);
+
+        // Setup texture for the demosaiced half size preview
+        const nv::camera2::Size size = Demosaic::outputSize(
+                nv::camera2::Size( width, height ), Demosaic::Method::HALF_SIZE );
+        glBindTexture( GL_TEXTURE_2D, textures[0] );
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.width, size.height,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*) NULL);
 
-        // Setup texture for V plane
-        glBindTexture( GL_TEXTURE_2D, textures[2] );
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width/2, height/2,
-                         0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
         CHECK_GL_ERROR();
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
     }
+    // YCbCr_420_888 textures are created by the YuvUploader once it knows
+    // the chroma layout of the buffers.
 }
 
 void NativeCamera::drawStreamImage(const nv::camera2::CameraStream *stream,
-        GLuint *textures)
+        YuvUploader& uploader, GLuint *textures, float viewAspectRatio)
 {
     float edgeX, edgeY;
 
+    if ( stream->format() == nv::camera2::RAW16 && !textures ) return;
+
     // TODO!
     float aspectRatio = (float) stream->size().width /
                         (float) stream->size().height;
-    if ( aspectRatio < mViewAspectRatio )
+    if ( aspectRatio < viewAspectRatio )
     {
-        edgeX = aspectRatio / mViewAspectRatio;
+        edgeX = aspectRatio / viewAspectRatio;
         edgeY = 1.0f;
     }
     // View is taller than image - use entire width, center height
     else
     {
         edgeX = 1.0f;
-        edgeY = mViewAspectRatio / aspectRatio;
+        edgeY = viewAspectRatio / aspectRatio;
     }
 
     float const vertexPosition[] = {
@@ -214,14 +981,41 @@ void NativeCamera::drawStreamImage(const nv::camera2::CameraStream *stream,
         1.0f, 0.0f,
         0.0f, 0.0f };
 
-    if ( stream->format() == nv::camera2::YCbCr_420_888)
+    if ( stream->format() == nv::camera2::YCbCr_420_888 &&
+         uploader.interleaved() )
+    {
+        // NV12/NV21: luma and one two channel chroma texture.
+        NvGLSLProgram& prog = *mProgYUVSemiPlanar;
+        glUseProgram(prog.getProgram());
+
+        glActiveTexture( GL_TEXTURE0 );
+        glBindTexture( GL_TEXTURE_2D, uploader.lumaTexture() );
+        glActiveTexture( GL_TEXTURE1 );
+        glBindTexture( GL_TEXTURE_2D, uploader.chromaTexture(0) );
+
+        glUniform1i(prog.getUniformLocation("uYTex"), 0);
+        glUniform1i(prog.getUniformLocation("uUVTex"), 1);
+        glUniform1f(prog.getUniformLocation("uVUOrder"),
+                uploader.layout() == YuvUploader::Layout::NV21 ? 1.0f : 0.0f);
+
+        int aPosCoord = prog.getAttribLocation("aPosition");
+        int aTexCoord = prog.getAttribLocation("aTexCoord");
+
+        glVertexAttribPointer(aPosCoord, 2, GL_FLOAT, GL_FALSE, 0, vertexPosition);
+        glVertexAttribPointer(aTexCoord, 2, GL_FLOAT, GL_FALSE, 0, textureCoord);
+        glEnableVertexAttribArray(aPosCoord);
+        glEnableVertexAttribArray(aTexCoord);
+    }
+    else if ( stream->format() == nv::camera2::YCbCr_420_888)
     {
         glUseProgram(mProgYUV->getProgram());
 
-        for ( uint i = 0; i < 3; ++i )
+        glActiveTexture( GL_TEXTURE0 );
+        glBindTexture( GL_TEXTURE_2D, uploader.lumaTexture() );
+        for ( uint i = 0; i < 2; ++i )
         {
-            glActiveTexture( GL_TEXTURE0 + i );
-            glBindTexture( GL_TEXTURE_2D, textures[i]);
+            glActiveTexture( GL_TEXTURE1 + i );
+            glBindTexture( GL_TEXTURE_2D, uploader.chromaTexture(i) );
         }
 
         glUniform1i(mProgYUV->getUniformLocation("uYTex"), 0);
@@ -238,6 +1032,22 @@ void NativeCamera::drawStreamImage(const nv::camera2::CameraStream *stream,
 
 
     }
+    else if ( stream->format() == nv::camera2::RAW16 )
+    {
+        glUseProgram(mProgRGB->getProgram());
+
+        glActiveTexture( GL_TEXTURE0 );
+        glBindTexture( GL_TEXTURE_2D, textures[0]);
+        glUniform1i(mProgRGB->getUniformLocation("uRGBTex"), 0);
+
+        int aPosCoord = mProgRGB->getAttribLocation("aPosition");
+        int aTexCoord = mProgRGB->getAttribLocation("aTexCoord");
+
+        glVertexAttribPointer(aPosCoord, 2, GL_FLOAT, GL_FALSE, 0, vertexPosition);
+        glVertexAttribPointer(aTexCoord, 2, GL_FLOAT, GL_FALSE, 0, textureCoord);
+        glEnableVertexAttribArray(aPosCoord);
+        glEnableVertexAttribArray(aTexCoord);
+    }
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
@@ -255,31 +1065,211 @@ void NativeCamera::draw(void)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Nothing to draw if the preview stream is no longer running.
-    if ( !mPreviewStream ) return;
+    std::lock_guard<std::mutex> lk( mCameraMutex );
 
-    // Dequeue the next available frame - do not wait, if a frame
-    // is not available we will render the previous frame.
-    std::unique_ptr<nv::camera2::CameraFrame> frame;
-    frame = mPreviewStream->dequeue( 0 );
+    // Nothing to draw if the preview streams are no longer running.
+    if ( mViews.empty() ) return;
 
-    if ( frame )
+    // Uploaders own GL objects, so they stay with the GL thread and
+    // outlive the views.
+    while ( mYuvUploaders.size() < mViews.size() )
     {
-        // Update the textures with the image content.
-        uploadImage( *(frame->imageBuffer.get()), mPreviewTextures );
+        mYuvUploaders.push_back( std::unique_ptr<YuvUploader>( new YuvUploader() ) );
+    }
+
+    FrameTracer& tracer = FrameTracer::instance();
+
+    // All cameras are drawn in one pass, in a grid of equal cells.
+    const unsigned numViews = mViews.size();
+    unsigned columns = 1;
+    while ( columns * columns < numViews ) ++columns;
+    const unsigned rows = ( numViews + columns - 1 ) / columns;
+    const GLsizei cellWidth = mViewWidth / columns;
+    const GLsizei cellHeight = mViewHeight / rows;
+    const float cellAspectRatio = mViewAspectRatio * rows / columns;
+
+    for ( unsigned i = 0; i < numViews; ++i )
+    {
+        CameraView& view = *mViews[i];
+        if ( numViews > 1 )
+        {
+            glViewport( ( i % columns ) * cellWidth,
+                    ( rows - 1 - i / columns ) * cellHeight,
+                    cellWidth, cellHeight );
+        }
+
+        // Take the newest captured frame - do not wait, if a frame
+        // is not available we will render the previous frame.
+        FrameDistributor::FrameRef frame = view.preview->acquire();
+
+        if ( frame && view.session->frameArrived( *frame ) )
+        {
+            const CameraSession::Counters session = view.session->counters();
+            if ( session.lastStartWarm )
+            {
+                LOGI("Camera %d: warm start, first frame after %lld us, "
+                     "mean %lld us", view.cameraId,
+                     (long long) session.lastWarmUs,
+                     (long long) session.meanWarmUs);
+            }
+            else
+            {
+                LOGI("Camera %d: cold start, first frame after %lld us, "
+                     "mean %lld us; manager %lld us, properties %lld us (%s), "
+                     "device %lld us", view.cameraId,
+                     (long long) session.lastColdUs,
+                     (long long) session.meanColdUs,
+                     (long long) session.managerUs,
+                     (long long) session.propertiesUs,
+                     session.lastCached ? "cached" : "queried",
+                     (long long) session.deviceUs);
+            }
+        }
+
+        // RAW16 previews are only set up for camera 0, once its stream runs.
+        GLuint* textures = nullptr;
+        if ( i == 0 && view.stream->format() == nv::camera2::RAW16 )
+        {
+            const nv::camera2::Size size = view.stream->size();
+            if ( !mPreviewTextures[0] ||
+                 size.width != mPreviewTextureSize.width ||
+                 size.height != mPreviewTextureSize.height )
+            {
+                setupStreamTextures( view.stream.get(), mPreviewTextures );
+                mPreviewTextureSize = size;
+            }
+            textures = mPreviewTextures;
+        }
+
+        if ( frame )
+        {
+            // Zoom uploads only the pixels shown; the textures take the
+            // size of the view.
+            nv::camera2::CameraBuffer* img = frame->imageBuffer.get();
+            BufferView zoomed;
+            if ( i == 0 && mZoom > 1.0f &&
+                 img->format() == nv::camera2::YCbCr_420_888 &&
+                 zoomed.attach( *img, zoomRect( *img ) ) )
+            {
+                img = &zoomed;
+            }
+
+            // Update the textures with the image content.
+            const int64_t uploadStart = FrameTracer::now();
+            uploadImage( *img, *mYuvUploaders[i], textures );
+            tracer.record( FrameTracer::Stage::UPLOAD, *frame, uploadStart );
+        }
+
+        // Draw the image
+        const int64_t drawStart = FrameTracer::now();
+        drawStreamImage( view.stream.get(), *mYuvUploaders[i], textures,
+                cellAspectRatio );
+        if ( frame )
+        {
+            tracer.record( FrameTracer::Stage::DRAW, *frame, drawStart );
+            view.preview->presented( *frame );
+        }
     }
 
-    // Draw the image
-    drawStreamImage(mPreviewStream.get(), mPreviewTextures);
+    if ( numViews > 1 )
+    {
+        glViewport( 0, 0, mViewWidth, mViewHeight );
+    }
 
-    // print fps
+    // print fps and the capture to display latency
     if (mFrameRate->nextFrame())
     {
-        LOGI("fps: %.2f", mFrameRate->getMeanFramerate());
+        const FrameTracer::StageSummary draw =
+                tracer.summary( FrameTracer::Stage::DRAW );
+        const FrameTracer::StageSummary upload =
+                tracer.summary( FrameTracer::Stage::UPLOAD );
+        const StreamConsumer::Counters preview =
+                mViews[0]->preview->counters();
+        LOGI("fps: %.2f, capture to draw p50 %lld us p99 %lld us, "
+             "preview frames dropped %llu, frame duration %lld us, "
+             "upload p99 %lld us, saves dropped %llu",
+             mFrameRate->getMeanFramerate(),
+             (long long) draw.latencyP50, (long long) draw.latencyP99,
+             (unsigned long long) preview.framesDropped,
+             (long long) preview.frameDurationUs,
+             (long long) upload.durationP99,
+             (unsigned long long) tracer.summary(
+                     FrameTracer::Stage::SAVE_ENQUEUE ).dropped);
+
+        // Throughput of every camera since the last report.
+        const int64_t now = FrameTracer::now();
+        FramePairer::Counters pairs;
+        if ( mPairer ) pairs = mPairer->counters();
+        for ( unsigned i = 0; i < numViews; ++i )
+        {
+            CameraView& view = *mViews[i];
+            const FrameDistributor::Counters capture = view.fanout->counters();
+            const double seconds = ( now - view.reportTime ) * 1e-9;
+            const double fps = view.reportTime > 0 && seconds > 0.0 ?
+                    ( capture.framesCaptured - view.reportedFrames ) / seconds :
+                    0.0;
+            view.reportedFrames = capture.framesCaptured;
+            view.reportTime = now;
+
+            std::lock_guard<std::mutex> lk( mMeteringMutex );
+            LOGI("camera %d: %.1f fps, %llu starved, %llu unpaired, "
+                 "luma mean %.1f center weighted %.1f median %u, "
+                 "clipped %.2f%%, statistics %lld us",
+                 view.cameraId, fps,
+                 (unsigned long long) capture.framesStarved,
+                 (unsigned long long) ( mPairer ? pairs.framesUnmatched[i] : 0 ),
+                 view.metering.meanLuma, view.metering.centerWeightedLuma,
+                 (unsigned) view.metering.medianLuma,
+                 100.0f * view.metering.clippedFraction,
+                 (long long) view.statisticsTimeUs);
+        }
+        if ( mPairer )
+        {
+            LOGI("frame sets %llu, skew mean %lld us max %lld us",
+                 (unsigned long long) pairs.sets,
+                 (long long) pairs.meanSkewUs, (long long) pairs.maxSkewUs);
+        }
+
+        const MotionGate::Counters motion = mMotionGate->counters();
+        LOGI("motion gate openings %llu, open %llu of %llu frames, "
+             "gate mean %lld us max %lld us",
+             (unsigned long long) motion.openings,
+             (unsigned long long) motion.framesOpen,
+             (unsigned long long) motion.framesProcessed,
+             (long long) motion.meanTimeUs, (long long) motion.maxTimeUs);
+
+        const MetadataJournal::Counters journal = mJournal->counters();
+        LOGI("journal %llu records, %.1f MB statistics, %llu statistics "
+             "dropped, %llu frames dropped",
+             (unsigned long long) journal.records,
+             journal.statisticsBytes / 1048576.0,
+             (unsigned long long) journal.statisticsDropped,
+             (unsigned long long) journal.framesDropped);
+
+        if ( mRecording )
+        {
+            const VideoRecorder::Counters video = mRecorder->counters();
+            LOGI("recording %llu frames, %llu dropped, %.1f MB",
+                 (unsigned long long) video.framesWritten,
+                 (unsigned long long) video.framesDropped,
+                 video.bytesWritten / 1048576.0);
+        }
     }
 }
 
-void NativeCamera::uploadImage( nv::camera2::CameraBuffer &img, GLuint *textures )
+void NativeCamera::exportTrace()
+{
+    FrameTracer& tracer = FrameTracer::instance();
+    const std::string base = ImageSave::outputDir() + "/trace";
+
+    const bool json = tracer.writeChromeTrace( base + ".json" );
+    const bool binary = tracer.writeBinaryLog( base + ".bin" );
+    LOGI("trace export to %s.json/.bin: %s", base.c_str(),
+            json && binary ? "done" : "failed");
+}
+
+void NativeCamera::uploadImage( nv::camera2::CameraBuffer &img,
+        YuvUploader& uploader, GLuint *textures )
 {
 
     nv::camera2::CameraBuffer::Data imgPlane;
@@ -287,31 +1277,27 @@ void NativeCamera::uploadImage( nv::camera2::CameraBuffer &img, GLuint *textures
 
     if ( img.format() == nv::camera2::YCbCr_420_888 )
     {
-        for ( uint i = 0; i < 3; i++ )
-        {
-            imgPlane = img.data(i);
-            glPixelStorei(GL_UNPACK_ROW_LENGTH, imgPlane.stride);
-
-            glActiveTexture( GL_TEXTURE0 + i);
-            glBindTexture( GL_TEXTURE_2D, textures[i] );
-            glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0,
-                imgPlane.width, imgPlane.height,
-                GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*) imgPlane.ptr);
-
-            glBindTexture( GL_TEXTURE_2D, 0 );
-            CHECK_GL_ERROR();
-        }
+        // Two texture updates for NV12/NV21, three for planar buffers,
+        // all from a pixel buffer.
+        uploader.upload( img );
+        CHECK_GL_ERROR();
     }
-    else if ( img.format() == nv::camera2::RAW16 )
+    else if ( img.format() == nv::camera2::RAW16 && mRawPreview && textures )
     {
+        // Demosaic to a half size RGBA image on the CPU
         imgPlane = img.data(0);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, imgPlane.stride);
+        const nv::camera2::Size size = Demosaic::outputSize(
+                nv::camera2::Size( imgPlane.width, imgPlane.height ),
+                Demosaic::Method::HALF_SIZE );
+        mRawPreviewPixels.resize( size.width * size.height * 4 );
+        if ( !mRawPreview->process( imgPlane, mRawPreviewPixels.data(),
+                size.width * 4 ) ) return;
 
         glActiveTexture( GL_TEXTURE0 );
         glBindTexture( GL_TEXTURE_2D, textures[0] );
         glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0,
-            imgPlane.width, imgPlane.height,
-            GL_LUMINANCE, GL_UNSIGNED_SHORT, (GLvoid*) imgPlane.ptr);
+            size.width, size.height,
+            GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*) mRawPreviewPixels.data());
 
         glBindTexture( GL_TEXTURE_2D, 0 );
         CHECK_GL_ERROR();
@@ -7,7 +7,27 @@
 
 #include "native_camera2/native_camera2.h"
 
+#include "AsyncImageSaver.h"
+#include "BufferView.h"
+#include "BurstCapture.h"
+#include "CameraSession.h"
+#include "Demosaic.h"
+#include "FrameDistributor.h"
+#include "FramePairer.h"
+#include "MetadataJournal.h"
+#include "MotionGate.h"
+#include "StatisticsEngine.h"
+#include "StatisticsExchange.h"
+#include "StreamConsumer.h"
+#include "VideoRecorder.h"
+#include "YuvUploader.h"
+#include "ZslCapture.h"
+
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class NvStopWatch;
 class NvFramerateCounter;
@@ -26,29 +46,181 @@ public:
 
     void configurationCallback(NvEGLConfiguration& config);
 
+    NvUIEventResponse handleReaction(const NvUIReaction& react);
+
 protected:
     void drawStreamImage(const nv::camera2::CameraStream *stream,
-            GLuint *textures);
+            YuvUploader& uploader, GLuint *textures, float viewAspectRatio);
     void setupStreamTextures( const nv::camera2::CameraStream *stream,
             GLuint *textures);
     void uploadImage( nv::camera2::CameraBuffer &img,
-            GLuint *textures);
+            YuvUploader& uploader, GLuint *textures);
 
     std::unique_ptr<NvFramerateCounter> mFrameRate;
     std::unique_ptr<NvGLSLProgram> mProgYUV;
+    std::unique_ptr<NvGLSLProgram> mProgYUVSemiPlanar;
+    std::unique_ptr<NvGLSLProgram> mProgRGB;
+    // RAW16 preview texture of camera 0 and the stream size it was set up
+    // for, by draw() on the GL thread
     GLuint mPreviewTextures[4];
+    nv::camera2::Size mPreviewTextureSize;
+    // One per camera view, kept on the GL thread across camera restarts
+    std::vector<std::unique_ptr<YuvUploader>> mYuvUploaders;
     float mViewAspectRatio;
+    int32_t mViewWidth;
+    int32_t mViewHeight;
 
     // Camera setup and destruction
     void startCamera();
     void stopCamera();
 
-    // Camera objects
-    std::unique_ptr<nv::camera2::CameraManager> mCameraManager;
-    std::unique_ptr<nv::camera2::CameraDevice>  mCameraDevice;
-    std::unique_ptr<nv::camera2::CameraStream>  mPreviewStream;
+    // Resumes the streaming requests of warm sessions, false if any of
+    // them has to be started again
+    bool resumeCamera();
+
+    // Adds the session of the next camera id
+    void addSession();
+
+    // Tears the camera down once it has been paused for too long, called
+    // from the session's timer thread
+    void expireCamera();
+
+    // Camera objects. Session i is camera i; the sessions keep the
+    // devices and the streams open while the app is paused. mCameraMutex
+    // serializes focus changes, drawing and the expiry of the sessions.
+    std::vector<std::unique_ptr<CameraSession>> mSessions;
+    std::mutex mCameraMutex;
+
+    // Manager every session connects through: the camera HAL's, or a
+    // replay one, see replayManager()
+    std::shared_ptr<nv::camera2::CameraManager> mManager;
+    bool mReplaying;
+
+    // Preview stream of one camera, with a capture thread, frame slots and
+    // statistics of its own
+    struct CameraView
+    {
+        int cameraId = 0;
+        CameraSession* session = nullptr;
+        nv::camera2::StaticProperties properties;
+        nv::camera2::CaptureRequest request;
+        std::unique_ptr<nv::camera2::CameraStream> stream;
+
+        // Capture thread of the stream, pinned to a core, and the queues
+        // the GL thread, the statistics thread and the pairing thread
+        // take frames from
+        std::unique_ptr<FrameDistributor> fanout;
+        FrameDistributor::Consumer* previewQueue = nullptr;
+        FrameDistributor::Consumer* statisticsQueue = nullptr;
+        FrameDistributor::Consumer* journalQueue = nullptr;
+        FrameDistributor::Consumer* pairQueue = nullptr;
+
+        // Picks the preview frame from previewQueue and slows the sensor
+        // down while the GL thread lags behind
+        std::unique_ptr<StreamConsumer> preview;
+
+        // CPU statistics of the preview frames; metering and
+        // statisticsTimeUs are guarded by mMeteringMutex
+        std::unique_ptr<StatisticsEngine> statistics;
+        std::thread statisticsThread;
+        StatisticsEngine::Metering metering;
+        int64_t statisticsTimeUs = 0;
+
+        // CPU statistics of the last processed frames, for the journal
+        // thread and anything else that wants more than the metering
+        std::unique_ptr<StatisticsExchange> exchange;
+        std::thread journalThread;
+
+        // Frames captured at the last report, kept by the GL thread
+        uint64_t reportedFrames = 0;
+        int64_t reportTime = 0;
+    };
+
+    // Open cameras, camera 0 first; its stream also feeds the stills,
+    // bursts, motion gate and recording below
+    std::vector<std::unique_ptr<CameraView>> mViews;
     nv::camera2::StaticProperties mStaticProperties;
-    nv::camera2::CaptureRequest mRequest;
+
+    // CPU statistics of the preview frames and the journal, two threads
+    // per camera
+    void statisticsLoop( CameraView* view );
+    void journalLoop( CameraView* view );
+
+    std::atomic<bool> mStatisticsRunning;
+    std::mutex mMeteringMutex;
+
+    // Metadata of every frame of every camera, with the CPU statistics of
+    // the frames that have them, appended by the journal threads
+    std::unique_ptr<MetadataJournal> mJournal;
+
+    // Result settings of the last preview frame of camera 0, the base
+    // exposure of bursts
+    nv::camera2::RequestSettings mPreviewSettings;
+
+    // Frames of all cameras matched by capture time on their own thread;
+    // the last complete set is saved with every still
+    void pairLoop();
+    void saveFrameSet();
+
+    std::unique_ptr<FramePairer> mPairer;
+    std::thread mPairThread;
+    std::atomic<bool> mPairRunning;
+    std::mutex mFrameSetMutex;
+    std::vector<FrameDistributor::FrameRef> mFrameSet;
+    uint32_t mFrameSetCount;
+
+    // Zero shutter lag stills
+    void captureStill();
+
+    // Writes the frame trace to ImageSave::outputDir()
+    void exportTrace();
+
+    std::unique_ptr<ZslCapture> mZsl;
+    std::unique_ptr<AsyncImageSaver> mSaver;
+    uint32_t mStillCount;
+
+    // Digital zoom of camera 0: the preview shows a BufferView of every
+    // frame and stills are scaled back up from the same region
+    void cycleZoom();
+    BufferView::Rect zoomRect( nv::camera2::CameraBuffer& img ) const;
+
+    float mZoom;
+
+    // Merged bursts, captured on the ZSL stream on their own thread
+    void captureBurst();
+    void burstLoop();
+
+    std::unique_ptr<BurstCapture> mBurst;
+    std::thread mBurstThread;
+    std::atomic<bool> mBurstRunning;
+    uint32_t mBurstCount;
+
+    // Motion gated recording of the preview stream; the gate runs on every
+    // frame, frames are only saved while recording and the gate is open
+    void motionLoop();
+    void toggleMotionRecording();
+
+    FrameDistributor::Consumer* mMotionQueue;
+    std::unique_ptr<MotionGate> mMotionGate;
+    std::thread mMotionThread;
+    std::atomic<bool> mMotionRunning;
+    std::atomic<bool> mMotionRecording;
+    uint32_t mMotionCount;
+
+    // Preview stream recording into one file, started and stopped on the
+    // recording thread when mRecording changes
+    void recordLoop();
+
+    FrameDistributor::Consumer* mRecordQueue;
+    std::unique_ptr<VideoRecorder> mRecorder;
+    std::thread mRecordThread;
+    std::atomic<bool> mRecordRunning;
+    std::atomic<bool> mRecording;
+    uint32_t mVideoCount;
+
+    // Half size RGB preview of RAW16 streams
+    std::unique_ptr<Demosaic> mRawPreview;
+    std::vector<uint8_t> mRawPreviewPixels;
 
 };
 
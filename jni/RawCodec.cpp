@@ -0,0 +1,1076 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "RawCodec.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define RAWCODEC_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define RAWCODEC_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+const char MAGIC[4] = { 'N', 'V', 'R', 'C' };
+constexpr uint8_t VERSION = 1;
+
+// Samples per packed run and per Rice parameter.
+constexpr int RUN = 16;
+
+// Samples the row predictor is chosen on: one run in four.
+constexpr int SAMPLE_STEP = 4 * RUN;
+
+// Unary prefixes this long are followed by the residual as is, wide
+// enough for the difference of any two 16 bit samples.
+constexpr unsigned ESCAPE = 16;
+constexpr unsigned RAW_BITS = 17;
+
+constexpr unsigned K_BITS = 5;
+constexpr unsigned MAX_K = 16;
+constexpr unsigned PREDICTOR_BITS = 2;
+
+// Row predictors of LOSSLESS, from the same color samples two to the left
+// and two rows up.
+enum Predictor
+{
+    LEFT,
+    UP,
+    MED,    //< Median edge detector of LOCO-I.
+    NUM_PREDICTORS
+};
+
+// Little endian on disk, followed by the byte count of every stripe as
+// uint32_t and the stripes.
+struct FileHeader
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t mode;
+    uint8_t bitDepth;
+    uint8_t cfaPattern;
+    uint32_t width;
+    uint32_t height;
+    int32_t blackLevel[4];
+    int32_t whiteLevel;
+    int32_t requestId;
+    int64_t captureTime;
+    int64_t exposure;
+    int64_t frameDuration;
+    int32_t sensitivity;
+    uint32_t stripeRows;
+    uint32_t stripes;
+    uint32_t reserved;
+};
+
+static_assert( sizeof(FileHeader) == 80, "FileHeader is not packed" );
+
+/*
+ * pack() stores runs of RUN samples, clamped to the bit depth, as their
+ * high bytes followed by the low bits: first a nibble per sample, samples
+ * j and j + 8 in byte j, then two bits per sample, samples j, j + 4,
+ * j + 8 and j + 12 in byte j, as far as the depth needs them. unpack()
+ * reverses it. 16 bit samples are stored as is.
+ */
+typedef void (*PackKernel)( const uint16_t* src, int runs, uint8_t* dst );
+typedef void (*UnpackKernel)( const uint8_t* src, int runs, uint16_t* dst );
+
+struct KernelSet
+{
+    // Indexed by depthIndex().
+    PackKernel pack[4];
+    UnpackKernel unpack[4];
+};
+
+unsigned depthIndex( unsigned depth )
+{
+    return ( depth - 10 ) / 2;
+}
+
+size_t runBytes( unsigned depth )
+{
+    return 2 * depth;
+}
+
+void pack16( const uint16_t* src, int runs, uint8_t* dst )
+{
+    memcpy( dst, src, runs * RUN * sizeof(uint16_t) );
+}
+
+void unpack16( const uint8_t* src, int runs, uint16_t* dst )
+{
+    memcpy( dst, src, runs * RUN * sizeof(uint16_t) );
+}
+
+template <int D>
+void packScalar( const uint16_t* src, int runs, uint8_t* dst )
+{
+    const unsigned maxValue = ( 1u << D ) - 1;
+    const int shift = D == 14 ? 2 : 0;
+
+    for ( int r = 0; r < runs; ++r, src += RUN )
+    {
+        unsigned v[RUN];
+        for ( int i = 0; i < RUN; ++i )
+        {
+            v[i] = std::min<unsigned>( src[i], maxValue );
+            dst[i] = uint8_t( v[i] >> ( D - 8 ) );
+        }
+        dst += RUN;
+
+        if ( D == 12 || D == 14 )
+        {
+            for ( int j = 0; j < 8; ++j )
+            {
+                dst[j] = uint8_t( ( ( v[j] >> shift ) & 15 ) |
+                                  ( ( ( v[j + 8] >> shift ) & 15 ) << 4 ) );
+            }
+            dst += 8;
+        }
+        if ( D == 10 || D == 14 )
+        {
+            for ( int j = 0; j < 4; ++j )
+            {
+                dst[j] = uint8_t( ( v[j] & 3 ) | ( v[j + 4] & 3 ) << 2 |
+                                  ( v[j + 8] & 3 ) << 4 | ( v[j + 12] & 3 ) << 6 );
+            }
+            dst += 4;
+        }
+    }
+}
+
+template <int D>
+void unpackScalar( const uint8_t* src, int runs, uint16_t* dst )
+{
+    const int shift = D == 14 ? 2 : 0;
+
+    for ( int r = 0; r < runs; ++r, dst += RUN )
+    {
+        unsigned v[RUN];
+        for ( int i = 0; i < RUN; ++i )
+        {
+            v[i] = unsigned( src[i] ) << ( D - 8 );
+        }
+        src += RUN;
+
+        if ( D == 12 || D == 14 )
+        {
+            for ( int j = 0; j < 8; ++j )
+            {
+                v[j] |= unsigned( src[j] & 15 ) << shift;
+                v[j + 8] |= unsigned( src[j] >> 4 ) << shift;
+            }
+            src += 8;
+        }
+        if ( D == 10 || D == 14 )
+        {
+            for ( int j = 0; j < 4; ++j )
+            {
+                v[j] |= src[j] & 3;
+                v[j + 4] |= ( src[j] >> 2 ) & 3;
+                v[j + 8] |= ( src[j] >> 4 ) & 3;
+                v[j + 12] |= src[j] >> 6;
+            }
+            src += 4;
+        }
+
+        for ( int i = 0; i < RUN; ++i )
+        {
+            dst[i] = uint16_t( v[i] );
+        }
+    }
+}
+
+#if RAWCODEC_HAVE_SSE2
+
+template <int D>
+void packSse2( const uint16_t* src, int runs, uint8_t* dst )
+{
+    const __m128i maxValue = _mm_set1_epi16( short( ( 1 << D ) - 1 ) );
+    const __m128i mask4 = _mm_set1_epi16( 15 );
+    const __m128i mask2 = _mm_set1_epi16( 3 );
+    const int shift = D == 14 ? 2 : 0;
+
+    for ( int r = 0; r < runs; ++r, src += RUN )
+    {
+        // Unsigned min without SSE4.1: x - max( x - m, 0 ).
+        __m128i a = _mm_loadu_si128( (const __m128i*) src );
+        __m128i b = _mm_loadu_si128( (const __m128i*)( src + 8 ) );
+        a = _mm_sub_epi16( a, _mm_subs_epu16( a, maxValue ) );
+        b = _mm_sub_epi16( b, _mm_subs_epu16( b, maxValue ) );
+
+        _mm_storeu_si128( (__m128i*) dst, _mm_packus_epi16(
+                _mm_srli_epi16( a, D - 8 ), _mm_srli_epi16( b, D - 8 ) ) );
+        dst += RUN;
+
+        // Byte shifts bring sample j + 8 (and j + 4) next to sample j;
+        // the 16 bit shifts after them cannot carry across bytes.
+        if ( D == 12 || D == 14 )
+        {
+            const __m128i n = _mm_packus_epi16(
+                    _mm_and_si128( _mm_srli_epi16( a, shift ), mask4 ),
+                    _mm_and_si128( _mm_srli_epi16( b, shift ), mask4 ) );
+            _mm_storel_epi64( (__m128i*) dst, _mm_or_si128( n,
+                    _mm_slli_epi16( _mm_srli_si128( n, 8 ), 4 ) ) );
+            dst += 8;
+        }
+        if ( D == 10 || D == 14 )
+        {
+            const __m128i c = _mm_packus_epi16( _mm_and_si128( a, mask2 ),
+                    _mm_and_si128( b, mask2 ) );
+            __m128i t = _mm_or_si128( c, _mm_slli_epi16( _mm_srli_si128( c, 8 ), 4 ) );
+            t = _mm_or_si128( t, _mm_slli_epi16( _mm_srli_si128( t, 4 ), 2 ) );
+            const int32_t word = _mm_cvtsi128_si32( t );
+            memcpy( dst, &word, 4 );
+            dst += 4;
+        }
+    }
+}
+
+template <int D>
+void unpackSse2( const uint8_t* src, int runs, uint16_t* dst )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask4 = _mm_set1_epi8( 15 );
+    const __m128i mask2[4] = {
+            _mm_set_epi32( 0, 0, 0, 0x03030303 ),
+            _mm_set_epi32( 0, 0, 0x03030303, 0 ),
+            _mm_set_epi32( 0, 0x03030303, 0, 0 ),
+            _mm_set_epi32( 0x03030303, 0, 0, 0 ) };
+    const int shift = D == 14 ? 2 : 0;
+
+    for ( int r = 0; r < runs; ++r, dst += RUN )
+    {
+        const __m128i h = _mm_loadu_si128( (const __m128i*) src );
+        __m128i a = _mm_slli_epi16( _mm_unpacklo_epi8( h, zero ), D - 8 );
+        __m128i b = _mm_slli_epi16( _mm_unpackhi_epi8( h, zero ), D - 8 );
+        src += RUN;
+
+        if ( D == 12 || D == 14 )
+        {
+            // Low nibbles are samples 0 to 7, high nibbles 8 to 15.
+            const __m128i bytes = _mm_loadl_epi64( (const __m128i*) src );
+            const __m128i n = _mm_and_si128( _mm_unpacklo_epi64( bytes,
+                    _mm_srli_epi16( bytes, 4 ) ), mask4 );
+            a = _mm_or_si128( a, _mm_slli_epi16( _mm_unpacklo_epi8( n, zero ), shift ) );
+            b = _mm_or_si128( b, _mm_slli_epi16( _mm_unpackhi_epi8( n, zero ), shift ) );
+            src += 8;
+        }
+        if ( D == 10 || D == 14 )
+        {
+            // The four bytes repeated, each copy shifted to its samples.
+            int32_t word;
+            memcpy( &word, src, 4 );
+            const __m128i bytes = _mm_shuffle_epi32( _mm_cvtsi32_si128( word ), 0 );
+            __m128i c = _mm_and_si128( bytes, mask2[0] );
+            c = _mm_or_si128( c, _mm_and_si128( _mm_srli_epi16( bytes, 2 ), mask2[1] ) );
+            c = _mm_or_si128( c, _mm_and_si128( _mm_srli_epi16( bytes, 4 ), mask2[2] ) );
+            c = _mm_or_si128( c, _mm_and_si128( _mm_srli_epi16( bytes, 6 ), mask2[3] ) );
+            a = _mm_or_si128( a, _mm_unpacklo_epi8( c, zero ) );
+            b = _mm_or_si128( b, _mm_unpackhi_epi8( c, zero ) );
+            src += 4;
+        }
+
+        _mm_storeu_si128( (__m128i*) dst, a );
+        _mm_storeu_si128( (__m128i*)( dst + 8 ), b );
+    }
+}
+
+#endif
+
+#if RAWCODEC_HAVE_NEON
+
+template <int D>
+void packNeon( const uint16_t* src, int runs, uint8_t* dst )
+{
+    const uint16x8_t maxValue = vdupq_n_u16( ( 1 << D ) - 1 );
+    const uint16x8_t mask4 = vdupq_n_u16( 15 );
+    const uint16x8_t mask2 = vdupq_n_u16( 3 );
+
+    for ( int r = 0; r < runs; ++r, src += RUN )
+    {
+        const uint16x8_t a = vminq_u16( vld1q_u16( src ), maxValue );
+        const uint16x8_t b = vminq_u16( vld1q_u16( src + 8 ), maxValue );
+
+        vst1q_u8( dst, vcombine_u8( vmovn_u16( vshrq_n_u16( a, D - 8 ) ),
+                vmovn_u16( vshrq_n_u16( b, D - 8 ) ) ) );
+        dst += RUN;
+
+        if ( D == 12 || D == 14 )
+        {
+            const uint16x8_t an = D == 14 ? vshrq_n_u16( a, 2 ) : a;
+            const uint16x8_t bn = D == 14 ? vshrq_n_u16( b, 2 ) : b;
+            const uint8x8_t lo = vmovn_u16( vandq_u16( an, mask4 ) );
+            const uint8x8_t hi = vmovn_u16( vandq_u16( bn, mask4 ) );
+            vst1_u8( dst, vorr_u8( lo, vshl_n_u8( hi, 4 ) ) );
+            dst += 8;
+        }
+        if ( D == 10 || D == 14 )
+        {
+            const uint8x8_t lo = vmovn_u16( vandq_u16( a, mask2 ) );
+            const uint8x8_t hi = vmovn_u16( vandq_u16( b, mask2 ) );
+            const uint8x8_t t = vorr_u8( lo, vshl_n_u8( hi, 4 ) );
+            const uint8x8_t c = vorr_u8( t, vshl_n_u8( vext_u8( t, t, 4 ), 2 ) );
+            uint8_t bytes[8];
+            vst1_u8( bytes, c );
+            memcpy( dst, bytes, 4 );
+            dst += 4;
+        }
+    }
+}
+
+template <int D>
+void unpackNeon( const uint8_t* src, int runs, uint16_t* dst )
+{
+    // Right shifts of the repeated two bit bytes, per sample.
+    const int8x8_t shiftLo = vcreate_s8( 0xFEFEFEFE00000000ull );
+    const int8x8_t shiftHi = vcreate_s8( 0xFAFAFAFAFCFCFCFCull );
+    const uint8x8_t mask4 = vdup_n_u8( 15 );
+    const uint8x8_t mask2 = vdup_n_u8( 3 );
+
+    for ( int r = 0; r < runs; ++r, dst += RUN )
+    {
+        const uint8x16_t h = vld1q_u8( src );
+        uint16x8_t a = vshlq_n_u16( vmovl_u8( vget_low_u8( h ) ), D - 8 );
+        uint16x8_t b = vshlq_n_u16( vmovl_u8( vget_high_u8( h ) ), D - 8 );
+        src += RUN;
+
+        if ( D == 12 || D == 14 )
+        {
+            const uint8x8_t n = vld1_u8( src );
+            uint16x8_t lo = vmovl_u8( vand_u8( n, mask4 ) );
+            uint16x8_t hi = vmovl_u8( vshr_n_u8( n, 4 ) );
+            if ( D == 14 )
+            {
+                lo = vshlq_n_u16( lo, 2 );
+                hi = vshlq_n_u16( hi, 2 );
+            }
+            a = vorrq_u16( a, lo );
+            b = vorrq_u16( b, hi );
+            src += 8;
+        }
+        if ( D == 10 || D == 14 )
+        {
+            uint32_t word;
+            memcpy( &word, src, 4 );
+            const uint8x8_t bytes = vreinterpret_u8_u32( vdup_n_u32( word ) );
+            a = vorrq_u16( a, vmovl_u8( vand_u8( vshl_u8( bytes, shiftLo ), mask2 ) ) );
+            b = vorrq_u16( b, vmovl_u8( vand_u8( vshl_u8( bytes, shiftHi ), mask2 ) ) );
+            src += 4;
+        }
+
+        vst1q_u16( dst, a );
+        vst1q_u16( dst + 8, b );
+    }
+}
+
+#endif
+
+const KernelSet* selectKernel( RawCodec::Kernel kernel )
+{
+    static const KernelSet scalar = {
+            { packScalar<10>, packScalar<12>, packScalar<14>, pack16 },
+            { unpackScalar<10>, unpackScalar<12>, unpackScalar<14>, unpack16 } };
+#if RAWCODEC_HAVE_NEON
+    static const KernelSet neon = {
+            { packNeon<10>, packNeon<12>, packNeon<14>, pack16 },
+            { unpackNeon<10>, unpackNeon<12>, unpackNeon<14>, unpack16 } };
+#endif
+#if RAWCODEC_HAVE_SSE2
+    static const KernelSet sse2 = {
+            { packSse2<10>, packSse2<12>, packSse2<14>, pack16 },
+            { unpackSse2<10>, unpackSse2<12>, unpackSse2<14>, unpack16 } };
+#endif
+
+    switch ( kernel )
+    {
+    case RawCodec::Kernel::AUTO:
+#if RAWCODEC_HAVE_NEON
+        return &neon;
+#elif RAWCODEC_HAVE_SSE2
+        return &sse2;
+#endif
+        return &scalar;
+
+    case RawCodec::Kernel::SCALAR:
+        return &scalar;
+
+#if RAWCODEC_HAVE_NEON
+    case RawCodec::Kernel::NEON:
+        return &neon;
+#endif
+
+#if RAWCODEC_HAVE_SSE2
+    case RawCodec::Kernel::SSE2:
+        return &sse2;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+int64_t elapsedUs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+}
+
+size_t packedRowBytes( unsigned width, unsigned depth )
+{
+    return ( width + RUN - 1 ) / RUN * runBytes( depth );
+}
+
+// The last run of a row is padded with zeros.
+void packRow( const KernelSet& kernels, unsigned depth, const uint16_t* src,
+        int width, uint8_t* dst )
+{
+    const PackKernel pack = kernels.pack[depthIndex( depth )];
+    const int runs = width / RUN;
+    pack( src, runs, dst );
+
+    const int rest = width - runs * RUN;
+    if ( rest > 0 )
+    {
+        uint16_t tail[RUN] = {};
+        memcpy( tail, src + runs * RUN, rest * sizeof(uint16_t) );
+        pack( tail, 1, dst + runs * runBytes( depth ) );
+    }
+}
+
+void unpackRow( const KernelSet& kernels, unsigned depth, const uint8_t* src,
+        int width, uint16_t* dst )
+{
+    const UnpackKernel unpack = kernels.unpack[depthIndex( depth )];
+    const int runs = width / RUN;
+    unpack( src, runs, dst );
+
+    const int rest = width - runs * RUN;
+    if ( rest > 0 )
+    {
+        uint16_t tail[RUN];
+        unpack( src + runs * runBytes( depth ), 1, tail );
+        memcpy( dst + runs * RUN, tail, rest * sizeof(uint16_t) );
+    }
+}
+
+// Most significant bit first, into a buffer sized for the worst case.
+class BitWriter
+{
+public:
+
+    explicit BitWriter( uint8_t* out ) :
+        mStart(out),
+        mOut(out)
+    {
+    }
+
+    // bits is at most 32.
+    void put( uint32_t value, unsigned bits )
+    {
+        mAcc = ( mAcc << bits ) | value;
+        mBits += bits;
+        if ( mBits >= 32 )
+        {
+            mBits -= 32;
+            const uint32_t word = __builtin_bswap32( uint32_t( mAcc >> mBits ) );
+            memcpy( mOut, &word, sizeof(word) );
+            mOut += sizeof(word);
+        }
+    }
+
+    // Pads the last byte with zeros; returns the bytes written.
+    size_t finish()
+    {
+        for ( ; mBits >= 8; mBits -= 8 )
+        {
+            *mOut++ = uint8_t( mAcc >> ( mBits - 8 ) );
+        }
+        if ( mBits > 0 )
+        {
+            *mOut++ = uint8_t( mAcc << ( 8 - mBits ) );
+            mBits = 0;
+        }
+        return mOut - mStart;
+    }
+
+private:
+
+    uint8_t* mStart;
+    uint8_t* mOut;
+    uint64_t mAcc = 0;
+    unsigned mBits = 0;
+};
+
+/*
+ * Reads what BitWriter wrote. refill() tops the buffer up to at least 56
+ * bits; past the end of the data it reads zeros, which overrun() reports.
+ */
+class BitReader
+{
+public:
+
+    BitReader( const uint8_t* data, size_t size ) :
+        mPos(data),
+        mEnd(data + size)
+    {
+        refill();
+    }
+
+    void refill()
+    {
+        // Eight bytes at once; the bits of the byte that does not fit
+        // whole are the same ones the next refill puts there.
+        if ( mEnd - mPos >= 8 )
+        {
+            uint64_t word;
+            memcpy( &word, mPos, sizeof(word) );
+            mAcc |= __builtin_bswap64( word ) >> mBits;
+            mPos += ( 63 - mBits ) >> 3;
+            mBits |= 56;
+            return;
+        }
+
+        while ( mBits <= 56 )
+        {
+            const uint64_t byte = mPos < mEnd ? *mPos : 0;
+            mAcc |= byte << ( 56 - mBits );
+            ++mPos;
+            mBits += 8;
+        }
+    }
+
+    unsigned leadingZeros() const
+    {
+        return mAcc ? __builtin_clzll( mAcc ) : 64;
+    }
+
+    // bits is 1 to 32.
+    uint32_t get( unsigned bits )
+    {
+        const uint32_t value = uint32_t( mAcc >> ( 64 - bits ) );
+        skip( bits );
+        return value;
+    }
+
+    void skip( unsigned bits )
+    {
+        mAcc <<= bits;
+        mBits -= bits;
+    }
+
+    bool overrun() const
+    {
+        return mPos - mEnd > ptrdiff_t( mBits / 8 );
+    }
+
+private:
+
+    const uint8_t* mPos;
+    const uint8_t* mEnd;
+    uint64_t mAcc = 0;
+    unsigned mBits = 0;
+};
+
+uint32_t zigzag( int32_t residual )
+{
+    return ( uint32_t( residual ) << 1 ) ^ uint32_t( residual >> 31 );
+}
+
+int32_t unzigzag( uint32_t value )
+{
+    return int32_t( value >> 1 ) ^ -int32_t( value & 1 );
+}
+
+// The gradient clamped to the two neighbors, without branches to miss on
+// noise.
+int med( int left, int up, int upLeft )
+{
+    return std::min( std::max( left + up - upLeft, std::min( left, up ) ),
+            std::max( left, up ) );
+}
+
+/*
+ * Prediction of sample x >= 2 of row from the same color samples two to
+ * the left and in up, two rows above.
+ */
+template <Predictor P>
+int predict( const uint16_t* row, const uint16_t* up, int x )
+{
+    return P == LEFT ? row[x - 2] : P == UP ? up[x] :
+           med( row[x - 2], up[x], up[x - 2] );
+}
+
+/*
+ * Zigzag residuals of a row and their sum. up is nullptr at the top of a
+ * stripe, where only LEFT works; samples without a left neighbor are
+ * predicted from above, or from half the range.
+ */
+template <Predictor P>
+uint64_t residuals( const uint16_t* row, const uint16_t* up, int width,
+        int half, uint32_t* values )
+{
+    uint64_t sum = 0;
+    for ( int x = 0; x < std::min( width, 2 ); ++x )
+    {
+        values[x] = zigzag( row[x] - ( up ? up[x] : half ) );
+        sum += values[x];
+    }
+    for ( int x = 2; x < width; ++x )
+    {
+        values[x] = zigzag( row[x] - predict<P>( row, up, x ) );
+        sum += values[x];
+    }
+    return sum;
+}
+
+// Residual sum of every SAMPLE_STEP-th run of a row, to choose a predictor.
+template <Predictor P>
+uint64_t sampledCost( const uint16_t* row, const uint16_t* up, int width )
+{
+    uint64_t sum = 0;
+    for ( int start = 2; start < width; start += SAMPLE_STEP )
+    {
+        const int end = std::min( start + RUN, width );
+        for ( int x = start; x < end; ++x )
+        {
+            sum += zigzag( row[x] - predict<P>( row, up, x ) );
+        }
+    }
+    return sum;
+}
+
+void encodeRun( BitWriter& writer, const uint32_t* values, int count )
+{
+    // 2^k is the largest power of two not above the mean.
+    uint64_t sum = 0;
+    for ( int i = 0; i < count; ++i ) sum += values[i];
+    unsigned k = 0;
+    while ( k < MAX_K && ( uint64_t(count) << ( k + 1 ) ) <= sum ) ++k;
+
+    // q zeros, a one and the k low bits, at most 32 bits.
+    writer.put( k, K_BITS );
+    const uint32_t mask = ( 1u << k ) - 1;
+    for ( int i = 0; i < count; ++i )
+    {
+        const uint32_t q = values[i] >> k;
+        if ( q < ESCAPE )
+        {
+            writer.put( ( mask + 1 ) | ( values[i] & mask ), q + 1 + k );
+        }
+        else
+        {
+            writer.put( 0, ESCAPE );
+            writer.put( values[i], RAW_BITS );
+        }
+    }
+}
+
+// Worst case size of a LOSSLESS stripe.
+size_t maxStripeBytes( unsigned width, unsigned rows )
+{
+    const size_t runs = ( width + RUN - 1 ) / RUN;
+    const size_t bitsPerRow = PREDICTOR_BITS + runs * K_BITS +
+                              size_t(width) * ( ESCAPE + RAW_BITS );
+    return ( rows * bitsPerRow + 7 ) / 8 + sizeof(uint32_t);
+}
+
+size_t encodeLossless( const uint16_t* src, size_t stride, int width, int rows,
+        unsigned depth, uint8_t* out )
+{
+    const int half = 1 << ( depth - 1 );
+    std::vector<uint32_t> values( width );
+    BitWriter writer( out );
+
+    for ( int y = 0; y < rows; ++y )
+    {
+        const uint16_t* row = src + y * stride;
+        const uint16_t* above = y >= 2 ? row - 2 * stride : nullptr;
+
+        // The predictor is chosen on a sample of the row and only its
+        // residuals are taken for the whole row.
+        Predictor best = LEFT;
+        if ( above )
+        {
+            const uint64_t sums[NUM_PREDICTORS] = {
+                    sampledCost<LEFT>( row, above, width ),
+                    sampledCost<UP>( row, above, width ),
+                    sampledCost<MED>( row, above, width ) };
+            if ( sums[UP] < sums[best] ) best = UP;
+            if ( sums[MED] < sums[best] ) best = MED;
+        }
+
+        uint32_t* chosen = values.data();
+        switch ( best )
+        {
+        case UP:
+            residuals<UP>( row, above, width, half, chosen );
+            break;
+        case MED:
+            residuals<MED>( row, above, width, half, chosen );
+            break;
+        default:
+            residuals<LEFT>( row, above, width, half, chosen );
+            break;
+        }
+
+        writer.put( best, PREDICTOR_BITS );
+        for ( int x = 0; x < width; x += RUN )
+        {
+            encodeRun( writer, chosen + x, std::min( RUN, width - x ) );
+        }
+    }
+    return writer.finish();
+}
+
+template <Predictor P>
+bool decodeRow( BitReader& reader, uint16_t* row, const uint16_t* up,
+        int width, int half )
+{
+    // The two samples to the left stay in registers; reading them back
+    // from row would wait on the stores.
+    int left2 = 0;
+    int left1 = 0;
+
+    for ( int x = 0; x < width; )
+    {
+        reader.refill();
+        const unsigned k = reader.get( K_BITS );
+        if ( k > MAX_K ) return false;
+
+        // The run is read before any sample is predicted, which keeps the
+        // bit reader out of the prediction's dependency chain.
+        const int count = std::min( RUN, width - x );
+        int32_t residual[RUN];
+        for ( int i = 0; i < count; ++i )
+        {
+            reader.refill();
+            uint32_t value;
+            const unsigned zeros = reader.leadingZeros();
+            if ( zeros < ESCAPE )
+            {
+                value = ( zeros << k ) + reader.get( zeros + 1 + k ) - ( 1u << k );
+            }
+            else
+            {
+                reader.skip( ESCAPE );
+                value = reader.get( RAW_BITS );
+            }
+            residual[i] = unzigzag( value );
+        }
+
+        for ( int i = 0; i < count; ++x, ++i )
+        {
+            int prediction;
+            if ( x < 2 )
+            {
+                prediction = up ? up[x] : half;
+            }
+            else
+            {
+                prediction = P == LEFT ? left2 : P == UP ? up[x] :
+                             med( left2, up[x], up[x - 2] );
+            }
+            const int value = uint16_t( prediction + residual[i] );
+            row[x] = value;
+            left2 = left1;
+            left1 = value;
+        }
+    }
+    return true;
+}
+
+bool decodeLossless( const uint8_t* data, size_t size, int width, int rows,
+        unsigned depth, uint16_t* dst, size_t stride )
+{
+    const int half = 1 << ( depth - 1 );
+    BitReader reader( data, size );
+
+    for ( int y = 0; y < rows; ++y )
+    {
+        uint16_t* row = dst + y * stride;
+        const uint16_t* up = y >= 2 ? row - 2 * stride : nullptr;
+
+        reader.refill();
+        const unsigned predictor = reader.get( PREDICTOR_BITS );
+        bool ok;
+        if ( predictor == LEFT )
+        {
+            ok = decodeRow<LEFT>( reader, row, up, width, half );
+        }
+        else if ( predictor == UP && up )
+        {
+            ok = decodeRow<UP>( reader, row, up, width, half );
+        }
+        else if ( predictor == MED && up )
+        {
+            ok = decodeRow<MED>( reader, row, up, width, half );
+        }
+        else
+        {
+            ok = false;
+        }
+        if ( !ok ) return false;
+    }
+    return !reader.overrun();
+}
+
+}
+
+RawCodec::RawCodec( const StaticProperties& properties,
+        const Options& options ) :
+    mProperties(properties),
+    mOptions(options)
+{
+    mOptions.stripeRows = ( std::max( mOptions.stripeRows, 2u ) + 1 ) & ~1u;
+    mKernels = selectKernel( mOptions.kernel );
+}
+
+bool RawCodec::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+unsigned RawCodec::bitDepth( int32_t whiteLevel )
+{
+    if ( whiteLevel <= 0 ) return 16;
+
+    unsigned depth = 10;
+    while ( depth < 16 && whiteLevel >= ( 1 << depth ) ) depth += 2;
+    return depth;
+}
+
+bool RawCodec::encode( const CameraFrame& frame, std::vector<uint8_t>& out )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    if ( !mKernels || !frame.imageBuffer ||
+         frame.imageBuffer->format() != RAW16 )
+    {
+        return false;
+    }
+    const KernelSet& kernels = *static_cast<const KernelSet*>( mKernels );
+
+    // RAW16 strides are in pixels.
+    const CameraBuffer::Data plane = frame.imageBuffer->data( 0 );
+    const int width = plane.width;
+    const int height = plane.height;
+    const size_t stride = plane.stride;
+    const uint16_t* pixels = (const uint16_t*) plane.ptr;
+    if ( width <= 0 || height <= 0 ) return false;
+
+    const StaticProperties::SensorProperties& sensor = mProperties.sensor;
+    const unsigned depth = bitDepth( sensor.whiteLevel );
+    const bool lossless = mOptions.mode == Mode::LOSSLESS;
+    const unsigned stripeRows = mOptions.stripeRows;
+    const unsigned stripes = ( height + stripeRows - 1 ) / stripeRows;
+    const size_t rowBytes = packedRowBytes( width, depth );
+
+    mStripes.resize( stripes );
+    mStripeBytes.resize( stripes );
+    ThreadPool::instance().parallelFor( stripes, [&]( unsigned s ) {
+        const int y0 = s * stripeRows;
+        const int rows = std::min<int>( stripeRows, height - y0 );
+        const uint16_t* src = pixels + y0 * stride;
+        std::vector<uint8_t>& data = mStripes[s];
+
+        if ( lossless )
+        {
+            data.resize( std::max( data.size(), maxStripeBytes( width, rows ) ) );
+            mStripeBytes[s] = encodeLossless( src, stride, width, rows, depth,
+                    data.data() );
+            return;
+        }
+
+        data.resize( std::max( data.size(), rows * rowBytes ) );
+        for ( int y = 0; y < rows; ++y )
+        {
+            packRow( kernels, depth, src + y * stride, width,
+                    data.data() + y * rowBytes );
+        }
+        mStripeBytes[s] = rows * rowBytes;
+    }, mOptions.maxThreads );
+
+    FileHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, MAGIC, sizeof(MAGIC) );
+    header.version = VERSION;
+    header.mode = uint8_t( mOptions.mode );
+    header.bitDepth = depth;
+    header.cfaPattern = uint8_t( mOptions.cfaPattern );
+    header.width = width;
+    header.height = height;
+    std::copy_n( sensor.blackLevelPattern, 4, header.blackLevel );
+    header.whiteLevel = sensor.whiteLevel;
+    header.requestId = frame.requestId;
+    header.captureTime = frame.captureTime;
+    header.exposure = frame.resultSettings.sensor.exposure;
+    header.frameDuration = frame.resultSettings.sensor.frameDuration;
+    header.sensitivity = frame.resultSettings.sensor.sensitivity;
+    header.stripeRows = stripeRows;
+    header.stripes = stripes;
+
+    size_t total = sizeof(header) + stripes * sizeof(uint32_t);
+    for ( size_t bytes : mStripeBytes ) total += bytes;
+    out.resize( total );
+
+    uint8_t* p = out.data();
+    memcpy( p, &header, sizeof(header) );
+    p += sizeof(header);
+    for ( size_t bytes : mStripeBytes )
+    {
+        const uint32_t size = bytes;
+        memcpy( p, &size, sizeof(size) );
+        p += sizeof(size);
+    }
+    for ( unsigned s = 0; s < stripes; ++s )
+    {
+        memcpy( p, mStripes[s].data(), mStripeBytes[s] );
+        p += mStripeBytes[s];
+    }
+
+    mStats.rawBytes = size_t(width) * height * sizeof(uint16_t);
+    mStats.codedBytes = total;
+    mStats.timeUs = elapsedUs( start );
+    return true;
+}
+
+bool RawCodec::readHeader( const uint8_t* data, size_t size, Header& header )
+{
+    FileHeader file;
+    if ( size < sizeof(file) ) return false;
+    memcpy( &file, data, sizeof(file) );
+
+    if ( memcmp( file.magic, MAGIC, sizeof(MAGIC) ) != 0 ||
+         file.version != VERSION || file.mode > uint8_t( Mode::LOSSLESS ) ||
+         file.bitDepth < 10 || file.bitDepth > 16 || ( file.bitDepth & 1 ) ||
+         file.cfaPattern > uint8_t( DngWriter::CfaPattern::BGGR ) ||
+         file.width == 0 || file.height == 0 || file.stripeRows == 0 ||
+         file.stripes != ( file.height + file.stripeRows - 1 ) / file.stripeRows )
+    {
+        return false;
+    }
+
+    header.mode = Mode( file.mode );
+    header.bitDepth = file.bitDepth;
+    header.size = Size( file.width, file.height );
+    header.cfaPattern = DngWriter::CfaPattern( file.cfaPattern );
+    std::copy_n( file.blackLevel, 4, header.blackLevel );
+    header.whiteLevel = file.whiteLevel;
+    header.captureTime = file.captureTime;
+    header.requestId = file.requestId;
+    header.sensor.exposure = file.exposure;
+    header.sensor.sensitivity = file.sensitivity;
+    header.sensor.frameDuration = file.frameDuration;
+    header.stripeRows = file.stripeRows;
+    header.stripes = file.stripes;
+    return true;
+}
+
+bool RawCodec::decode( const uint8_t* data, size_t size, uint16_t* pixels,
+        size_t stride )
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    Header header;
+    if ( !mKernels || !readHeader( data, size, header ) ||
+         stride < header.size.width )
+    {
+        return false;
+    }
+    const KernelSet& kernels = *static_cast<const KernelSet*>( mKernels );
+
+    const unsigned stripes = header.stripes;
+    const size_t tableEnd = sizeof(FileHeader) + stripes * sizeof(uint32_t);
+    if ( size < tableEnd ) return false;
+
+    // Stripe offsets from the byte counts.
+    std::vector<size_t> offsets( stripes + 1 );
+    offsets[0] = tableEnd;
+    for ( unsigned s = 0; s < stripes; ++s )
+    {
+        uint32_t bytes;
+        memcpy( &bytes, data + sizeof(FileHeader) + s * sizeof(uint32_t),
+                sizeof(bytes) );
+        offsets[s + 1] = offsets[s] + bytes;
+        if ( offsets[s + 1] > size ) return false;
+    }
+
+    const int width = header.size.width;
+    const int height = header.size.height;
+    const unsigned depth = header.bitDepth;
+    const unsigned stripeRows = header.stripeRows;
+    const size_t rowBytes = packedRowBytes( width, depth );
+    const bool lossless = header.mode == Mode::LOSSLESS;
+
+    std::atomic<bool> failed( false );
+    ThreadPool::instance().parallelFor( stripes, [&]( unsigned s ) {
+        const int y0 = s * stripeRows;
+        const int rows = std::min<int>( stripeRows, height - y0 );
+        const uint8_t* src = data + offsets[s];
+        const size_t bytes = offsets[s + 1] - offsets[s];
+        uint16_t* dst = pixels + y0 * stride;
+
+        if ( lossless )
+        {
+            if ( !decodeLossless( src, bytes, width, rows, depth, dst, stride ) )
+            {
+                failed = true;
+            }
+            return;
+        }
+
+        if ( bytes != rows * rowBytes )
+        {
+            failed = true;
+            return;
+        }
+        for ( int y = 0; y < rows; ++y )
+        {
+            unpackRow( kernels, depth, src + y * rowBytes, width, dst + y * stride );
+        }
+    }, mOptions.maxThreads );
+
+    mStats.rawBytes = size_t(width) * height * sizeof(uint16_t);
+    mStats.codedBytes = offsets[stripes];
+    mStats.timeUs = elapsedUs( start );
+    return !failed;
+}
@@ -0,0 +1,158 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef RawCodec_H
+#define RawCodec_H
+
+#include "DngWriter.h"
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <vector>
+
+/*!
+ * Compact storage of RAW16 frames. Samples are stored with the bit depth
+ * of the sensor, 10, 12, 14 or 16 bits from StaticProperties::sensor's
+ * white level, instead of 16 bits plus row padding.
+ *
+ * PACKED splits every run of 16 samples of a row into its high bytes and
+ * the remaining low bits, so that packing and unpacking are a few vector
+ * operations per run. Samples above the bit depth are clamped.
+ *
+ * LOSSLESS predicts every sample from its same color neighbors with the
+ * predictor that fits the row best, and Rice codes the residuals with a
+ * parameter adapted to every run of 16. It keeps any 16 bit value.
+ *
+ * Frames are coded in stripes of rows that are independent of each other,
+ * encoded and decoded in parallel on the ThreadPool. The header carries
+ * everything needed to decode and interpret the frame: size, bit depth,
+ * CFA layout, black and white levels, and the capture settings.
+ *
+ * A codec keeps its stripe buffers between frames; use one per thread.
+ */
+class RawCodec
+{
+public:
+
+    enum class Mode
+    {
+        PACKED,
+        LOSSLESS
+    };
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSE2
+    };
+
+    struct Options
+    {
+        Mode mode = Mode::PACKED;
+        DngWriter::CfaPattern cfaPattern = DngWriter::CfaPattern::RGGB;
+
+        // Rows per stripe, rounded up to an even number.
+        unsigned stripeRows = 32;
+
+        Kernel kernel = Kernel::AUTO;
+
+        // Threads of the ThreadPool, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    // Frame description read back from encoded data.
+    struct Header
+    {
+        Mode mode = Mode::PACKED;
+        unsigned bitDepth = 16;
+        nv::camera2::Size size;
+        DngWriter::CfaPattern cfaPattern = DngWriter::CfaPattern::RGGB;
+        int32_t blackLevel[4] = { 0, 0, 0, 0 };
+        int32_t whiteLevel = 0;
+        int64_t captureTime = 0;
+        int32_t requestId = 0;
+        nv::camera2::Request::Sensor sensor;
+        unsigned stripeRows = 0;
+        unsigned stripes = 0;
+    };
+
+    struct Stats
+    {
+        size_t rawBytes = 0;        //< 16 bits per sample, no padding.
+        size_t codedBytes = 0;
+        int64_t timeUs = 0;
+    };
+
+    RawCodec( const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    static bool isAvailable( Kernel kernel );
+
+    // Bits per sample that hold whiteLevel: 10, 12, 14 or 16.
+    static unsigned bitDepth( int32_t whiteLevel );
+
+    /*!
+     * Encodes the frame's RAW16 image with its metadata into out. Returns
+     * false if the frame is not RAW16 or the kernel is not available.
+     */
+    bool encode( const nv::camera2::CameraFrame& frame,
+            std::vector<uint8_t>& out );
+
+    // Returns false if data does not start with a valid header.
+    static bool readHeader( const uint8_t* data, size_t size, Header& header );
+
+    /*!
+     * Decodes a frame into pixels, which has room for the header's size
+     * with rows stride samples apart. Returns false if data is not
+     * complete or not valid.
+     */
+    bool decode( const uint8_t* data, size_t size, uint16_t* pixels,
+            size_t stride );
+
+    // Statistics of the last encode() or decode() call.
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    nv::camera2::StaticProperties mProperties;
+    Options mOptions;
+    const void* mKernels;
+    Stats mStats;
+    std::vector< std::vector<uint8_t> > mStripes;
+    std::vector<size_t> mStripeBytes;   //< Used part of mStripes.
+};
+
+#endif
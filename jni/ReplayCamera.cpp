@@ -0,0 +1,895 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "ReplayCamera.h"
+#include "FramePool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+enum class ChromaLayout
+{
+    I420,
+    NV12,
+    NV21
+};
+
+struct RecordedFrame
+{
+    std::string file;
+    int64_t exposure = -1;
+    int32_t sensitivity = -1;
+    std::shared_ptr< std::vector<uint8_t> > data;
+};
+
+struct Recording
+{
+    std::string directory;
+    PixelFormat format = UNKNOWN;
+    Size size;
+    ChromaLayout layout = ChromaLayout::I420;
+    int32_t stride = 0;
+    int32_t minFrameTime = 33333;
+    StaticProperties properties;
+    std::vector<RecordedFrame> frames;
+
+    size_t frameBytes() const
+    {
+        if ( format == RAW16 )
+        {
+            return size_t(stride) * size.height * 2;
+        }
+        // The chroma planes together are half the size of the luma plane
+        // for all supported layouts.
+        return size_t(stride) * size.height * 3 / 2;
+    }
+};
+
+bool parseRecording( const std::string& directory, int cameraId,
+        Recording& rec )
+{
+    std::ifstream infile( directory + "/recording.txt" );
+    if ( !infile ) return false;
+
+    rec = Recording();
+    rec.directory = directory;
+
+    StaticProperties& props = rec.properties;
+    props.cameraId = cameraId;
+    props.request.maxNumRAWStreams = 1;
+    props.request.maxNumYUVStreams = 3;
+    props.request.maxNumJPGStreams = 0;
+
+    std::string line;
+    while ( std::getline( infile, line ) )
+    {
+        line = line.substr( 0, line.find( '#' ) );
+
+        std::istringstream fields( line );
+        std::string key;
+        if ( !( fields >> key ) ) continue;
+
+        if ( key == "format" )
+        {
+            std::string value;
+            fields >> value;
+            if ( value == "YCbCr_420_888" )  rec.format = YCbCr_420_888;
+            else if ( value == "RAW16" )     rec.format = RAW16;
+            else return false;
+        }
+        else if ( key == "size" )
+        {
+            fields >> rec.size.width >> rec.size.height;
+        }
+        else if ( key == "layout" )
+        {
+            std::string value;
+            fields >> value;
+            if ( value == "I420" )       rec.layout = ChromaLayout::I420;
+            else if ( value == "NV12" )  rec.layout = ChromaLayout::NV12;
+            else if ( value == "NV21" )  rec.layout = ChromaLayout::NV21;
+            else return false;
+        }
+        else if ( key == "stride" )
+        {
+            fields >> rec.stride;
+        }
+        else if ( key == "min_frame_time" )
+        {
+            fields >> rec.minFrameTime;
+        }
+        else if ( key == "white_level" )
+        {
+            fields >> props.sensor.whiteLevel;
+        }
+        else if ( key == "black_level" )
+        {
+            for ( int i = 0; i < 4; ++i )
+                fields >> props.sensor.blackLevelPattern[i];
+        }
+        else if ( key == "active_array" )
+        {
+            for ( int i = 0; i < 4; ++i )
+                fields >> props.sensor.activeArraySize[i];
+        }
+        else if ( key == "color_transform1" )
+        {
+            for ( int i = 0; i < 9; ++i )
+                fields >> props.sensor.colorTransformIlluminant1[i];
+        }
+        else if ( key == "color_transform2" )
+        {
+            for ( int i = 0; i < 9; ++i )
+                fields >> props.sensor.colorTransformIlluminant2[i];
+        }
+        else if ( key == "illuminant1" )
+        {
+            fields >> props.sensor.illuminant1;
+        }
+        else if ( key == "illuminant2" )
+        {
+            fields >> props.sensor.illuminant2;
+        }
+        else if ( key == "max_raw_streams" )
+        {
+            fields >> props.request.maxNumRAWStreams;
+        }
+        else if ( key == "max_yuv_streams" )
+        {
+            fields >> props.request.maxNumYUVStreams;
+        }
+        else if ( key == "histogram_buckets" )
+        {
+            fields >> props.statistics.histogramBucketCount;
+        }
+        else if ( key == "sharpness_map_size" )
+        {
+            fields >> props.statistics.sharpnessMapSize.width
+                   >> props.statistics.sharpnessMapSize.height;
+        }
+        else if ( key == "frame" )
+        {
+            RecordedFrame frame;
+            fields >> frame.file;
+            fields >> frame.exposure >> frame.sensitivity;
+            rec.frames.push_back( frame );
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if ( rec.format == UNKNOWN || rec.size.width == 0 ||
+         rec.size.height == 0 || rec.frames.empty() )
+    {
+        return false;
+    }
+
+    if ( rec.stride < int32_t(rec.size.width) )
+    {
+        rec.stride = rec.size.width;
+    }
+
+    props.scaler.availablePixelFormats.push_back( rec.format );
+    if ( rec.format == RAW16 )
+    {
+        props.scaler.availableRAWSizes.push_back( rec.size );
+        props.scaler.availableRAWMinFrameTimes.push_back( rec.minFrameTime );
+    }
+    else
+    {
+        props.scaler.availableYUVSizes.push_back( rec.size );
+        props.scaler.availableYUVMinFrameTimes.push_back( rec.minFrameTime );
+    }
+    props.scaler.availableMaxDigitalZoom = 1.0f;
+    props.sensor.maxFrameDuration = std::max<int64_t>( rec.minFrameTime,
+            props.sensor.maxFrameDuration );
+
+    if ( props.sensor.activeArraySize[2] < 0 )
+    {
+        props.sensor.activeArraySize[0] = 0;
+        props.sensor.activeArraySize[1] = 0;
+        props.sensor.activeArraySize[2] = rec.size.width;
+        props.sensor.activeArraySize[3] = rec.size.height;
+    }
+
+    return true;
+}
+
+bool loadFrames( Recording& rec )
+{
+    const size_t bytes = rec.frameBytes();
+
+    for ( auto& frame : rec.frames )
+    {
+        std::ifstream infile( rec.directory + "/" + frame.file,
+                std::ifstream::binary );
+        if ( !infile ) return false;
+
+        frame.data = std::make_shared< std::vector<uint8_t> >( bytes );
+        infile.read( (char*) frame.data->data(), bytes );
+        if ( size_t(infile.gcount()) != bytes ) return false;
+    }
+    return true;
+}
+
+/*
+ * A buffer referencing one recorded frame. The frame data is shared, not
+ * copied, so a buffer stays valid after the device is gone. Buffers stay
+ * attached to their pooled frame and are pointed at the next recorded
+ * frame when it is reused.
+ */
+class ReplayBuffer : public CameraBuffer
+{
+public:
+
+    ReplayBuffer() = default;
+    ReplayBuffer( const ReplayBuffer& ) = default;
+
+    void attach( const Recording& rec,
+            const std::shared_ptr< std::vector<uint8_t> >& data )
+    {
+        data_ = data;
+        format_ = rec.format;
+
+        uint8_t* base = data_->data();
+        const int32_t width  = rec.size.width;
+        const int32_t height = rec.size.height;
+
+        if ( rec.format == RAW16 )
+        {
+            number_of_planes_ = 1;
+            setPlane( 0, base, width, height, rec.stride, 2, 1 );
+            return;
+        }
+
+        number_of_planes_ = 3;
+        setPlane( 0, base, width, height, rec.stride, 1, 1 );
+
+        uint8_t* chroma = base + size_t(rec.stride) * height;
+        switch ( rec.layout )
+        {
+        case ChromaLayout::I420:
+            setPlane( 1, chroma, width/2, height/2, rec.stride/2, 1, 1 );
+            setPlane( 2, chroma + size_t(rec.stride/2) * (height/2),
+                    width/2, height/2, rec.stride/2, 1, 1 );
+            break;
+        case ChromaLayout::NV12:
+            setPlane( 1, chroma,     width/2, height/2, rec.stride, 1, 2 );
+            setPlane( 2, chroma + 1, width/2, height/2, rec.stride, 1, 2 );
+            break;
+        case ChromaLayout::NV21:
+            setPlane( 1, chroma + 1, width/2, height/2, rec.stride, 1, 2 );
+            setPlane( 2, chroma,     width/2, height/2, rec.stride, 1, 2 );
+            break;
+        }
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height, int32_t stride, int32_t bytesPerChannel,
+            int32_t channelStep )
+    {
+        Data& d = buffer_planes_[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = stride;
+        d.num_channels = 1;
+        d.bytes_per_channel = bytesPerChannel;
+        d.channel_step = channelStep;
+    }
+
+    std::shared_ptr< std::vector<uint8_t> > data_;
+};
+
+/*
+ * The frame queue behind a stream. It is shared between the stream and
+ * the device producer so either side can go away first. Frames come from
+ * a per-stream pool and wait in a fixed ring, so steady-state streaming
+ * does not allocate.
+ */
+class StreamQueue
+{
+public:
+
+    StreamQueue( PixelFormat format, Size size,
+            const ReplayCamera::Options& options,
+            const StaticProperties& properties ) :
+        format_(format), size_(size),
+        pool_( properties.statistics,
+               std::max( options.framePoolSize, options.queueDepth + 1 ) ),
+        ring_( std::max( options.queueDepth, 1u ) ) {}
+
+    PixelFormat format() const { return format_; }
+    Size size() const { return size_; }
+    FramePool& pool() { return pool_; }
+
+    // Queues a frame. When full, either waits for the consumer or drops
+    // the oldest frame. Returns false if the frame was discarded.
+    bool push( FramePool::Frame frame, bool wait,
+            const std::atomic<bool>& abort )
+    {
+        FramePool::Frame dropped;
+        std::unique_lock<std::mutex> lk( mutex_ );
+
+        if ( wait )
+        {
+            while ( !closed_ && !abort && count_ >= ring_.size() )
+            {
+                spaceAvailable_.wait_for( lk, std::chrono::milliseconds(10) );
+            }
+            if ( closed_ || abort ) return false;
+        }
+        else
+        {
+            if ( closed_ ) return false;
+            if ( count_ >= ring_.size() )
+            {
+                dropped = std::move( ring_[head_] );
+                head_ = ( head_ + 1 ) % ring_.size();
+                --count_;
+            }
+        }
+
+        ring_[( head_ + count_ ) % ring_.size()] = std::move(frame);
+        ++count_;
+        frameAvailable_.notify_one();
+        return true;
+    }
+
+    FramePool::Frame pop( int timeoutUs )
+    {
+        std::unique_lock<std::mutex> lk( mutex_ );
+
+        // A closed queue is empty and stays so; waiting would never end.
+        if ( timeoutUs < 0 )
+        {
+            frameAvailable_.wait( lk, [this]{ return count_ > 0 || closed_; } );
+        }
+        else if ( timeoutUs > 0 )
+        {
+            frameAvailable_.wait_for( lk, std::chrono::microseconds(timeoutUs),
+                    [this]{ return count_ > 0 || closed_; } );
+        }
+
+        FramePool::Frame frame;
+        if ( closed_ ) return frame;
+        if ( count_ > 0 )
+        {
+            frame = std::move( ring_[head_] );
+            head_ = ( head_ + 1 ) % ring_.size();
+            --count_;
+            spaceAvailable_.notify_one();
+        }
+        return frame;
+    }
+
+    int count()
+    {
+        std::lock_guard<std::mutex> lk( mutex_ );
+        return (int) count_;
+    }
+
+    void close()
+    {
+        std::unique_lock<std::mutex> lk( mutex_ );
+        closed_ = true;
+
+        std::vector<FramePool::Frame> pending;
+        for ( ; count_ > 0; --count_ )
+        {
+            pending.push_back( std::move( ring_[head_] ) );
+            head_ = ( head_ + 1 ) % ring_.size();
+        }
+        spaceAvailable_.notify_all();
+        frameAvailable_.notify_all();
+
+        // Recycle outside the lock.
+        lk.unlock();
+    }
+
+private:
+
+    const PixelFormat format_;
+    const Size size_;
+    FramePool pool_;
+
+    std::mutex mutex_;
+    std::condition_variable frameAvailable_;
+    std::condition_variable spaceAvailable_;
+    std::vector<FramePool::Frame> ring_;
+    size_t head_ = 0;
+    size_t count_ = 0;
+    bool closed_ = false;
+};
+
+struct PendingRequest
+{
+    int requestId = -1;
+    bool streaming = false;
+    RequestSettings settings;
+    std::vector< std::shared_ptr<StreamQueue> > outputs;
+};
+
+/*
+ * Device state shared with the streams, so a stream can unregister
+ * itself even after the device object has been deleted.
+ */
+class DeviceCore
+{
+public:
+
+    DeviceCore( Recording&& rec, const ReplayCamera::Options& options,
+            CameraDeviceCallbacks* callbacks ) :
+        rec_(std::move(rec)), options_(options), callbacks_(callbacks) {}
+
+    const Recording& recording() const { return rec_; }
+    const ReplayCamera::Options& options() const { return options_; }
+
+    void registerStream( const CameraStream* stream,
+            const std::shared_ptr<StreamQueue>& queue )
+    {
+        std::lock_guard<std::mutex> lk( mutex_ );
+        streams_[stream] = queue;
+    }
+
+    void unregisterStream( const CameraStream* stream )
+    {
+        std::lock_guard<std::mutex> lk( mutex_ );
+        auto it = streams_.find( stream );
+        if ( it == streams_.end() ) return;
+
+        auto detach = [&it]( PendingRequest& req ) {
+            req.outputs.erase( std::remove( req.outputs.begin(),
+                    req.outputs.end(), it->second ), req.outputs.end() );
+        };
+
+        // The producer may be delivering the repeating request right now,
+        // so replace it rather than editing it in place.
+        if ( repeating_ )
+        {
+            std::shared_ptr<PendingRequest> updated =
+                    std::make_shared<PendingRequest>( *repeating_ );
+            detach( *updated );
+            repeating_ = updated;
+        }
+        for ( auto& req : oneShots_ ) detach( req );
+
+        streams_.erase( it );
+    }
+
+    int submit( std::vector<CaptureRequest>& reqs )
+    {
+        std::lock_guard<std::mutex> lk( mutex_ );
+
+        // Resolve all the outputs first so a bad request submits nothing.
+        std::vector<PendingRequest> pending( reqs.size() );
+        for ( size_t i = 0; i < reqs.size(); ++i )
+        {
+            for ( auto stream : reqs[i].outputs )
+            {
+                auto it = streams_.find( stream );
+                if ( it == streams_.end() ) return -1;
+                pending[i].outputs.push_back( it->second );
+            }
+        }
+
+        int requestId = -1;
+        for ( size_t i = 0; i < reqs.size(); ++i )
+        {
+            requestId = nextRequestId_++;
+            reqs[i].requestId = requestId;
+
+            pending[i].requestId = requestId;
+            pending[i].streaming = reqs[i].streaming;
+            pending[i].settings  = reqs[i].settings;
+
+            if ( reqs[i].streaming )
+            {
+                repeating_ = std::make_shared<PendingRequest>( pending[i] );
+            }
+            else
+            {
+                oneShots_.push_back( pending[i] );
+            }
+        }
+
+        wakeup_.notify_all();
+        return requestId;
+    }
+
+    int cancel( int requestId )
+    {
+        std::lock_guard<std::mutex> lk( mutex_ );
+        if ( !repeating_ || repeating_->requestId != requestId ) return -1;
+
+        repeating_.reset();
+        wakeup_.notify_all();
+        return 0;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lk( mutex_ );
+            quit_ = true;
+        }
+        wakeup_.notify_all();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lk( mutex_ );
+        Clock::time_point nextFrameTime = Clock::now();
+
+        while ( !quit_ )
+        {
+            if ( oneShots_.empty() && !repeating_ )
+            {
+                wakeup_.wait( lk );
+                nextFrameTime = std::max( nextFrameTime, Clock::now() );
+                continue;
+            }
+
+            // One-shot requests take priority over the repeating request,
+            // as they do on the HAL.
+            const RequestSettings& next = oneShots_.empty() ?
+                    repeating_->settings : oneShots_.front().settings;
+
+            std::chrono::microseconds period( 0 );
+            if ( !options_.freeRun )
+            {
+                period = std::chrono::microseconds( std::max<int64_t>(
+                        next.sensor.frameDuration,
+                        rec_.minFrameTime ) );
+
+                if ( Clock::now() < nextFrameTime )
+                {
+                    // Re-evaluate on any change to the request queue.
+                    wakeup_.wait_until( lk, nextFrameTime );
+                    continue;
+                }
+            }
+
+            // The repeating request is shared rather than copied, so that
+            // streaming does not allocate per frame.
+            std::shared_ptr<const PendingRequest> req;
+            if ( oneShots_.empty() )
+            {
+                req = repeating_;
+                if ( !options_.loop && frameIndex_ + 1 >= rec_.frames.size() )
+                {
+                    repeating_.reset();
+                }
+            }
+            else
+            {
+                req = std::make_shared<PendingRequest>(
+                        std::move( oneShots_.front() ) );
+                oneShots_.pop_front();
+            }
+
+            if ( frameIndex_ >= rec_.frames.size() )
+            {
+                if ( !options_.loop ) continue;
+                frameIndex_ = 0;
+            }
+            const RecordedFrame& recorded = rec_.frames[frameIndex_++];
+
+            const Clock::time_point captureTime = options_.freeRun ?
+                    Clock::now() : nextFrameTime;
+            nextFrameTime = std::max( nextFrameTime + period, Clock::now() );
+
+            lk.unlock();
+            deliver( *req, recorded, captureTime, period );
+            lk.lock();
+        }
+    }
+
+private:
+
+    void deliver( const PendingRequest& req, const RecordedFrame& recorded,
+            Clock::time_point captureTime, std::chrono::microseconds period )
+    {
+        const int64_t timestamp = std::chrono::duration_cast<
+                std::chrono::nanoseconds>( captureTime.time_since_epoch() ).count();
+
+        if ( callbacks_ )
+        {
+            callbacks_->onCaptureStarted( req.requestId, timestamp );
+        }
+
+        for ( auto& queue : req.outputs )
+        {
+            FramePool::Frame frame = queue->pool().acquire();
+            frame->requestId = req.requestId;
+            frame->streaming = req.streaming;
+            frame->captureTime = timestamp;
+            frame->requestSettings = req.settings;
+
+            frame->resultSettings = req.settings;
+            if ( recorded.exposure > 0 )
+                frame->resultSettings.sensor.exposure = recorded.exposure;
+            if ( recorded.sensitivity > 0 )
+                frame->resultSettings.sensor.sensitivity = recorded.sensitivity;
+            if ( period.count() > 0 )
+                frame->resultSettings.sensor.frameDuration = period.count();
+
+            const bool converged =
+                    req.settings.control.mode != CONTROL_MODE::OFF;
+            frame->autoControlState.aeState = converged ?
+                    AE_STATE::CONVERGED : AE_STATE::INACTIVE;
+            frame->autoControlState.afState = converged ?
+                    AF_STATE::PASSIVE_FOCUSED : AF_STATE::INACTIVE;
+            frame->autoControlState.awbState = converged ?
+                    AWB_STATE::CONVERGED : AWB_STATE::INACTIVE;
+
+            if ( !frame->imageBuffer )
+            {
+                frame->imageBuffer.reset( new ReplayBuffer );
+            }
+            static_cast<ReplayBuffer*>( frame->imageBuffer.get() )->attach(
+                    rec_, recorded.data );
+
+            queue->push( std::move(frame), options_.freeRun, quit_ );
+        }
+
+        if ( callbacks_ )
+        {
+            callbacks_->onCaptureResults( req.requestId );
+        }
+    }
+
+    const Recording rec_;
+    const ReplayCamera::Options options_;
+    CameraDeviceCallbacks* const callbacks_;
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::atomic<bool> quit_{ false };
+
+    std::map< const CameraStream*, std::shared_ptr<StreamQueue> > streams_;
+    std::shared_ptr<const PendingRequest> repeating_;
+    std::deque<PendingRequest> oneShots_;
+    int nextRequestId_ = 0;
+    size_t frameIndex_ = 0;
+};
+
+class ReplayStream : public CameraStream, public PooledFrameSource
+{
+public:
+
+    ReplayStream( const std::shared_ptr<DeviceCore>& core,
+            const std::shared_ptr<StreamQueue>& queue ) :
+        PooledFrameSource( static_cast<const CameraStream&>( *this ) ),
+        core_(core), queue_(queue)
+    {
+        core_->registerStream( this, queue_ );
+    }
+
+    ~ReplayStream()
+    {
+        core_->unregisterStream( this );
+        queue_->close();
+    }
+
+    Size size() const { return queue_->size(); }
+
+    PixelFormat format() const { return queue_->format(); }
+
+    // Copies the pooled frame into a heap allocated one, the buffer still
+    // shares the recorded data.
+    std::unique_ptr<CameraFrame> dequeue( int timeoutUs )
+    {
+        FramePool::Frame pooled = queue_->pop( timeoutUs );
+        if ( !pooled ) return nullptr;
+
+        std::unique_ptr<CameraFrame> frame( new CameraFrame );
+        frame->requestId = pooled->requestId;
+        frame->streaming = pooled->streaming;
+        frame->captureTime = pooled->captureTime;
+        frame->requestSettings = pooled->requestSettings;
+        frame->resultSettings = pooled->resultSettings;
+        frame->autoControlState = pooled->autoControlState;
+        frame->statistics = pooled->statistics;
+        frame->imageBuffer.reset( new ReplayBuffer(
+                *static_cast<ReplayBuffer*>( pooled->imageBuffer.get() ) ) );
+        return frame;
+    }
+
+    int numberOfAvailableFrames()
+    {
+        return queue_->count();
+    }
+
+    FramePool::Frame dequeuePooled( int timeoutUs )
+    {
+        return queue_->pop( timeoutUs );
+    }
+
+    FramePool::Counters poolCounters() const
+    {
+        return queue_->pool().counters();
+    }
+
+private:
+
+    std::shared_ptr<DeviceCore> core_;
+    std::shared_ptr<StreamQueue> queue_;
+};
+
+class ReplayDevice : public CameraDevice
+{
+public:
+
+    explicit ReplayDevice( const std::shared_ptr<DeviceCore>& core ) :
+        core_(core), producer_( &DeviceCore::run, core.get() ) {}
+
+    ~ReplayDevice()
+    {
+        core_->stop();
+        producer_.join();
+    }
+
+    std::unique_ptr<CameraStream> createStream( PixelFormat format, Size size )
+    {
+        // Frames are replayed as recorded, there is no scaler.
+        const Recording& rec = core_->recording();
+        if ( format != rec.format || size.width != rec.size.width ||
+             size.height != rec.size.height )
+        {
+            return nullptr;
+        }
+
+        std::shared_ptr<StreamQueue> queue = std::make_shared<StreamQueue>(
+                format, size, core_->options(), rec.properties );
+        return std::unique_ptr<CameraStream>( new ReplayStream( core_, queue ) );
+    }
+
+    void initializeDefaultSettings( CAPTURE_INTENT intent,
+            CaptureRequest& req )
+    {
+        req = CaptureRequest();
+        req.settings.intent = intent;
+        req.streaming = ( intent == CAPTURE_INTENT::PREVIEW ||
+                          intent == CAPTURE_INTENT::VIDEO_RECORD ||
+                          intent == CAPTURE_INTENT::ZERO_SHUTTER_LAG );
+
+        if ( intent != CAPTURE_INTENT::CUSTOM )
+        {
+            req.settings.control.mode = CONTROL_MODE::AUTO;
+            req.settings.control.aeMode = AE_MODE::ON;
+            req.settings.control.afMode = AF_MODE::CONTINUOUS_PICTURE;
+            req.settings.control.awbMode = AWB_MODE::AUTO;
+        }
+        req.settings.sensor.frameDuration = core_->recording().minFrameTime;
+    }
+
+    int capture( CaptureRequest& req )
+    {
+        std::vector<CaptureRequest> reqs( 1, req );
+        int requestId = core_->submit( reqs );
+        req.requestId = reqs[0].requestId;
+        return requestId;
+    }
+
+    int capture( std::vector<CaptureRequest>& reqs )
+    {
+        return core_->submit( reqs );
+    }
+
+    int cancelRequest( int requestId )
+    {
+        return core_->cancel( requestId );
+    }
+
+private:
+
+    std::shared_ptr<DeviceCore> core_;
+    std::thread producer_;
+};
+
+class ReplayManager : public CameraManager
+{
+public:
+
+    ReplayManager( std::vector<Recording>&& recordings,
+            const ReplayCamera::Options& options ) :
+        recordings_(std::move(recordings)), options_(options) {}
+
+    int getNumberOfCameras() const
+    {
+        return (int) recordings_.size();
+    }
+
+    int queryStaticProperties( int cameraId, StaticProperties& properties )
+    {
+        if ( cameraId < 0 || cameraId >= getNumberOfCameras() ) return -1;
+
+        properties = recordings_[cameraId].properties;
+        return 0;
+    }
+
+    std::unique_ptr<CameraDevice> createCameraDevice( unsigned cameraId,
+            CameraDeviceCallbacks* callbacks )
+    {
+        if ( cameraId >= recordings_.size() ) return nullptr;
+
+        Recording rec = recordings_[cameraId];
+        if ( !loadFrames( rec ) ) return nullptr;
+
+        std::shared_ptr<DeviceCore> core = std::make_shared<DeviceCore>(
+                std::move(rec), options_, callbacks );
+        return std::unique_ptr<CameraDevice>( new ReplayDevice( core ) );
+    }
+
+private:
+
+    const std::vector<Recording> recordings_;
+    const ReplayCamera::Options options_;
+};
+
+}
+
+std::shared_ptr<CameraManager> ReplayCamera::createCameraManager(
+        const std::vector<std::string>& recordings, const Options& options )
+{
+    std::vector<Recording> parsed( recordings.size() );
+    for ( size_t i = 0; i < recordings.size(); ++i )
+    {
+        if ( !parseRecording( recordings[i], (int) i, parsed[i] ) )
+        {
+            return nullptr;
+        }
+    }
+    if ( parsed.empty() ) return nullptr;
+
+    return std::shared_ptr<CameraManager>(
+            new ReplayManager( std::move(parsed), options ) );
+}
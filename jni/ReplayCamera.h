@@ -0,0 +1,118 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef ReplayCamera_H
+#define ReplayCamera_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*!
+ * A CameraManager backend that replays recorded frames from disk instead
+ * of talking to the camera HAL. It lets the capture, upload and save paths
+ * run on a host machine, either paced like the real sensor or as fast as
+ * the consumers can drain the streams.
+ *
+ * Each recording is a directory holding a "recording.txt" description
+ * and one file per frame. Every recording is exposed as one camera, the
+ * camera id being the index in the list passed to createCameraManager().
+ *
+ * recording.txt is a list of "key values..." lines ('#' starts a comment):
+ *
+ *   format YCbCr_420_888 | RAW16       (required)
+ *   size <width> <height>              (required)
+ *   layout I420 | NV12 | NV21          YUV chroma layout, default I420
+ *   stride <elements>                  row stride of the frame files,
+ *                                      default width
+ *   min_frame_time <us>                default 33333
+ *   white_level <value>
+ *   black_level <b0> <b1> <b2> <b3>
+ *   active_array <x> <y> <width> <height>
+ *   color_transform1 <9 floats>
+ *   color_transform2 <9 floats>
+ *   illuminant1 <n>                    EXIF light source of the
+ *   illuminant2 <n>                    color transforms
+ *   max_raw_streams <n>                default 1
+ *   max_yuv_streams <n>                default 3
+ *   histogram_buckets <n>
+ *   sharpness_map_size <width> <height>
+ *   frame <file> [exposure_us] [sensitivity]
+ *
+ * Streams implement PooledFrameSource, so consumers dequeuing through a
+ * PooledStream get recycled frames without any per-frame allocation.
+ *
+ * Frame files hold the planes back to back (Y, then the chroma planes as
+ * described by layout) with no header; RAW16 samples are little endian.
+ * Strides and channel steps of the produced buffers are in elements of
+ * bytes_per_channel, as for the HAL buffers.
+ */
+class ReplayCamera
+{
+public:
+
+    struct Options
+    {
+        // Deliver frames as fast as the streams are drained instead of
+        // pacing them by the request frame duration.
+        bool freeRun = false;
+
+        // Start over once the last recorded frame has been delivered.
+        bool loop = true;
+
+        // Frames a stream holds before the producer drops the oldest one
+        // (paced mode) or waits for the consumer (free-run mode).
+        unsigned queueDepth = 4;
+
+        // Frames kept for recycling per stream. It should cover the queue
+        // depth plus the frames the consumers hold on to.
+        unsigned framePoolSize = 8;
+    };
+
+    /*!
+     * The manager is shared, as CameraSession::Options::manager takes it.
+     * CameraManager has no virtual destructor; the shared_ptr destroys
+     * the manager as the type it was created with.
+     */
+    static std::shared_ptr<nv::camera2::CameraManager> createCameraManager(
+            const std::vector<std::string>& recordings,
+            const Options& options );
+
+    static std::shared_ptr<nv::camera2::CameraManager> createCameraManager(
+            const std::vector<std::string>& recordings )
+    {
+        return createCameraManager( recordings, Options() );
+    }
+};
+
+#endif
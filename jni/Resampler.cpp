@@ -0,0 +1,561 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "Resampler.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define RESAMPLER_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define RESAMPLER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Weights are Q14, so a tap times a sample fits 16 by 16 bit multiplies
+// and the sums of all taps fit 32 bits.
+constexpr int SHIFT = 14;
+constexpr int32_t ONE = 1 << SHIFT;
+constexpr int32_t ROUND = 1 << ( SHIFT - 1 );
+
+// Bands of output rows per thread, so uneven bands even out.
+constexpr unsigned BANDS_PER_THREAD = 4;
+
+uint8_t clamp8( int32_t value )
+{
+    return uint8_t( std::min( std::max( value, 0 ), 255 ) );
+}
+
+/*
+ * column() writes count samples, each the weighted sum of the samples at
+ * the same offset of the taps rows, rounded and clamped to 8 bits.
+ */
+typedef void (*ColumnKernel)( const uint8_t* const* rows,
+        const int16_t* weights, unsigned taps, int count, uint8_t* out );
+
+struct KernelSet
+{
+    ColumnKernel column;
+};
+
+void columnTail( const uint8_t* const* rows, const int16_t* weights,
+        unsigned taps, int x, int count, uint8_t* out )
+{
+    for ( ; x < count; ++x )
+    {
+        int32_t sum = ROUND;
+        for ( unsigned k = 0; k < taps; ++k )
+        {
+            sum += rows[k][x] * weights[k];
+        }
+        out[x] = clamp8( sum >> SHIFT );
+    }
+}
+
+void columnScalar( const uint8_t* const* rows, const int16_t* weights,
+        unsigned taps, int count, uint8_t* out )
+{
+    columnTail( rows, weights, taps, 0, count, out );
+}
+
+#if RESAMPLER_HAVE_SSE2
+
+void columnSse2( const uint8_t* const* rows, const int16_t* weights,
+        unsigned taps, int count, uint8_t* out )
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        __m128i acc0 = _mm_set1_epi32( ROUND );
+        __m128i acc1 = acc0;
+        __m128i acc2 = acc0;
+        __m128i acc3 = acc0;
+
+        // Two rows at a time: pmaddwd of interleaved samples and weights.
+        for ( unsigned k = 0; k < taps; k += 2 )
+        {
+            const bool pair = k + 1 < taps;
+            const __m128i w = _mm_set1_epi32( int32_t( uint16_t( weights[k] ) |
+                    ( uint32_t( uint16_t( pair ? weights[k + 1] : 0 ) ) << 16 ) ) );
+            const __m128i a = _mm_loadu_si128( (const __m128i*)( rows[k] + x ) );
+            const __m128i b = pair ?
+                    _mm_loadu_si128( (const __m128i*)( rows[k + 1] + x ) ) : zero;
+
+            const __m128i aLo = _mm_unpacklo_epi8( a, zero );
+            const __m128i aHi = _mm_unpackhi_epi8( a, zero );
+            const __m128i bLo = _mm_unpacklo_epi8( b, zero );
+            const __m128i bHi = _mm_unpackhi_epi8( b, zero );
+
+            acc0 = _mm_add_epi32( acc0, _mm_madd_epi16( _mm_unpacklo_epi16( aLo, bLo ), w ) );
+            acc1 = _mm_add_epi32( acc1, _mm_madd_epi16( _mm_unpackhi_epi16( aLo, bLo ), w ) );
+            acc2 = _mm_add_epi32( acc2, _mm_madd_epi16( _mm_unpacklo_epi16( aHi, bHi ), w ) );
+            acc3 = _mm_add_epi32( acc3, _mm_madd_epi16( _mm_unpackhi_epi16( aHi, bHi ), w ) );
+        }
+
+        const __m128i lo = _mm_packs_epi32( _mm_srai_epi32( acc0, SHIFT ),
+                _mm_srai_epi32( acc1, SHIFT ) );
+        const __m128i hi = _mm_packs_epi32( _mm_srai_epi32( acc2, SHIFT ),
+                _mm_srai_epi32( acc3, SHIFT ) );
+        _mm_storeu_si128( (__m128i*)( out + x ), _mm_packus_epi16( lo, hi ) );
+    }
+    columnTail( rows, weights, taps, x, count, out );
+}
+
+#endif
+
+#if RESAMPLER_HAVE_NEON
+
+void columnNeon( const uint8_t* const* rows, const int16_t* weights,
+        unsigned taps, int count, uint8_t* out )
+{
+    int x = 0;
+    for ( ; x + 8 <= count; x += 8 )
+    {
+        int32x4_t lo = vdupq_n_s32( 0 );
+        int32x4_t hi = vdupq_n_s32( 0 );
+        for ( unsigned k = 0; k < taps; ++k )
+        {
+            const int16x8_t samples = vreinterpretq_s16_u16(
+                    vmovl_u8( vld1_u8( rows[k] + x ) ) );
+            lo = vmlal_n_s16( lo, vget_low_s16( samples ), weights[k] );
+            hi = vmlal_n_s16( hi, vget_high_s16( samples ), weights[k] );
+        }
+
+        // The rounding narrow adds ROUND before the shift.
+        const int16x8_t sums = vcombine_s16( vqrshrn_n_s32( lo, SHIFT ),
+                vqrshrn_n_s32( hi, SHIFT ) );
+        vst1_u8( out + x, vqmovun_s16( sums ) );
+    }
+    columnTail( rows, weights, taps, x, count, out );
+}
+
+#endif
+
+const KernelSet* selectKernel( Resampler::Kernel kernel )
+{
+    static const KernelSet scalar = { columnScalar };
+#if RESAMPLER_HAVE_NEON
+    static const KernelSet neon = { columnNeon };
+#endif
+#if RESAMPLER_HAVE_SSE2
+    static const KernelSet sse2 = { columnSse2 };
+#endif
+
+    switch ( kernel )
+    {
+    case Resampler::Kernel::AUTO:
+#if RESAMPLER_HAVE_NEON
+        return &neon;
+#elif RESAMPLER_HAVE_SSE2
+        return &sse2;
+#endif
+        return &scalar;
+
+    case Resampler::Kernel::SCALAR:
+        return &scalar;
+
+#if RESAMPLER_HAVE_NEON
+    case Resampler::Kernel::NEON:
+        return &neon;
+#endif
+
+#if RESAMPLER_HAVE_SSE2
+    case Resampler::Kernel::SSE2:
+        return &sse2;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+// Filter support in source pixels at scale 1.
+double support( Resampler::Filter filter )
+{
+    switch ( filter )
+    {
+    case Resampler::Filter::BOX:      return 0.5;
+    case Resampler::Filter::BILINEAR: return 1.0;
+    case Resampler::Filter::LANCZOS:  return 3.0;
+    }
+    return 1.0;
+}
+
+double sinc( double x )
+{
+    if ( x == 0.0 ) return 1.0;
+    x *= M_PI;
+    return std::sin( x ) / x;
+}
+
+double weight( Resampler::Filter filter, double x )
+{
+    switch ( filter )
+    {
+    case Resampler::Filter::BOX:
+        return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+    case Resampler::Filter::BILINEAR:
+        x = std::fabs( x );
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case Resampler::Filter::LANCZOS:
+        return std::fabs( x ) < 3.0 ? sinc( x ) * sinc( x / 3.0 ) : 0.0;
+    }
+    return 0.0;
+}
+
+// Row pass of one output row, the scalar part after the column kernel.
+void filterRow( const uint8_t* row, int srcStep, const int32_t* start,
+        const int16_t* weights, unsigned taps, int width, uint8_t* out,
+        int dstStep )
+{
+    for ( int x = 0; x < width; ++x, weights += taps )
+    {
+        const uint8_t* src = row + start[x] * srcStep;
+        int32_t sum = ROUND;
+        for ( unsigned k = 0; k < taps; ++k )
+        {
+            sum += src[k * srcStep] * weights[k];
+        }
+        out[x * dstStep] = clamp8( sum >> SHIFT );
+    }
+}
+
+/*
+ * The pooled result: I420 with planes of one byte per sample, packed
+ * rows and no padding.
+ */
+class PlanarBuffer : public CameraBuffer
+{
+public:
+
+    PlanarBuffer( int32_t width, int32_t height )
+    {
+        format_ = YCbCr_420_888;
+        number_of_planes_ = 3;
+
+        const int32_t chromaWidth = width / 2;
+        const int32_t chromaHeight = height / 2;
+        const size_t lumaBytes = size_t(width) * height;
+        const size_t chromaBytes = size_t(chromaWidth) * chromaHeight;
+
+        data_.resize( lumaBytes + 2 * chromaBytes );
+        setPlane( 0, data_.data(), width, height );
+        setPlane( 1, data_.data() + lumaBytes, chromaWidth, chromaHeight );
+        setPlane( 2, data_.data() + lumaBytes + chromaBytes,
+                chromaWidth, chromaHeight );
+    }
+
+    bool hasSize( int32_t width, int32_t height ) const
+    {
+        return buffer_planes_[0].width == width &&
+               buffer_planes_[0].height == height;
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height )
+    {
+        Data& d = buffer_planes_[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = width;
+        d.num_channels = 1;
+        d.bytes_per_channel = 1;
+        d.channel_step = 1;
+    }
+
+    std::vector<uint8_t> data_;
+};
+
+int64_t elapsedUs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+}
+
+}
+
+struct Resampler::State
+{
+    std::mutex mutex;
+    std::vector< std::unique_ptr<PlanarBuffer> > freeList;
+    unsigned capacity = 0;
+    uint64_t allocations = 0;
+
+    std::unique_ptr<PlanarBuffer> acquire( int32_t width, int32_t height )
+    {
+        {
+            std::lock_guard<std::mutex> lk( mutex );
+            for ( auto it = freeList.begin(); it != freeList.end(); ++it )
+            {
+                if ( (*it)->hasSize( width, height ) )
+                {
+                    std::unique_ptr<PlanarBuffer> buffer = std::move( *it );
+                    freeList.erase( it );
+                    return buffer;
+                }
+            }
+            ++allocations;
+        }
+        return std::unique_ptr<PlanarBuffer>( new PlanarBuffer( width, height ) );
+    }
+
+    // The oldest buffer goes when the list is full, so a size change
+    // drains buffers of the old size.
+    void recycle( PlanarBuffer* buffer )
+    {
+        std::unique_ptr<PlanarBuffer> owned( buffer );
+
+        std::lock_guard<std::mutex> lk( mutex );
+        if ( capacity == 0 ) return;
+        if ( freeList.size() == capacity )
+        {
+            freeList.erase( freeList.begin() );
+        }
+        freeList.push_back( std::move(owned) );
+    }
+};
+
+void Resampler::Recycler::operator()( CameraBuffer* buffer ) const
+{
+    if ( pool )
+    {
+        pool->recycle( static_cast<PlanarBuffer*>( buffer ) );
+    }
+    else
+    {
+        delete buffer;
+    }
+}
+
+Resampler::Resampler( const Options& options ) :
+    mOptions(options),
+    mPool( std::make_shared<State>() ),
+    mTaps(4)
+{
+    mKernels = selectKernel( mOptions.kernel );
+    mPool->capacity = mOptions.poolCapacity;
+}
+
+bool Resampler::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+const Resampler::Taps& Resampler::taps( int32_t srcLength, int32_t dstLength )
+{
+    for ( const Taps& t : mTaps )
+    {
+        if ( t.srcLength == srcLength && t.dstLength == dstLength ) return t;
+    }
+
+    Taps& t = mTaps[mNextTaps];
+    mNextTaps = ( mNextTaps + 1 ) % mTaps.size();
+
+    // Downscaling widens the filter to cover every source sample.
+    const double scale = double( srcLength ) / dstLength;
+    const double filterScale = std::max( scale, 1.0 );
+    const double radius = support( mOptions.filter ) * filterScale;
+
+    t.srcLength = srcLength;
+    t.dstLength = dstLength;
+    t.count = std::min( unsigned( std::ceil( radius ) ) * 2 + 1,
+            unsigned( srcLength ) );
+    t.start.assign( dstLength, 0 );
+    t.weights.assign( size_t(dstLength) * t.count, 0 );
+
+    std::vector<double> w( t.count );
+    for ( int32_t x = 0; x < dstLength; ++x )
+    {
+        const double center = ( x + 0.5 ) * scale;
+        const int32_t first = std::max( int32_t( center - radius + 0.5 ), 0 );
+        const int32_t last = std::min( int32_t( center + radius + 0.5 ), srcLength );
+        const unsigned n = std::min( unsigned( std::max( last - first, 1 ) ),
+                t.count );
+
+        double total = 0.0;
+        for ( unsigned j = 0; j < n; ++j )
+        {
+            w[j] = weight( mOptions.filter,
+                    ( first + j - center + 0.5 ) / filterScale );
+            total += w[j];
+        }
+
+        // Every window is t.count taps inside the source; ones past the
+        // edge move left with zero weights on the right.
+        const int32_t start = std::min( first, srcLength - int32_t( t.count ) );
+        int16_t* q = &t.weights[size_t(x) * t.count + ( first - start )];
+        t.start[x] = start;
+
+        if ( total <= 0.0 )
+        {
+            q[0] = int16_t( ONE );
+            continue;
+        }
+
+        // Rounding errors go to the largest weight, so flat areas stay flat.
+        int32_t sum = 0;
+        unsigned largest = 0;
+        for ( unsigned j = 0; j < n; ++j )
+        {
+            q[j] = int16_t( std::lround( w[j] / total * ONE ) );
+            sum += q[j];
+            if ( q[j] > q[largest] ) largest = j;
+        }
+        q[largest] = int16_t( q[largest] + ONE - sum );
+    }
+    return t;
+}
+
+bool Resampler::resample( const CameraBuffer::Data& src,
+        const CameraBuffer::Data& dst )
+{
+    const KernelSet* kernels = static_cast<const KernelSet*>( mKernels );
+    if ( !kernels || !src.ptr || !dst.ptr ||
+         src.width <= 0 || src.height <= 0 ||
+         dst.width <= 0 || dst.height <= 0 ||
+         std::max( src.bytes_per_channel, 1 ) != 1 ||
+         std::max( dst.bytes_per_channel, 1 ) != 1 )
+    {
+        return false;
+    }
+
+    const Taps& across = taps( src.width, dst.width );
+    const Taps& down = taps( src.height, dst.height );
+
+    const int srcStep = std::max( src.channel_step, 1 );
+    const int dstStep = std::max( dst.channel_step, 1 );
+
+    // The column pass keeps the source layout, interleaved samples too.
+    const int span = ( src.width - 1 ) * srcStep + 1;
+
+    const unsigned bands = std::min( unsigned( dst.height ),
+            ThreadPool::instance().concurrency() * BANDS_PER_THREAD );
+    if ( mScratch.size() < bands ) mScratch.resize( bands );
+    for ( unsigned b = 0; b < bands; ++b )
+    {
+        mScratch[b].row.resize( span );
+        mScratch[b].sources.resize( down.count );
+    }
+
+    const uint8_t* srcPixels = static_cast<const uint8_t*>( src.ptr );
+    uint8_t* dstPixels = static_cast<uint8_t*>( dst.ptr );
+
+    ThreadPool::instance().parallelFor( bands, [&]( unsigned band ) {
+        Scratch& scratch = mScratch[band];
+        const int32_t y0 = int32_t( uint64_t( dst.height ) * band / bands );
+        const int32_t y1 = int32_t( uint64_t( dst.height ) * ( band + 1 ) / bands );
+
+        for ( int32_t y = y0; y < y1; ++y )
+        {
+            for ( unsigned k = 0; k < down.count; ++k )
+            {
+                scratch.sources[k] = srcPixels +
+                        size_t( down.start[y] + k ) * src.stride;
+            }
+            kernels->column( scratch.sources.data(),
+                    &down.weights[size_t(y) * down.count], down.count,
+                    span, scratch.row.data() );
+
+            filterRow( scratch.row.data(), srcStep, across.start.data(),
+                    across.weights.data(), across.count, dst.width,
+                    dstPixels + size_t(y) * dst.stride, dstStep );
+        }
+    }, mOptions.maxThreads );
+
+    return true;
+}
+
+bool Resampler::resample( CameraBuffer& src, CameraBuffer& dst )
+{
+    if ( src.format() != YCbCr_420_888 || src.numberOfPlanes() < 3 ||
+         dst.format() != YCbCr_420_888 || dst.numberOfPlanes() < 3 )
+    {
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for ( unsigned plane = 0; plane < 3; ++plane )
+    {
+        if ( !resample( src.data(plane), dst.data(plane) ) ) return false;
+    }
+
+    const int64_t timeUs = elapsedUs( start );
+    ++mCounters.frames;
+    mCounters.lastTimeUs = timeUs;
+    mCounters.maxTimeUs = std::max( mCounters.maxTimeUs, timeUs );
+    mTotalTimeUs += timeUs;
+    mCounters.meanTimeUs = mTotalTimeUs / int64_t( mCounters.frames );
+    return true;
+}
+
+Resampler::Buffer Resampler::resample( CameraBuffer& src, const Size& size )
+{
+    const int32_t width = int32_t( size.width ) & ~1;
+    const int32_t height = int32_t( size.height ) & ~1;
+    if ( width <= 0 || height <= 0 || !mKernels ||
+         src.format() != YCbCr_420_888 )
+    {
+        return Buffer( nullptr, Recycler() );
+    }
+
+    Buffer buffer( mPool->acquire( width, height ).release(),
+            Recycler{ mPool } );
+    if ( !resample( src, *buffer ) )
+    {
+        return Buffer( nullptr, Recycler() );
+    }
+    return buffer;
+}
+
+Resampler::Counters Resampler::counters() const
+{
+    Counters c = mCounters;
+    {
+        std::lock_guard<std::mutex> lk( mPool->mutex );
+        c.allocations = mPool->allocations;
+    }
+    return c;
+}
@@ -0,0 +1,164 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef Resampler_H
+#define Resampler_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*!
+ * Scales YCbCr_420_888 buffers, or BufferViews of them, on the CPU: the
+ * digital zoom of a view back to the stream size, or a smaller copy for
+ * analysis. Each plane is filtered down its columns and then along its
+ * rows with fixed point weights; interleaved chroma is filtered in place,
+ * so NV12 sources are not repacked.
+ *
+ * The column pass has SSE2 and NEON kernels and bands of output rows run
+ * on the ThreadPool. Results go into planar buffers from a pool owned by
+ * the resampler, so a stream of same sized frames allocates nothing
+ * after the first few.
+ *
+ * One thread at a time may use a resampler; buffers may be released from
+ * any thread and may outlive it.
+ */
+class Resampler
+{
+    struct State;
+
+public:
+
+    enum class Filter
+    {
+        BOX,        //< Area average down, nearest up.
+        BILINEAR,
+        LANCZOS     //< Three lobes; sharpest, and the slowest.
+    };
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSE2
+    };
+
+    struct Options
+    {
+        Filter filter = Filter::BILINEAR;
+        Kernel kernel = Kernel::AUTO;
+
+        // Buffers kept for reuse; the resampler itself holds none, so
+        // this should cover the results the caller holds at once.
+        unsigned poolCapacity = 2;
+
+        // Threads of the ThreadPool, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    struct Counters
+    {
+        uint64_t frames = 0;
+        uint64_t allocations = 0;   //< Buffers allocated by the pool.
+        int64_t lastTimeUs = 0;
+        int64_t maxTimeUs = 0;
+        int64_t meanTimeUs = 0;
+    };
+
+    // Without a pool the buffer is deleted.
+    struct Recycler
+    {
+        std::shared_ptr<State> pool;
+        void operator()( nv::camera2::CameraBuffer* buffer ) const;
+    };
+
+    typedef std::unique_ptr<nv::camera2::CameraBuffer, Recycler> Buffer;
+
+    explicit Resampler( const Options& options );
+
+    static bool isAvailable( Kernel kernel );
+
+    /*!
+     * Scales src to size, rounded down to even, into a planar buffer
+     * from the pool. Returns nullptr if src is not a YCbCr_420_888 buffer,
+     * size is empty or the kernel cannot be used.
+     */
+    Buffer resample( nv::camera2::CameraBuffer& src,
+            const nv::camera2::Size& size );
+
+    // Scales src to the size of dst, which may have any chroma layout.
+    bool resample( nv::camera2::CameraBuffer& src,
+            nv::camera2::CameraBuffer& dst );
+
+    // Scales one plane to the size of the other, for 8 bit planes.
+    bool resample( const nv::camera2::CameraBuffer::Data& src,
+            const nv::camera2::CameraBuffer::Data& dst );
+
+    Counters counters() const;
+
+private:
+
+    // Weights of one direction, taps per output sample, in Q14.
+    struct Taps
+    {
+        int32_t srcLength = 0;
+        int32_t dstLength = 0;
+        unsigned count = 0;
+        std::vector<int32_t> start;
+        std::vector<int16_t> weights;
+    };
+
+    const Taps& taps( int32_t srcLength, int32_t dstLength );
+
+    Options mOptions;
+    const void* mKernels = nullptr;
+    std::shared_ptr<State> mPool;
+
+    // Luma and chroma of both directions are usually all in use.
+    std::vector<Taps> mTaps;
+    unsigned mNextTaps = 0;
+
+    // Column pass output and its source rows, for each band.
+    struct Scratch
+    {
+        std::vector<uint8_t> row;
+        std::vector<const uint8_t*> sources;
+    };
+    std::vector<Scratch> mScratch;
+
+    Counters mCounters;
+    int64_t mTotalTimeUs = 0;
+};
+
+#endif
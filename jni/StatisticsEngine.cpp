@@ -0,0 +1,547 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "StatisticsEngine.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define STATISTICS_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define STATISTICS_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+constexpr unsigned LEVELS = 256;
+constexpr unsigned DEFAULT_BUCKETS = 64;
+const Size DEFAULT_MAP_SIZE( 32, 18 );
+
+// Tiles of one tile row are accumulated on the stack.
+constexpr unsigned MAX_MAP_WIDTH = 256;
+
+// The vector kernels sum squares in 32 bit lanes; that many pixels per
+// call cannot overflow them.
+constexpr int MAX_KERNEL_PIXELS = 65536;
+
+struct Moments
+{
+    uint64_t sum = 0;
+    uint64_t sumSq = 0;
+};
+
+/*
+ * moments() adds the sum and sum of squares of count pixels.
+ * gradient() returns the sum over count pixels of the squared differences
+ * to the right neighbor and to the pixel below; row[count] must be valid.
+ */
+typedef void (*MomentsKernel)( const uint8_t* row, int count, Moments& m );
+typedef uint64_t (*GradientKernel)( const uint8_t* row, const uint8_t* below,
+        int count );
+
+struct KernelSet
+{
+    MomentsKernel moments;
+    GradientKernel gradient;
+};
+
+void momentsScalar( const uint8_t* row, int count, Moments& m )
+{
+    uint32_t sum = 0;
+    uint64_t sumSq = 0;
+    for ( int x = 0; x < count; ++x )
+    {
+        const uint32_t v = row[x];
+        sum += v;
+        sumSq += v * v;
+    }
+    m.sum += sum;
+    m.sumSq += sumSq;
+}
+
+uint64_t gradientScalar( const uint8_t* row, const uint8_t* below, int count )
+{
+    uint64_t energy = 0;
+    for ( int x = 0; x < count; ++x )
+    {
+        const int dx = row[x + 1] - row[x];
+        const int dy = below[x] - row[x];
+        energy += dx * dx + dy * dy;
+    }
+    return energy;
+}
+
+#if STATISTICS_HAVE_SSE2
+
+inline __m128i absDiff( __m128i a, __m128i b )
+{
+    return _mm_or_si128( _mm_subs_epu8( a, b ), _mm_subs_epu8( b, a ) );
+}
+
+// Sum of squares of 16 bytes, in four 32 bit lanes.
+inline __m128i squares( __m128i v )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8( v, zero );
+    const __m128i hi = _mm_unpackhi_epi8( v, zero );
+    return _mm_add_epi32( _mm_madd_epi16( lo, lo ), _mm_madd_epi16( hi, hi ) );
+}
+
+inline uint64_t horizontalSum( __m128i v )
+{
+    uint32_t lanes[4];
+    _mm_storeu_si128( (__m128i*) lanes, v );
+    return uint64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+}
+
+void momentsSse2( const uint8_t* row, int count, Moments& m )
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    __m128i sumSq = zero;
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const __m128i v = _mm_loadu_si128( (const __m128i*)( row + x ) );
+        sum = _mm_add_epi64( sum, _mm_sad_epu8( v, zero ) );
+        sumSq = _mm_add_epi32( sumSq, squares( v ) );
+    }
+
+    uint64_t sums[2];
+    _mm_storeu_si128( (__m128i*) sums, sum );
+    m.sum += sums[0] + sums[1];
+    m.sumSq += horizontalSum( sumSq );
+    momentsScalar( row + x, count - x, m );
+}
+
+uint64_t gradientSse2( const uint8_t* row, const uint8_t* below, int count )
+{
+    __m128i energyX = _mm_setzero_si128();
+    __m128i energyY = _mm_setzero_si128();
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const __m128i v = _mm_loadu_si128( (const __m128i*)( row + x ) );
+        const __m128i right = _mm_loadu_si128( (const __m128i*)( row + x + 1 ) );
+        const __m128i down = _mm_loadu_si128( (const __m128i*)( below + x ) );
+        energyX = _mm_add_epi32( energyX, squares( absDiff( v, right ) ) );
+        energyY = _mm_add_epi32( energyY, squares( absDiff( v, down ) ) );
+    }
+
+    return horizontalSum( energyX ) + horizontalSum( energyY ) +
+           gradientScalar( row + x, below + x, count - x );
+}
+
+#endif
+
+#if STATISTICS_HAVE_NEON
+
+inline uint64_t horizontalSum( uint32x4_t v )
+{
+    const uint64x2_t pairs = vpaddlq_u32( v );
+    return vgetq_lane_u64( pairs, 0 ) + vgetq_lane_u64( pairs, 1 );
+}
+
+// Adds the squares of 16 bytes to four 32 bit lanes.
+inline uint32x4_t accumulateSquares( uint32x4_t acc, uint8x16_t v )
+{
+    acc = vpadalq_u16( acc, vmull_u8( vget_low_u8( v ), vget_low_u8( v ) ) );
+    return vpadalq_u16( acc, vmull_u8( vget_high_u8( v ), vget_high_u8( v ) ) );
+}
+
+void momentsNeon( const uint8_t* row, int count, Moments& m )
+{
+    uint32x4_t sum = vdupq_n_u32( 0 );
+    uint32x4_t sumSq = vdupq_n_u32( 0 );
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const uint8x16_t v = vld1q_u8( row + x );
+        sum = vpadalq_u16( sum, vpaddlq_u8( v ) );
+        sumSq = accumulateSquares( sumSq, v );
+    }
+
+    m.sum += horizontalSum( sum );
+    m.sumSq += horizontalSum( sumSq );
+    momentsScalar( row + x, count - x, m );
+}
+
+uint64_t gradientNeon( const uint8_t* row, const uint8_t* below, int count )
+{
+    uint32x4_t energyX = vdupq_n_u32( 0 );
+    uint32x4_t energyY = vdupq_n_u32( 0 );
+
+    int x = 0;
+    for ( ; x + 16 <= count; x += 16 )
+    {
+        const uint8x16_t v = vld1q_u8( row + x );
+        energyX = accumulateSquares( energyX, vabdq_u8( v, vld1q_u8( row + x + 1 ) ) );
+        energyY = accumulateSquares( energyY, vabdq_u8( v, vld1q_u8( below + x ) ) );
+    }
+
+    return horizontalSum( energyX ) + horizontalSum( energyY ) +
+           gradientScalar( row + x, below + x, count - x );
+}
+
+#endif
+
+const KernelSet* selectKernel( StatisticsEngine::Kernel kernel )
+{
+    static const KernelSet scalar = { momentsScalar, gradientScalar };
+#if STATISTICS_HAVE_NEON
+    static const KernelSet neon = { momentsNeon, gradientNeon };
+#endif
+#if STATISTICS_HAVE_SSE2
+    static const KernelSet sse2 = { momentsSse2, gradientSse2 };
+#endif
+
+    switch ( kernel )
+    {
+    case StatisticsEngine::Kernel::AUTO:
+#if STATISTICS_HAVE_NEON
+        return &neon;
+#elif STATISTICS_HAVE_SSE2
+        return &sse2;
+#endif
+        return &scalar;
+
+    case StatisticsEngine::Kernel::SCALAR:
+        return &scalar;
+
+#if STATISTICS_HAVE_NEON
+    case StatisticsEngine::Kernel::NEON:
+        return &neon;
+#endif
+
+#if STATISTICS_HAVE_SSE2
+    case StatisticsEngine::Kernel::SSE2:
+        return &sse2;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+// Four interleaved histograms, so runs of equal pixels do not serialize
+// on one counter.
+void addToHistogram( const uint8_t* row, int count, uint32_t (*hist)[LEVELS] )
+{
+    int x = 0;
+    for ( ; x + 4 <= count; x += 4 )
+    {
+        ++hist[0][row[x]];
+        ++hist[1][row[x + 1]];
+        ++hist[2][row[x + 2]];
+        ++hist[3][row[x + 3]];
+    }
+    for ( ; x < count; ++x )
+    {
+        ++hist[0][row[x]];
+    }
+}
+
+// Accumulators of one tile over the rows of its tile row.
+struct TileSums
+{
+    Moments moments;
+    uint64_t gradient = 0;
+    uint32_t samples = 0;
+    uint32_t gradientSamples = 0;
+};
+
+// Moments, histogram and gradient of the samples of one row segment.
+void processSegment( const KernelSet& kernels, const uint8_t* row,
+        const uint8_t* below, int x0, int x1, int width, int step,
+        TileSums& tile, uint32_t (*hist)[LEVELS] )
+{
+    // The last column has no right neighbor.
+    const int gradientEnd = std::min( x1, width - 1 );
+
+    if ( step == 1 )
+    {
+        for ( int x = x0; x < x1; x += MAX_KERNEL_PIXELS )
+        {
+            const int count = std::min( x1 - x, MAX_KERNEL_PIXELS );
+            kernels.moments( row + x, count, tile.moments );
+            addToHistogram( row + x, count, hist );
+        }
+        for ( int x = x0; x < gradientEnd; x += MAX_KERNEL_PIXELS )
+        {
+            const int count = std::min( gradientEnd - x, MAX_KERNEL_PIXELS );
+            tile.gradient += kernels.gradient( row + x, below + x, count );
+        }
+        tile.samples += x1 - x0;
+        tile.gradientSamples += std::max( gradientEnd - x0, 0 );
+        return;
+    }
+
+    // Sampled columns are aligned to the image, not to the tile.
+    const int first = ( x0 + step - 1 ) / step * step;
+    uint32_t sum = 0;
+    uint64_t sumSq = 0;
+    for ( int x = first; x < x1; x += step )
+    {
+        const uint32_t v = row[x];
+        sum += v;
+        sumSq += v * v;
+        ++hist[0][v];
+        ++tile.samples;
+
+        if ( x < gradientEnd )
+        {
+            const int dx = row[x + 1] - int(v);
+            const int dy = below[x] - int(v);
+            tile.gradient += dx * dx + dy * dy;
+            ++tile.gradientSamples;
+        }
+    }
+    tile.moments.sum += sum;
+    tile.moments.sumSq += sumSq;
+}
+
+}
+
+StatisticsEngine::StatisticsEngine( const StaticProperties& properties,
+        const Options& options ) :
+    mOptions(options),
+    mMaxHistogramCount(properties.statistics.maxHistogramCount),
+    mMaxSharpness(properties.statistics.maxSharpnessMapValue)
+{
+    mOptions.subsample = std::max( options.subsample, 1u );
+
+    mBuckets = options.histogramBuckets;
+    if ( mBuckets == 0 )
+    {
+        mBuckets = properties.statistics.histogramBucketCount > 0 ?
+                properties.statistics.histogramBucketCount : DEFAULT_BUCKETS;
+    }
+    mBuckets = std::min( mBuckets, LEVELS );
+
+    mMapSize = options.mapSize;
+    if ( mMapSize.width == 0 || mMapSize.height == 0 )
+    {
+        const Size& map = properties.statistics.sharpnessMapSize;
+        mMapSize = map.width > 0 && map.height > 0 ? map : DEFAULT_MAP_SIZE;
+    }
+    mMapSize.width = std::min( mMapSize.width, MAX_MAP_WIDTH );
+
+    const size_t tiles = size_t(mMapSize.width) * mMapSize.height;
+    mRowHistograms.resize( size_t(mMapSize.height) * LEVELS );
+    mHistogram.resize( LEVELS );
+    mTileMeans.resize( tiles );
+    mTileVariances.resize( tiles );
+    mTileSharpness.resize( tiles );
+    mTileSamples.resize( tiles );
+}
+
+bool StatisticsEngine::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+bool StatisticsEngine::process( CameraBuffer& img, Statistics& statistics )
+{
+    if ( img.format() != YCbCr_420_888 ) return false;
+
+    return process( img.data(0), statistics );
+}
+
+bool StatisticsEngine::process( const CameraBuffer::Data& luma,
+        Statistics& statistics )
+{
+    const auto start = std::chrono::steady_clock::now();
+    mStats = Stats();
+
+    const KernelSet* kernels = selectKernel( mOptions.kernel );
+    if ( !kernels || !luma.ptr || luma.width < 1 || luma.height < 1 ||
+         std::max( luma.channel_step, 1 ) != 1 )
+    {
+        return false;
+    }
+
+    const int width = luma.width;
+    const int height = luma.height;
+    const int step = mOptions.subsample;
+    const unsigned mapWidth = mMapSize.width;
+    const uint8_t* pixels = static_cast<const uint8_t*>( luma.ptr );
+
+    ThreadPool::instance().parallelFor( mMapSize.height, [&]( unsigned tileRow ) {
+        uint32_t hist[4][LEVELS];
+        memset( hist, 0, sizeof(hist) );
+
+        TileSums tiles[MAX_MAP_WIDTH];
+        const int y0 = int( uint64_t(tileRow) * height / mMapSize.height );
+        const int y1 = int( uint64_t(tileRow + 1) * height / mMapSize.height );
+
+        for ( int y = ( y0 + step - 1 ) / step * step; y < y1; y += step )
+        {
+            const uint8_t* row = pixels + size_t(y) * luma.stride;
+
+            // The last row only has horizontal gradients.
+            const uint8_t* below = y + 1 < height ? row + luma.stride : row;
+
+            for ( unsigned tileX = 0; tileX < mapWidth; ++tileX )
+            {
+                const int x0 = int( uint64_t(tileX) * width / mapWidth );
+                const int x1 = int( uint64_t(tileX + 1) * width / mapWidth );
+                processSegment( *kernels, row, below, x0, x1, width, step,
+                        tiles[tileX], hist );
+            }
+        }
+
+        uint32_t* rowHist = &mRowHistograms[size_t(tileRow) * LEVELS];
+        for ( unsigned level = 0; level < LEVELS; ++level )
+        {
+            rowHist[level] = hist[0][level] + hist[1][level] +
+                             hist[2][level] + hist[3][level];
+        }
+
+        for ( unsigned tileX = 0; tileX < mapWidth; ++tileX )
+        {
+            const TileSums& t = tiles[tileX];
+            const size_t i = size_t(tileRow) * mapWidth + tileX;
+            const double n = std::max( t.samples, 1u );
+            const double mean = t.moments.sum / n;
+            mTileMeans[i] = float( mean );
+            mTileVariances[i] = float( std::max( t.moments.sumSq / n - mean * mean, 0.0 ) );
+            mTileSharpness[i] = float( double(t.gradient) /
+                    std::max( t.gradientSamples, 1u ) );
+            mTileSamples[i] = t.samples;
+        }
+    }, mOptions.maxThreads );
+
+    std::fill( mHistogram.begin(), mHistogram.end(), 0 );
+    for ( unsigned tileRow = 0; tileRow < mMapSize.height; ++tileRow )
+    {
+        const uint32_t* rowHist = &mRowHistograms[size_t(tileRow) * LEVELS];
+        for ( unsigned level = 0; level < LEVELS; ++level )
+        {
+            mHistogram[level] += rowHist[level];
+        }
+    }
+
+    uint64_t samples = 0;
+    for ( auto n : mTileSamples ) samples += n;
+
+    // Same counts for each of the three channels, bucket by bucket, as the
+    // HAL reports them.
+    statistics.histogram.numBuckets = mBuckets;
+    statistics.histogram.data.resize( 3 * mBuckets );
+    for ( unsigned bucket = 0; bucket < mBuckets; ++bucket )
+    {
+        uint64_t count = 0;
+        for ( unsigned level = bucket * LEVELS / mBuckets;
+              level < ( bucket + 1 ) * LEVELS / mBuckets; ++level )
+        {
+            count += mHistogram[level];
+        }
+        if ( mMaxHistogramCount > 0 )
+        {
+            count = std::min<uint64_t>( count, mMaxHistogramCount );
+        }
+        std::fill_n( &statistics.histogram.data[3 * bucket], 3, unsigned(count) );
+    }
+
+    statistics.sharpnessMap.resize( 3 * mTileSharpness.size() );
+    for ( size_t i = 0; i < mTileSharpness.size(); ++i )
+    {
+        float sharpness = mTileSharpness[i];
+        if ( mMaxSharpness > 0 )
+        {
+            sharpness = std::min( sharpness, float(mMaxSharpness) );
+        }
+        std::fill_n( &statistics.sharpnessMap[3 * i], 3, sharpness );
+    }
+
+    meter( samples );
+
+    mStats.samples = samples;
+    mStats.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+    return true;
+}
+
+void StatisticsEngine::meter( uint64_t samples )
+{
+    mMetering = Metering();
+    if ( samples == 0 ) return;
+
+    double sum = 0.0;
+    double weightedSum = 0.0;
+    double weights = 0.0;
+    for ( unsigned tileY = 0; tileY < mMapSize.height; ++tileY )
+    {
+        for ( unsigned tileX = 0; tileX < mMapSize.width; ++tileX )
+        {
+            const size_t i = size_t(tileY) * mMapSize.width + tileX;
+            const double tileSum = double(mTileMeans[i]) * mTileSamples[i];
+
+            // Tiles whose center lies in the middle half of both axes.
+            const bool center =
+                    4 * ( 2 * tileX + 1 ) >= mMapSize.width * 2 &&
+                    4 * ( 2 * tileX + 1 ) <= mMapSize.width * 6 &&
+                    4 * ( 2 * tileY + 1 ) >= mMapSize.height * 2 &&
+                    4 * ( 2 * tileY + 1 ) <= mMapSize.height * 6;
+            const double weight = center ? 3.0 : 1.0;
+
+            sum += tileSum;
+            weightedSum += weight * tileSum;
+            weights += weight * mTileSamples[i];
+        }
+    }
+    mMetering.meanLuma = float( sum / samples );
+    mMetering.centerWeightedLuma = float( weightedSum / std::max( weights, 1.0 ) );
+
+    uint64_t below = 0;
+    for ( unsigned level = 0; level < LEVELS; ++level )
+    {
+        below += mHistogram[level];
+        if ( 2 * below >= samples )
+        {
+            mMetering.medianLuma = uint8_t( level );
+            break;
+        }
+    }
+    mMetering.clippedFraction = float( double(mHistogram[LEVELS - 1]) / samples );
+    mMetering.crushedFraction = float( double(mHistogram[0]) / samples );
+}
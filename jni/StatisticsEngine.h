@@ -0,0 +1,170 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef StatisticsEngine_H
+#define StatisticsEngine_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <vector>
+
+/*!
+ * CPU replacement for the HAL statistics of Request::Statistics, computed
+ * from the Y plane: a luma histogram, the mean and variance of every tile
+ * of a grid and a gradient energy sharpness map on the same grid. The
+ * results fill nv::camera2::Statistics the way a HAL would, so AE/AF code
+ * does not depend on what the device reports.
+ *
+ * Rows of tiles are processed on the ThreadPool. Pixels can be sampled
+ * every subsample pixels and rows; the sharpness still takes the
+ * gradient to the direct neighbors of each sample.
+ */
+class StatisticsEngine
+{
+public:
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSE2
+    };
+
+    struct Options
+    {
+        // StaticProperties::statistics::histogramBucketCount if left at 0,
+        // 64 if the camera does not report one. At most 256.
+        unsigned histogramBuckets = 0;
+
+        // Tile grid, StaticProperties::statistics::sharpnessMapSize if
+        // left at 0x0, 32x18 if the camera does not report one. At most
+        // 256 tiles wide.
+        nv::camera2::Size mapSize;
+
+        // Distance between sampled pixels and rows.
+        unsigned subsample = 1;
+
+        Kernel kernel = Kernel::AUTO;
+
+        // Threads of the ThreadPool used for tile rows, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    struct Metering
+    {
+        float meanLuma = 0.0f;              //< 0 to 255.
+        float centerWeightedLuma = 0.0f;    //< Center half of the frame
+                                            //  weighted three times.
+        uint8_t medianLuma = 0;
+        float clippedFraction = 0.0f;       //< Samples at 255.
+        float crushedFraction = 0.0f;       //< Samples at 0.
+    };
+
+    struct Stats
+    {
+        int64_t timeUs = 0;
+        uint64_t samples = 0;
+    };
+
+    StatisticsEngine( const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    static bool isAvailable( Kernel kernel );
+
+    /*!
+     * Computes the statistics of the Y plane of a YCbCr_420_888 buffer and
+     * writes the histogram and sharpness map into statistics. Returns
+     * false if the buffer is not YCbCr_420_888 or the kernel is not
+     * available.
+     */
+    bool process( nv::camera2::CameraBuffer& img,
+            nv::camera2::Statistics& statistics );
+
+    bool process( const nv::camera2::CameraBuffer::Data& luma,
+            nv::camera2::Statistics& statistics );
+
+    nv::camera2::Size mapSize() const
+    {
+        return mMapSize;
+    }
+
+    unsigned histogramBuckets() const
+    {
+        return mBuckets;
+    }
+
+    // Row major per tile results of the last process() call.
+    const std::vector<float>& tileMeans() const
+    {
+        return mTileMeans;
+    }
+
+    const std::vector<float>& tileVariances() const
+    {
+        return mTileVariances;
+    }
+
+    const Metering& lastMetering() const
+    {
+        return mMetering;
+    }
+
+    const Stats& lastStats() const
+    {
+        return mStats;
+    }
+
+private:
+
+    void meter( uint64_t samples );
+
+    Options mOptions;
+    nv::camera2::Size mMapSize;
+    unsigned mBuckets;
+    int32_t mMaxHistogramCount;
+    int32_t mMaxSharpness;
+
+    // One 256 level histogram per row of tiles, merged after the loop.
+    std::vector<uint32_t> mRowHistograms;
+    std::vector<uint64_t> mHistogram;
+
+    std::vector<float> mTileMeans;
+    std::vector<float> mTileVariances;
+    std::vector<float> mTileSharpness;
+    std::vector<uint32_t> mTileSamples;
+
+    Metering mMetering;
+    Stats mStats;
+};
+
+#endif
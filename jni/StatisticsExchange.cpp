@@ -0,0 +1,122 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "StatisticsExchange.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+StatisticsExchange::StatisticsExchange( unsigned kept ) :
+    mProcessed( std::max( kept, 1u ) ),
+    mProcessedTimes( std::max( kept, 1u ), -1 )
+{
+}
+
+void StatisticsExchange::take( int64_t captureTime )
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mTakenTime = captureTime;
+        mTakenDone = false;
+    }
+    mChanged.notify_all();
+}
+
+void StatisticsExchange::publish( nv::camera2::Statistics& statistics )
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        std::swap( mProcessed[mNext], statistics );
+        mProcessedTimes[mNext] = mTakenTime;
+        mNext = ( mNext + 1 ) % mProcessed.size();
+        mTakenDone = true;
+    }
+    mChanged.notify_all();
+}
+
+void StatisticsExchange::skip()
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mTakenDone = true;
+    }
+    mChanged.notify_all();
+}
+
+bool StatisticsExchange::find( int64_t captureTime,
+        nv::camera2::Statistics& statistics )
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return findLocked( captureTime, statistics );
+}
+
+bool StatisticsExchange::wait( int64_t captureTime, int64_t timeoutUs,
+        nv::camera2::Statistics& statistics )
+{
+    std::unique_lock<std::mutex> lk( mMutex );
+    mChanged.wait_for( lk, std::chrono::microseconds( timeoutUs ), [&]
+            {
+                return mStopped || settled( captureTime );
+            } );
+    return !mStopped && findLocked( captureTime, statistics );
+}
+
+void StatisticsExchange::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mStopped = true;
+    }
+    mChanged.notify_all();
+}
+
+bool StatisticsExchange::settled( int64_t captureTime ) const
+{
+    // A later frame taken means this one was processed before it or
+    // skipped; frames are taken one at a time.
+    return mTakenTime > captureTime ||
+           ( mTakenTime == captureTime && mTakenDone );
+}
+
+bool StatisticsExchange::findLocked( int64_t captureTime,
+        nv::camera2::Statistics& statistics ) const
+{
+    for ( unsigned i = 0; i < mProcessedTimes.size(); ++i )
+    {
+        if ( mProcessedTimes[i] == captureTime )
+        {
+            statistics = mProcessed[i];
+            return true;
+        }
+    }
+    return false;
+}
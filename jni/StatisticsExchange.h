@@ -0,0 +1,110 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef StatisticsExchange_H
+#define StatisticsExchange_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*!
+ * Hands the statistics one thread computes from a stream to the threads
+ * that want them by capture time, such as the metadata journal.
+ *
+ * The statistics thread always takes the newest frame, so it skips frames
+ * while it is busy. It calls take() when it takes a frame, which settles
+ * every earlier frame, and publish() or skip() when it is done with it.
+ * wait() therefore knows when a frame is settled, and only waits while the
+ * frame is being processed or may still be taken, at most about two
+ * process times. The statistics of the last few frames are kept.
+ */
+class StatisticsExchange
+{
+public:
+
+    // Keeps the statistics of the last kept processed frames.
+    explicit StatisticsExchange( unsigned kept );
+
+    // Statistics thread: the frame captured at captureTime was taken.
+    void take( int64_t captureTime );
+
+    /*!
+     * Statistics thread: the frame taken last was processed. Published by
+     * swapping, statistics gets the vectors of the oldest entry back to be
+     * filled by the next frame.
+     */
+    void publish( nv::camera2::Statistics& statistics );
+
+    // Statistics thread: the frame taken last could not be processed.
+    void skip();
+
+    /*!
+     * Copies the statistics of the frame captured at captureTime. Returns
+     * false if the frame was skipped, is not settled yet or too many
+     * frames have been processed since.
+     */
+    bool find( int64_t captureTime, nv::camera2::Statistics& statistics );
+
+    /*!
+     * Waits up to timeoutUs until the frame captured at captureTime is
+     * settled, then finds its statistics. Returns false at once after
+     * stop().
+     */
+    bool wait( int64_t captureTime, int64_t timeoutUs,
+            nv::camera2::Statistics& statistics );
+
+    // Releases the waiting threads, for good.
+    void stop();
+
+private:
+
+    bool settled( int64_t captureTime ) const;
+    bool findLocked( int64_t captureTime,
+            nv::camera2::Statistics& statistics ) const;
+
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+
+    // Ring of the processed frames, by capture time
+    std::vector<nv::camera2::Statistics> mProcessed;
+    std::vector<int64_t> mProcessedTimes;
+    unsigned mNext = 0;
+
+    int64_t mTakenTime = -1;    //< Capture time of the frame taken last.
+    bool mTakenDone = true;     //< Published or skipped.
+    bool mStopped = false;
+};
+
+#endif
@@ -0,0 +1,211 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "StreamConsumer.h"
+#include "FrameTracer.h"
+
+#include <algorithm>
+
+namespace
+{
+
+// Number of glass-to-glass samples the percentiles are taken over.
+constexpr unsigned LATENCY_SAMPLES = 256;
+
+}
+
+StreamConsumer::StreamConsumer( FrameDistributor::Consumer& queue,
+        nv::camera2::CaptureRequest& request,
+        SubmitFunction submit,
+        const Options& options ) :
+    mQueue(queue),
+    mRequest(request),
+    mSubmit(std::move(submit)),
+    mOptions(options),
+    mBaseFrameDuration(request.settings.sensor.frameDuration)
+{
+    mLatencies.reserve( LATENCY_SAMPLES );
+    mCounters.frameDurationUs = mBaseFrameDuration;
+}
+
+FrameDistributor::FrameRef StreamConsumer::acquire()
+{
+    FrameDistributor::FrameRef frame;
+    if ( !mQueue.tryPop( frame ) ) return frame;
+
+    // Frames displaced from the queue were never seen either.
+    const uint64_t queueDropped = mQueue.counters().framesDropped;
+    uint64_t dropped = queueDropped - mQueueDropped;
+    mQueueDropped = queueDropped;
+
+    FrameDistributor::FrameRef next;
+    switch ( mOptions.policy )
+    {
+    case Policy::EVERY_FRAME:
+        break;
+
+    case Policy::NEWEST_ONLY:
+    case Policy::ADAPTIVE:
+        // Only take the frames that are queued now; frames arriving while
+        // draining are left for the next call.
+        for ( unsigned n = mQueue.counters().queueDepth; n > 0; --n )
+        {
+            if ( !mQueue.tryPop( next ) ) break;
+            frame = std::move( next );
+            ++dropped;
+        }
+        break;
+
+    case Policy::MAX_LATENCY:
+    {
+        const int64_t now = FrameTracer::now();
+        while ( ( now - frame->captureTime ) / 1000 > mOptions.maxLatencyUs &&
+                mQueue.tryPop( next ) )
+        {
+            frame = std::move( next );
+            ++dropped;
+        }
+        break;
+    }
+    }
+
+    for ( uint64_t i = 0; i < dropped; ++i )
+    {
+        FrameTracer::instance().recordDrop( FrameTracer::Stage::DEQUEUE );
+    }
+
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        ++mCounters.framesAcquired;
+        mCounters.framesDropped += dropped;
+    }
+
+    if ( mOptions.policy == Policy::ADAPTIVE )
+    {
+        adapt( dropped > 0 );
+    }
+
+    return frame;
+}
+
+void StreamConsumer::presented( const nv::camera2::CameraFrame& frame )
+{
+    const int64_t latency = ( FrameTracer::now() - frame.captureTime ) / 1000;
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    if ( mLatencies.size() < LATENCY_SAMPLES )
+    {
+        mLatencies.push_back( latency );
+    }
+    else
+    {
+        mLatencies[mLatencyNext] = latency;
+    }
+    mLatencyNext = ( mLatencyNext + 1 ) % LATENCY_SAMPLES;
+    ++mCounters.framesPresented;
+}
+
+StreamConsumer::Counters StreamConsumer::counters() const
+{
+    std::vector<int64_t> sorted;
+    Counters c;
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        c = mCounters;
+        sorted = mLatencies;
+    }
+
+    if ( !sorted.empty() )
+    {
+        std::sort( sorted.begin(), sorted.end() );
+        const size_t last = sorted.size() - 1;
+        c.latencyP50 = sorted[last / 2];
+        c.latencyP99 = sorted[last * 99 / 100];
+        c.latencyMax = sorted[last];
+    }
+    return c;
+}
+
+void StreamConsumer::restoreFrameDuration()
+{
+    if ( mRequest.settings.sensor.frameDuration != mBaseFrameDuration )
+    {
+        setFrameDuration( mBaseFrameDuration );
+    }
+    mWindowFrames = 0;
+    mWindowDrops = 0;
+}
+
+void StreamConsumer::adapt( bool dropped )
+{
+    ++mWindowFrames;
+    if ( dropped ) ++mWindowDrops;
+    if ( mWindowFrames < std::max( mOptions.window, 1u ) ) return;
+
+    const int64_t current = mRequest.settings.sensor.frameDuration;
+    int64_t next = current;
+
+    if ( mWindowDrops >= mOptions.lagRatio * mWindowFrames )
+    {
+        // The consumer keeps falling behind: have the sensor deliver fewer
+        // frames instead of capturing frames that are thrown away.
+        next = std::min<int64_t>( current * mOptions.frameDurationStep,
+                mOptions.maxFrameDurationUs );
+    }
+    else if ( mWindowDrops == 0 )
+    {
+        next = std::max<int64_t>( current / mOptions.frameDurationStep,
+                mBaseFrameDuration );
+    }
+
+    if ( next != current )
+    {
+        setFrameDuration( next );
+    }
+
+    mWindowFrames = 0;
+    mWindowDrops = 0;
+}
+
+void StreamConsumer::setFrameDuration( int64_t frameDurationUs )
+{
+    const int64_t previous = mRequest.settings.sensor.frameDuration;
+    mRequest.settings.sensor.frameDuration = frameDurationUs;
+    if ( !mSubmit( mRequest ) )
+    {
+        mRequest.settings.sensor.frameDuration = previous;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    mCounters.frameDurationUs = frameDurationUs;
+    ++mCounters.frameDurationChanges;
+}
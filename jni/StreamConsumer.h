@@ -0,0 +1,162 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef StreamConsumer_H
+#define StreamConsumer_H
+
+#include "FrameDistributor.h"
+#include "native_camera2/native_camera2.h"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*!
+ * Decides which of the frames in a FrameDistributor queue a consumer such
+ * as the preview loop gets to see. Frames that are skipped are released
+ * right away, so their slots and buffers go back to the camera instead of
+ * piling up in the queue and adding to the latency of every later frame.
+ * Frames the queue displaced since the last acquire() count as dropped
+ * too.
+ *
+ * Call acquire() once per consumer iteration and presented() once the
+ * frame it returned is on screen; the time between captureTime and
+ * presented() is the glass-to-glass latency reported by counters().
+ */
+class StreamConsumer
+{
+public:
+
+    enum class Policy
+    {
+        EVERY_FRAME,    //< One frame per acquire(), nothing is dropped.
+        NEWEST_ONLY,    //< Drains the queue and keeps the newest frame.
+        MAX_LATENCY,    //< Drops frames older than Options::maxLatencyUs.
+        ADAPTIVE        //< NEWEST_ONLY, and slows the sensor down on lag.
+    };
+
+    /*
+     * ADAPTIVE changes the frame duration of the whole repeating request.
+     * Every stream of the request and every other consumer of the same
+     * distributor, such as recording or ZSL, then gets fewer frames too, so
+     * it only suits requests whose frames feed nothing but this consumer.
+     */
+
+    struct Options
+    {
+        Policy policy = Policy::NEWEST_ONLY;
+
+        // MAX_LATENCY: age in microseconds past which a frame is skipped
+        // if a newer one is queued behind it.
+        int64_t maxLatencyUs = 50000;
+
+        // ADAPTIVE: the consumer lags when at least lagRatio of the last
+        // window acquired frames came with drops. The frame duration then
+        // grows by frameDurationStep, up to maxFrameDurationUs, and goes
+        // back one step after a window without lag.
+        unsigned window = 60;
+        float lagRatio = 0.25f;
+        float frameDurationStep = 1.25f;
+        int64_t maxFrameDurationUs = 100000;
+    };
+
+    struct Counters
+    {
+        uint64_t framesAcquired = 0;
+        uint64_t framesDropped = 0;     //< Released without being acquired.
+        uint64_t framesPresented = 0;
+
+        // Glass-to-glass latency over the last presented frames, in us.
+        int64_t latencyP50 = 0;
+        int64_t latencyP99 = 0;
+        int64_t latencyMax = 0;
+
+        // ADAPTIVE: current sensor frame duration and number of changes.
+        int64_t frameDurationUs = 0;
+        uint64_t frameDurationChanges = 0;
+    };
+
+    /*!
+     * Submits the repeating request again, such as
+     * CameraSession::updateStreaming(); returns false if it failed.
+     */
+    typedef std::function<bool( nv::camera2::CaptureRequest& )> SubmitFunction;
+
+    /*!
+     * For Policy::ADAPTIVE, request is the repeating request feeding the
+     * queue. It is handed to submit whenever the frame duration changes,
+     * which also updates its requestId, so it has to outlive the consumer.
+     */
+    StreamConsumer( FrameDistributor::Consumer& queue,
+            nv::camera2::CaptureRequest& request,
+            SubmitFunction submit,
+            const Options& options );
+
+    /*!
+     * Returns the frame the policy picks from the queue, or an empty
+     * FrameRef if no frame is queued. Never blocks.
+     */
+    FrameDistributor::FrameRef acquire();
+
+    // Records the glass-to-glass latency of a frame returned by acquire().
+    void presented( const nv::camera2::CameraFrame& frame );
+
+    Counters counters() const;
+
+    // Restores the frame duration the request had at construction.
+    void restoreFrameDuration();
+
+private:
+
+    void adapt( bool dropped );
+    void setFrameDuration( int64_t frameDurationUs );
+
+    FrameDistributor::Consumer& mQueue;
+    nv::camera2::CaptureRequest& mRequest;
+    SubmitFunction mSubmit;
+    const Options mOptions;
+    const int64_t mBaseFrameDuration;
+
+    // Frames the queue had displaced at the last acquire().
+    uint64_t mQueueDropped = 0;
+
+    // ADAPTIVE state, only touched by acquire().
+    unsigned mWindowFrames = 0;
+    unsigned mWindowDrops = 0;
+
+    // Ring of the last glass-to-glass latencies.
+    mutable std::mutex mMutex;
+    std::vector<int64_t> mLatencies;
+    unsigned mLatencyNext = 0;
+    Counters mCounters;
+};
+
+#endif
@@ -0,0 +1,142 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool( std::max( std::thread::hardware_concurrency(), 1u ) - 1 );
+    return pool;
+}
+
+ThreadPool::ThreadPool( unsigned numWorkers ) :
+    mBusy(false),
+    mNext(0)
+{
+    for ( unsigned i = 0; i < numWorkers; ++i )
+    {
+        mWorkers.push_back( std::thread( &ThreadPool::workerLoop, this ) );
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mQuit = true;
+    }
+    mWake.notify_all();
+
+    for ( auto& worker : mWorkers )
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::run( unsigned count, Task task, void* context,
+        unsigned maxThreads )
+{
+    if ( count == 0 ) return;
+
+    bool idle = false;
+    const unsigned threads = maxThreads ?
+            std::min( maxThreads, concurrency() ) : concurrency();
+
+    if ( count == 1 || threads == 1 ||
+         !mBusy.compare_exchange_strong( idle, true ) )
+    {
+        for ( unsigned i = 0; i < count; ++i )
+        {
+            task( context, i );
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mTask = task;
+        mContext = context;
+        mCount = count;
+        mNext = 0;
+        mHelpers = std::min( threads, count ) - 1;
+        ++mGeneration;
+    }
+    mWake.notify_all();
+
+    for ( unsigned i = mNext++; i < count; i = mNext++ )
+    {
+        task( context, i );
+    }
+
+    {
+        // Workers that have not picked the loop up yet no longer need to.
+        std::unique_lock<std::mutex> lk( mMutex );
+        mHelpers = 0;
+        mDone.wait( lk, [this]{ return mActive == 0; } );
+    }
+
+    mBusy = false;
+}
+
+void ThreadPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lk( mMutex );
+    uint64_t seen = mGeneration;
+
+    for (;;)
+    {
+        mWake.wait( lk, [&]{
+            return mQuit || ( mGeneration != seen && mHelpers > 0 ); } );
+        if ( mQuit ) return;
+
+        seen = mGeneration;
+        --mHelpers;
+        ++mActive;
+
+        Task task = mTask;
+        void* context = mContext;
+        unsigned count = mCount;
+        lk.unlock();
+
+        for ( unsigned i = mNext++; i < count; i = mNext++ )
+        {
+            task( context, i );
+        }
+
+        lk.lock();
+        if ( --mActive == 0 )
+        {
+            mDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,108 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef ThreadPool_H
+#define ThreadPool_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*!
+ * A fixed set of worker threads for data-parallel loops over a frame.
+ * The calling thread takes part in every loop, and a loop started while
+ * the pool is busy (another caller, or a nested loop) runs on the calling
+ * thread alone, so parallelFor() never deadlocks and never allocates.
+ */
+class ThreadPool
+{
+public:
+
+    // Process-wide pool with one worker less than there are cores.
+    static ThreadPool& instance();
+
+    explicit ThreadPool( unsigned numWorkers );
+    ~ThreadPool();
+
+    // Number of threads a loop can run on, the caller included.
+    unsigned concurrency() const
+    {
+        return mWorkers.size() + 1;
+    }
+
+    /*!
+     * Calls fn(i) for every i in [0, count) and returns once all calls
+     * are done. Indices are handed out one at a time, so callers should
+     * split their work into bands of a useful size. maxThreads limits the
+     * threads used, 0 meaning all of them.
+     */
+    template <typename Fn>
+    void parallelFor( unsigned count, Fn&& fn, unsigned maxThreads = 0 )
+    {
+        typedef typename std::remove_reference<Fn>::type Function;
+        run( count, &invoke<Function>, (void*) &fn, maxThreads );
+    }
+
+private:
+
+    typedef void (*Task)( void* context, unsigned index );
+
+    template <typename Function>
+    static void invoke( void* context, unsigned index )
+    {
+        (*static_cast<Function*>( context ))( index );
+    }
+
+    void run( unsigned count, Task task, void* context, unsigned maxThreads );
+    void workerLoop();
+
+    std::vector<std::thread> mWorkers;
+    std::atomic<bool> mBusy;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    uint64_t mGeneration = 0;
+    unsigned mHelpers = 0;
+    unsigned mActive = 0;
+    bool mQuit = false;
+
+    Task mTask = nullptr;
+    void* mContext = nullptr;
+    unsigned mCount = 0;
+    std::atomic<unsigned> mNext;
+};
+
+#endif
@@ -0,0 +1,553 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "VideoRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Frames of RAW16 containers start on a page, so that readers can map
+// them directly.
+constexpr uint32_t PAGE = 4096;
+
+// iovecs per frame: header, pixels, padding.
+constexpr unsigned MAX_BATCH_FRAMES = 256;
+
+const char MAGIC[8] = { 'N', 'V', 'C', 'A', 'M', 'V', 'I', 'D' };
+constexpr uint32_t VERSION = 1;
+
+// First bytes of a RAW16 container and of the index file of a Y4M file.
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frameBytes;
+    uint32_t frameCount;
+    uint64_t indexOffset;
+};
+
+const uint8_t ZEROS[PAGE] = {};
+
+int64_t elapsedUs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+}
+
+bool writeAll( int fd, const void* data, size_t bytes, uint64_t offset )
+{
+    const uint8_t* p = (const uint8_t*) data;
+    while ( bytes > 0 )
+    {
+        const ssize_t n = pwrite64( fd, p, bytes, offset );
+        if ( n <= 0 ) return false;
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool readAll( int fd, void* data, size_t bytes, uint64_t offset )
+{
+    uint8_t* p = (uint8_t*) data;
+    while ( bytes > 0 )
+    {
+        const ssize_t n = pread64( fd, p, bytes, offset );
+        if ( n <= 0 ) return false;
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+    return true;
+}
+
+void copyRows( const CameraBuffer::Data& plane, int width, int height,
+        int bytesPerPixel, size_t strideBytes, uint8_t* dst )
+{
+    const size_t rowBytes = size_t(width) * bytesPerPixel;
+    const uint8_t* src = (const uint8_t*) plane.ptr;
+    for ( int y = 0; y < height; ++y )
+    {
+        memcpy( dst, src + size_t(y) * strideBytes, rowBytes );
+        dst += rowBytes;
+    }
+}
+
+// One plane of semi-planar chroma to planar.
+void deinterleaveRows( const CameraBuffer::Data& plane, int width, int height,
+        uint8_t* dst )
+{
+    const int step = plane.channel_step;
+    for ( int y = 0; y < height; ++y )
+    {
+        const uint8_t* src = (const uint8_t*) plane.ptr + size_t(y) * plane.stride;
+        for ( int x = 0; x < width; ++x )
+        {
+            dst[x] = src[x * step];
+        }
+        dst += width;
+    }
+}
+
+}
+
+VideoRecorder::VideoRecorder( const Options& options ) :
+    mOptions(options)
+{
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    close();
+}
+
+bool VideoRecorder::open( const std::string& path, const Size& size,
+        PixelFormat format )
+{
+    if ( isOpen() ) return false;
+    if ( size.width == 0 || size.height == 0 ) return false;
+
+    Info info;
+    info.format = format;
+    info.size = size;
+    std::string fileHeader;
+    uint64_t dataStart = 0;
+
+    if ( format == YCbCr_420_888 )
+    {
+        const size_t chroma = size_t( ( size.width + 1 ) / 2 ) *
+                              ( ( size.height + 1 ) / 2 );
+        info.frameBytes = size_t(size.width) * size.height + 2 * chroma;
+
+        // Camera YUV streams are video range, as the preview shader has it.
+        char header[128];
+        snprintf( header, sizeof(header),
+                "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+                size.width, size.height, std::max( mOptions.frameRate, 1u ) );
+        fileHeader = header;
+        dataStart = fileHeader.size();
+        mFrameHeader = "FRAME\n";
+        mFramePadding = 0;
+    }
+    else if ( format == RAW16 )
+    {
+        info.frameBytes = size_t(size.width) * size.height * 2;
+        fileHeader.assign( PAGE, '\0' );
+        dataStart = PAGE;
+        mFrameHeader.clear();
+        mFramePadding = ( PAGE - info.frameBytes % PAGE ) % PAGE;
+    }
+    else
+    {
+        return false;
+    }
+
+    const int fd = ::open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 ) return false;
+
+    // The RAW16 header is filled in by close().
+    if ( !writeAll( fd, fileHeader.data(), fileHeader.size(), 0 ) ||
+         lseek64( fd, dataStart, SEEK_SET ) != off64_t( dataStart ) )
+    {
+        ::close( fd );
+        unlink( path.c_str() );
+        return false;
+    }
+
+    const unsigned numSlots = std::max( mOptions.stagingFrames, 1u );
+    mSlots.resize( numSlots );
+    for ( auto& slot : mSlots )
+    {
+        void* pixels = nullptr;
+        if ( posix_memalign( &pixels, PAGE, info.frameBytes ) != 0 )
+        {
+            ::close( fd );
+            unlink( path.c_str() );
+            releaseSlots();
+            return false;
+        }
+        slot.pixels = (uint8_t*) pixels;
+    }
+
+    mFd = fd;
+    mPath = path;
+    mInfo = info;
+    mFileEnd = dataStart;
+    mReserved = 0;
+    mWritebackEnd = dataStart;
+    mCachedStart = 0;
+    mIndex.clear();
+    mIndex.reserve( 4096 );
+    mHead = 0;
+    mCount = 0;
+    mQuit = false;
+    mCounters = Counters();
+
+    reserve( dataStart );
+    mWriter = std::thread( &VideoRecorder::writerLoop, this );
+    return true;
+}
+
+bool VideoRecorder::write( const CameraFrame& frame )
+{
+    if ( !isOpen() || !frame.imageBuffer ) return false;
+
+    CameraBuffer& img = *frame.imageBuffer;
+    if ( img.format() != mInfo.format ) return false;
+
+    const CameraBuffer::Data luma = img.data( 0 );
+    if ( uint32_t( luma.width ) != mInfo.size.width ||
+         uint32_t( luma.height ) != mInfo.size.height )
+    {
+        return false;
+    }
+    if ( mInfo.format == YCbCr_420_888 )
+    {
+        const int cw = ( mInfo.size.width + 1 ) / 2;
+        const int ch = ( mInfo.size.height + 1 ) / 2;
+        for ( unsigned p = 1; p < 3; ++p )
+        {
+            const CameraBuffer::Data chroma = img.data( p );
+            if ( !chroma.ptr || chroma.width < cw || chroma.height < ch )
+            {
+                return false;
+            }
+        }
+    }
+
+    Slot* slot;
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        if ( mCount == mSlots.size() )
+        {
+            ++mCounters.framesDropped;
+            return false;
+        }
+        slot = &mSlots[( mHead + mCount ) % mSlots.size()];
+    }
+
+    // The slot is not visible to the writer until it is counted.
+    const auto start = std::chrono::steady_clock::now();
+    gather( img, slot->pixels );
+    slot->captureTime = frame.captureTime;
+    slot->requestId = frame.requestId;
+    const int64_t gatherUs = elapsedUs( start );
+
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        ++mCount;
+        mCounters.maxQueueDepth = std::max( mCounters.maxQueueDepth, mCount );
+        mCounters.maxGatherUs = std::max( mCounters.maxGatherUs, gatherUs );
+    }
+    mStaged.notify_one();
+    return true;
+}
+
+void VideoRecorder::gather( CameraBuffer& img, uint8_t* dst ) const
+{
+    const int width = mInfo.size.width;
+    const int height = mInfo.size.height;
+
+    if ( mInfo.format == RAW16 )
+    {
+        // RAW16 strides are in pixels.
+        const CameraBuffer::Data plane = img.data( 0 );
+        copyRows( plane, width, height, 2, size_t( plane.stride ) * 2, dst );
+        return;
+    }
+
+    copyRows( img.data( 0 ), width, height, 1, img.data( 0 ).stride, dst );
+    dst += size_t(width) * height;
+
+    const int cw = ( width + 1 ) / 2;
+    const int ch = ( height + 1 ) / 2;
+    for ( unsigned p = 1; p < 3; ++p )
+    {
+        const CameraBuffer::Data plane = img.data( p );
+        if ( plane.channel_step > 1 )
+        {
+            deinterleaveRows( plane, cw, ch, dst );
+        }
+        else
+        {
+            copyRows( plane, cw, ch, 1, plane.stride, dst );
+        }
+        dst += size_t(cw) * ch;
+    }
+}
+
+void VideoRecorder::writerLoop()
+{
+    const size_t frameStride = mFrameHeader.size() + mInfo.frameBytes +
+                               mFramePadding;
+    const unsigned batchFrames = std::min<size_t>( MAX_BATCH_FRAMES,
+            std::max<size_t>( mOptions.batchBytes / frameStride, 1 ) );
+
+    std::unique_lock<std::mutex> lk( mMutex );
+    for (;;)
+    {
+        mStaged.wait( lk, [this]{ return mQuit || mCount > 0; } );
+
+        // Drain the staged frames before quitting.
+        if ( mCount == 0 ) break;
+
+        // Slots stay counted until written, so write() cannot reuse them.
+        const unsigned first = mHead;
+        const unsigned count = std::min( mCount, batchFrames );
+        const bool failed = mCounters.failed;
+        lk.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        const bool ok = !failed && writeBatch( first, count );
+        const int64_t batchUs = elapsedUs( start );
+
+        lk.lock();
+        mHead = ( mHead + count ) % mSlots.size();
+        mCount -= count;
+        mCounters.maxBatchUs = std::max( mCounters.maxBatchUs, batchUs );
+        if ( ok )
+        {
+            mCounters.framesWritten += count;
+            mCounters.bytesWritten += uint64_t( count ) * frameStride;
+        }
+        else
+        {
+            mCounters.failed = true;
+        }
+    }
+}
+
+bool VideoRecorder::writeBatch( unsigned first, unsigned count )
+{
+    const size_t frameStride = mFrameHeader.size() + mInfo.frameBytes +
+                               mFramePadding;
+    if ( !reserve( mFileEnd + uint64_t( count ) * frameStride ) )
+    {
+        return false;
+    }
+
+    // The header and padding are shared by all frames; a contiguous run
+    // of slots still needs one pixel iovec per frame.
+    struct iovec iov[3 * MAX_BATCH_FRAMES];
+    unsigned numIov = 0;
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        const Slot& slot = mSlots[( first + i ) % mSlots.size()];
+        if ( !mFrameHeader.empty() )
+        {
+            iov[numIov].iov_base = (void*) mFrameHeader.data();
+            iov[numIov++].iov_len = mFrameHeader.size();
+        }
+        iov[numIov].iov_base = slot.pixels;
+        iov[numIov++].iov_len = mInfo.frameBytes;
+        if ( mFramePadding > 0 )
+        {
+            iov[numIov].iov_base = (void*) ZEROS;
+            iov[numIov++].iov_len = mFramePadding;
+        }
+
+        IndexEntry entry;
+        entry.captureTime = slot.captureTime;
+        entry.requestId = slot.requestId;
+        entry.offset = mFileEnd + i * frameStride + mFrameHeader.size();
+        mIndex.push_back( entry );
+    }
+
+    // Short writes continue where they stopped.
+    struct iovec* next = iov;
+    while ( numIov > 0 )
+    {
+        ssize_t n = writev( mFd, next, numIov );
+        if ( n <= 0 )
+        {
+            mIndex.resize( mIndex.size() - count );
+            return false;
+        }
+        while ( numIov > 0 && size_t(n) >= next->iov_len )
+        {
+            n -= next->iov_len;
+            ++next;
+            --numIov;
+        }
+        if ( numIov > 0 )
+        {
+            next->iov_base = (uint8_t*) next->iov_base + n;
+            next->iov_len -= n;
+        }
+    }
+    mFileEnd += uint64_t( count ) * frameStride;
+
+    // Starts writeback of the new range, and drops the older one, which is
+    // clean by now, from the page cache.
+    const uint64_t writeback = mOptions.writebackBytes;
+    if ( writeback > 0 && mFileEnd - mWritebackEnd >= writeback )
+    {
+        posix_fadvise64( mFd, mCachedStart, mFileEnd - mCachedStart,
+                POSIX_FADV_DONTNEED );
+        mCachedStart = mWritebackEnd;
+        mWritebackEnd = mFileEnd;
+    }
+    return true;
+}
+
+bool VideoRecorder::reserve( uint64_t end )
+{
+    if ( end <= mReserved || mOptions.preallocateBytes == 0 ) return true;
+
+    const uint64_t size = std::max( end, mReserved + mOptions.preallocateBytes );
+    if ( fallocate64( mFd, 0, mReserved, size - mReserved ) != 0 )
+    {
+        // Not supported by every file system; the file grows as written.
+        mReserved = UINT64_MAX;
+        return true;
+    }
+    mReserved = size;
+    return true;
+}
+
+bool VideoRecorder::close()
+{
+    if ( !isOpen() ) return false;
+
+    {
+        std::lock_guard<std::mutex> lk( mMutex );
+        mQuit = true;
+    }
+    mStaged.notify_one();
+    mWriter.join();
+    releaseSlots();
+
+    FileHeader header;
+    memcpy( header.magic, MAGIC, sizeof(MAGIC) );
+    header.version = VERSION;
+    header.format = mInfo.format;
+    header.width = mInfo.size.width;
+    header.height = mInfo.size.height;
+    header.frameBytes = mInfo.frameBytes;
+    header.frameCount = mIndex.size();
+
+    const size_t indexBytes = mIndex.size() * sizeof(IndexEntry);
+    bool ok = !mCounters.failed;
+
+    if ( mInfo.format == RAW16 )
+    {
+        header.indexOffset = mFileEnd;
+        ok = ok && writeAll( mFd, mIndex.data(), indexBytes, mFileEnd ) &&
+             writeAll( mFd, &header, sizeof(header), 0 );
+        mFileEnd += indexBytes;
+    }
+    else
+    {
+        header.indexOffset = sizeof(header);
+        const std::string indexPath = mPath + ".idx";
+        const int fd = ::open( indexPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        ok = ok && fd >= 0 &&
+             writeAll( fd, &header, sizeof(header), 0 ) &&
+             writeAll( fd, mIndex.data(), indexBytes, sizeof(header) );
+        if ( fd >= 0 ) ok = ( ::close( fd ) == 0 ) && ok;
+    }
+
+    // Gives back the preallocation past the last frame.
+    ok = ( ftruncate64( mFd, mFileEnd ) == 0 ) && ok;
+    ok = ( ::close( mFd ) == 0 ) && ok;
+    mFd = -1;
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    mCounters.failed = !ok;
+    return ok;
+}
+
+VideoRecorder::Counters VideoRecorder::counters() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mCounters;
+}
+
+void VideoRecorder::releaseSlots()
+{
+    for ( auto& slot : mSlots )
+    {
+        free( slot.pixels );
+    }
+    mSlots.clear();
+}
+
+bool VideoRecorder::readIndex( const std::string& path, Info& info,
+        std::vector<IndexEntry>& index )
+{
+    FileHeader header;
+    int fd = ::open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) return false;
+
+    // Y4M files keep the index next to them.
+    if ( !readAll( fd, &header, sizeof(header), 0 ) ||
+         memcmp( header.magic, MAGIC, sizeof(MAGIC) ) != 0 )
+    {
+        ::close( fd );
+        fd = ::open( ( path + ".idx" ).c_str(), O_RDONLY );
+        if ( fd < 0 ) return false;
+        if ( !readAll( fd, &header, sizeof(header), 0 ) ||
+             memcmp( header.magic, MAGIC, sizeof(MAGIC) ) != 0 )
+        {
+            ::close( fd );
+            return false;
+        }
+    }
+
+    bool ok = header.version == VERSION;
+    if ( ok )
+    {
+        info.format = PixelFormat( header.format );
+        info.size = Size( header.width, header.height );
+        info.frameBytes = header.frameBytes;
+        index.resize( header.frameCount );
+        ok = readAll( fd, index.data(), index.size() * sizeof(IndexEntry),
+                header.indexOffset );
+    }
+    ::close( fd );
+    return ok;
+}
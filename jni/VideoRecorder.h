@@ -0,0 +1,194 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef VideoRecorder_H
+#define VideoRecorder_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+ * Records a stream into one container file instead of files per frame:
+ * YCbCr_420_888 frames as Y4M (planar 4:2:0), RAW16 frames as an indexed
+ * raw container.
+ *
+ * write() copies the frame into a preallocated staging slot, dropping the
+ * row padding and deinterleaving semi-planar chroma on the way, and
+ * returns. A writer thread appends the staged frames with large writev()
+ * batches to a file preallocated with fallocate(), and pushes written
+ * ranges out of the page cache so that dirty pages do not pile up. The
+ * caller never waits on the disk; if every slot is still queued, write()
+ * drops the frame.
+ *
+ * Every frame gets an index entry with its capture time and file offset.
+ * RAW16 containers carry the index at their end; Y4M has no room for it,
+ * so it goes to "<path>.idx" in the same layout.
+ */
+class VideoRecorder
+{
+public:
+
+    struct Options
+    {
+        // Frame rate in the Y4M header; players use it, the index does not.
+        unsigned frameRate = 30;
+
+        // Frames write() can be ahead of the disk. Each slot is one
+        // frame without padding.
+        unsigned stagingFrames = 8;
+
+        // Upper bound of a single writev() call.
+        size_t batchBytes = 8u << 20;
+
+        // Reserved at open() and whenever the file grows past it.
+        uint64_t preallocateBytes = 1ull << 30;
+
+        // Written bytes after which writeback of the range is started and
+        // the range before it is dropped from the page cache; 0 leaves
+        // that to the kernel.
+        uint64_t writebackBytes = 32u << 20;
+    };
+
+    // On disk as is, little endian.
+    struct IndexEntry
+    {
+        int64_t captureTime = 0;
+        uint64_t offset = 0;        //< File offset of the frame's pixels.
+        int32_t requestId = 0;
+        uint32_t reserved = 0;
+    };
+
+    // Container description, as returned by readIndex().
+    struct Info
+    {
+        nv::camera2::PixelFormat format = nv::camera2::YCbCr_420_888;
+        nv::camera2::Size size;
+        uint32_t frameBytes = 0;    //< Pixels of one frame, no padding.
+    };
+
+    struct Counters
+    {
+        uint64_t framesWritten = 0;
+        uint64_t framesDropped = 0;     //< No free staging slot.
+        uint64_t bytesWritten = 0;
+        unsigned maxQueueDepth = 0;     //< Staged frames not yet written.
+        int64_t maxGatherUs = 0;        //< Longest copy in write().
+        int64_t maxBatchUs = 0;         //< Longest writev() batch.
+        bool failed = false;            //< A write to the file failed.
+    };
+
+    explicit VideoRecorder( const Options& options );
+
+    // Closes an open recording.
+    ~VideoRecorder();
+
+    /*!
+     * Creates the file and starts the writer thread. path is used as is;
+     * ".y4m" and ".raw16" are the usual extensions. Returns false if the
+     * format is not supported, or if the file cannot be created.
+     */
+    bool open( const std::string& path, const nv::camera2::Size& size,
+            nv::camera2::PixelFormat format );
+
+    bool isOpen() const
+    {
+        return mFd >= 0;
+    }
+
+    /*!
+     * Stages a frame of the size and format given to open(). Returns false
+     * if the frame was dropped or does not match. Call from one thread.
+     */
+    bool write( const nv::camera2::CameraFrame& frame );
+
+    /*!
+     * Writes out the staged frames and the index, and trims the
+     * preallocation. Returns false if any part of the recording failed.
+     */
+    bool close();
+
+    // Of the current or last recording.
+    Counters counters() const;
+
+    /*!
+     * Reads the index of a recording made by VideoRecorder, from the end of
+     * a RAW16 container or from the ".idx" file next to a Y4M file.
+     */
+    static bool readIndex( const std::string& path, Info& info,
+            std::vector<IndexEntry>& index );
+
+private:
+
+    struct Slot
+    {
+        uint8_t* pixels = nullptr;
+        int64_t captureTime = 0;
+        int32_t requestId = 0;
+    };
+
+    void gather( nv::camera2::CameraBuffer& img, uint8_t* dst ) const;
+    void writerLoop();
+    bool writeBatch( unsigned first, unsigned count );
+    bool reserve( uint64_t end );
+    void releaseSlots();
+
+    const Options mOptions;
+
+    int mFd = -1;
+    std::string mPath;
+    Info mInfo;
+    std::string mFrameHeader;   //< Bytes before every frame.
+    uint32_t mFramePadding = 0; //< Bytes after every frame.
+    uint64_t mFileEnd = 0;      //< Written so far.
+    uint64_t mReserved = 0;     //< Preallocated so far.
+    uint64_t mWritebackEnd = 0; //< Start of the range not yet pushed out.
+    uint64_t mCachedStart = 0;  //< Start of the range left in the cache.
+
+    std::vector<Slot> mSlots;
+    std::vector<IndexEntry> mIndex;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mStaged;
+    unsigned mHead = 0;
+    unsigned mCount = 0;        //< Staged or being written.
+    bool mQuit = false;
+    std::thread mWriter;
+
+    Counters mCounters;
+};
+
+#endif
@@ -0,0 +1,511 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "YuvConverter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define YUV_HAVE_NEON 1
+#include <arm_neon.h>
+#elif defined(__GNUC__) && ( defined(__i386__) || defined(__x86_64__) )
+#define YUV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace nv::camera2;
+
+namespace
+{
+
+/*
+ * Fixed point BT.601 video range, matching shaders/yuv.frag:
+ *   R = 1.164 (Y - 16) + 1.596 (V - 128)
+ *   G = 1.164 (Y - 16) - 0.813 (V - 128) - 0.391 (U - 128)
+ *   B = 1.164 (Y - 16) + 2.018 (U - 128)
+ * Values are scaled by 64. The luma product is taken at scale 128 and
+ * halved to keep it in 16 bits; the -16 offset and the rounding term are
+ * folded into BIAS. SIMD kernels use saturating adds, which only kick in
+ * for values well above 255, so they match the scalar code exactly.
+ */
+constexpr int YG  = 149;
+constexpr int VR  = 102;
+constexpr int VG  = -52;
+constexpr int UG  = -25;
+constexpr int UB  = 129;
+constexpr int BIAS = -16 * 74 + 32;
+
+constexpr int BAND_ROWS = 16;
+
+struct Row
+{
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+    int uvStep;
+    uint8_t* dst;
+    int width;
+    YuvConverter::RgbFormat format;
+};
+
+typedef int (*RowKernel)( const Row& row );
+
+inline uint8_t clamp8( int value )
+{
+    return value < 0 ? 0 : ( value > 255 ? 255 : value );
+}
+
+// Converts pixels [x, width) of the row, returns width.
+int convertRowScalar( const Row& row, int x )
+{
+    const unsigned bpp = YuvConverter::bytesPerPixel( row.format );
+    const bool bgr = row.format == YuvConverter::RgbFormat::BGR888;
+
+    for ( ; x < row.width; ++x )
+    {
+        const int yy = ( row.y[x] * YG ) >> 1;
+        const int u = row.u[( x >> 1 ) * row.uvStep] - 128;
+        const int v = row.v[( x >> 1 ) * row.uvStep] - 128;
+
+        const uint8_t r = clamp8( ( yy + VR * v + BIAS ) >> 6 );
+        const uint8_t g = clamp8( ( yy + VG * v + UG * u + BIAS ) >> 6 );
+        const uint8_t b = clamp8( ( yy + UB * u + BIAS ) >> 6 );
+
+        uint8_t* out = row.dst + x * bpp;
+        out[0] = bgr ? b : r;
+        out[1] = g;
+        out[2] = bgr ? r : b;
+        if ( bpp == 4 ) out[3] = 255;
+    }
+    return x;
+}
+
+int convertRowScalar( const Row& row )
+{
+    return convertRowScalar( row, 0 );
+}
+
+// Semi-planar chroma the SIMD kernels can deinterleave with one load.
+inline bool interleavedChroma( const Row& row )
+{
+    return row.uvStep == 2 && ( row.u - row.v == 1 || row.v - row.u == 1 );
+}
+
+#if YUV_HAVE_NEON
+
+int convertRowNeon( const Row& row )
+{
+    if ( row.uvStep != 1 && !interleavedChroma( row ) )
+    {
+        return convertRowScalar( row );
+    }
+
+    const bool uFirst = row.u < row.v;
+    const uint8_t* uv = uFirst ? row.u : row.v;
+    const bool bgr = row.format == YuvConverter::RgbFormat::BGR888;
+
+    const uint8x8_t yg = vdup_n_u8( YG );
+    const uint8x8_t c128 = vdup_n_u8( 128 );
+    const int16x8_t bias = vdupq_n_s16( BIAS );
+    const uint8x16_t alpha = vdupq_n_u8( 255 );
+
+    int x = 0;
+    for ( ; x + 16 <= row.width; x += 16 )
+    {
+        const uint8x16_t y = vld1q_u8( row.y + x );
+
+        uint8x8_t u8, v8;
+        if ( row.uvStep == 1 )
+        {
+            u8 = vld1_u8( row.u + x / 2 );
+            v8 = vld1_u8( row.v + x / 2 );
+        }
+        else
+        {
+            const uint8x8x2_t pairs = vld2_u8( uv + x );
+            u8 = pairs.val[uFirst ? 0 : 1];
+            v8 = pairs.val[uFirst ? 1 : 0];
+        }
+
+        const int16x8_t u = vreinterpretq_s16_u16( vsubl_u8( u8, c128 ) );
+        const int16x8_t v = vreinterpretq_s16_u16( vsubl_u8( v8, c128 ) );
+
+        // Each chroma sample covers two pixels.
+        const int16x8x2_t cr = vzipq_s16( vmlaq_n_s16( bias, v, VR ),
+                vmlaq_n_s16( bias, v, VR ) );
+        const int16x8_t g0 = vmlaq_n_s16( vmlaq_n_s16( bias, v, VG ), u, UG );
+        const int16x8x2_t cg = vzipq_s16( g0, g0 );
+        const int16x8x2_t cb = vzipq_s16( vmlaq_n_s16( bias, u, UB ),
+                vmlaq_n_s16( bias, u, UB ) );
+
+        const int16x8_t ylo = vreinterpretq_s16_u16(
+                vshrq_n_u16( vmull_u8( vget_low_u8( y ), yg ), 1 ) );
+        const int16x8_t yhi = vreinterpretq_s16_u16(
+                vshrq_n_u16( vmull_u8( vget_high_u8( y ), yg ), 1 ) );
+
+        const uint8x16_t r = vcombine_u8(
+                vqshrun_n_s16( vqaddq_s16( ylo, cr.val[0] ), 6 ),
+                vqshrun_n_s16( vqaddq_s16( yhi, cr.val[1] ), 6 ) );
+        const uint8x16_t g = vcombine_u8(
+                vqshrun_n_s16( vqaddq_s16( ylo, cg.val[0] ), 6 ),
+                vqshrun_n_s16( vqaddq_s16( yhi, cg.val[1] ), 6 ) );
+        const uint8x16_t b = vcombine_u8(
+                vqshrun_n_s16( vqaddq_s16( ylo, cb.val[0] ), 6 ),
+                vqshrun_n_s16( vqaddq_s16( yhi, cb.val[1] ), 6 ) );
+
+        if ( row.format == YuvConverter::RgbFormat::RGBA8888 )
+        {
+            uint8x16x4_t out;
+            out.val[0] = r;
+            out.val[1] = g;
+            out.val[2] = b;
+            out.val[3] = alpha;
+            vst4q_u8( row.dst + x * 4, out );
+        }
+        else
+        {
+            uint8x16x3_t out;
+            out.val[0] = bgr ? b : r;
+            out.val[1] = g;
+            out.val[2] = bgr ? r : b;
+            vst3q_u8( row.dst + x * 3, out );
+        }
+    }
+
+    return convertRowScalar( row, x );
+}
+
+#endif
+
+#if YUV_HAVE_X86
+
+// Interleaves 16 pixels of R, G, B and stores them in the row format.
+// Always inlined, so the AVX2 kernel gets a VEX encoded copy and does not
+// pay for switching between SSE and AVX state.
+__attribute__((target("ssse3"), always_inline))
+inline void storePixels( uint8_t* dst, __m128i r, __m128i g, __m128i b,
+        YuvConverter::RgbFormat format )
+{
+    if ( format == YuvConverter::RgbFormat::BGR888 )
+    {
+        std::swap( r, b );
+    }
+
+    const __m128i alpha = _mm_set1_epi8( (char) 0xff );
+    const __m128i rgLo = _mm_unpacklo_epi8( r, g );
+    const __m128i rgHi = _mm_unpackhi_epi8( r, g );
+    const __m128i baLo = _mm_unpacklo_epi8( b, alpha );
+    const __m128i baHi = _mm_unpackhi_epi8( b, alpha );
+
+    __m128i p0 = _mm_unpacklo_epi16( rgLo, baLo );
+    __m128i p1 = _mm_unpackhi_epi16( rgLo, baLo );
+    __m128i p2 = _mm_unpacklo_epi16( rgHi, baHi );
+    __m128i p3 = _mm_unpackhi_epi16( rgHi, baHi );
+
+    if ( format == YuvConverter::RgbFormat::RGBA8888 )
+    {
+        _mm_storeu_si128( (__m128i*) ( dst ), p0 );
+        _mm_storeu_si128( (__m128i*) ( dst + 16 ), p1 );
+        _mm_storeu_si128( (__m128i*) ( dst + 32 ), p2 );
+        _mm_storeu_si128( (__m128i*) ( dst + 48 ), p3 );
+        return;
+    }
+
+    // Drop the alpha bytes, then stitch the four 12 byte groups together.
+    const __m128i pack = _mm_setr_epi8( 0, 1, 2, 4, 5, 6, 8, 9, 10,
+            12, 13, 14, -1, -1, -1, -1 );
+    p0 = _mm_shuffle_epi8( p0, pack );
+    p1 = _mm_shuffle_epi8( p1, pack );
+    p2 = _mm_shuffle_epi8( p2, pack );
+    p3 = _mm_shuffle_epi8( p3, pack );
+
+    _mm_storeu_si128( (__m128i*) ( dst ),
+            _mm_or_si128( p0, _mm_slli_si128( p1, 12 ) ) );
+    _mm_storeu_si128( (__m128i*) ( dst + 16 ),
+            _mm_or_si128( _mm_srli_si128( p1, 4 ), _mm_slli_si128( p2, 8 ) ) );
+    _mm_storeu_si128( (__m128i*) ( dst + 32 ),
+            _mm_or_si128( _mm_srli_si128( p2, 8 ), _mm_slli_si128( p3, 4 ) ) );
+}
+
+__attribute__((target("ssse3")))
+int convertRowSsse3( const Row& row )
+{
+    if ( row.uvStep != 1 && !interleavedChroma( row ) )
+    {
+        return convertRowScalar( row );
+    }
+
+    const bool uFirst = row.u < row.v;
+    const uint8_t* uv = uFirst ? row.u : row.v;
+    const unsigned bpp = YuvConverter::bytesPerPixel( row.format );
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowBytes = _mm_set1_epi16( 0x00ff );
+    const __m128i c128 = _mm_set1_epi16( 128 );
+    const __m128i yg = _mm_set1_epi16( YG );
+    const __m128i vr = _mm_set1_epi16( VR );
+    const __m128i vg = _mm_set1_epi16( VG );
+    const __m128i ug = _mm_set1_epi16( UG );
+    const __m128i ub = _mm_set1_epi16( UB );
+    const __m128i bias = _mm_set1_epi16( BIAS );
+
+    int x = 0;
+    for ( ; x + 16 <= row.width; x += 16 )
+    {
+        const __m128i y = _mm_loadu_si128( (const __m128i*) ( row.y + x ) );
+        const __m128i ylo = _mm_srli_epi16(
+                _mm_mullo_epi16( _mm_unpacklo_epi8( y, zero ), yg ), 1 );
+        const __m128i yhi = _mm_srli_epi16(
+                _mm_mullo_epi16( _mm_unpackhi_epi8( y, zero ), yg ), 1 );
+
+        __m128i u, v;
+        if ( row.uvStep == 1 )
+        {
+            u = _mm_unpacklo_epi8( _mm_loadl_epi64(
+                    (const __m128i*) ( row.u + x / 2 ) ), zero );
+            v = _mm_unpacklo_epi8( _mm_loadl_epi64(
+                    (const __m128i*) ( row.v + x / 2 ) ), zero );
+        }
+        else
+        {
+            const __m128i pairs = _mm_loadu_si128( (const __m128i*) ( uv + x ) );
+            const __m128i even = _mm_and_si128( pairs, lowBytes );
+            const __m128i odd = _mm_srli_epi16( pairs, 8 );
+            u = uFirst ? even : odd;
+            v = uFirst ? odd : even;
+        }
+        u = _mm_sub_epi16( u, c128 );
+        v = _mm_sub_epi16( v, c128 );
+
+        const __m128i cr = _mm_add_epi16( _mm_mullo_epi16( v, vr ), bias );
+        const __m128i cg = _mm_add_epi16( _mm_add_epi16(
+                _mm_mullo_epi16( v, vg ), _mm_mullo_epi16( u, ug ) ), bias );
+        const __m128i cb = _mm_add_epi16( _mm_mullo_epi16( u, ub ), bias );
+
+        // Each chroma sample covers two pixels.
+        const __m128i r = _mm_packus_epi16(
+                _mm_srai_epi16( _mm_adds_epi16( ylo, _mm_unpacklo_epi16( cr, cr ) ), 6 ),
+                _mm_srai_epi16( _mm_adds_epi16( yhi, _mm_unpackhi_epi16( cr, cr ) ), 6 ) );
+        const __m128i g = _mm_packus_epi16(
+                _mm_srai_epi16( _mm_adds_epi16( ylo, _mm_unpacklo_epi16( cg, cg ) ), 6 ),
+                _mm_srai_epi16( _mm_adds_epi16( yhi, _mm_unpackhi_epi16( cg, cg ) ), 6 ) );
+        const __m128i b = _mm_packus_epi16(
+                _mm_srai_epi16( _mm_adds_epi16( ylo, _mm_unpacklo_epi16( cb, cb ) ), 6 ),
+                _mm_srai_epi16( _mm_adds_epi16( yhi, _mm_unpackhi_epi16( cb, cb ) ), 6 ) );
+
+        storePixels( row.dst + x * bpp, r, g, b, row.format );
+    }
+
+    return convertRowScalar( row, x );
+}
+
+// Combines the luma halves with chroma spread over pixel pairs, and packs
+// the 32 results back into pixel order.
+__attribute__((target("avx2")))
+inline __m256i channelAvx2( __m256i ylo, __m256i yhi, __m256i c )
+{
+    const __m256i lo = _mm256_unpacklo_epi16( c, c );
+    const __m256i hi = _mm256_unpackhi_epi16( c, c );
+    const __m256i a = _mm256_srai_epi16( _mm256_adds_epi16( ylo,
+            _mm256_permute2x128_si256( lo, hi, 0x20 ) ), 6 );
+    const __m256i b = _mm256_srai_epi16( _mm256_adds_epi16( yhi,
+            _mm256_permute2x128_si256( lo, hi, 0x31 ) ), 6 );
+    return _mm256_permute4x64_epi64( _mm256_packus_epi16( a, b ), 0xd8 );
+}
+
+__attribute__((target("avx2")))
+int convertRowAvx2( const Row& row )
+{
+    if ( row.uvStep != 1 && !interleavedChroma( row ) )
+    {
+        return convertRowScalar( row );
+    }
+
+    const bool uFirst = row.u < row.v;
+    const uint8_t* uv = uFirst ? row.u : row.v;
+    const unsigned bpp = YuvConverter::bytesPerPixel( row.format );
+
+    const __m256i lowBytes = _mm256_set1_epi16( 0x00ff );
+    const __m256i c128 = _mm256_set1_epi16( 128 );
+    const __m256i yg = _mm256_set1_epi16( YG );
+    const __m256i vr = _mm256_set1_epi16( VR );
+    const __m256i vg = _mm256_set1_epi16( VG );
+    const __m256i ug = _mm256_set1_epi16( UG );
+    const __m256i ub = _mm256_set1_epi16( UB );
+    const __m256i bias = _mm256_set1_epi16( BIAS );
+
+    int x = 0;
+    for ( ; x + 32 <= row.width; x += 32 )
+    {
+        const __m128i y0 = _mm_loadu_si128( (const __m128i*) ( row.y + x ) );
+        const __m128i y1 = _mm_loadu_si128( (const __m128i*) ( row.y + x + 16 ) );
+        const __m256i ylo = _mm256_srli_epi16( _mm256_mullo_epi16(
+                _mm256_cvtepu8_epi16( y0 ), yg ), 1 );
+        const __m256i yhi = _mm256_srli_epi16( _mm256_mullo_epi16(
+                _mm256_cvtepu8_epi16( y1 ), yg ), 1 );
+
+        __m256i u, v;
+        if ( row.uvStep == 1 )
+        {
+            u = _mm256_cvtepu8_epi16( _mm_loadu_si128(
+                    (const __m128i*) ( row.u + x / 2 ) ) );
+            v = _mm256_cvtepu8_epi16( _mm_loadu_si128(
+                    (const __m128i*) ( row.v + x / 2 ) ) );
+        }
+        else
+        {
+            const __m256i pairs = _mm256_loadu_si256( (const __m256i*) ( uv + x ) );
+            const __m256i even = _mm256_and_si256( pairs, lowBytes );
+            const __m256i odd = _mm256_srli_epi16( pairs, 8 );
+            u = uFirst ? even : odd;
+            v = uFirst ? odd : even;
+        }
+        u = _mm256_sub_epi16( u, c128 );
+        v = _mm256_sub_epi16( v, c128 );
+
+        const __m256i r = channelAvx2( ylo, yhi,
+                _mm256_add_epi16( _mm256_mullo_epi16( v, vr ), bias ) );
+        const __m256i g = channelAvx2( ylo, yhi, _mm256_add_epi16( _mm256_add_epi16(
+                _mm256_mullo_epi16( v, vg ), _mm256_mullo_epi16( u, ug ) ), bias ) );
+        const __m256i b = channelAvx2( ylo, yhi,
+                _mm256_add_epi16( _mm256_mullo_epi16( u, ub ), bias ) );
+
+        storePixels( row.dst + x * bpp, _mm256_castsi256_si128( r ),
+                _mm256_castsi256_si128( g ), _mm256_castsi256_si128( b ),
+                row.format );
+        storePixels( row.dst + ( x + 16 ) * bpp,
+                _mm256_extracti128_si256( r, 1 ),
+                _mm256_extracti128_si256( g, 1 ),
+                _mm256_extracti128_si256( b, 1 ), row.format );
+    }
+
+    return convertRowScalar( row, x );
+}
+
+#endif
+
+RowKernel selectKernel( YuvConverter::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case YuvConverter::Kernel::AUTO:
+#if YUV_HAVE_NEON
+        return convertRowNeon;
+#elif YUV_HAVE_X86
+        if ( __builtin_cpu_supports( "avx2" ) ) return convertRowAvx2;
+        if ( __builtin_cpu_supports( "ssse3" ) ) return convertRowSsse3;
+#endif
+        return convertRowScalar;
+
+    case YuvConverter::Kernel::SCALAR:
+        return convertRowScalar;
+
+#if YUV_HAVE_NEON
+    case YuvConverter::Kernel::NEON:
+        return convertRowNeon;
+#endif
+
+#if YUV_HAVE_X86
+    case YuvConverter::Kernel::SSSE3:
+        return __builtin_cpu_supports( "ssse3" ) ? convertRowSsse3 : nullptr;
+
+    case YuvConverter::Kernel::AVX2:
+        return __builtin_cpu_supports( "avx2" ) ? convertRowAvx2 : nullptr;
+#endif
+
+    default:
+        return nullptr;
+    }
+}
+
+}
+
+bool YuvConverter::isAvailable( Kernel kernel )
+{
+    return selectKernel( kernel ) != nullptr;
+}
+
+bool YuvConverter::convert( CameraBuffer& img, RgbFormat format,
+        uint8_t* dst, size_t dstStride, const Options& options )
+{
+    if ( img.format() != YCbCr_420_888 || img.numberOfPlanes() < 3 )
+    {
+        return false;
+    }
+
+    const CameraBuffer::Data planes[3] = { img.data(0), img.data(1), img.data(2) };
+    return convert( planes, format, dst, dstStride, options );
+}
+
+bool YuvConverter::convert( const CameraBuffer::Data* planes,
+        RgbFormat format, uint8_t* dst, size_t dstStride,
+        const Options& options )
+{
+    const RowKernel kernel = selectKernel( options.kernel );
+    if ( !kernel || !dst ) return false;
+
+    const CameraBuffer::Data& yPlane = planes[0];
+    const CameraBuffer::Data& uPlane = planes[1];
+    const CameraBuffer::Data& vPlane = planes[2];
+
+    if ( yPlane.bytes_per_channel != 1 || uPlane.bytes_per_channel != 1 ||
+         vPlane.bytes_per_channel != 1 ||
+         uPlane.channel_step != vPlane.channel_step ||
+         uPlane.stride != vPlane.stride ||
+         dstStride < size_t(yPlane.width) * bytesPerPixel( format ) )
+    {
+        return false;
+    }
+
+    const int height = yPlane.height;
+    const unsigned bands = ( height + BAND_ROWS - 1 ) / BAND_ROWS;
+
+    ThreadPool::instance().parallelFor( bands, [&]( unsigned band ) {
+        const int rowEnd = std::min( height, int( band + 1 ) * BAND_ROWS );
+
+        Row row;
+        row.uvStep = std::max( uPlane.channel_step, 1 );
+        row.width = yPlane.width;
+        row.format = format;
+
+        for ( int y = band * BAND_ROWS; y < rowEnd; ++y )
+        {
+            row.y = (const uint8_t*) yPlane.ptr + size_t(y) * yPlane.stride;
+            row.u = (const uint8_t*) uPlane.ptr + size_t(y / 2) * uPlane.stride;
+            row.v = (const uint8_t*) vPlane.ptr + size_t(y / 2) * vPlane.stride;
+            row.dst = dst + size_t(y) * dstStride;
+            kernel( row );
+        }
+    }, options.maxThreads );
+
+    return true;
+}
@@ -0,0 +1,107 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef YuvConverter_H
+#define YuvConverter_H
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/*!
+ * CPU conversion of YCbCr_420_888 buffers to packed RGB, using the same
+ * BT.601 video range coefficients as shaders/yuv.frag. The planes are
+ * read in place, honouring their stride and channel_step, so planar
+ * (I420/YV12) and semi-planar (NV12/NV21) buffers need no repacking.
+ *
+ * The conversion is done in 16 bit fixed point; all kernels give
+ * identical results, within two levels of the floating point shader.
+ * Chroma is replicated over each 2x2 block of pixels.
+ */
+class YuvConverter
+{
+public:
+
+    enum class RgbFormat
+    {
+        RGB888,
+        BGR888,
+        RGBA8888
+    };
+
+    enum class Kernel
+    {
+        AUTO,       //< The fastest kernel available on this CPU.
+        SCALAR,
+        NEON,
+        SSSE3,
+        AVX2
+    };
+
+    struct Options
+    {
+        Kernel kernel = Kernel::AUTO;
+
+        // Threads of the ThreadPool used for row bands, 0 for all.
+        unsigned maxThreads = 0;
+    };
+
+    static unsigned bytesPerPixel( RgbFormat format )
+    {
+        return format == RgbFormat::RGBA8888 ? 4 : 3;
+    }
+
+    static bool isAvailable( Kernel kernel );
+
+    /*!
+     * Converts the buffer into dst, which must hold plane 0's width x
+     * height pixels with rows dstStride bytes apart. Returns false if the
+     * buffer is not YCbCr_420_888 or the kernel is not available.
+     */
+    static bool convert( nv::camera2::CameraBuffer& img, RgbFormat format,
+            uint8_t* dst, size_t dstStride, const Options& options );
+
+    static bool convert( nv::camera2::CameraBuffer& img, RgbFormat format,
+            uint8_t* dst, size_t dstStride )
+    {
+        return convert( img, format, dst, dstStride, Options() );
+    }
+
+    /*!
+     * Converts three Y, U, V planes described like CameraBuffer planes.
+     */
+    static bool convert( const nv::camera2::CameraBuffer::Data* planes,
+            RgbFormat format, uint8_t* dst, size_t dstStride,
+            const Options& options );
+};
+
+#endif
@@ -0,0 +1,249 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "YuvUploader.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+uint8_t* plane( const CameraBuffer::Data& data )
+{
+    return static_cast<uint8_t*>( data.ptr );
+}
+
+// Copies a plane into tightly packed rows of one byte per sample.
+uint8_t* packPlane( uint8_t* dst, const CameraBuffer::Data& data )
+{
+    const uint8_t* src = plane( data );
+    const int step = std::max( data.channel_step, 1 );
+
+    for ( int y = 0; y < data.height; ++y, src += data.stride )
+    {
+        if ( step == 1 )
+        {
+            memcpy( dst, src, data.width );
+            dst += data.width;
+        }
+        else
+        {
+            for ( int x = 0; x < data.width; ++x )
+            {
+                *dst++ = src[x * step];
+            }
+        }
+    }
+    return dst;
+}
+
+bool sameSize( const CameraBuffer::Data& data, const Size& size )
+{
+    return uint32_t(data.width) == size.width &&
+           uint32_t(data.height) == size.height;
+}
+
+void setupTexture( GLuint texture, GLenum format, const Size& size )
+{
+    glBindTexture( GL_TEXTURE_2D, texture );
+    glTexImage2D( GL_TEXTURE_2D, 0, format, size.width, size.height,
+                  0, format, GL_UNSIGNED_BYTE, (GLvoid*) NULL );
+
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+}
+
+}
+
+YuvUploader::Layout YuvUploader::detectLayout( CameraBuffer& img )
+{
+    if ( img.format() != YCbCr_420_888 || img.numberOfPlanes() < 3 )
+    {
+        return Layout::NONE;
+    }
+
+    const CameraBuffer::Data y = img.data(0);
+    const CameraBuffer::Data u = img.data(1);
+    const CameraBuffer::Data v = img.data(2);
+    if ( y.channel_step > 1 ) return Layout::STRIDED;
+
+    if ( u.channel_step <= 1 && v.channel_step <= 1 )
+    {
+        return Layout::PLANAR;
+    }
+
+    if ( u.channel_step == 2 && v.channel_step == 2 && u.stride == v.stride )
+    {
+        if ( plane( v ) == plane( u ) + 1 ) return Layout::NV12;
+        if ( plane( u ) == plane( v ) + 1 ) return Layout::NV21;
+    }
+    return Layout::STRIDED;
+}
+
+YuvUploader::YuvUploader()
+{
+    std::fill( mTextures, mTextures + 3, 0 );
+    std::fill( mPixelBuffers, mPixelBuffers + 2, 0 );
+}
+
+YuvUploader::~YuvUploader()
+{
+    release();
+}
+
+void YuvUploader::release()
+{
+    if ( mTextures[0] ) glDeleteTextures( 3, mTextures );
+    if ( mPixelBuffers[0] ) glDeleteBuffers( 2, mPixelBuffers );
+    std::fill( mTextures, mTextures + 3, 0 );
+    std::fill( mPixelBuffers, mPixelBuffers + 2, 0 );
+
+    mLayout = Layout::NONE;
+    mBufferSize = 0;
+}
+
+void YuvUploader::allocate( CameraBuffer& img, Layout layout )
+{
+    if ( !mTextures[0] ) glGenTextures( 3, mTextures );
+    if ( !mPixelBuffers[0] ) glGenBuffers( 2, mPixelBuffers );
+
+    const CameraBuffer::Data y = img.data(0);
+    const CameraBuffer::Data u = img.data(1);
+    mLumaSize = Size( y.width, y.height );
+    mChromaSize = Size( u.width, u.height );
+    mLayout = layout;
+
+    glActiveTexture( GL_TEXTURE0 );
+    setupTexture( mTextures[0], GL_LUMINANCE, mLumaSize );
+    if ( interleaved() )
+    {
+        setupTexture( mTextures[1], GL_LUMINANCE_ALPHA, mChromaSize );
+    }
+    else
+    {
+        setupTexture( mTextures[1], GL_LUMINANCE, mChromaSize );
+        setupTexture( mTextures[2], GL_LUMINANCE, mChromaSize );
+    }
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    // Both layouts take the same number of chroma bytes.
+    mBufferSize = size_t(mLumaSize.width) * mLumaSize.height +
+                  size_t(mChromaSize.width) * mChromaSize.height * 2;
+}
+
+bool YuvUploader::upload( CameraBuffer& img )
+{
+    const Layout layout = detectLayout( img );
+    if ( layout == Layout::NONE ) return false;
+
+    const CameraBuffer::Data y = img.data(0);
+    const CameraBuffer::Data u = img.data(1);
+    const CameraBuffer::Data v = img.data(2);
+    if ( layout != mLayout || !sameSize( y, mLumaSize ) ||
+         !sameSize( u, mChromaSize ) )
+    {
+        allocate( img, layout );
+    }
+
+    // Orphan the buffer so mapping it never waits for a transfer that
+    // is still reading the previous contents.
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, mPixelBuffers[mNextBuffer] );
+    mNextBuffer ^= 1;
+    glBufferData( GL_PIXEL_UNPACK_BUFFER, mBufferSize, NULL, GL_STREAM_DRAW );
+    uint8_t* mapped = static_cast<uint8_t*>( glMapBufferRange(
+            GL_PIXEL_UNPACK_BUFFER, 0, mBufferSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) );
+    if ( !mapped )
+    {
+        glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+        return false;
+    }
+
+    uint8_t* dst = packPlane( mapped, y );
+    const size_t chromaOffset = dst - mapped;
+    size_t secondChromaOffset = 0;
+
+    if ( interleaved() )
+    {
+        // One plane of UV or VU pairs, starting at the lower address.
+        CameraBuffer::Data uv = layout == Layout::NV12 ? u : v;
+        uv.width *= 2;
+        uv.channel_step = 1;
+        dst = packPlane( dst, uv );
+    }
+    else
+    {
+        dst = packPlane( dst, u );
+        secondChromaOffset = dst - mapped;
+        dst = packPlane( dst, v );
+    }
+    mUploadBytes = dst - mapped;
+
+    glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+
+    // Texture data now comes from offsets into the bound pixel buffer.
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+    glActiveTexture( GL_TEXTURE0 );
+
+    glBindTexture( GL_TEXTURE_2D, mTextures[0] );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, mLumaSize.width, mLumaSize.height,
+            GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*) 0 );
+
+    if ( interleaved() )
+    {
+        glBindTexture( GL_TEXTURE_2D, mTextures[1] );
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0,
+                mChromaSize.width, mChromaSize.height,
+                GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, (GLvoid*) chromaOffset );
+    }
+    else
+    {
+        glBindTexture( GL_TEXTURE_2D, mTextures[1] );
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0,
+                mChromaSize.width, mChromaSize.height,
+                GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*) chromaOffset );
+
+        glBindTexture( GL_TEXTURE_2D, mTextures[2] );
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0,
+                mChromaSize.width, mChromaSize.height,
+                GL_LUMINANCE, GL_UNSIGNED_BYTE, (GLvoid*) secondChromaOffset );
+    }
+
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    return true;
+}
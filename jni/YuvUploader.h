@@ -0,0 +1,128 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef YuvUploader_H
+#define YuvUploader_H
+
+#include "NV/NvPlatformGL.h"
+
+#include "native_camera2/native_camera2.h"
+
+#include <cstdint>
+#include <vector>
+
+/*!
+ * Streams YCbCr_420_888 buffers into GL textures. The chroma layout is
+ * detected from the buffer planes: when U and V are interleaved views of
+ * one buffer (NV12 or NV21) the chroma goes into a single two channel
+ * texture, uploaded once, instead of two textures each read with a
+ * stride of two bytes.
+ *
+ * Frames are copied into one of two pixel buffer objects, used in turn,
+ * and the textures are updated from there. The copy never waits for the
+ * GPU to finish reading the previous frame, and glTexSubImage2D returns
+ * without waiting for the transfer.
+ *
+ * All calls need the GL context current.
+ */
+class YuvUploader
+{
+public:
+
+    enum class Layout
+    {
+        NONE,
+        PLANAR,     //< Three planes with channel_step 1.
+        NV12,       //< One interleaved chroma plane, U first.
+        NV21,       //< One interleaved chroma plane, V first.
+        STRIDED     //< Any other channel_step, repacked to PLANAR.
+    };
+
+    static Layout detectLayout( nv::camera2::CameraBuffer& img );
+
+    YuvUploader();
+    ~YuvUploader();
+
+    /*!
+     * Uploads img, reallocating the textures if its size or layout
+     * changed. Returns false if img is not a YCbCr_420_888 buffer or the
+     * pixel buffer could not be mapped.
+     */
+    bool upload( nv::camera2::CameraBuffer& img );
+
+    // Layout of the last upload; decides which shader samples the textures.
+    Layout layout() const
+    {
+        return mLayout;
+    }
+
+    // True if the chroma is in the single texture chromaTexture(0).
+    bool interleaved() const
+    {
+        return mLayout == Layout::NV12 || mLayout == Layout::NV21;
+    }
+
+    GLuint lumaTexture() const
+    {
+        return mTextures[0];
+    }
+
+    // U and V for planar layouts, the two channel UV texture otherwise.
+    GLuint chromaTexture( unsigned i ) const
+    {
+        return mTextures[1 + i];
+    }
+
+    // Bytes copied into pixel buffers by the last upload.
+    size_t lastUploadBytes() const
+    {
+        return mUploadBytes;
+    }
+
+    // Releases the GL objects; the next upload creates them again.
+    void release();
+
+private:
+
+    void allocate( nv::camera2::CameraBuffer& img, Layout layout );
+
+    Layout mLayout = Layout::NONE;
+    nv::camera2::Size mLumaSize;
+    nv::camera2::Size mChromaSize;
+
+    GLuint mTextures[3];
+    GLuint mPixelBuffers[2];
+    unsigned mNextBuffer = 0;
+    size_t mBufferSize = 0;
+    size_t mUploadBytes = 0;
+};
+
+#endif
@@ -0,0 +1,234 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#include "ZslCapture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Frames the drain thread waits for before checking for stop().
+constexpr int DEQUEUE_TIMEOUT_US = 100000;
+
+// Frames in flight besides the ring: the one being dequeued and the ones
+// handed out by trigger() and not yet released.
+constexpr unsigned POOL_HEADROOM = 4;
+
+Size largestSize( const std::vector<Size>& sizes )
+{
+    Size largest;
+    for ( const auto& size : sizes )
+    {
+        if ( uint64_t(size.width) * size.height >
+             uint64_t(largest.width) * largest.height )
+        {
+            largest = size;
+        }
+    }
+    return largest;
+}
+
+}
+
+ZslCapture::ZslCapture( CameraDevice& device,
+        const StaticProperties& properties, const Options& options ) :
+    mDevice(device),
+    mProperties(properties),
+    mOptions(options),
+    mRing( std::max( options.depth, 1u ) ),
+    mRunning(false)
+{
+}
+
+ZslCapture::~ZslCapture()
+{
+    stop();
+}
+
+bool ZslCapture::attach( CaptureRequest& request )
+{
+    int32_t maxStreams;
+    Size size = mOptions.size;
+
+    if ( mOptions.format == RAW16 )
+    {
+        maxStreams = mProperties.request.maxNumRAWStreams;
+        if ( size.width == 0 ) size = largestSize( mProperties.scaler.availableRAWSizes );
+    }
+    else if ( mOptions.format == YCbCr_420_888 )
+    {
+        maxStreams = mProperties.request.maxNumYUVStreams;
+        if ( size.width == 0 ) size = largestSize( mProperties.scaler.availableYUVSizes );
+    }
+    else
+    {
+        return false;
+    }
+
+    if ( size.width == 0 || size.height == 0 ) return false;
+
+    // A negative limit means the HAL did not report one.
+    int32_t used = 0;
+    for ( const CameraStream* output : request.outputs )
+    {
+        if ( output->format() == mOptions.format ) ++used;
+    }
+    if ( maxStreams >= 0 && used >= maxStreams ) return false;
+
+    mStream = mDevice.createStream( mOptions.format, size );
+    if ( !mStream ) return false;
+
+    mPooled.reset( new PooledStream( *mStream, mProperties,
+            mRing.size() + POOL_HEADROOM ) );
+
+    request.outputs.push_back( mStream.get() );
+    return true;
+}
+
+void ZslCapture::start()
+{
+    if ( !mPooled || mRunning ) return;
+
+    mRunning = true;
+    mThread = std::thread( &ZslCapture::drainLoop, this );
+}
+
+void ZslCapture::stop()
+{
+    if ( !mRunning ) return;
+
+    mRunning = false;
+    mThread.join();
+
+    // Return the held frames to the pool.
+    std::lock_guard<std::mutex> lk( mMutex );
+    for ( auto& frame : mRing )
+    {
+        frame.reset();
+    }
+    mHead = 0;
+    mCount = 0;
+}
+
+void ZslCapture::drainLoop()
+{
+    while ( mRunning )
+    {
+        FramePool::Frame frame = mPooled->dequeue( DEQUEUE_TIMEOUT_US );
+        if ( !frame ) continue;
+
+        std::lock_guard<std::mutex> lk( mMutex );
+        ++mCounters.framesReceived;
+
+        const unsigned capacity = mRing.size();
+        if ( mCount == capacity )
+        {
+            // The evicted frame is released when frame goes out of scope.
+            mRing[mHead].swap( frame );
+            mHead = ( mHead + 1 ) % capacity;
+            ++mCounters.framesEvicted;
+        }
+        else
+        {
+            mRing[( mHead + mCount ) % capacity] = std::move( frame );
+            ++mCount;
+        }
+    }
+}
+
+FramePool::Frame ZslCapture::trigger( int64_t pressTime )
+{
+    const int64_t start = now();
+
+    std::lock_guard<std::mutex> lk( mMutex );
+    ++mCounters.triggers;
+
+    if ( mCount == 0 )
+    {
+        ++mCounters.misses;
+        return FramePool::Frame( nullptr, FramePool::Recycler() );
+    }
+
+    const unsigned capacity = mRing.size();
+    unsigned best = 0;
+    int64_t bestDistance = INT64_MAX;
+    for ( unsigned i = 0; i < mCount; ++i )
+    {
+        const int64_t distance = std::abs(
+                mRing[( mHead + i ) % capacity]->captureTime - pressTime );
+        if ( distance < bestDistance )
+        {
+            best = i;
+            bestDistance = distance;
+        }
+    }
+
+    FramePool::Frame frame = std::move( mRing[( mHead + best ) % capacity] );
+
+    // Close the gap, keeping the ring in capture order.
+    for ( unsigned i = best; i + 1 < mCount; ++i )
+    {
+        mRing[( mHead + i ) % capacity] =
+                std::move( mRing[( mHead + i + 1 ) % capacity] );
+    }
+    --mCount;
+
+    mLatency.pressTime = pressTime;
+    mLatency.captureTime = frame->captureTime;
+    mLatency.shutterToFrameUs = ( frame->captureTime - pressTime ) / 1000;
+    mLatency.handoffUs = ( now() - start ) / 1000;
+
+    return frame;
+}
+
+ZslCapture::Latency ZslCapture::lastLatency() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mLatency;
+}
+
+ZslCapture::Counters ZslCapture::counters() const
+{
+    std::lock_guard<std::mutex> lk( mMutex );
+    return mCounters;
+}
+
+int64_t ZslCapture::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
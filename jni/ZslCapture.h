@@ -0,0 +1,153 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+#ifndef ZslCapture_H
+#define ZslCapture_H
+
+#include "FramePool.h"
+#include "native_camera2/native_camera2.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*!
+ * Zero shutter lag capture. A full resolution stream runs next to the
+ * preview for the whole session and its last frames are kept in a ring,
+ * so a shutter press picks a frame that has already been captured instead
+ * of creating a stream and submitting a new request.
+ *
+ * The stream has to be part of the repeating request: call attach()
+ * before the request is submitted with CameraDevice::capture(), then
+ * start() to begin filling the ring.
+ *
+ * The ring holds depth frames on top of the stream's queue; depth has to
+ * stay below the number of buffers the HAL allocates for the stream.
+ */
+class ZslCapture
+{
+public:
+
+    struct Options
+    {
+        nv::camera2::PixelFormat format = nv::camera2::RAW16;
+
+        // Largest available size of the format if left at 0x0.
+        nv::camera2::Size size;
+
+        // Number of frames kept in the ring.
+        unsigned depth = 4;
+    };
+
+    struct Latency
+    {
+        int64_t pressTime = 0;      //< ns, ZslCapture::now() clock.
+        int64_t captureTime = 0;    //< ns, captureTime of the chosen frame.
+
+        // captureTime - pressTime; negative if the frame started
+        // exposing before the press.
+        int64_t shutterToFrameUs = 0;
+
+        // Time spent in trigger() picking the frame.
+        int64_t handoffUs = 0;
+    };
+
+    struct Counters
+    {
+        uint64_t framesReceived = 0;
+        uint64_t framesEvicted = 0;     //< Pushed out of the ring unused.
+        uint64_t triggers = 0;
+        uint64_t misses = 0;            //< Triggers with an empty ring.
+    };
+
+    ZslCapture( nv::camera2::CameraDevice& device,
+            const nv::camera2::StaticProperties& properties,
+            const Options& options );
+
+    ~ZslCapture();
+
+    /*!
+     * Creates the ZSL stream and adds it to the outputs of request.
+     * Fails if the format has no available size or if request already
+     * uses all streams of that format allowed by
+     * StaticProperties::request.
+     */
+    bool attach( nv::camera2::CaptureRequest& request );
+
+    // Starts and stops draining the stream into the ring.
+    void start();
+    void stop();
+
+    /*!
+     * Takes the frame whose captureTime is closest to pressTime out of the
+     * ring. The frame is handed over as is; it returns to the stream's pool
+     * when released. Returns an empty frame if the ring is empty.
+     */
+    FramePool::Frame trigger( int64_t pressTime );
+
+    // Latency of the last successful trigger().
+    Latency lastLatency() const;
+
+    Counters counters() const;
+
+    nv::camera2::CameraStream* stream() const
+    {
+        return mStream.get();
+    }
+
+    // Timestamp in the clock domain of CameraFrame::captureTime.
+    static int64_t now();
+
+private:
+
+    void drainLoop();
+
+    nv::camera2::CameraDevice& mDevice;
+    const nv::camera2::StaticProperties mProperties;
+    const Options mOptions;
+
+    std::unique_ptr<nv::camera2::CameraStream> mStream;
+    std::unique_ptr<PooledStream> mPooled;
+
+    mutable std::mutex mMutex;
+    std::vector<FramePool::Frame> mRing;
+    unsigned mHead = 0;
+    unsigned mCount = 0;
+    Latency mLatency;
+    Counters mCounters;
+
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+};
+
+#endif
@@ -0,0 +1,179 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Measures BurstMerge on a synthetic RAW16 burst:
+ *
+ *   burst_bench [width height [frames]]
+ *
+ * The frames are copies of one textured, noisy frame shifted by a few
+ * quads each. Every available kernel merges the burst on one thread and
+ * on all threads of the ThreadPool; the time is split into pyramid
+ * building, alignment and merging.
+ */
+
+#include "BurstMerge.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+const char* kernelName( BurstMerge::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case BurstMerge::Kernel::AUTO:   return "auto";
+    case BurstMerge::Kernel::SCALAR: return "scalar";
+    case BurstMerge::Kernel::NEON:   return "neon";
+    case BurstMerge::Kernel::SSE2:   return "sse2";
+    }
+    return "";
+}
+
+class BenchBuffer : public CameraBuffer
+{
+public:
+
+    BenchBuffer( int32_t width, int32_t height ) :
+        pixels( size_t(width) * height )
+    {
+        format_ = RAW16;
+        number_of_planes_ = 1;
+
+        Data& d = buffer_planes_[0];
+        d.ptr = pixels.data();
+        d.width = width;
+        d.height = height;
+        d.stride = width;
+        d.num_channels = 1;
+        d.bytes_per_channel = 2;
+        d.channel_step = 1;
+    }
+
+    std::vector<uint16_t> pixels;
+};
+
+// Merges the burst and returns the wall time in microseconds.
+int64_t timeMerge( BurstMerge& merge,
+        const std::vector< std::unique_ptr<BenchBuffer> >& frames )
+{
+    const auto start = std::chrono::steady_clock::now();
+    merge.begin( *frames[0] );
+    for ( size_t i = 1; i < frames.size(); ++i )
+    {
+        merge.add( *frames[i] );
+    }
+    merge.finish();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    const int width = argc > 2 ? atoi( argv[1] ) : 4000;
+    const int height = argc > 2 ? atoi( argv[2] ) : 3000;
+    const int count = argc > 3 ? atoi( argv[3] ) : 8;
+
+    if ( width < 64 || height < 64 || count < 1 )
+    {
+        fprintf( stderr, "usage: %s [width height [frames]]\n", argv[0] );
+        return 1;
+    }
+
+    // 10 bit blocks and noise; every frame shifted by a different number
+    // of quads, within the reach of the default search.
+    StaticProperties properties;
+    properties.sensor.whiteLevel = 1023;
+    std::fill_n( properties.sensor.blackLevelPattern, 4, 64 );
+
+    std::vector< std::unique_ptr<BenchBuffer> > frames;
+    uint32_t seed = 1;
+    for ( int i = 0; i < count; ++i )
+    {
+        const int dx = 2 * ( i % 5 ) - 4;
+        const int dy = 2 * ( i % 3 ) - 2;
+        frames.emplace_back( new BenchBuffer( width, height ) );
+        std::vector<uint16_t>& pixels = frames.back()->pixels;
+        for ( int y = 0; y < height; ++y )
+        {
+            for ( int x = 0; x < width; ++x )
+            {
+                seed = seed * 1664525u + 1013904223u;
+                const int block = ( ( ( x + dx ) / 24 ) ^ ( ( y + dy ) / 40 ) ) & 7;
+                pixels[size_t(y) * width + x] = uint16_t( 64 + block * 100 +
+                        ( seed >> 26 ) );
+            }
+        }
+    }
+
+    const unsigned cores = ThreadPool::instance().concurrency();
+    printf( "%d frames of %dx%d RAW16, %u threads\n", count, width, height, cores );
+    printf( "%-7s %10s %10s %12s %10s %10s\n", "kernel", "1T ms", "NT ms",
+            "pyramid ms", "align ms", "merge ms" );
+
+    const BurstMerge::Kernel kernels[] = {
+            BurstMerge::Kernel::SCALAR, BurstMerge::Kernel::NEON,
+            BurstMerge::Kernel::SSE2 };
+
+    for ( auto kernel : kernels )
+    {
+        if ( !BurstMerge::isAvailable( kernel ) ) continue;
+
+        BurstMerge::Options options;
+        options.kernel = kernel;
+
+        options.maxThreads = 1;
+        BurstMerge single( properties, options );
+        const int64_t singleUs = timeMerge( single, frames );
+
+        options.maxThreads = 0;
+        BurstMerge parallel( properties, options );
+        const int64_t parallelUs = timeMerge( parallel, frames );
+        const BurstMerge::Stats& stats = parallel.lastStats();
+
+        printf( "%-7s %10.1f %10.1f %12.1f %10.1f %10.1f\n", kernelName( kernel ),
+                singleUs / 1000.0, parallelUs / 1000.0, stats.pyramidUs / 1000.0,
+                stats.alignUs / 1000.0, stats.mergeUs / 1000.0 );
+    }
+
+    return 0;
+}
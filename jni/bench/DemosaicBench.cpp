@@ -0,0 +1,180 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Measures Demosaic throughput on a synthetic RAW16 frame:
+ *
+ *   demosaic_bench [width height [iterations]]
+ *
+ * Every method and available kernel is run on one thread and on all
+ * threads of the ThreadPool; throughput is reported in megapixels of
+ * RAW input per second, overall and per core.
+ */
+
+#include "Demosaic.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+const char* methodName( Demosaic::Method method )
+{
+    switch ( method )
+    {
+    case Demosaic::Method::BILINEAR:  return "bilinear";
+    case Demosaic::Method::MALVAR:    return "malvar";
+    case Demosaic::Method::HALF_SIZE: return "half";
+    }
+    return "";
+}
+
+const char* kernelName( Demosaic::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case Demosaic::Kernel::AUTO:   return "auto";
+    case Demosaic::Kernel::SCALAR: return "scalar";
+    case Demosaic::Kernel::NEON:   return "neon";
+    case Demosaic::Kernel::SSE2:   return "sse2";
+    }
+    return "";
+}
+
+// Average time of one frame in microseconds, after a warm-up run.
+double timeFrame( Demosaic& demosaic, const CameraBuffer::Data& plane,
+        std::vector<uint8_t>& out, size_t stride, int iterations )
+{
+    demosaic.process( plane, out.data(), stride );
+
+    int64_t total = 0;
+    for ( int i = 0; i < iterations; ++i )
+    {
+        demosaic.process( plane, out.data(), stride );
+        total += demosaic.lastStats().timeUs;
+    }
+    return double(total) / iterations;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    const int width = argc > 2 ? atoi( argv[1] ) & ~1 : 4000;
+    const int height = argc > 2 ? atoi( argv[2] ) & ~1 : 3000;
+    const int iterations = argc > 3 ? atoi( argv[3] ) : 10;
+
+    if ( width < 2 || height < 2 || iterations < 1 )
+    {
+        fprintf( stderr, "usage: %s [width height [iterations]]\n", argv[0] );
+        return 1;
+    }
+
+    // 10 bit sensor data with some texture.
+    std::vector<uint16_t> raw( size_t(width) * height );
+    uint32_t seed = 1;
+    for ( int y = 0; y < height; ++y )
+    {
+        for ( int x = 0; x < width; ++x )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            raw[size_t(y) * width + x] = 64 + ( ( x ^ y ) & 511 ) + ( seed >> 26 );
+        }
+    }
+
+    CameraBuffer::Data plane;
+    plane.ptr = raw.data();
+    plane.width = width;
+    plane.height = height;
+    plane.stride = width;
+    plane.num_channels = 1;
+    plane.bytes_per_channel = 2;
+    plane.channel_step = 1;
+
+    StaticProperties properties;
+    properties.sensor.whiteLevel = 1023;
+    for ( int i = 0; i < 4; ++i )
+    {
+        properties.sensor.blackLevelPattern[i] = 64;
+    }
+
+    const unsigned cores = ThreadPool::instance().concurrency();
+    const double megapixels = double(width) * height / 1e6;
+
+    printf( "%dx%d RAW16, %d iterations, %u threads\n", width, height,
+            iterations, cores );
+    printf( "%-9s %-7s %10s %10s %10s %12s\n", "method", "kernel",
+            "1T ms", "1T MP/s", "NT MP/s", "MP/s/core" );
+
+    const Demosaic::Method methods[] = { Demosaic::Method::BILINEAR,
+            Demosaic::Method::MALVAR, Demosaic::Method::HALF_SIZE };
+    const Demosaic::Kernel kernels[] = { Demosaic::Kernel::SCALAR,
+            Demosaic::Kernel::NEON, Demosaic::Kernel::SSE2 };
+
+    for ( auto method : methods )
+    {
+        for ( auto kernel : kernels )
+        {
+            if ( !Demosaic::isAvailable( kernel ) ) continue;
+
+            Demosaic::Options options;
+            options.method = method;
+            options.kernel = kernel;
+            options.format = Demosaic::OutputFormat::RGBA8888;
+
+            const Size size = Demosaic::outputSize(
+                    Size( width, height ), method );
+            const size_t stride = size_t(size.width) * 4;
+            std::vector<uint8_t> out( stride * size.height );
+
+            options.maxThreads = 1;
+            Demosaic single( properties, options );
+            const double singleUs = timeFrame( single, plane, out, stride, iterations );
+
+            options.maxThreads = 0;
+            Demosaic parallel( properties, options );
+            const double parallelUs = timeFrame( parallel, plane, out, stride, iterations );
+
+            printf( "%-9s %-7s %10.2f %10.1f %10.1f %12.1f\n",
+                    methodName( method ), kernelName( kernel ),
+                    singleUs / 1000.0, megapixels / singleUs * 1e6,
+                    megapixels / parallelUs * 1e6,
+                    megapixels / parallelUs * 1e6 / cores );
+        }
+    }
+
+    return 0;
+}
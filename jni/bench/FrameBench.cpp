@@ -0,0 +1,527 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Times the per-frame hot paths on synthetic frames and checks them
+ * against a baseline:
+ *
+ *   frame_bench [-n iterations] [-d dir] [-b baseline [-t tolerance]]
+ *               [-y WxH,...] [-r WxH,...]
+ *
+ * On Android the sizes are every availableYUVSizes and availableRAWSizes
+ * entry of every camera; elsewhere, or with -y and -r, a given list of
+ * even sizes.
+ * Every size runs packed and with padded rows, YCbCr with NV12 chroma
+ * then, through the ImageSave writers (files go to dir), YuvConverter,
+ * Resampler and Demosaic. Each case reports one tab separated line:
+ *
+ *   case layout width height ns_per_pixel mpix_per_s allocs_per_frame
+ *
+ * The output of one run is the baseline of later ones. A case slower per
+ * pixel than its baseline by more than tolerance, or allocating more per
+ * frame, is reported on stderr and the run exits with status 2.
+ *
+ * The suite builds for the host as well, from jni:
+ *
+ *   g++ -std=c++11 -O2 -pthread -I. -Iexternal/native_camera2/include \
+ *       bench/FrameBench.cpp ImageSave.cpp JpegEncoder.cpp DngWriter.cpp \
+ *       RawCodec.cpp YuvConverter.cpp Demosaic.cpp Resampler.cpp \
+ *       ThreadPool.cpp -ljpeg -o frame_bench
+ */
+
+#include "Demosaic.h"
+#include "ImageSave.h"
+#include "JpegEncoder.h"
+#include "Resampler.h"
+#include "ThreadPool.h"
+#include "YuvConverter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+// Every heap allocation of the process, the ThreadPool's included.
+static std::atomic<uint64_t> gAllocations( 0 );
+
+void* operator new( size_t size )
+{
+    ++gAllocations;
+    void* p = malloc( size ? size : 1 );
+    if ( !p ) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+    free( p );
+}
+
+namespace
+{
+
+constexpr int DEFAULT_ITERATIONS = 10;
+constexpr double DEFAULT_TOLERANCE = 0.15;
+
+// An allocation more per frame than the baseline is a regression; less
+// than one is noise from the thread pool.
+constexpr double ALLOCATION_SLACK = 0.5;
+
+const char* const FILENAME = "frame_bench";
+
+#if defined(__ANDROID__)
+const char* const DEFAULT_DIR = "/data/local/tmp/frame_bench";
+#else
+const char* const DEFAULT_DIR = "/tmp/frame_bench";
+#endif
+
+int32_t alignUp( int32_t value, int32_t alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+/*
+ * A YCbCr_420_888 or RAW16 frame. Packed frames have rows of exactly the
+ * width and planar chroma; padded ones have longer rows, as HALs hand
+ * out, and YCbCr chroma interleaved as NV12.
+ */
+class BenchBuffer : public CameraBuffer
+{
+public:
+
+    BenchBuffer( PixelFormat format, int32_t width, int32_t height,
+            bool padded )
+    {
+        format_ = format;
+        if ( format == RAW16 )
+        {
+            // RAW16 strides are in pixels.
+            const int32_t stride = padded ? alignUp( width, 64 ) + 32 : width;
+            number_of_planes_ = 1;
+            data_.resize( size_t(stride) * height * 2 );
+            setPlane( 0, data_.data(), width, height, stride, 2, 1 );
+            return;
+        }
+
+        number_of_planes_ = 3;
+        const int32_t stride = padded ? alignUp( width, 128 ) + 64 : width;
+        const size_t lumaBytes = size_t(stride) * height;
+        data_.resize( lumaBytes + lumaBytes / 2 );
+        setPlane( 0, data_.data(), width, height, stride, 1, 1 );
+
+        uint8_t* chroma = data_.data() + lumaBytes;
+        if ( padded )
+        {
+            setPlane( 1, chroma, width / 2, height / 2, stride, 1, 2 );
+            setPlane( 2, chroma + 1, width / 2, height / 2, stride, 1, 2 );
+        }
+        else
+        {
+            const size_t chromaBytes = size_t( width / 2 ) * ( height / 2 );
+            setPlane( 1, chroma, width / 2, height / 2, width / 2, 1, 1 );
+            setPlane( 2, chroma + chromaBytes, width / 2, height / 2,
+                    width / 2, 1, 1 );
+        }
+    }
+
+    // Smooth gradients with noise, so the encoders do real work.
+    void fill()
+    {
+        uint32_t seed = 1;
+        const Data& luma = buffer_planes_[0];
+        for ( size_t i = 0; i < data_.size(); ++i )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            const size_t x = i % std::max( luma.stride, 1 );
+            const size_t y = i / std::max( luma.stride, 1 );
+            data_[i] = uint8_t( ( x + y ) / 8 + ( seed >> 28 ) );
+        }
+
+        // 10 bit samples above the black level.
+        if ( format_ == RAW16 )
+        {
+            uint16_t* samples = reinterpret_cast<uint16_t*>( data_.data() );
+            for ( size_t i = 0; i < data_.size() / 2; ++i )
+            {
+                samples[i] = 64 + ( samples[i] & 511 );
+            }
+        }
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height, int32_t stride, int32_t bytesPerChannel,
+            int32_t channelStep )
+    {
+        Data& d = buffer_planes_[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = stride;
+        d.num_channels = 1;
+        d.bytes_per_channel = bytesPerChannel;
+        d.channel_step = channelStep;
+    }
+
+    std::vector<uint8_t> data_;
+};
+
+struct Case
+{
+    std::string name;
+    PixelFormat format;
+    std::function<bool( CameraFrame& )> run;
+};
+
+struct Result
+{
+    double nsPerPixel = 0.0;
+    double allocsPerFrame = 0.0;
+};
+
+std::string key( const std::string& name, const std::string& layout,
+        const Size& size )
+{
+    std::ostringstream s;
+    s << name << ' ' << layout << ' ' << size.width << 'x' << size.height;
+    return s.str();
+}
+
+bool parseSizes( const char* list, std::vector<Size>& sizes )
+{
+    sizes.clear();
+    std::istringstream in( list );
+    std::string item;
+    while ( std::getline( in, item, ',' ) )
+    {
+        unsigned width = 0, height = 0;
+        if ( sscanf( item.c_str(), "%ux%u", &width, &height ) != 2 ||
+             width < 2 || height < 2 )
+        {
+            return false;
+        }
+
+        // 4:2:0 chroma and Bayer quads need even sizes; rounding would
+        // time a size other than the one asked for.
+        if ( ( width | height ) & 1 )
+        {
+            fprintf( stderr, "%s: sizes have to be even\n", item.c_str() );
+            return false;
+        }
+        sizes.push_back( Size( width, height ) );
+    }
+    return !sizes.empty();
+}
+
+#if defined(__ANDROID__)
+
+void addSize( std::vector<Size>& sizes, const Size& size )
+{
+    for ( const Size& s : sizes )
+    {
+        if ( s.width == size.width && s.height == size.height ) return;
+    }
+    sizes.push_back( size );
+}
+
+// Sizes of all cameras; the properties of the first camera with RAW.
+void queryCameras( std::vector<Size>& yuv, std::vector<Size>& raw,
+        StaticProperties& properties )
+{
+    std::unique_ptr<CameraManager> manager = CameraManager::createCameraManager();
+    if ( !manager ) return;
+
+    for ( int id = 0; id < manager->getNumberOfCameras(); ++id )
+    {
+        StaticProperties p;
+        if ( manager->queryStaticProperties( id, p ) < 0 ) continue;
+
+        for ( const Size& size : p.scaler.availableYUVSizes ) addSize( yuv, size );
+        if ( raw.empty() && !p.scaler.availableRAWSizes.empty() )
+        {
+            properties = p;
+        }
+        for ( const Size& size : p.scaler.availableRAWSizes ) addSize( raw, size );
+    }
+}
+
+#endif
+
+bool readBaseline( const char* path, std::map<std::string, Result>& baseline )
+{
+    std::ifstream in( path );
+    if ( !in ) return false;
+
+    std::string line;
+    while ( std::getline( in, line ) )
+    {
+        if ( line.empty() || line[0] == '#' ) continue;
+
+        std::istringstream fields( line );
+        std::string name, layout;
+        Size size;
+        double mpixPerSecond = 0.0;
+        Result result;
+        if ( fields >> name >> layout >> size.width >> size.height >>
+             result.nsPerPixel >> mpixPerSecond >> result.allocsPerFrame )
+        {
+            baseline[key( name, layout, size )] = result;
+        }
+    }
+    return true;
+}
+
+// One warm-up call, so first-time allocations and file creation do not
+// count, then iterations timed calls.
+bool measure( const Case& c, CameraFrame& frame, const Size& size,
+        int iterations, Result& result )
+{
+    if ( !c.run( frame ) ) return false;
+
+    const uint64_t allocations = gAllocations;
+    const auto start = std::chrono::steady_clock::now();
+    for ( int i = 0; i < iterations; ++i )
+    {
+        if ( !c.run( frame ) ) return false;
+    }
+    const double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start ).count();
+
+    result.nsPerPixel = ns / iterations / ( double(size.width) * size.height );
+    result.allocsPerFrame = double( gAllocations - allocations ) / iterations;
+    return true;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    int iterations = DEFAULT_ITERATIONS;
+    double tolerance = DEFAULT_TOLERANCE;
+    const char* dir = DEFAULT_DIR;
+    const char* baselinePath = nullptr;
+    std::vector<Size> yuvSizes;
+    std::vector<Size> rawSizes;
+    bool sizesGiven = false;
+    bool usage = false;
+
+    int opt;
+    while ( ( opt = getopt( argc, argv, "n:d:b:t:y:r:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'n': iterations = atoi( optarg ); usage = usage || iterations < 1; break;
+        case 'd': dir = optarg; break;
+        case 'b': baselinePath = optarg; break;
+        case 't': tolerance = atof( optarg ); usage = usage || tolerance < 0.0; break;
+        case 'y': usage = usage || !parseSizes( optarg, yuvSizes ); sizesGiven = true; break;
+        case 'r': usage = usage || !parseSizes( optarg, rawSizes ); sizesGiven = true; break;
+        default:  usage = true; break;
+        }
+    }
+    if ( usage || optind != argc )
+    {
+        fprintf( stderr, "usage: %s [-n iterations] [-d dir] "
+                "[-b baseline [-t tolerance]] [-y WxH,...] [-r WxH,...]\n",
+                argv[0] );
+        return 1;
+    }
+
+    StaticProperties properties;
+    properties.sensor.whiteLevel = 1023;
+    for ( int i = 0; i < 4; ++i )
+    {
+        properties.sensor.blackLevelPattern[i] = 64;
+    }
+
+#if defined(__ANDROID__)
+    if ( !sizesGiven ) queryCameras( yuvSizes, rawSizes, properties );
+#endif
+    if ( !sizesGiven && yuvSizes.empty() && rawSizes.empty() )
+    {
+        yuvSizes = { Size( 640, 480 ), Size( 1280, 720 ), Size( 1920, 1080 ) };
+        rawSizes = { Size( 4208, 3120 ) };
+    }
+
+    std::map<std::string, Result> baseline;
+    if ( baselinePath && !readBaseline( baselinePath, baseline ) )
+    {
+        fprintf( stderr, "%s: cannot read baseline %s\n", argv[0], baselinePath );
+        return 1;
+    }
+
+    mkdir( dir, 0755 );
+    ImageSave::setOutputDir( dir );
+
+    // Outputs are sized by the cases for the largest frame they see and
+    // kept, like the app keeps them across frames.
+    std::vector<uint8_t> rgba;
+    const Resampler::Options resamplerOptions;
+    Resampler resampler( resamplerOptions );
+    Demosaic::Options demosaicOptions;
+    demosaicOptions.method = Demosaic::Method::HALF_SIZE;
+    demosaicOptions.format = Demosaic::OutputFormat::RGBA8888;
+    Demosaic demosaic( properties, demosaicOptions );
+    JpegEncoder encoder;
+
+    const Case cases[] = {
+        { "pgm", YCbCr_420_888, [&]( CameraFrame& frame ) {
+            return ImageSave::writePGM( *frame.imageBuffer, properties,
+                    FILENAME ) > 0; } },
+        { "jpg", YCbCr_420_888, [&]( CameraFrame& frame ) {
+            return ImageSave::writeJPG( *frame.imageBuffer, encoder,
+                    FILENAME ) > 0; } },
+        { "yuv_rgba", YCbCr_420_888, [&]( CameraFrame& frame ) {
+            const CameraBuffer::Data luma = frame.imageBuffer->data(0);
+            rgba.resize( std::max( rgba.size(), size_t(luma.width) * luma.height * 4 ) );
+            return YuvConverter::convert( *frame.imageBuffer,
+                    YuvConverter::RgbFormat::RGBA8888, rgba.data(),
+                    size_t(luma.width) * 4 ); } },
+        { "resample_half", YCbCr_420_888, [&]( CameraFrame& frame ) {
+            const CameraBuffer::Data luma = frame.imageBuffer->data(0);
+            return bool( resampler.resample( *frame.imageBuffer,
+                    Size( luma.width / 2, luma.height / 2 ) ) ); } },
+        { "raw", RAW16, []( CameraFrame& frame ) {
+            return ImageSave::writeRAW( *frame.imageBuffer, FILENAME ) > 0; } },
+        { "dng", RAW16, [&]( CameraFrame& frame ) {
+            return ImageSave::writeDNG( frame, properties, FILENAME ) > 0; } },
+        { "nvraw_packed", RAW16, [&]( CameraFrame& frame ) {
+            return ImageSave::writeNVRAW( frame, properties, FILENAME, false ) > 0; } },
+        { "nvraw_lossless", RAW16, [&]( CameraFrame& frame ) {
+            return ImageSave::writeNVRAW( frame, properties, FILENAME, true ) > 0; } },
+        { "demosaic_half", RAW16, [&]( CameraFrame& frame ) {
+            const CameraBuffer::Data plane = frame.imageBuffer->data(0);
+            const Size size = Demosaic::outputSize(
+                    Size( plane.width, plane.height ), Demosaic::Method::HALF_SIZE );
+            rgba.resize( std::max( rgba.size(), size_t(size.width) * size.height * 4 ) );
+            return demosaic.process( *frame.imageBuffer, rgba.data(),
+                    size_t(size.width) * 4 ); } } };
+
+    printf( "# frame_bench, %d iterations, %u threads, output in %s\n",
+            iterations, ThreadPool::instance().concurrency(), dir );
+    printf( "# case\tlayout\twidth\theight\tns_per_pixel\tmpix_per_s\t"
+            "allocs_per_frame\n" );
+
+    unsigned measured = 0;
+    unsigned failed = 0;
+    unsigned regressions = 0;
+
+    const PixelFormat formats[] = { YCbCr_420_888, RAW16 };
+    for ( PixelFormat format : formats )
+    {
+        const std::vector<Size>& sizes = format == RAW16 ? rawSizes : yuvSizes;
+        for ( const Size& size : sizes )
+        {
+            for ( int padded = 0; padded < 2; ++padded )
+            {
+                const char* layout = format == RAW16 ?
+                        ( padded ? "padded" : "packed" ) :
+                        ( padded ? "nv12_padded" : "i420_packed" );
+
+                CameraFrame frame;
+                BenchBuffer* buffer = new BenchBuffer( format, size.width,
+                        size.height, padded != 0 );
+                buffer->fill();
+                frame.imageBuffer.reset( buffer );
+
+                for ( const Case& c : cases )
+                {
+                    if ( c.format != format ) continue;
+
+                    Result result;
+                    if ( !measure( c, frame, size, iterations, result ) )
+                    {
+                        fprintf( stderr, "%s: %s failed\n", argv[0],
+                                key( c.name, layout, size ).c_str() );
+                        ++failed;
+                        continue;
+                    }
+                    ++measured;
+
+                    printf( "%s\t%s\t%u\t%u\t%.4f\t%.2f\t%.2f\n", c.name.c_str(),
+                            layout, size.width, size.height, result.nsPerPixel,
+                            1e3 / result.nsPerPixel, result.allocsPerFrame );
+                    fflush( stdout );
+
+                    auto base = baseline.find( key( c.name, layout, size ) );
+                    if ( base == baseline.end() ) continue;
+
+                    const Result& b = base->second;
+                    if ( result.nsPerPixel > b.nsPerPixel * ( 1.0 + tolerance ) )
+                    {
+                        fprintf( stderr, "REGRESSION %s: %.4f ns/pixel, "
+                                "baseline %.4f (+%.0f%%)\n",
+                                key( c.name, layout, size ).c_str(),
+                                result.nsPerPixel, b.nsPerPixel,
+                                100.0 * ( result.nsPerPixel / b.nsPerPixel - 1.0 ) );
+                        ++regressions;
+                    }
+                    if ( result.allocsPerFrame > b.allocsPerFrame + ALLOCATION_SLACK )
+                    {
+                        fprintf( stderr, "REGRESSION %s: %.2f allocations "
+                                "per frame, baseline %.2f\n",
+                                key( c.name, layout, size ).c_str(),
+                                result.allocsPerFrame, b.allocsPerFrame );
+                        ++regressions;
+                    }
+                }
+            }
+        }
+    }
+
+    // The files of the writers are only kept until the next iteration.
+    const char* const extensions[] = { "-Y.pgm", "-U.pgm", "-V.pgm", ".pgm",
+            ".jpg", ".raw", ".dng", ".nvraw" };
+    for ( const char* extension : extensions )
+    {
+        unlink( ( std::string( dir ) + "/" + FILENAME + extension ).c_str() );
+    }
+
+    printf( "# %u cases, %u failed, %u regressions against %s\n", measured,
+            failed, regressions, baselinePath ? baselinePath : "no baseline" );
+
+    if ( failed > 0 ) return 1;
+    return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,303 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Measures RawCodec on recorded or synthetic RAW16 frames:
+ *
+ *   raw_codec_bench recording.raw16 [whiteLevel [frames]]
+ *   raw_codec_bench width height [whiteLevel]
+ *
+ * Recordings are RAW16 containers of VideoRecorder. Synthetic frames are
+ * a smooth Bayer scene with shot noise. Every frame is encoded and
+ * decoded with every available kernel, in both modes, on one thread and
+ * on all threads of the ThreadPool; the round trip is checked, and the
+ * compression ratio and the throughput in GB/s of RAW16 data reported.
+ */
+
+#include "RawCodec.h"
+#include "ThreadPool.h"
+#include "VideoRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+const char* kernelName( RawCodec::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case RawCodec::Kernel::AUTO:   return "auto";
+    case RawCodec::Kernel::SCALAR: return "scalar";
+    case RawCodec::Kernel::NEON:   return "neon";
+    case RawCodec::Kernel::SSE2:   return "sse2";
+    }
+    return "";
+}
+
+class BenchBuffer : public CameraBuffer
+{
+public:
+
+    BenchBuffer( int32_t width, int32_t height ) :
+        pixels( size_t(width) * height )
+    {
+        format_ = RAW16;
+        number_of_planes_ = 1;
+
+        Data& d = buffer_planes_[0];
+        d.ptr = pixels.data();
+        d.width = width;
+        d.height = height;
+        d.stride = width;
+        d.num_channels = 1;
+        d.bytes_per_channel = 2;
+        d.channel_step = 1;
+    }
+
+    std::vector<uint16_t> pixels;
+};
+
+bool loadRecording( const char* path, unsigned maxFrames,
+        std::vector< std::unique_ptr<CameraFrame> >& frames )
+{
+    VideoRecorder::Info info;
+    std::vector<VideoRecorder::IndexEntry> index;
+    if ( !VideoRecorder::readIndex( path, info, index ) || info.format != RAW16 )
+    {
+        return false;
+    }
+
+    const int fd = open( path, O_RDONLY );
+    if ( fd < 0 ) return false;
+
+    bool ok = true;
+    for ( size_t i = 0; i < index.size() && i < maxFrames && ok; ++i )
+    {
+        BenchBuffer* buffer = new BenchBuffer( info.size.width, info.size.height );
+        frames.emplace_back( new CameraFrame );
+        frames.back()->imageBuffer.reset( buffer );
+        frames.back()->captureTime = index[i].captureTime;
+        ok = pread( fd, buffer->pixels.data(), info.frameBytes,
+                index[i].offset ) == ssize_t( info.frameBytes );
+    }
+    close( fd );
+    return ok && !frames.empty();
+}
+
+void synthesize( int width, int height, int whiteLevel,
+        std::vector< std::unique_ptr<CameraFrame> >& frames )
+{
+    uint32_t seed = 1;
+    for ( int f = 0; f < 2; ++f )
+    {
+        BenchBuffer* buffer = new BenchBuffer( width, height );
+        frames.emplace_back( new CameraFrame );
+        frames.back()->imageBuffer.reset( buffer );
+
+        const float black = 64.0f;
+        for ( int y = 0; y < height; ++y )
+        {
+            for ( int x = 0; x < width; ++x )
+            {
+                // Channels of different gain over soft shapes.
+                const float gain = ( x & 1 ) == ( y & 1 ) ? 1.0f :
+                        ( y & 1 ) ? 0.5f : 0.7f;
+                const float scene = 0.5f + 0.4f * std::sin( x * 0.01f + f ) *
+                        std::cos( y * 0.013f ) + 0.1f * ( ( x / 200 + y / 150 ) & 1 );
+                const float signal = black + gain * scene * ( whiteLevel - black ) * 0.8f;
+
+                seed = seed * 1664525u + 1013904223u;
+                const float noise = ( ( seed >> 8 ) * ( 1.0f / 16777216.0f ) - 0.5f ) *
+                        3.4f * std::sqrt( signal );
+                const float value = std::min( std::max( signal + noise, 0.0f ),
+                        float( whiteLevel ) );
+                buffer->pixels[size_t(y) * width + x] = uint16_t( value );
+            }
+        }
+    }
+}
+
+struct Result
+{
+    double ratio = 0;
+    double encodeGBs = 0;
+    double decodeGBs = 0;
+    bool exact = true;
+};
+
+Result measure( const StaticProperties& properties, RawCodec::Options options,
+        const std::vector< std::unique_ptr<CameraFrame> >& frames )
+{
+    RawCodec codec( properties, options );
+    const unsigned maxValue = ( 1u << RawCodec::bitDepth(
+            properties.sensor.whiteLevel ) ) - 1;
+
+    Result result;
+    size_t raw = 0;
+    size_t coded = 0;
+    double encodeS = 0;
+    double decodeS = 0;
+    std::vector<uint8_t> data;
+    std::vector<uint16_t> decoded;
+
+    for ( const auto& frame : frames )
+    {
+        const CameraBuffer::Data plane = frame->imageBuffer->data( 0 );
+        decoded.resize( size_t( plane.width ) * plane.height );
+
+        // Best of a few runs, the first one warms up the buffers.
+        double encodeBest = 1e9;
+        double decodeBest = 1e9;
+        for ( int run = 0; run < 3; ++run )
+        {
+            codec.encode( *frame, data );
+            encodeBest = std::min( encodeBest, codec.lastStats().timeUs * 1e-6 );
+            result.exact = codec.decode( data.data(), data.size(),
+                    decoded.data(), plane.width ) && result.exact;
+            decodeBest = std::min( decodeBest, codec.lastStats().timeUs * 1e-6 );
+        }
+        encodeS += encodeBest;
+        decodeS += decodeBest;
+        raw += codec.lastStats().rawBytes;
+        coded += data.size();
+
+        const uint16_t* src = (const uint16_t*) plane.ptr;
+        for ( int y = 0; y < plane.height; ++y )
+        {
+            for ( int x = 0; x < plane.width; ++x )
+            {
+                unsigned expected = src[size_t(y) * plane.stride + x];
+                if ( options.mode == RawCodec::Mode::PACKED )
+                {
+                    expected = std::min( expected, maxValue );
+                }
+                result.exact = result.exact &&
+                        decoded[size_t(y) * plane.width + x] == expected;
+            }
+        }
+    }
+
+    result.ratio = double( raw ) / coded;
+    result.encodeGBs = raw / encodeS * 1e-9;
+    result.decodeGBs = raw / decodeS * 1e-9;
+    return result;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    std::vector< std::unique_ptr<CameraFrame> > frames;
+    StaticProperties properties;
+    properties.sensor.whiteLevel = 1023;
+
+    const bool recording = argc > 1 && atoi( argv[1] ) == 0;
+    if ( recording )
+    {
+        if ( argc > 2 ) properties.sensor.whiteLevel = atoi( argv[2] );
+        const unsigned maxFrames = argc > 3 ? atoi( argv[3] ) : 4;
+        if ( !loadRecording( argv[1], maxFrames, frames ) )
+        {
+            fprintf( stderr, "cannot read RAW16 frames from %s\n", argv[1] );
+            return 1;
+        }
+    }
+    else
+    {
+        const int width = argc > 2 ? atoi( argv[1] ) : 4000;
+        const int height = argc > 2 ? atoi( argv[2] ) : 3000;
+        if ( argc > 3 ) properties.sensor.whiteLevel = atoi( argv[3] );
+        if ( width < 2 || height < 2 || properties.sensor.whiteLevel < 1 )
+        {
+            fprintf( stderr, "usage: %s recording.raw16 [whiteLevel [frames]]\n"
+                     "       %s [width height [whiteLevel]]\n", argv[0], argv[0] );
+            return 1;
+        }
+        synthesize( width, height, properties.sensor.whiteLevel, frames );
+    }
+    std::fill_n( properties.sensor.blackLevelPattern, 4, 64 );
+
+    const CameraBuffer::Data plane = frames[0]->imageBuffer->data( 0 );
+    const unsigned cores = ThreadPool::instance().concurrency();
+    printf( "%zu frames of %dx%d RAW16, white level %d (%u bits), %u threads\n",
+            frames.size(), plane.width, plane.height, properties.sensor.whiteLevel,
+            RawCodec::bitDepth( properties.sensor.whiteLevel ), cores );
+    printf( "%-9s %-7s %7s %9s %9s %9s %9s %s\n", "mode", "kernel", "ratio",
+            "enc 1T", "dec 1T", "enc NT", "dec NT", "GB/s" );
+
+    const RawCodec::Kernel kernels[] = {
+            RawCodec::Kernel::SCALAR, RawCodec::Kernel::NEON,
+            RawCodec::Kernel::SSE2 };
+    const RawCodec::Mode modes[] = {
+            RawCodec::Mode::PACKED, RawCodec::Mode::LOSSLESS };
+
+    bool exact = true;
+    for ( auto mode : modes )
+    {
+        for ( auto kernel : kernels )
+        {
+            if ( !RawCodec::isAvailable( kernel ) ) continue;
+
+            RawCodec::Options options;
+            options.mode = mode;
+            options.kernel = kernel;
+
+            options.maxThreads = 1;
+            const Result single = measure( properties, options, frames );
+            options.maxThreads = 0;
+            const Result parallel = measure( properties, options, frames );
+
+            printf( "%-9s %-7s %7.2f %9.2f %9.2f %9.2f %9.2f %s\n",
+                    mode == RawCodec::Mode::PACKED ? "packed" : "lossless",
+                    kernelName( kernel ), parallel.ratio, single.encodeGBs,
+                    single.decodeGBs, parallel.encodeGBs, parallel.decodeGBs,
+                    single.exact && parallel.exact ? "" : "MISMATCH" );
+            exact = exact && single.exact && parallel.exact;
+
+            // The lossless coder has no vector kernels.
+            if ( mode == RawCodec::Mode::LOSSLESS ) break;
+        }
+    }
+
+    return exact ? 0 : 2;
+}
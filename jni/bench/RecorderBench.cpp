@@ -0,0 +1,183 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Records synthetic frames in real time with VideoRecorder:
+ *
+ *   recorder_bench [path [width height [fps [seconds]]]]
+ *
+ * The frames are semi-planar YUV with padded rows, like most camera
+ * HALs hand out, or RAW16 if path ends with ".raw16". write() is called
+ * at the frame rate from one thread; the frames dropped because the disk
+ * fell behind and the index read back from the file are reported.
+ */
+
+#include "VideoRecorder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+class BenchBuffer : public CameraBuffer
+{
+public:
+
+    BenchBuffer( int32_t width, int32_t height, bool raw )
+    {
+        // Rows padded to 64 bytes plus a bit.
+        const int32_t stride = ( width + 127 ) & ~63;
+
+        if ( raw )
+        {
+            format_ = RAW16;
+            number_of_planes_ = 1;
+            pixels.resize( size_t(stride) * height * 2 );
+
+            Data& d = buffer_planes_[0];
+            d.ptr = pixels.data();
+            d.width = width;
+            d.height = height;
+            d.stride = stride;
+            d.num_channels = 1;
+            d.bytes_per_channel = 2;
+            d.channel_step = 1;
+            return;
+        }
+
+        format_ = YCbCr_420_888;
+        number_of_planes_ = 3;
+        pixels.resize( size_t(stride) * height * 3 / 2 + stride );
+        uint8_t* chroma = pixels.data() + size_t(stride) * height;
+
+        for ( unsigned p = 0; p < 3; ++p )
+        {
+            Data& d = buffer_planes_[p];
+            d.ptr = p == 0 ? pixels.data() : chroma + ( p - 1 );
+            d.width = p == 0 ? width : width / 2;
+            d.height = p == 0 ? height : height / 2;
+            d.stride = stride;
+            d.num_channels = 1;
+            d.bytes_per_channel = 1;
+            d.channel_step = p == 0 ? 1 : 2;
+        }
+    }
+
+    // Changes some bytes so that no two frames are alike.
+    void touch( unsigned frame )
+    {
+        for ( size_t i = frame % 4096; i < pixels.size(); i += 4096 )
+        {
+            pixels[i] = uint8_t( frame + i );
+        }
+    }
+
+    std::vector<uint8_t> pixels;
+};
+
+}
+
+int main( int argc, char** argv )
+{
+    const std::string path = argc > 1 ? argv[1] :
+            "/mnt/sdcard/native_camera2/recorder_bench.y4m";
+    const int width = argc > 3 ? atoi( argv[2] ) : 1920;
+    const int height = argc > 3 ? atoi( argv[3] ) : 1080;
+    const int fps = argc > 4 ? atoi( argv[4] ) : 60;
+    const int seconds = argc > 5 ? atoi( argv[5] ) : 10;
+    const bool raw = path.size() > 6 &&
+            path.compare( path.size() - 6, 6, ".raw16" ) == 0;
+
+    if ( width < 2 || height < 2 || fps < 1 || seconds < 1 )
+    {
+        fprintf( stderr, "usage: %s [path [width height [fps [seconds]]]]\n",
+                argv[0] );
+        return 1;
+    }
+
+    VideoRecorder::Options options;
+    options.frameRate = fps;
+    VideoRecorder recorder( options );
+    if ( !recorder.open( path, Size( width, height ), raw ? RAW16 : YCbCr_420_888 ) )
+    {
+        fprintf( stderr, "cannot create %s\n", path.c_str() );
+        return 1;
+    }
+
+    BenchBuffer* buffer = new BenchBuffer( width, height, raw );
+    CameraFrame frame;
+    frame.imageBuffer.reset( buffer );
+
+    const unsigned count = unsigned( fps ) * seconds;
+    const auto period = std::chrono::microseconds( 1000000 / fps );
+    const auto start = std::chrono::steady_clock::now();
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        std::this_thread::sleep_until( start + i * period );
+        buffer->touch( i );
+        frame.captureTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start ).count();
+        frame.requestId = i;
+        recorder.write( frame );
+    }
+    const bool closed = recorder.close();
+    const double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start ).count();
+
+    const VideoRecorder::Counters c = recorder.counters();
+    printf( "%s: %ux%d %s at %d fps, %u frames in %.2f s%s\n", path.c_str(),
+            width, height, raw ? "RAW16" : "YUV", fps, count, elapsed,
+            closed ? "" : ", FAILED" );
+    printf( "written %llu dropped %llu, %.1f MB/s, queue depth max %u, "
+            "gather max %.2f ms, batch max %.2f ms\n",
+            (unsigned long long) c.framesWritten,
+            (unsigned long long) c.framesDropped,
+            c.bytesWritten / elapsed / ( 1 << 20 ), c.maxQueueDepth,
+            c.maxGatherUs / 1000.0, c.maxBatchUs / 1000.0 );
+
+    VideoRecorder::Info info;
+    std::vector<VideoRecorder::IndexEntry> index;
+    if ( !VideoRecorder::readIndex( path, info, index ) )
+    {
+        fprintf( stderr, "cannot read the index of %s\n", path.c_str() );
+        return 1;
+    }
+    printf( "index: %zu frames of %u bytes\n", index.size(), info.frameBytes );
+
+    return closed && c.framesDropped == 0 ? 0 : 2;
+}
@@ -0,0 +1,289 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Replays recordings through the capture and save paths of the app, on a
+ * device or on a host:
+ *
+ *   replay_bench [-n frames] [-f] [-t pgm|jpg|raw|dng|none] [-d dir]
+ *                recording...
+ *
+ * Every recording is a camera of a ReplayCamera manager, see
+ * ReplayCamera.h. Its stream runs through a FrameDistributor as in the
+ * app, and a thread per camera hands each distributed frame to an
+ * AsyncImageSaver writing to dir, until frames frames have been taken.
+ * -f replays as fast as the frames are drained instead of at the
+ * recorded frame rate. The rate, the frames lost on the way and the
+ * latency from capture to written file are reported.
+ *
+ * The bench builds for the host as well, from jni:
+ *
+ *   g++ -std=c++11 -O2 -pthread -I. -Iexternal/native_camera2/include \
+ *       bench/ReplayBench.cpp ReplayCamera.cpp FrameDistributor.cpp \
+ *       FramePool.cpp FrameTracer.cpp AsyncImageSaver.cpp ImageSave.cpp \
+ *       JpegEncoder.cpp DngWriter.cpp RawCodec.cpp YuvConverter.cpp \
+ *       BufferView.cpp Resampler.cpp ThreadPool.cpp -ljpeg -o replay_bench
+ */
+
+#include "AsyncImageSaver.h"
+#include "FrameDistributor.h"
+#include "FrameTracer.h"
+#include "ImageSave.h"
+#include "ReplayCamera.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+constexpr int DEFAULT_FRAMES = 300;
+
+struct Camera
+{
+    StaticProperties properties;
+    std::unique_ptr<CameraDevice> device;
+    std::unique_ptr<CameraStream> stream;
+    CaptureRequest request;
+    std::unique_ptr<FrameDistributor> fanout;
+    FrameDistributor::Consumer* queue = nullptr;
+    std::unique_ptr<AsyncImageSaver> saver;
+    std::thread thread;
+
+    // Taken once the camera's frames are written.
+    unsigned frames = 0;
+    double seconds = 0.0;
+    FrameDistributor::Counters capture;
+    FrameDistributor::ConsumerCounters queued;
+};
+
+bool parseType( const char* name, bool& save, AsyncImageSaver::FileType& type )
+{
+    save = true;
+    if ( strcmp( name, "pgm" ) == 0 ) type = AsyncImageSaver::FileType::PGM;
+    else if ( strcmp( name, "jpg" ) == 0 ) type = AsyncImageSaver::FileType::JPG;
+    else if ( strcmp( name, "raw" ) == 0 ) type = AsyncImageSaver::FileType::RAW;
+    else if ( strcmp( name, "dng" ) == 0 ) type = AsyncImageSaver::FileType::DNG;
+    else if ( strcmp( name, "none" ) == 0 ) save = false;
+    else return false;
+    return true;
+}
+
+// The recorded size is the only one a replayed camera offers.
+bool openCamera( CameraManager& manager, int id, Camera& camera )
+{
+    if ( manager.queryStaticProperties( id, camera.properties ) < 0 ) return false;
+    camera.device = manager.createCameraDevice( id, nullptr );
+    if ( !camera.device ) return false;
+
+    const auto& scaler = camera.properties.scaler;
+    if ( !scaler.availableYUVSizes.empty() )
+    {
+        camera.stream = camera.device->createStream( YCbCr_420_888,
+                scaler.availableYUVSizes[0] );
+    }
+    else if ( !scaler.availableRAWSizes.empty() )
+    {
+        camera.stream = camera.device->createStream( RAW16,
+                scaler.availableRAWSizes[0] );
+    }
+    if ( !camera.stream ) return false;
+
+    camera.device->initializeDefaultSettings( CAPTURE_INTENT::PREVIEW,
+            camera.request );
+    camera.request.outputs.clear();
+    camera.request.outputs.push_back( camera.stream.get() );
+    return true;
+}
+
+void drain( Camera& camera, int id, unsigned frames, bool save,
+        AsyncImageSaver::FileType type,
+        std::chrono::steady_clock::time_point start )
+{
+    FrameDistributor::FrameRef frame;
+    while ( camera.frames < frames )
+    {
+        if ( !camera.queue->pop( frame, WaitTimeMs( 1000 ) ) ) break;
+
+        if ( save )
+        {
+            std::ostringstream name;
+            name << "replay-" << id << "-" << camera.frames;
+            camera.saver->save( std::move( frame ), type, name.str() );
+        }
+        frame.reset();
+        ++camera.frames;
+    }
+
+    // The other cameras may still run; later frames do not count.
+    camera.saver->flush();
+    camera.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start ).count();
+    camera.capture = camera.fanout->counters();
+    camera.queued = camera.queue->counters();
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    int frames = DEFAULT_FRAMES;
+    const char* dir = "/mnt/sdcard/native_camera2/replay_bench";
+    bool save = true;
+    AsyncImageSaver::FileType type = AsyncImageSaver::FileType::JPG;
+    ReplayCamera::Options replayOptions;
+    bool usage = false;
+
+    int opt;
+    while ( ( opt = getopt( argc, argv, "n:ft:d:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'n': frames = atoi( optarg ); usage = usage || frames < 1; break;
+        case 'f': replayOptions.freeRun = true; break;
+        case 't': usage = usage || !parseType( optarg, save, type ); break;
+        case 'd': dir = optarg; break;
+        default:  usage = true; break;
+        }
+    }
+    if ( usage || optind == argc )
+    {
+        fprintf( stderr, "usage: %s [-n frames] [-f] [-t pgm|jpg|raw|dng|none] "
+                "[-d dir] recording...\n", argv[0] );
+        return 1;
+    }
+
+    const std::vector<std::string> recordings( argv + optind, argv + argc );
+    std::shared_ptr<CameraManager> manager =
+            ReplayCamera::createCameraManager( recordings, replayOptions );
+    if ( !manager )
+    {
+        fprintf( stderr, "%s: cannot read the recordings\n", argv[0] );
+        return 1;
+    }
+
+    mkdir( dir, 0755 );
+    ImageSave::setOutputDir( dir );
+
+    // Every frame is saved; a full saver holds up the consumer, whose
+    // queue then drops frames at the distributor.
+    std::vector<std::unique_ptr<Camera>> cameras;
+    for ( size_t i = 0; i < recordings.size(); ++i )
+    {
+        std::unique_ptr<Camera> camera( new Camera() );
+        if ( !openCamera( *manager, i, *camera ) )
+        {
+            fprintf( stderr, "%s: cannot open %s\n", argv[0],
+                    recordings[i].c_str() );
+            return 1;
+        }
+
+        AsyncImageSaver::Options saverOptions;
+        saverOptions.properties = camera->properties;
+        saverOptions.overflowPolicy = AsyncImageSaver::OverflowPolicy::BLOCK;
+        camera->saver.reset( new AsyncImageSaver( saverOptions ) );
+
+        camera->fanout.reset( new FrameDistributor( *camera->stream,
+                camera->properties ) );
+        FrameDistributor::ConsumerOptions queueOptions;
+        queueOptions.depth = 4;
+        queueOptions.dropPolicy = FrameDistributor::DropPolicy::DROP_NEWEST;
+        queueOptions.held = saverOptions.queueCapacity + 2;
+        camera->queue = camera->fanout->addConsumer( queueOptions );
+        cameras.push_back( std::move( camera ) );
+    }
+
+    FrameTracer::instance().reset();
+    const auto start = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < cameras.size(); ++i )
+    {
+        Camera& camera = *cameras[i];
+        camera.device->capture( camera.request );
+        camera.fanout->start();
+        camera.thread = std::thread( drain, std::ref( camera ), int( i ),
+                unsigned( frames ), save, type, start );
+    }
+    for ( auto& camera : cameras )
+    {
+        camera->thread.join();
+    }
+
+    for ( size_t i = 0; i < cameras.size(); ++i )
+    {
+        Camera& camera = *cameras[i];
+        camera.device->cancelRequest( camera.request.requestId );
+        camera.fanout->stop();
+
+        const Size size = camera.stream->size();
+        const AsyncImageSaver::Counters saved = camera.saver->counters();
+        printf( "%s: %dx%d %s, %u frames in %.2f s, %.1f fps, "
+                "%llu starved, %llu dropped; written %llu, failed %llu, %.1f MB\n",
+                recordings[i].c_str(), size.width, size.height,
+                camera.stream->format() == RAW16 ? "RAW16" : "YUV",
+                camera.frames, camera.seconds, camera.frames / camera.seconds,
+                (unsigned long long) camera.capture.framesStarved,
+                (unsigned long long) camera.queued.framesDropped,
+                (unsigned long long) saved.framesWritten,
+                (unsigned long long) saved.framesFailed,
+                saved.bytesWritten / 1048576.0 );
+    }
+
+    if ( save )
+    {
+        const FrameTracer::StageSummary s = FrameTracer::instance().summary(
+                FrameTracer::Stage::SAVE_COMPLETE );
+        printf( "capture to written file p50 %lld us p99 %lld us max %lld us, "
+                "write p50 %lld us p99 %lld us\n",
+                (long long) s.latencyP50, (long long) s.latencyP99,
+                (long long) s.latencyMax, (long long) s.durationP50,
+                (long long) s.durationP99 );
+    }
+
+    // Distributors stop before their streams go away.
+    for ( auto& camera : cameras )
+    {
+        camera->saver = nullptr;
+        camera->fanout = nullptr;
+    }
+    return 0;
+}
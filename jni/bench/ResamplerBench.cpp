@@ -0,0 +1,212 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Measures Resampler cost on a synthetic NV12 frame:
+ *
+ *   resampler_bench [width height [iterations]]
+ *
+ * Every available kernel and filter scales a 2x digital zoom view back
+ * to the frame size and the whole frame down to half size, on one thread
+ * and on all threads of the ThreadPool.
+ */
+
+#include "BufferView.h"
+#include "Resampler.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// One plane of luma and one of interleaved UV, as most HALs deliver.
+class Nv12Buffer : public CameraBuffer
+{
+public:
+
+    Nv12Buffer( int32_t width, int32_t height )
+    {
+        format_ = YCbCr_420_888;
+        number_of_planes_ = 3;
+        data_.resize( size_t(width) * height * 3 / 2 );
+
+        uint8_t* chroma = data_.data() + size_t(width) * height;
+        setPlane( 0, data_.data(), width, height, width, 1 );
+        setPlane( 1, chroma, width / 2, height / 2, width, 2 );
+        setPlane( 2, chroma + 1, width / 2, height / 2, width, 2 );
+    }
+
+    std::vector<uint8_t>& bytes()
+    {
+        return data_;
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height, int32_t stride, int32_t channelStep )
+    {
+        Data& d = buffer_planes_[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = stride;
+        d.num_channels = 1;
+        d.bytes_per_channel = 1;
+        d.channel_step = channelStep;
+    }
+
+    std::vector<uint8_t> data_;
+};
+
+const char* kernelName( Resampler::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case Resampler::Kernel::AUTO:   return "auto";
+    case Resampler::Kernel::SCALAR: return "scalar";
+    case Resampler::Kernel::NEON:   return "neon";
+    case Resampler::Kernel::SSE2:   return "sse2";
+    }
+    return "";
+}
+
+const char* filterName( Resampler::Filter filter )
+{
+    switch ( filter )
+    {
+    case Resampler::Filter::BOX:      return "box";
+    case Resampler::Filter::BILINEAR: return "bilinear";
+    case Resampler::Filter::LANCZOS:  return "lanczos";
+    }
+    return "";
+}
+
+// Average time of one frame in microseconds, after a warm-up run.
+double timeFrame( Resampler& resampler, CameraBuffer& src, const Size& size,
+        int iterations )
+{
+    resampler.resample( src, size );
+
+    int64_t total = 0;
+    for ( int i = 0; i < iterations; ++i )
+    {
+        resampler.resample( src, size );
+        total += resampler.counters().lastTimeUs;
+    }
+    return double(total) / iterations;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    const int width = argc > 2 ? atoi( argv[1] ) : 1920;
+    const int height = argc > 2 ? atoi( argv[2] ) : 1080;
+    const int iterations = argc > 3 ? atoi( argv[3] ) : 50;
+
+    if ( width < 4 || height < 4 || iterations < 1 )
+    {
+        fprintf( stderr, "usage: %s [width height [iterations]]\n", argv[0] );
+        return 1;
+    }
+
+    Nv12Buffer frame( width & ~1, height & ~1 );
+    uint32_t seed = 1;
+    for ( auto& byte : frame.bytes() )
+    {
+        seed = seed * 1664525u + 1013904223u;
+        byte = uint8_t( seed >> 24 );
+    }
+
+    const BufferView::Rect zoom = BufferView::zoomRect( width, height,
+            2.0f, 2.0f );
+    BufferView view( frame, zoom );
+
+    struct Case
+    {
+        const char* name;
+        CameraBuffer* src;
+        Size size;
+    };
+    const Case cases[] = {
+            { "zoom 2x", &view, Size( width, height ) },
+            { "half", &frame, Size( width / 2, height / 2 ) } };
+
+    const unsigned cores = ThreadPool::instance().concurrency();
+    printf( "%dx%d NV12, %d iterations, %u threads\n", width, height,
+            iterations, cores );
+    printf( "%-7s %-9s %-8s %10s %10s\n", "kernel", "filter", "case",
+            "1T ms", "NT ms" );
+
+    const Resampler::Kernel kernels[] = {
+            Resampler::Kernel::SCALAR, Resampler::Kernel::NEON,
+            Resampler::Kernel::SSE2 };
+    const Resampler::Filter filters[] = {
+            Resampler::Filter::BOX, Resampler::Filter::BILINEAR,
+            Resampler::Filter::LANCZOS };
+
+    for ( auto kernel : kernels )
+    {
+        if ( !Resampler::isAvailable( kernel ) ) continue;
+
+        for ( auto filter : filters )
+        {
+            for ( const Case& c : cases )
+            {
+                Resampler::Options options;
+                options.kernel = kernel;
+                options.filter = filter;
+
+                options.maxThreads = 1;
+                Resampler single( options );
+                const double singleUs = timeFrame( single, *c.src, c.size,
+                        iterations );
+
+                options.maxThreads = 0;
+                Resampler parallel( options );
+                const double parallelUs = timeFrame( parallel, *c.src, c.size,
+                        iterations );
+
+                printf( "%-7s %-9s %-8s %10.3f %10.3f\n", kernelName( kernel ),
+                        filterName( filter ), c.name, singleUs / 1000.0,
+                        parallelUs / 1000.0 );
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Measures StatisticsEngine cost on a synthetic Y plane:
+ *
+ *   statistics_bench [width height [iterations]]
+ *
+ * Every available kernel and subsample step is run on one thread and on
+ * all threads of the ThreadPool. Times are reported per frame and as a
+ * share of the frame period at 60 fps.
+ */
+
+#include "StatisticsEngine.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+constexpr double FRAME_PERIOD_60FPS_US = 1e6 / 60.0;
+
+const char* kernelName( StatisticsEngine::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case StatisticsEngine::Kernel::AUTO:   return "auto";
+    case StatisticsEngine::Kernel::SCALAR: return "scalar";
+    case StatisticsEngine::Kernel::NEON:   return "neon";
+    case StatisticsEngine::Kernel::SSE2:   return "sse2";
+    }
+    return "";
+}
+
+// Average time of one frame in microseconds, after a warm-up run.
+double timeFrame( StatisticsEngine& engine, const CameraBuffer::Data& luma,
+        Statistics& statistics, int iterations )
+{
+    engine.process( luma, statistics );
+
+    int64_t total = 0;
+    for ( int i = 0; i < iterations; ++i )
+    {
+        engine.process( luma, statistics );
+        total += engine.lastStats().timeUs;
+    }
+    return double(total) / iterations;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    const int width = argc > 2 ? atoi( argv[1] ) : 1920;
+    const int height = argc > 2 ? atoi( argv[2] ) : 1080;
+    const int iterations = argc > 3 ? atoi( argv[3] ) : 100;
+
+    if ( width < 1 || height < 1 || iterations < 1 )
+    {
+        fprintf( stderr, "usage: %s [width height [iterations]]\n", argv[0] );
+        return 1;
+    }
+
+    // Noise over a checkerboard, so every tile has texture.
+    std::vector<uint8_t> pixels( size_t(width) * height );
+    uint32_t seed = 1;
+    for ( int y = 0; y < height; ++y )
+    {
+        for ( int x = 0; x < width; ++x )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            pixels[size_t(y) * width + x] =
+                    ( ( ( x >> 4 ) ^ ( y >> 4 ) ) & 1 ) * 160 + ( seed >> 27 );
+        }
+    }
+
+    CameraBuffer::Data luma;
+    luma.ptr = pixels.data();
+    luma.width = width;
+    luma.height = height;
+    luma.stride = width;
+    luma.num_channels = 1;
+    luma.bytes_per_channel = 1;
+    luma.channel_step = 1;
+
+    StaticProperties properties;
+    Statistics statistics;
+
+    const unsigned cores = ThreadPool::instance().concurrency();
+    printf( "%dx%d Y plane, %d iterations, %u threads\n", width, height,
+            iterations, cores );
+    printf( "%-7s %9s %10s %10s %14s\n", "kernel", "subsample",
+            "1T ms", "NT ms", "NT % of 60fps" );
+
+    const StatisticsEngine::Kernel kernels[] = {
+            StatisticsEngine::Kernel::SCALAR, StatisticsEngine::Kernel::NEON,
+            StatisticsEngine::Kernel::SSE2 };
+    const unsigned subsamples[] = { 1, 2, 4 };
+
+    for ( auto kernel : kernels )
+    {
+        if ( !StatisticsEngine::isAvailable( kernel ) ) continue;
+
+        for ( auto subsample : subsamples )
+        {
+            StatisticsEngine::Options options;
+            options.kernel = kernel;
+            options.subsample = subsample;
+
+            options.maxThreads = 1;
+            StatisticsEngine single( properties, options );
+            const double singleUs = timeFrame( single, luma, statistics, iterations );
+
+            options.maxThreads = 0;
+            StatisticsEngine parallel( properties, options );
+            const double parallelUs = timeFrame( parallel, luma, statistics, iterations );
+
+            printf( "%-7s %9u %10.3f %10.3f %13.1f%%\n", kernelName( kernel ),
+                    subsample, singleUs / 1000.0, parallelUs / 1000.0,
+                    100.0 * parallelUs / FRAME_PERIOD_60FPS_US );
+        }
+    }
+
+    return 0;
+}
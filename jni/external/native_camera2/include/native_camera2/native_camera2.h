@@ -29,6 +29,7 @@
 #define NATIVE_CAMERA2_H_
 
 
+#include <array>
 #include <vector>
 #include <memory>
 #include <cstdint>
@@ -0,0 +1,10 @@
+# Image codec libraries prebuilt from the OpenCV for Android 3rdparty tree,
+# shipped in libs/. The headers come from the same OpenCV source tree.
+OPENCV_3RDPARTY_PATH := /home/lineo/opencv/3rdparty
+LOCAL_PATH := $(call my-dir)/../../../libs/$(TARGET_ARCH_ABI)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE    := libjpeg
+LOCAL_EXPORT_C_INCLUDES := $(OPENCV_3RDPARTY_PATH)/libjpeg
+LOCAL_SRC_FILES := liblibjpeg.a
+include $(PREBUILT_STATIC_LIBRARY)
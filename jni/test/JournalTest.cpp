@@ -0,0 +1,290 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Checks that the metadata journal keeps up with the camera while the
+ * statistics thread is slower than the frame rate:
+ *
+ *   journal_test [journal path]
+ *
+ * A synthetic stream feeds FrameDistributor at 200 fps. As in NativeCamera,
+ * a statistics thread takes the newest frame off a queue of one, runs
+ * StatisticsEngine on it and spends STATISTICS_MS per frame in all, so it
+ * skips most frames; a journal thread takes every frame off a queue of
+ * JOURNAL_DEPTH, waits on StatisticsExchange and appends it to a
+ * MetadataJournal. No frame may be dropped, every processed frame has to
+ * be journaled with its statistics, and no wait may run into its timeout.
+ * Failures are reported on stderr and the test exits with status 1.
+ *
+ * The test builds for the host as well, with the Makefile next to this
+ * file or from jni:
+ *
+ *   g++ -std=c++11 -O2 -pthread -I. -Iexternal/native_camera2/include \
+ *       test/JournalTest.cpp StatisticsExchange.cpp StatisticsEngine.cpp \
+ *       FrameDistributor.cpp FramePool.cpp FrameTracer.cpp \
+ *       MetadataJournal.cpp ThreadPool.cpp -o journal_test
+ */
+
+#include "FrameDistributor.h"
+#include "MetadataJournal.h"
+#include "StatisticsEngine.h"
+#include "StatisticsExchange.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+// Small enough that the time of StatisticsEngine does not count, even in
+// sanitizer builds.
+constexpr int WIDTH = 320;
+constexpr int HEIGHT = 240;
+constexpr unsigned FRAMES = 400;
+constexpr int FRAME_PERIOD_US = 5000;
+
+// Time the statistics thread spends on a frame, more than two periods. A
+// wait lasts two of these at most, less than JOURNAL_DEPTH periods.
+constexpr int STATISTICS_MS = 12;
+
+// As in NativeCamera.
+constexpr unsigned JOURNAL_DEPTH = 8;
+constexpr unsigned STATISTICS_KEPT = 4;
+constexpr int64_t WAIT_TIMEOUT_US = 100000;
+
+// A Y plane shared by every frame; the chroma planes are not read.
+class LumaBuffer : public CameraBuffer
+{
+public:
+
+    explicit LumaBuffer( uint8_t* pixels )
+    {
+        format_ = YCbCr_420_888;
+        number_of_planes_ = 1;
+        buffer_planes_[0].ptr = pixels;
+        buffer_planes_[0].width = WIDTH;
+        buffer_planes_[0].height = HEIGHT;
+        buffer_planes_[0].stride = WIDTH;
+        buffer_planes_[0].num_channels = 1;
+        buffer_planes_[0].bytes_per_channel = 1;
+        buffer_planes_[0].channel_step = 1;
+    }
+};
+
+// Hands out FRAMES frames, one every FRAME_PERIOD_US, then times out.
+class SyntheticStream : public CameraStream
+{
+public:
+
+    SyntheticStream() :
+        mPixels( size_t( WIDTH ) * HEIGHT ),
+        mNext( std::chrono::steady_clock::now() )
+    {
+        uint32_t seed = 1;
+        for ( auto& p : mPixels )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            p = uint8_t( seed >> 24 );
+        }
+    }
+
+    Size size() const override
+    {
+        return Size( WIDTH, HEIGHT );
+    }
+
+    PixelFormat format() const override
+    {
+        return YCbCr_420_888;
+    }
+
+    std::unique_ptr<CameraFrame> dequeue( int timeoutUs ) override
+    {
+        if ( mFrames == FRAMES )
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds(
+                    std::max( timeoutUs, 0 ) ) );
+            return nullptr;
+        }
+        std::this_thread::sleep_until( mNext );
+        mNext += std::chrono::microseconds( FRAME_PERIOD_US );
+
+        std::unique_ptr<CameraFrame> frame( new CameraFrame );
+        frame->streaming = true;
+        frame->captureTime = int64_t( ++mFrames ) * FRAME_PERIOD_US * 1000;
+        frame->imageBuffer.reset( new LumaBuffer( mPixels.data() ) );
+        return frame;
+    }
+
+    int numberOfAvailableFrames() override
+    {
+        return 0;
+    }
+
+private:
+
+    std::vector<uint8_t> mPixels;
+    std::chrono::steady_clock::time_point mNext;
+    unsigned mFrames = 0;
+};
+
+}
+
+int main( int argc, char** argv )
+{
+#ifdef __ANDROID__
+    const char* path = argc > 1 ? argv[1] : "/data/local/tmp/journal_test.journal";
+#else
+    const char* path = argc > 1 ? argv[1] : "journal_test.journal";
+#endif
+
+    MetadataJournal::Options journalOptions;
+    journalOptions.capacity = 1024;
+    journalOptions.sideBytes = 8 << 20;
+    MetadataJournal journal( journalOptions );
+    if ( !journal.open( path ) )
+    {
+        fprintf( stderr, "FAIL cannot open %s\n", path );
+        return 1;
+    }
+
+    StaticProperties properties;
+    SyntheticStream stream;
+    FrameDistributor fanout( stream, properties );
+
+    FrameDistributor::ConsumerOptions queueOptions;
+    queueOptions.depth = 1;
+    FrameDistributor::Consumer* statisticsQueue = fanout.addConsumer( queueOptions );
+    queueOptions.depth = JOURNAL_DEPTH;
+    FrameDistributor::Consumer* journalQueue = fanout.addConsumer( queueOptions );
+
+    StatisticsEngine engine( properties, StatisticsEngine::Options() );
+    StatisticsExchange exchange( STATISTICS_KEPT );
+    std::atomic<bool> running( true );
+    uint64_t processed = 0;
+
+    std::thread statisticsThread( [&]
+    {
+        Statistics statistics;
+        FrameDistributor::FrameRef frame;
+        while ( running )
+        {
+            if ( !statisticsQueue->pop( frame, WaitTimeMs( 100 ) ) ) continue;
+
+            FrameDistributor::FrameRef newer = statisticsQueue->popNewest();
+            if ( newer ) frame = std::move( newer );
+            exchange.take( frame->captureTime );
+
+            const auto start = std::chrono::steady_clock::now();
+            const bool done = engine.process( *frame->imageBuffer, statistics );
+            std::this_thread::sleep_until( start +
+                    std::chrono::milliseconds( STATISTICS_MS ) );
+            if ( done )
+            {
+                exchange.publish( statistics );
+                ++processed;
+            }
+            else
+            {
+                exchange.skip();
+            }
+            frame.reset();
+        }
+    } );
+
+    // The journal thread, on this one.
+    fanout.start();
+    Statistics statistics;
+    FrameDistributor::FrameRef frame;
+    uint64_t journaled = 0;
+    uint64_t withStatistics = 0;
+    int64_t maxWaitUs = 0;
+    while ( journaled + journalQueue->counters().framesDropped < FRAMES )
+    {
+        if ( !journalQueue->pop( frame, WaitTimeMs( 1000 ) ) ) break;
+
+        const auto start = std::chrono::steady_clock::now();
+        const bool found = exchange.wait( frame->captureTime, WAIT_TIMEOUT_US,
+                statistics );
+        maxWaitUs = std::max( maxWaitUs, int64_t(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start ).count() ) );
+
+        journal.append( *frame, 0, found ? statistics : frame->statistics );
+        ++journaled;
+        if ( found ) ++withStatistics;
+        frame.reset();
+    }
+
+    running = false;
+    exchange.stop();
+    statisticsThread.join();
+    fanout.stop();
+
+    const uint64_t dropped = journalQueue->counters().framesDropped;
+    const uint64_t records = journal.counters().records;
+    journal.close();
+    unlink( path );
+
+    unsigned failures = 0;
+    if ( journaled != FRAMES || records != FRAMES || dropped != 0 )
+    {
+        fprintf( stderr, "FAIL %llu of %u frames journaled, %llu dropped\n",
+                (unsigned long long) records, FRAMES,
+                (unsigned long long) dropped );
+        ++failures;
+    }
+    if ( withStatistics != processed || processed == 0 )
+    {
+        fprintf( stderr, "FAIL %llu frames processed, %llu journaled with "
+                "their statistics\n", (unsigned long long) processed,
+                (unsigned long long) withStatistics );
+        ++failures;
+    }
+    if ( maxWaitUs >= WAIT_TIMEOUT_US )
+    {
+        fprintf( stderr, "FAIL a wait for statistics ran into its timeout\n" );
+        ++failures;
+    }
+
+    printf( "journal_test: %u frames, %llu processed, longest wait %.1f ms, "
+            "%u failed\n", FRAMES, (unsigned long long) processed,
+            maxWaitUs / 1000.0, failures );
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Checks YuvConverter against shaders/yuv.frag:
+ *
+ *   yuv_converter_test
+ *
+ * I420, NV12 and NV21 planes with padded strides and widths that leave
+ * SIMD tails are filled with random samples and converted to every
+ * RgbFormat by every kernel available on the CPU. Each kernel has to
+ * match the scalar kernel exactly, the scalar kernel has to stay within
+ * MAX_ERROR levels of a float model of the shader's BT.601 conversion,
+ * and nothing may be written to the padding of the output rows. Failures
+ * are reported on stderr and the test exits with status 1.
+ *
+ * The test builds for the host as well, with the Makefile next to this
+ * file or from jni:
+ *
+ *   g++ -std=c++11 -O2 -pthread -I. -Iexternal/native_camera2/include \
+ *       test/YuvConverterTest.cpp YuvConverter.cpp ThreadPool.cpp \
+ *       -o yuv_converter_test
+ */
+
+#include "YuvConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+constexpr int MAX_ERROR = 2;
+
+// Written to the padding of the output rows; no kernel may touch it.
+constexpr uint8_t GUARD = 0xa5;
+
+enum class Layout
+{
+    I420,
+    NV12,
+    NV21
+};
+
+const char* layoutName( Layout layout )
+{
+    switch ( layout )
+    {
+    case Layout::I420: return "I420";
+    case Layout::NV12: return "NV12";
+    case Layout::NV21: return "NV21";
+    }
+    return "";
+}
+
+const char* formatName( YuvConverter::RgbFormat format )
+{
+    switch ( format )
+    {
+    case YuvConverter::RgbFormat::RGB888: return "RGB888";
+    case YuvConverter::RgbFormat::BGR888: return "BGR888";
+    case YuvConverter::RgbFormat::RGBA8888: return "RGBA8888";
+    }
+    return "";
+}
+
+const char* kernelName( YuvConverter::Kernel kernel )
+{
+    switch ( kernel )
+    {
+    case YuvConverter::Kernel::AUTO: return "auto";
+    case YuvConverter::Kernel::SCALAR: return "scalar";
+    case YuvConverter::Kernel::NEON: return "neon";
+    case YuvConverter::Kernel::SSSE3: return "ssse3";
+    case YuvConverter::Kernel::AVX2: return "avx2";
+    }
+    return "";
+}
+
+// Planes with rows padded past their width, as camera HALs hand them out.
+class TestImage
+{
+public:
+
+    TestImage( int32_t width, int32_t height, Layout layout, uint32_t seed )
+    {
+        const int32_t lumaStride = width + 24;
+        const int32_t chromaWidth = width / 2;
+        const int32_t chromaHeight = height / 2;
+        const int32_t chromaStride = layout == Layout::I420 ?
+                chromaWidth + 12 : width + 24;
+
+        const size_t lumaBytes = size_t( lumaStride ) * height;
+        const size_t chromaBytes = size_t( chromaStride ) * chromaHeight;
+        mPixels.resize( lumaBytes + 2 * chromaBytes );
+        for ( auto& p : mPixels )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            p = uint8_t( seed >> 24 );
+        }
+
+        uint8_t* luma = mPixels.data();
+        uint8_t* chroma = luma + lumaBytes;
+        setPlane( 0, luma, width, height, lumaStride, 1 );
+        switch ( layout )
+        {
+        case Layout::I420:
+            setPlane( 1, chroma, chromaWidth, chromaHeight, chromaStride, 1 );
+            setPlane( 2, chroma + chromaBytes, chromaWidth, chromaHeight,
+                    chromaStride, 1 );
+            break;
+        case Layout::NV12:
+            setPlane( 1, chroma, chromaWidth, chromaHeight, chromaStride, 2 );
+            setPlane( 2, chroma + 1, chromaWidth, chromaHeight, chromaStride, 2 );
+            break;
+        case Layout::NV21:
+            setPlane( 2, chroma, chromaWidth, chromaHeight, chromaStride, 2 );
+            setPlane( 1, chroma + 1, chromaWidth, chromaHeight, chromaStride, 2 );
+            break;
+        }
+    }
+
+    const CameraBuffer::Data* planes() const
+    {
+        return mPlanes;
+    }
+
+    uint8_t sample( unsigned plane, int32_t x, int32_t y ) const
+    {
+        const CameraBuffer::Data& d = mPlanes[plane];
+        return ( (const uint8_t*) d.ptr )[y * d.stride + x * d.channel_step];
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height, int32_t stride, int32_t channelStep )
+    {
+        CameraBuffer::Data& d = mPlanes[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = stride;
+        d.num_channels = 1;
+        d.bytes_per_channel = 1;
+        d.channel_step = channelStep;
+    }
+
+    std::vector<uint8_t> mPixels;
+    CameraBuffer::Data mPlanes[3];
+};
+
+// yuv.frag in single precision: normalized samples, clamped output.
+uint8_t shaderChannel( float value )
+{
+    return uint8_t( lroundf( std::min( std::max( value, 0.0f ), 1.0f ) * 255.0f ) );
+}
+
+void shaderPixel( uint8_t y8, uint8_t u8, uint8_t v8, uint8_t rgb[3] )
+{
+    const float y = y8 / 255.0f;
+    const float u = u8 / 255.0f;
+    const float v = v8 / 255.0f;
+    rgb[0] = shaderChannel( 1.164f * ( y - 0.0625f ) + 1.596f * ( v - 0.5f ) );
+    rgb[1] = shaderChannel( 1.164f * ( y - 0.0625f ) - 0.813f * ( v - 0.5f ) -
+            0.391f * ( u - 0.5f ) );
+    rgb[2] = shaderChannel( 1.164f * ( y - 0.0625f ) + 2.018f * ( u - 0.5f ) );
+}
+
+struct Output
+{
+    std::vector<uint8_t> pixels;
+    size_t stride = 0;
+};
+
+bool convert( const TestImage& image, YuvConverter::RgbFormat format,
+        YuvConverter::Kernel kernel, Output& out )
+{
+    const CameraBuffer::Data& luma = image.planes()[0];
+    const size_t rowBytes = size_t( luma.width ) *
+            YuvConverter::bytesPerPixel( format );
+    out.stride = rowBytes + 16;
+    out.pixels.assign( out.stride * luma.height, GUARD );
+
+    YuvConverter::Options options;
+    options.kernel = kernel;
+    return YuvConverter::convert( image.planes(), format, out.pixels.data(),
+            out.stride, options );
+}
+
+}
+
+int main()
+{
+    const YuvConverter::Kernel kernels[] = {
+        YuvConverter::Kernel::NEON,
+        YuvConverter::Kernel::SSSE3,
+        YuvConverter::Kernel::AVX2
+    };
+    const YuvConverter::RgbFormat formats[] = {
+        YuvConverter::RgbFormat::RGB888,
+        YuvConverter::RgbFormat::BGR888,
+        YuvConverter::RgbFormat::RGBA8888
+    };
+    const Layout layouts[] = { Layout::I420, Layout::NV12, Layout::NV21 };
+    const int32_t sizes[][2] = { { 2, 2 }, { 18, 6 }, { 70, 34 }, { 646, 482 } };
+
+    unsigned checks = 0;
+    unsigned failures = 0;
+
+    for ( Layout layout : layouts )
+    {
+        for ( const auto& size : sizes )
+        {
+            const TestImage image( size[0], size[1], layout, 1 + checks );
+
+            for ( YuvConverter::RgbFormat format : formats )
+            {
+                const unsigned bpp = YuvConverter::bytesPerPixel( format );
+                const size_t rowBytes = size_t( size[0] ) * bpp;
+                const int r = format == YuvConverter::RgbFormat::BGR888 ? 2 : 0;
+                const int b = 2 - r;
+
+                Output scalar;
+                ++checks;
+                if ( !convert( image, format, YuvConverter::Kernel::SCALAR, scalar ) )
+                {
+                    fprintf( stderr, "FAIL scalar %s %s %dx%d: not converted\n",
+                            layoutName( layout ), formatName( format ),
+                            size[0], size[1] );
+                    ++failures;
+                    continue;
+                }
+
+                // Scalar against the shader, and the row padding.
+                int maxError = 0;
+                bool guardsKept = true;
+                for ( int32_t y = 0; y < size[1]; ++y )
+                {
+                    const uint8_t* row = &scalar.pixels[y * scalar.stride];
+                    for ( int32_t x = 0; x < size[0]; ++x )
+                    {
+                        uint8_t expected[3];
+                        shaderPixel( image.sample( 0, x, y ),
+                                image.sample( 1, x / 2, y / 2 ),
+                                image.sample( 2, x / 2, y / 2 ), expected );
+                        const uint8_t* px = row + x * bpp;
+                        maxError = std::max( maxError, abs( px[r] - expected[0] ) );
+                        maxError = std::max( maxError, abs( px[1] - expected[1] ) );
+                        maxError = std::max( maxError, abs( px[b] - expected[2] ) );
+                        if ( bpp == 4 && px[3] != 255 ) maxError = 255;
+                    }
+                    guardsKept = guardsKept && std::all_of( row + rowBytes,
+                            row + scalar.stride,
+                            []( uint8_t v ) { return v == GUARD; } );
+                }
+                if ( maxError > MAX_ERROR || !guardsKept )
+                {
+                    fprintf( stderr, "FAIL scalar %s %s %dx%d: %d levels off "
+                            "the shader%s\n", layoutName( layout ),
+                            formatName( format ), size[0], size[1], maxError,
+                            guardsKept ? "" : ", row padding written" );
+                    ++failures;
+                }
+
+                // Every SIMD kernel against the scalar one, padding included.
+                for ( YuvConverter::Kernel kernel : kernels )
+                {
+                    if ( !YuvConverter::isAvailable( kernel ) ) continue;
+
+                    Output simd;
+                    ++checks;
+                    if ( !convert( image, format, kernel, simd ) ||
+                         simd.pixels != scalar.pixels )
+                    {
+                        fprintf( stderr, "FAIL %s %s %s %dx%d: differs from "
+                                "scalar\n", kernelName( kernel ),
+                                layoutName( layout ), formatName( format ),
+                                size[0], size[1] );
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+
+    printf( "yuv_converter_test: kernels" );
+    for ( YuvConverter::Kernel kernel : kernels )
+    {
+        if ( YuvConverter::isAvailable( kernel ) ) printf( " %s", kernelName( kernel ) );
+    }
+    printf( " and scalar, %u checks, %u failed\n", checks, failures );
+    return failures == 0 ? 0 : 1;
+}
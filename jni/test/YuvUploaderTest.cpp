@@ -0,0 +1,352 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Uploads YCbCr_420_888 buffers through YuvUploader into a headless GL
+ * context and reads the textures back:
+ *
+ *   yuv_uploader_test
+ *
+ * The context is made current without a surface, on Mesa's surfaceless
+ * EGL platform where it is available, so the test runs on build machines
+ * without a display or a GPU; LIBGL_ALWAYS_SOFTWARE is set unless given,
+ * which selects llvmpipe. I420, NV12, NV21 and a strided chroma layout,
+ * all with padded rows, are uploaded twice each, so both pixel buffers are
+ * used, then at another size. Every texture has to hold the plane samples
+ * exactly, and the upload has to leave no GL error. Failures are reported
+ * on stderr and the test exits with status 1, or 2 if no context could be
+ * created.
+ *
+ * Built and run by the Makefile next to this file, for the host only.
+ */
+
+#include "YuvUploader.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+enum class Chroma
+{
+    I420,
+    NV12,
+    NV21,
+    STRIDED     //< U and V each every other byte of separate rows.
+};
+
+const char* chromaName( Chroma chroma )
+{
+    switch ( chroma )
+    {
+    case Chroma::I420: return "I420";
+    case Chroma::NV12: return "NV12";
+    case Chroma::NV21: return "NV21";
+    case Chroma::STRIDED: return "strided";
+    }
+    return "";
+}
+
+// YCbCr_420_888 planes with rows padded past their width.
+class TestBuffer : public CameraBuffer
+{
+public:
+
+    TestBuffer( int32_t width, int32_t height, Chroma chroma, uint32_t seed )
+    {
+        format_ = YCbCr_420_888;
+        number_of_planes_ = 3;
+
+        const int32_t lumaStride = width + 40;
+        const int32_t chromaWidth = width / 2;
+        const int32_t chromaHeight = height / 2;
+        const int32_t chromaStride = chroma == Chroma::I420 ?
+                chromaWidth + 20 : width + 40;
+
+        const size_t lumaBytes = size_t( lumaStride ) * height;
+        const size_t chromaBytes = size_t( chromaStride ) * chromaHeight;
+        data_.resize( lumaBytes + 2 * chromaBytes );
+        for ( auto& p : data_ )
+        {
+            seed = seed * 1664525u + 1013904223u;
+            p = uint8_t( seed >> 24 );
+        }
+
+        uint8_t* luma = data_.data();
+        uint8_t* chromaPlanes = luma + lumaBytes;
+        setPlane( 0, luma, width, height, lumaStride, 1 );
+        switch ( chroma )
+        {
+        case Chroma::I420:
+            setPlane( 1, chromaPlanes, chromaWidth, chromaHeight,
+                    chromaStride, 1 );
+            setPlane( 2, chromaPlanes + chromaBytes, chromaWidth,
+                    chromaHeight, chromaStride, 1 );
+            break;
+        case Chroma::NV12:
+            setPlane( 1, chromaPlanes, chromaWidth, chromaHeight,
+                    chromaStride, 2 );
+            setPlane( 2, chromaPlanes + 1, chromaWidth, chromaHeight,
+                    chromaStride, 2 );
+            break;
+        case Chroma::NV21:
+            setPlane( 2, chromaPlanes, chromaWidth, chromaHeight,
+                    chromaStride, 2 );
+            setPlane( 1, chromaPlanes + 1, chromaWidth, chromaHeight,
+                    chromaStride, 2 );
+            break;
+        case Chroma::STRIDED:
+            setPlane( 1, chromaPlanes, chromaWidth, chromaHeight,
+                    chromaStride, 2 );
+            setPlane( 2, chromaPlanes + chromaBytes, chromaWidth,
+                    chromaHeight, chromaStride, 2 );
+            break;
+        }
+    }
+
+    uint8_t sample( unsigned plane, int32_t x, int32_t y ) const
+    {
+        const Data& d = buffer_planes_[plane];
+        return static_cast<const uint8_t*>( d.ptr )[y * d.stride +
+                x * d.channel_step];
+    }
+
+private:
+
+    void setPlane( unsigned plane, uint8_t* ptr, int32_t width,
+            int32_t height, int32_t stride, int32_t channelStep )
+    {
+        Data& d = buffer_planes_[plane];
+        d.ptr = ptr;
+        d.width = width;
+        d.height = height;
+        d.stride = stride;
+        d.num_channels = 1;
+        d.bytes_per_channel = 1;
+        d.channel_step = channelStep;
+    }
+
+    std::vector<uint8_t> data_;
+};
+
+// A desktop GL context without a surface; false if there is none.
+bool makeContextCurrent()
+{
+    setenv( "LIBGL_ALWAYS_SOFTWARE", "1", 0 );
+
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress(
+                    "eglGetPlatformDisplayEXT" );
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    if ( getPlatformDisplay )
+    {
+        display = getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA,
+                EGL_DEFAULT_DISPLAY, NULL );
+    }
+#endif
+    if ( display == EGL_NO_DISPLAY )
+    {
+        display = eglGetDisplay( EGL_DEFAULT_DISPLAY );
+    }
+    if ( display == EGL_NO_DISPLAY || !eglInitialize( display, NULL, NULL ) )
+    {
+        fprintf( stderr, "yuv_uploader_test: no EGL display\n" );
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if ( !eglBindAPI( EGL_OPENGL_API ) ||
+         !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs ) ||
+         numConfigs < 1 )
+    {
+        fprintf( stderr, "yuv_uploader_test: no desktop GL config\n" );
+        return false;
+    }
+
+    // Compatibility profile: the uploader uses luminance textures.
+    EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT,
+            NULL );
+    if ( context == EGL_NO_CONTEXT ||
+         !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) )
+    {
+        fprintf( stderr, "yuv_uploader_test: no surfaceless context\n" );
+        return false;
+    }
+    return true;
+}
+
+// Compares a texture with samples of planes, count channels per texel.
+bool checkTexture( GLuint texture, GLenum format, const TestBuffer& img,
+        const unsigned* planes, unsigned count, const char* what )
+{
+    const CameraBuffer::Data d = const_cast<TestBuffer&>( img ).data( planes[0] );
+    std::vector<uint8_t> texels( size_t( d.width ) * d.height * count );
+
+    glBindTexture( GL_TEXTURE_2D, texture );
+    glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+    glGetTexImage( GL_TEXTURE_2D, 0, format, GL_UNSIGNED_BYTE, texels.data() );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+
+    const uint8_t* texel = texels.data();
+    for ( int32_t y = 0; y < d.height; ++y )
+    {
+        for ( int32_t x = 0; x < d.width; ++x )
+        {
+            for ( unsigned c = 0; c < count; ++c, ++texel )
+            {
+                const uint8_t expected = img.sample( planes[c], x, y );
+                if ( *texel != expected )
+                {
+                    fprintf( stderr, "%s texture at %d,%d: %u, expected %u\n",
+                            what, x, y, *texel, expected );
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool checkUpload( YuvUploader& uploader, int32_t width, int32_t height,
+        Chroma chroma, uint32_t seed )
+{
+    TestBuffer img( width, height, chroma, seed );
+    if ( !uploader.upload( img ) )
+    {
+        fprintf( stderr, "upload failed\n" );
+        return false;
+    }
+
+    const YuvUploader::Layout expected[] = {
+        YuvUploader::Layout::PLANAR,
+        YuvUploader::Layout::NV12,
+        YuvUploader::Layout::NV21,
+        YuvUploader::Layout::STRIDED
+    };
+    if ( uploader.layout() != expected[int( chroma )] )
+    {
+        fprintf( stderr, "layout %d detected\n", int( uploader.layout() ) );
+        return false;
+    }
+
+    const size_t bytes = size_t( width ) * height * 3 / 2;
+    if ( uploader.lastUploadBytes() != bytes )
+    {
+        fprintf( stderr, "%zu bytes uploaded, expected %zu\n",
+                uploader.lastUploadBytes(), bytes );
+        return false;
+    }
+
+    // Interleaved chroma is one texture of the pairs in memory order.
+    const unsigned luma[] = { 0 };
+    const unsigned u[] = { 1 };
+    const unsigned v[] = { 2 };
+    const unsigned uv[] = { 1, 2 };
+    const unsigned vu[] = { 2, 1 };
+    bool ok = checkTexture( uploader.lumaTexture(), GL_LUMINANCE, img, luma, 1,
+            "luma" );
+    if ( uploader.interleaved() )
+    {
+        ok = ok && checkTexture( uploader.chromaTexture( 0 ),
+                GL_LUMINANCE_ALPHA, img,
+                chroma == Chroma::NV12 ? uv : vu, 2, "chroma" );
+    }
+    else
+    {
+        ok = ok && checkTexture( uploader.chromaTexture( 0 ), GL_LUMINANCE,
+                img, u, 1, "U" );
+        ok = ok && checkTexture( uploader.chromaTexture( 1 ), GL_LUMINANCE,
+                img, v, 1, "V" );
+    }
+
+    const GLenum error = glGetError();
+    if ( error != GL_NO_ERROR )
+    {
+        fprintf( stderr, "GL error 0x%x\n", error );
+        return false;
+    }
+    return ok;
+}
+
+}
+
+int main()
+{
+    if ( !makeContextCurrent() ) return 2;
+    printf( "yuv_uploader_test: %s, %s\n",
+            (const char*) glGetString( GL_RENDERER ),
+            (const char*) glGetString( GL_VERSION ) );
+
+    const Chroma layouts[] = {
+        Chroma::I420, Chroma::NV12, Chroma::NV21, Chroma::STRIDED
+    };
+    const int32_t sizes[][2] = { { 70, 34 }, { 640, 480 } };
+
+    unsigned checks = 0;
+    unsigned failures = 0;
+
+    for ( Chroma chroma : layouts )
+    {
+        // One uploader per layout, reallocated when the size changes.
+        YuvUploader uploader;
+        for ( const auto& size : sizes )
+        {
+            for ( unsigned frame = 0; frame < 2; ++frame )
+            {
+                ++checks;
+                if ( !checkUpload( uploader, size[0], size[1], chroma,
+                        checks ) )
+                {
+                    fprintf( stderr, "FAIL %s %dx%d frame %u\n",
+                            chromaName( chroma ), size[0], size[1], frame );
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    printf( "yuv_uploader_test: %u uploads, %u failed\n", checks, failures );
+    return failures == 0 ? 0 : 1;
+}
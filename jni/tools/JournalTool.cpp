@@ -0,0 +1,235 @@
+//----------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, NVIDIA CORPORATION. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//  * Neither the name of NVIDIA CORPORATION nor the names of its
+//    contributors may be used to endorse or promote products derived
+//    from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+// OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+//----------------------------------------------------------------------------------
+
+/*
+ * Queries a metadata journal written by MetadataJournal, also while the
+ * app is writing it:
+ *
+ *   journal_tool [-r requestId | -t begin,end] [-s stream] [-v] journal
+ *
+ * Without -r or -t the records of each stream are summed up. Otherwise
+ * the records with the requestId, or with a captureTime in [begin, end)
+ * nanoseconds, are printed in capture time order, one tab separated line
+ * each:
+ *
+ *   sequence stream request_id capture_time ae_state af_state awb_state
+ *   exposure_us sensitivity frame_duration_us focus_distance
+ *   ae_compensation histogram_values sharpness_values
+ *
+ * The settings are the result settings of the frame. -v adds a line with
+ * the histogram and one with the sharpness map after each record. Only
+ * the pages of the records found are read, not the whole file.
+ *
+ * The tool builds for the host as well, from jni:
+ *
+ *   g++ -std=c++11 -O2 -I. -Iexternal/native_camera2/include \
+ *       tools/JournalTool.cpp MetadataJournal.cpp -o journal_tool
+ */
+
+#include "MetadataJournal.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace nv::camera2;
+
+namespace
+{
+
+struct StreamSummary
+{
+    uint64_t records = 0;
+    uint64_t withStatistics = 0;
+    uint64_t statisticsLost = 0;
+    int64_t firstTime = INT64_MAX;
+    int64_t lastTime = INT64_MIN;
+    int32_t firstRequest = INT32_MAX;
+    int32_t lastRequest = INT32_MIN;
+};
+
+bool parseRange( const char* arg, int64_t& begin, int64_t& end )
+{
+    char* next = nullptr;
+    begin = strtoll( arg, &next, 10 );
+    if ( next == arg || *next != ',' ) return false;
+    const char* second = next + 1;
+    end = strtoll( second, &next, 10 );
+    return next != second && *next == '\0' && begin <= end;
+}
+
+void summarize( const MetadataJournalReader& reader, int stream )
+{
+    const uint64_t begin = reader.begin();
+    const uint64_t end = reader.end();
+    printf( "sequences %llu to %llu\n",
+            (unsigned long long) begin, (unsigned long long) end );
+
+    std::map<uint16_t, StreamSummary> streams;
+    uint64_t unreadable = 0;
+    MetadataJournal::Entry entry;
+    for ( uint64_t sequence = begin; sequence < end; ++sequence )
+    {
+        if ( !reader.read( sequence, entry, false ) )
+        {
+            ++unreadable;
+            continue;
+        }
+        if ( stream >= 0 && entry.stream != stream ) continue;
+
+        StreamSummary& s = streams[entry.stream];
+        ++s.records;
+        if ( entry.statistics.histogram.numBuckets > 0 ) ++s.withStatistics;
+        if ( entry.statisticsLost ) ++s.statisticsLost;
+        s.firstTime = std::min( s.firstTime, entry.captureTime );
+        s.lastTime = std::max( s.lastTime, entry.captureTime );
+        s.firstRequest = std::min( s.firstRequest, entry.requestId );
+        s.lastRequest = std::max( s.lastRequest, entry.requestId );
+    }
+
+    for ( const auto& it : streams )
+    {
+        const StreamSummary& s = it.second;
+        const double seconds = ( s.lastTime - s.firstTime ) * 1e-9;
+        printf( "stream %u: %llu records, requests %d to %d, "
+                "capture time %lld to %lld (%.1f s, %.1f fps), "
+                "%llu with histogram, %llu statistics lost\n",
+                unsigned( it.first ), (unsigned long long) s.records,
+                s.firstRequest, s.lastRequest,
+                (long long) s.firstTime, (long long) s.lastTime, seconds,
+                seconds > 0.0 ? ( s.records - 1 ) / seconds : 0.0,
+                (unsigned long long) s.withStatistics,
+                (unsigned long long) s.statisticsLost );
+    }
+    if ( unreadable > 0 )
+    {
+        printf( "%llu records being written or overwritten\n",
+                (unsigned long long) unreadable );
+    }
+}
+
+void print( const MetadataJournal::Entry& entry, bool verbose )
+{
+    const RequestSettings& settings = entry.resultSettings;
+    printf( "%llu\t%u\t%d\t%lld\t%u\t%u\t%u\t%lld\t%d\t%lld\t%g\t%g\t%u\t%u\n",
+            (unsigned long long) entry.sequence, unsigned( entry.stream ),
+            entry.requestId, (long long) entry.captureTime,
+            unsigned( entry.autoControlState.aeState ),
+            unsigned( entry.autoControlState.afState ),
+            unsigned( entry.autoControlState.awbState ),
+            (long long) settings.sensor.exposure, settings.sensor.sensitivity,
+            (long long) settings.sensor.frameDuration,
+            settings.lens.focusDistance, settings.control.aeExposureCompensation,
+            unsigned( entry.statistics.histogram.data.size() ),
+            unsigned( entry.statistics.sharpnessMap.size() ) );
+    if ( !verbose ) return;
+
+    printf( "histogram" );
+    for ( unsigned value : entry.statistics.histogram.data )
+    {
+        printf( " %u", value );
+    }
+    printf( "\nsharpness" );
+    for ( float value : entry.statistics.sharpnessMap )
+    {
+        printf( " %g", value );
+    }
+    printf( "\n" );
+}
+
+}
+
+int main( int argc, char** argv )
+{
+    bool byRequest = false;
+    bool byTime = false;
+    int32_t requestId = 0;
+    int64_t begin = 0;
+    int64_t end = 0;
+    int stream = -1;
+    bool verbose = false;
+    bool usage = false;
+
+    int opt;
+    while ( ( opt = getopt( argc, argv, "r:t:s:v" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+        case 'r': requestId = atoi( optarg ); byRequest = true; break;
+        case 't': usage = usage || !parseRange( optarg, begin, end ); byTime = true; break;
+        case 's': stream = atoi( optarg ); usage = usage || stream < 0; break;
+        case 'v': verbose = true; break;
+        default:  usage = true; break;
+        }
+    }
+    if ( usage || ( byRequest && byTime ) || optind != argc - 1 )
+    {
+        fprintf( stderr, "usage: %s [-r requestId | -t begin,end] [-s stream] "
+                "[-v] journal\n", argv[0] );
+        return 1;
+    }
+
+    MetadataJournalReader reader;
+    if ( !reader.open( argv[optind] ) )
+    {
+        fprintf( stderr, "%s: not a metadata journal\n", argv[optind] );
+        return 1;
+    }
+
+    if ( !byRequest && !byTime )
+    {
+        summarize( reader, stream );
+        return 0;
+    }
+
+    reader.index();
+    std::vector<uint64_t> sequences;
+    if ( byRequest )
+    {
+        reader.findRequest( requestId, stream, sequences );
+    }
+    else
+    {
+        reader.findTime( begin, end, stream, sequences );
+    }
+
+    // Records overwritten since index() are left out.
+    MetadataJournal::Entry entry;
+    for ( uint64_t sequence : sequences )
+    {
+        if ( reader.read( sequence, entry, true ) ) print( entry, verbose );
+    }
+    return 0;
+}